@@ -0,0 +1,545 @@
+#pragma once
+
+#ifndef VKHL_BINDLESSHEAP_HPP
+#define VKHL_BINDLESSHEAP_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Device.hpp"
+#include "PhysicalDevice.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+#include <cassert>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Index into one of BindlessHeap's descriptor arrays, stays the same until it is removed
+	using BindlessIndex = uint32_t;
+	inline constexpr BindlessIndex InvalidBindlessIndex = ~0u;
+
+	// The descriptor arrays of a BindlessHeap, each one is the binding of the same number
+	enum class BindlessType : uint8_t
+	{
+		SampledImage,	// layout(binding = 0) uniform texture2D textures[];
+		StorageImage,	// layout(binding = 1) uniform image2D images[];
+		StorageBuffer,	// layout(binding = 2) buffer Buffers { ... } buffers[];
+	};
+
+	inline constexpr uint32_t BindlessTypeCount = 3;
+
+	struct BindlessHeapCreateInfo
+	{
+		uint32_t sampledImageCount = 65536; // 0 leaves the binding out
+		uint32_t storageImageCount = 8192;
+		uint32_t storageBufferCount = 65536;
+		VkShaderStageFlags stageFlags = VK_SHADER_STAGE_ALL;
+		uint32_t framesInFlight = 2; // Removed indices are handed out again this many frames later
+		bool bufferDeviceAddress = true; // Needed for GetBufferAddress
+	};
+
+	// Hands out the indices of one descriptor array from a lock free free list. Removed indices wait in a list per frame in flight,
+	// and are only handed out again once BeginFrame comes back around to the frame they were removed in
+	class BindlessIndexAllocator
+	{
+	public:
+		BindlessIndexAllocator() = default;
+		BindlessIndexAllocator(const BindlessIndexAllocator&) = delete;
+		BindlessIndexAllocator& operator=(const BindlessIndexAllocator&) = delete;
+
+		void Init(uint32_t capacity, uint32_t framesInFlight);
+		void Destroy();
+
+		// Returns InvalidBindlessIndex if every index is in use or waiting for its frame. Thread safe
+		BindlessIndex Allocate();
+		// Returns false and changes nothing if index is out of range or isn't in use. Thread safe
+		bool Remove(BindlessIndex index);
+		// Frees the indices removed in frameIndex % framesInFlight. No thread may remove while this runs
+		void BeginFrame(uint64_t frameIndex);
+
+		uint32_t GetCapacity() const { return m_capacity; }
+
+	private:
+		static constexpr uint32_t None = ~0u;
+
+		// Each list is linked through next, which a slot only uses while it's free or removed
+		std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+		std::atomic<uint64_t> m_head = None;	// Tag in the high half, bumped on every change so a slot popped and pushed back meanwhile fails the CAS
+		std::atomic<uint32_t> m_used = 0;		// Slots below this have been handed out before
+		std::unique_ptr<std::atomic<uint32_t>[]> m_removed; // List of slots removed in each frame slot
+		std::unique_ptr<std::atomic<bool>[]> m_live;	// Handed out and not removed since, so Remove can't link a slot in twice
+		uint32_t m_capacity = 0;
+		uint32_t m_framesInFlight = 0;
+		std::atomic<uint32_t> m_currentFrame = 0;
+	};
+
+	// What the device needs for createInfo, put it in PhysicalDeviceSelectionInfo::descriptorIndexing
+	VKHL_INLINE PhysicalDeviceDescriptorIndexingInfo GetBindlessHeapRequirements(const BindlessHeapCreateInfo& createInfo = {});
+
+	// One update after bind descriptor set for the whole device, with an array each of sampled images, storage images and storage buffers.
+	// Bind it once per command buffer and index it from shaders, instead of binding descriptors per draw.
+	// Indices come from lock free free lists, Add and Remove can be called from any thread.
+	// Descriptor writes are queued and written with one vkUpdateDescriptorSets in Flush.
+	// Needs a device made with performanceFeatures, selected with GetBindlessHeapRequirements
+	class BindlessHeap
+	{
+	public:
+		BindlessHeap() = default;
+		BindlessHeap(const BindlessHeap&) = delete;
+		BindlessHeap& operator=(const BindlessHeap&) = delete;
+		~BindlessHeap() { Destroy(); }
+
+		SmartResult Init(const DeviceDispatch& dispatch, VkPhysicalDevice physicalDevice, const DeviceInfo& deviceInfo, const BindlessHeapCreateInfo& createInfo = {});
+		// The device must be done with the set
+		void Destroy();
+
+		// Indices removed in frameIndex % framesInFlight can be handed out again, so the caller must know that frame's work is done.
+		// No thread may remove while this runs
+		void BeginFrame(uint64_t frameIndex);
+		// Writes every descriptor added since the last Flush, call it before submitting work that uses them. Not thread safe with itself
+		void Flush();
+
+		// Return InvalidBindlessIndex if the array is full
+		BindlessIndex AddSampledImage(VkImageView imageView, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		BindlessIndex AddStorageImage(VkImageView imageView, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+		// addressOut (optional) gets the buffer device address of offset, 0 if buffer device address is off
+		BindlessIndex AddStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE, VkDeviceAddress* addressOut = nullptr);
+
+		// The descriptor stays valid until the frame is done with it, the index is reused after framesInFlight frames.
+		// Each index must be removed once, removing one that isn't in use asserts and is ignored
+		void Remove(BindlessType type, BindlessIndex index);
+
+		// The buffer must have been made with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, and its memory with MemoryAllocatorCreateInfo::bufferDeviceAddress.
+		// Returns 0 if buffer device address is off
+		VkDeviceAddress GetBufferAddress(VkBuffer buffer) const;
+
+		VkDescriptorSetLayout GetLayout() const { return m_layout; }
+		VkDescriptorSet GetSet() const { return m_set; }
+		uint32_t GetCapacity(BindlessType type) const { return m_slots[static_cast<uint32_t>(type)].GetCapacity(); }
+
+	private:
+		struct PendingWrite
+		{
+			BindlessType type;
+			BindlessIndex index;
+			VkDescriptorImageInfo image;
+			VkDescriptorBufferInfo buffer;
+		};
+
+		void QueueWrite(const PendingWrite& write);
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+		VkDescriptorPool m_pool = VK_NULL_HANDLE;
+		VkDescriptorSet m_set = VK_NULL_HANDLE;
+		bool m_bufferDeviceAddress = false;
+
+		BindlessIndexAllocator m_slots[BindlessTypeCount];
+
+		std::mutex m_writesMutex;
+		std::vector<PendingWrite> m_writes;
+
+		// Scratch for Flush
+		std::vector<PendingWrite> m_flushWrites;
+		std::vector<VkDescriptorImageInfo> m_imageInfos;
+		std::vector<VkDescriptorBufferInfo> m_bufferInfos;
+		std::vector<VkWriteDescriptorSet> m_descriptorWrites;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	namespace detail
+	{
+		VKHL_INLINE_VAR constexpr VkDescriptorType g_bindlessDescriptorTypes[BindlessTypeCount] = {
+			VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+		};
+	}
+
+	VKHL_INLINE void BindlessIndexAllocator::Init(uint32_t capacity, uint32_t framesInFlight)
+	{
+		m_capacity = capacity;
+		m_framesInFlight = std::max(framesInFlight, 1u);
+		m_next = std::make_unique<std::atomic<uint32_t>[]>(capacity);
+		m_live = std::make_unique<std::atomic<bool>[]>(capacity);
+		m_head = None;
+		m_used = 0;
+		m_currentFrame = 0;
+
+		m_removed = std::make_unique<std::atomic<uint32_t>[]>(m_framesInFlight);
+		for (uint32_t frame = 0; frame < m_framesInFlight; frame++)
+			m_removed[frame] = None;
+	}
+
+	VKHL_INLINE void BindlessIndexAllocator::Destroy()
+	{
+		m_next.reset();
+		m_live.reset();
+		m_removed.reset();
+		m_capacity = 0;
+	}
+
+	VKHL_INLINE BindlessIndex BindlessIndexAllocator::Allocate()
+	{
+		// Reuse a free slot first
+		uint64_t head = m_head.load(std::memory_order_acquire);
+		while (static_cast<uint32_t>(head) != None)
+		{
+			const uint32_t slot = static_cast<uint32_t>(head);
+			const uint64_t next = ((head >> 32) + 1) << 32 | m_next[slot].load(std::memory_order_relaxed);
+			if (m_head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+			{
+				m_live[slot].store(true, std::memory_order_relaxed);
+				return slot;
+			}
+		}
+
+		// Then one that was never used
+		uint32_t used = m_used.load(std::memory_order_relaxed);
+		while (used < m_capacity)
+		{
+			if (m_used.compare_exchange_weak(used, used + 1, std::memory_order_relaxed))
+			{
+				m_live[used].store(true, std::memory_order_relaxed);
+				return used;
+			}
+		}
+
+		return InvalidBindlessIndex;
+	}
+
+	VKHL_INLINE bool BindlessIndexAllocator::Remove(BindlessIndex index)
+	{
+		if (index >= m_capacity)
+		{
+			PrintError("Bindless index %u is out of range, the array holds %u\n", index, m_capacity);
+			return false;
+		}
+
+		// Linking a slot into the lists twice would make a cycle, and BeginFrame would never reach the end of it
+		if (!m_live[index].exchange(false, std::memory_order_relaxed))
+		{
+			PrintError("Bindless index %u isn't in use, it was removed twice or never added\n", index);
+			return false;
+		}
+
+		// Only pushed here, BeginFrame takes the whole list at once, so there's nothing to tag
+		std::atomic<uint32_t>& removed = m_removed[m_currentFrame.load(std::memory_order_relaxed)];
+
+		uint32_t head = removed.load(std::memory_order_relaxed);
+		do
+			m_next[index].store(head, std::memory_order_relaxed);
+		while (!removed.compare_exchange_weak(head, index, std::memory_order_release, std::memory_order_relaxed));
+
+		return true;
+	}
+
+	VKHL_INLINE void BindlessIndexAllocator::BeginFrame(uint64_t frameIndex)
+	{
+		const uint32_t frameSlot = static_cast<uint32_t>(frameIndex % m_framesInFlight);
+		m_currentFrame.store(frameSlot, std::memory_order_relaxed);
+
+		const uint32_t first = m_removed[frameSlot].exchange(None, std::memory_order_acquire);
+		if (first == None)
+			return;
+
+		uint32_t last = first;
+		for (uint32_t next = m_next[last].load(std::memory_order_relaxed); next != None; next = m_next[last].load(std::memory_order_relaxed))
+			last = next;
+
+		// Splice the whole list onto the free list
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		uint64_t newHead;
+		do
+		{
+			m_next[last].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+			newHead = ((head >> 32) + 1) << 32 | first;
+		} while (!m_head.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	VKHL_INLINE PhysicalDeviceDescriptorIndexingInfo GetBindlessHeapRequirements(const BindlessHeapCreateInfo& createInfo)
+	{
+		return { createInfo.sampledImageCount, createInfo.storageImageCount, createInfo.storageBufferCount, createInfo.bufferDeviceAddress };
+	}
+
+	VKHL_INLINE SmartResult BindlessHeap::Init(const DeviceDispatch& dispatch, VkPhysicalDevice physicalDevice, const DeviceInfo& deviceInfo, const BindlessHeapCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::Init");
+
+		VkResult result = VK_SUCCESS;
+
+		if (const char* reason = detail::CheckDescriptorIndexing(physicalDevice, GetBindlessHeapRequirements(createInfo)))
+		{
+			PrintError("Device can't hold the bindless heap, %s\n", reason);
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		if (!deviceInfo.descriptorIndexing || (createInfo.bufferDeviceAddress && !deviceInfo.bufferDeviceAddress))
+		{
+			PrintError("BindlessHeap needs descriptor indexing and buffer device address, create the device with performanceFeatures\n");
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		m_dispatch = &dispatch;
+		m_bufferDeviceAddress = createInfo.bufferDeviceAddress;
+
+		// Every binding is partially bound, so only the descriptors in use need to be valid
+		const uint32_t counts[BindlessTypeCount] = { createInfo.sampledImageCount, createInfo.storageImageCount, createInfo.storageBufferCount };
+		VkDescriptorSetLayoutBinding bindings[BindlessTypeCount];
+		VkDescriptorBindingFlags bindingFlags[BindlessTypeCount];
+		VkDescriptorPoolSize poolSizes[BindlessTypeCount];
+		uint32_t bindingCount = 0;
+		for (uint32_t type = 0; type < BindlessTypeCount; type++)
+		{
+			m_slots[type].Init(counts[type], createInfo.framesInFlight);
+			if (counts[type] == 0)
+				continue;
+
+			bindings[bindingCount] = { type, detail::g_bindlessDescriptorTypes[type], counts[type], createInfo.stageFlags, nullptr };
+			bindingFlags[bindingCount] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+				VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+			poolSizes[bindingCount] = { detail::g_bindlessDescriptorTypes[type], counts[type] };
+			bindingCount++;
+		}
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+		flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flagsInfo.bindingCount = bindingCount;
+		flagsInfo.pBindingFlags = bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &flagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+
+		CHECK_VK_CALL(m_dispatch->vkCreateDescriptorSetLayout(m_dispatch->device, &layoutInfo, GetAllocationCallbacks(), &m_layout),
+			"Failed to create bindless descriptor set layout with error %s\n");
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = bindingCount;
+		poolInfo.pPoolSizes = poolSizes;
+
+		CHECK_VK_CALL(m_dispatch->vkCreateDescriptorPool(m_dispatch->device, &poolInfo, GetAllocationCallbacks(), &m_pool),
+			"Failed to create bindless descriptor pool with error %s\n");
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_layout;
+
+		CHECK_VK_CALL(m_dispatch->vkAllocateDescriptorSets(m_dispatch->device, &allocInfo, &m_set),
+			"Failed to allocate bindless descriptor set with error %s\n");
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void BindlessHeap::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		if (m_pool)
+			m_dispatch->vkDestroyDescriptorPool(m_dispatch->device, m_pool, GetAllocationCallbacks());
+		if (m_layout)
+			m_dispatch->vkDestroyDescriptorSetLayout(m_dispatch->device, m_layout, GetAllocationCallbacks());
+
+		for (auto& slots : m_slots)
+			slots.Destroy();
+
+		m_writes.clear();
+		m_pool = VK_NULL_HANDLE;
+		m_layout = VK_NULL_HANDLE;
+		m_set = VK_NULL_HANDLE;
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE void BindlessHeap::QueueWrite(const PendingWrite& write)
+	{
+		std::lock_guard lock(m_writesMutex);
+		m_writes.push_back(write);
+	}
+
+	VKHL_INLINE BindlessIndex BindlessHeap::AddSampledImage(VkImageView imageView, VkImageLayout layout)
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::AddSampledImage");
+
+		const BindlessIndex index = m_slots[static_cast<uint32_t>(BindlessType::SampledImage)].Allocate();
+		if (index == InvalidBindlessIndex)
+		{
+			PrintError("Bindless heap is out of sampled images\n");
+			return index;
+		}
+
+		QueueWrite({ BindlessType::SampledImage, index, { VK_NULL_HANDLE, imageView, layout }, {} });
+		return index;
+	}
+
+	VKHL_INLINE BindlessIndex BindlessHeap::AddStorageImage(VkImageView imageView, VkImageLayout layout)
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::AddStorageImage");
+
+		const BindlessIndex index = m_slots[static_cast<uint32_t>(BindlessType::StorageImage)].Allocate();
+		if (index == InvalidBindlessIndex)
+		{
+			PrintError("Bindless heap is out of storage images\n");
+			return index;
+		}
+
+		QueueWrite({ BindlessType::StorageImage, index, { VK_NULL_HANDLE, imageView, layout }, {} });
+		return index;
+	}
+
+	VKHL_INLINE BindlessIndex BindlessHeap::AddStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range, VkDeviceAddress* addressOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::AddStorageBuffer");
+
+		const BindlessIndex index = m_slots[static_cast<uint32_t>(BindlessType::StorageBuffer)].Allocate();
+		if (index == InvalidBindlessIndex)
+		{
+			PrintError("Bindless heap is out of storage buffers\n");
+			return index;
+		}
+
+		QueueWrite({ BindlessType::StorageBuffer, index, {}, { buffer, offset, range } });
+		if (addressOut)
+		{
+			const VkDeviceAddress address = GetBufferAddress(buffer);
+			*addressOut = address ? address + offset : 0;
+		}
+
+		return index;
+	}
+
+	VKHL_INLINE void BindlessHeap::Remove(BindlessType type, BindlessIndex index)
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::Remove");
+
+		if (index == InvalidBindlessIndex)
+			return;
+
+		const bool removed = m_slots[static_cast<uint32_t>(type)].Remove(index);
+		assert(removed && "BindlessHeap::Remove was given an index that isn't in use");
+		(void)removed;
+	}
+
+	VKHL_INLINE void BindlessHeap::BeginFrame(uint64_t frameIndex)
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::BeginFrame");
+
+		for (auto& slots : m_slots)
+			slots.BeginFrame(frameIndex);
+	}
+
+	VKHL_INLINE void BindlessHeap::Flush()
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::Flush");
+
+		{
+			std::lock_guard lock(m_writesMutex);
+			m_flushWrites.swap(m_writes);
+		}
+
+		if (m_flushWrites.empty())
+			return;
+
+		// The last write to a slot wins, and runs of neighbouring slots become one VkWriteDescriptorSet
+		std::stable_sort(m_flushWrites.begin(), m_flushWrites.end(), [](const PendingWrite& a, const PendingWrite& b) {
+			return a.type != b.type ? a.type < b.type : a.index < b.index;
+		});
+
+		m_imageInfos.clear();
+		m_bufferInfos.clear();
+		m_imageInfos.reserve(m_flushWrites.size());
+		m_bufferInfos.reserve(m_flushWrites.size());
+		m_descriptorWrites.clear();
+
+		for (size_t i = 0; i < m_flushWrites.size(); i++)
+		{
+			const PendingWrite& write = m_flushWrites[i];
+			if (i + 1 < m_flushWrites.size() && m_flushWrites[i + 1].type == write.type && m_flushWrites[i + 1].index == write.index)
+				continue;
+
+			const uint32_t binding = static_cast<uint32_t>(write.type);
+			const bool isBuffer = write.type == BindlessType::StorageBuffer;
+			if (isBuffer)
+				m_bufferInfos.push_back(write.buffer);
+			else
+				m_imageInfos.push_back(write.image);
+
+			if (!m_descriptorWrites.empty())
+			{
+				VkWriteDescriptorSet& previous = m_descriptorWrites.back();
+				if (previous.dstBinding == binding && previous.dstArrayElement + previous.descriptorCount == write.index)
+				{
+					previous.descriptorCount++;
+					continue;
+				}
+			}
+
+			VkWriteDescriptorSet descriptorWrite{};
+			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrite.dstSet = m_set;
+			descriptorWrite.dstBinding = binding;
+			descriptorWrite.dstArrayElement = write.index;
+			descriptorWrite.descriptorCount = 1;
+			descriptorWrite.descriptorType = detail::g_bindlessDescriptorTypes[binding];
+			descriptorWrite.pImageInfo = isBuffer ? nullptr : &m_imageInfos.back();
+			descriptorWrite.pBufferInfo = isBuffer ? &m_bufferInfos.back() : nullptr;
+			m_descriptorWrites.push_back(descriptorWrite);
+		}
+
+		m_dispatch->vkUpdateDescriptorSets(m_dispatch->device, static_cast<uint32_t>(m_descriptorWrites.size()), m_descriptorWrites.data(), 0, nullptr);
+		m_flushWrites.clear();
+	}
+
+	VKHL_INLINE VkDeviceAddress BindlessHeap::GetBufferAddress(VkBuffer buffer) const
+	{
+		VKHL_TRACE_ZONE("vkhl::BindlessHeap::GetBufferAddress");
+
+		if (!m_bufferDeviceAddress)
+			return 0;
+
+		VkBufferDeviceAddressInfo addressInfo{};
+		addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+		addressInfo.buffer = buffer;
+		return m_dispatch->vkGetBufferDeviceAddress(m_dispatch->device, &addressInfo);
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -0,0 +1,541 @@
+#pragma once
+
+#ifndef VKHL_CAPABILITIES_HPP
+#define VKHL_CAPABILITIES_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <vector>
+#include <string>
+#include <string_view>
+
+#include "Definitions.h"
+#include "Error.hpp"
+#include "Common.hpp"
+#include "Dispatch.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <mutex>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Set of names with hashed lookup, keeps the names in insertion order
+	class NameSet
+	{
+	public:
+		static constexpr uint32_t NotFound = ~0u;
+
+		void Insert(std::string_view name)
+		{
+			if (Find(name) != NotFound)
+				return;
+
+			m_names.emplace_back(name);
+			m_hashes.push_back(HashString(name));
+
+			// Keep the table at most half full
+			if (m_slots.size() < m_names.size() * 2)
+				Rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+			else
+				Place(static_cast<uint32_t>(m_names.size() - 1));
+		}
+
+		// Returns the insertion index of name, or NotFound
+		uint32_t Find(std::string_view name) const
+		{
+			if (m_slots.empty())
+				return NotFound;
+
+			const Hash hash = HashString(name);
+			const size_t mask = m_slots.size() - 1;
+			for (size_t slot = hash & mask; m_slots[slot] != 0; slot = (slot + 1) & mask)
+			{
+				const uint32_t index = m_slots[slot] - 1;
+				if (m_hashes[index] == hash && m_names[index] == name)
+					return index;
+			}
+
+			return NotFound;
+		}
+
+		bool Contains(std::string_view name) const { return Find(name) != NotFound; }
+
+		const std::vector<std::string>& GetNames() const { return m_names; }
+		size_t GetSize() const { return m_names.size(); }
+
+	private:
+		void Rehash(size_t slotCount)
+		{
+			m_slots.assign(slotCount, 0);
+			for (uint32_t index = 0; index < m_names.size(); index++)
+				Place(index);
+		}
+
+		void Place(uint32_t index)
+		{
+			const size_t mask = m_slots.size() - 1;
+			size_t slot = m_hashes[index] & mask;
+			while (m_slots[slot] != 0)
+				slot = (slot + 1) & mask;
+			m_slots[slot] = index + 1;
+		}
+
+		std::vector<std::string> m_names;
+		std::vector<Hash> m_hashes;
+		std::vector<uint32_t> m_slots; // Index into m_names + 1, 0 is empty
+	};
+
+	// Everything the loader reports before an instance exists, enumerated once per process
+	struct CapabilitySnapshot
+	{
+		Version apiVersion;
+		NameSet layers;
+		NameSet extensions;						// Extensions of the implementation and implicit layers
+		std::vector<NameSet> layerExtensions;	// Extensions of each layer, same order as layers
+
+		bool HasLayer(std::string_view name) const { return layers.Contains(name); }
+
+		// True if name is provided by the implementation or any layer in enabledLayers
+		bool HasExtension(std::string_view name, std::span<const char* const> enabledLayers = {}) const
+		{
+			if (extensions.Contains(name))
+				return true;
+
+			for (const char* layer : enabledLayers)
+			{
+				const uint32_t index = layers.Find(layer);
+				if (index != NameSet::NotFound && layerExtensions[index].Contains(name))
+					return true;
+			}
+
+			return false;
+		}
+	};
+
+	// Set to a file path to keep the snapshot between processes.
+	// The file is ignored once the loader, driver or layer manifests or binaries, or the loader environment variables change
+	VKHL_INLINE_VAR const char* g_capabilityCachePath = nullptr;
+
+	// Returns the snapshot, enumerating it (or loading it from g_capabilityCachePath) on first use. Thread safe.
+	// The snapshot lives until ResetCapabilitySnapshot
+	VKHL_INLINE SmartResult GetCapabilitySnapshot(const CapabilitySnapshot** snapshotOut);
+
+	// Makes the next GetCapabilitySnapshot enumerate again, pointers to the old snapshot become invalid
+	VKHL_INLINE void ResetCapabilitySnapshot();
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	namespace detail
+	{
+		struct CapabilityState
+		{
+			std::mutex mutex;
+			std::unique_ptr<CapabilitySnapshot> snapshot;
+			Hash cacheKey = 0;
+		};
+
+		VKHL_INLINE CapabilityState& GetCapabilityState()
+		{
+			static CapabilityState s_state;
+			return s_state;
+		}
+
+		// Hashes the path, write time and size of a file, or only the path and write time of a folder
+		VKHL_INLINE Hash HashFileStatus(Hash hash, const std::filesystem::path& path)
+		{
+			std::error_code error;
+			const auto time = std::filesystem::last_write_time(path, error);
+			if (error)
+				return hash;
+
+			hash = HashCombine(hash, HashString(path.string()));
+			hash = HashCombine(hash, static_cast<Hash>(time.time_since_epoch().count()));
+
+			const auto size = std::filesystem::file_size(path, error);
+			return error ? hash : HashCombine(hash, static_cast<Hash>(size));
+		}
+
+		// Returns the library_path of a driver or layer manifest, relative paths are made relative to the manifest.
+		// Empty if there is none, or if it is a bare file name the system library search finds
+		VKHL_INLINE std::filesystem::path GetManifestLibraryPath(const std::filesystem::path& manifest)
+		{
+			MappedFile file;
+			if (!MapFile(manifest.string().c_str(), &file))
+				return {};
+
+			// Not a full JSON parser, the value is the first string after the key
+			const std::string_view text(static_cast<const char*>(file.data), file.size);
+			std::string library;
+			size_t position = text.find("\"library_path\"");
+			if (position != std::string_view::npos)
+				position = text.find('"', text.find(':', position + 14));
+
+			for (position = std::min(position, text.size()) + 1; position < text.size() && text[position] != '"'; position++)
+			{
+				if (text[position] == '\\' && position + 1 < text.size())
+					position++;
+				library += text[position];
+			}
+
+			UnmapFile(&file);
+
+			const std::filesystem::path libraryPath = library;
+			if (library.empty() || !libraryPath.has_parent_path())
+				return {};
+			return libraryPath.is_relative() ? manifest.parent_path() / libraryPath : libraryPath;
+		}
+
+		// Hashes a file, and the binary it names if it is a driver or layer manifest
+		VKHL_INLINE Hash HashCapabilityFile(Hash hash, const std::filesystem::path& path)
+		{
+			hash = HashFileStatus(hash, path);
+			if (path.extension() != ".json")
+				return hash;
+
+			const std::filesystem::path library = GetManifestLibraryPath(path);
+			return library.empty() ? hash : HashFileStatus(hash, library);
+		}
+
+		// Hashes everything that changes what the loader reports: its own binary, the environment variables it reads,
+		// and the driver and layer manifests with the binaries they name. On Windows the manifests live in the registry, so only the first two are used
+		VKHL_INLINE Hash GetCapabilityCacheKey()
+		{
+			Hash hash = HashString("vkhl capabilities");
+
+			constexpr const char* s_environment[] = {
+				"VK_ICD_FILENAMES", "VK_DRIVER_FILES", "VK_ADD_DRIVER_FILES",
+				"VK_LAYER_PATH", "VK_ADD_LAYER_PATH", "VK_INSTANCE_LAYERS",
+				"VK_LOADER_LAYERS_ENABLE", "VK_LOADER_LAYERS_DISABLE", "VK_LOADER_DRIVERS_SELECT", "VK_LOADER_DRIVERS_DISABLE",
+				"XDG_CONFIG_DIRS", "XDG_DATA_DIRS", "XDG_DATA_HOME", "HOME",
+			};
+
+			std::vector<std::filesystem::path> paths;
+			for (const char* name : s_environment)
+			{
+				const char* value = std::getenv(name);
+				hash = HashCombine(hash, HashString(value ? value : ""));
+
+				// Files and folders named by the driver and layer variables
+				if (value && std::strncmp(name, "VK_", 3) == 0)
+				{
+#ifdef _WIN32
+					constexpr char separator = ';';
+#else
+					constexpr char separator = ':';
+#endif
+					std::string_view list = value;
+					while (!list.empty())
+					{
+						const size_t end = std::min(list.find(separator), list.size());
+						if (end > 0)
+							paths.emplace_back(list.substr(0, end));
+						list.remove_prefix(std::min(end + 1, list.size()));
+					}
+				}
+			}
+
+			// The loader binary
+#ifdef _WIN32
+			HMODULE loader = nullptr;
+			char loaderPath[MAX_PATH];
+			if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+				reinterpret_cast<LPCSTR>(g_globalDispatch.vkGetInstanceProcAddr), &loader) &&
+				GetModuleFileNameA(loader, loaderPath, MAX_PATH) > 0)
+				paths.emplace_back(loaderPath);
+#else
+			Dl_info loaderInfo;
+			if (dladdr(reinterpret_cast<void*>(g_globalDispatch.vkGetInstanceProcAddr), &loaderInfo) && loaderInfo.dli_fname)
+				paths.emplace_back(loaderInfo.dli_fname);
+
+			// Manifest folders the loader searches
+			std::vector<std::filesystem::path> roots = { "/etc", "/usr/local/etc", "/usr/local/share", "/usr/share" };
+			if (const char* home = std::getenv("HOME"))
+			{
+				roots.push_back(std::filesystem::path(home) / ".config");
+				roots.push_back(std::filesystem::path(home) / ".local/share");
+			}
+
+			for (const auto& root : roots)
+			{
+				for (const char* folder : { "vulkan/icd.d", "vulkan/explicit_layer.d", "vulkan/implicit_layer.d" })
+					paths.push_back(root / folder);
+			}
+#endif
+
+			for (const auto& path : paths)
+			{
+				hash = HashCapabilityFile(hash, path);
+
+				std::error_code error;
+				if (!std::filesystem::is_directory(path, error))
+					continue;
+
+				// Directory times only change when files are added or removed, so check every manifest too
+				for (const auto& entry : std::filesystem::directory_iterator(path, error))
+					hash = HashCapabilityFile(hash, entry.path());
+			}
+
+			return hash;
+		}
+
+		constexpr char s_capabilityCacheMagic[8] = { 'V', 'K', 'H', 'L', 'C', 'A', 'P', '2' };
+
+		struct CapabilityWriter
+		{
+			std::vector<uint8_t> data;
+
+			void Write(const void* bytes, size_t size)
+			{
+				data.insert(data.end(), static_cast<const uint8_t*>(bytes), static_cast<const uint8_t*>(bytes) + size);
+			}
+
+			void WriteU32(uint32_t value) { Write(&value, sizeof(value)); }
+
+			void WriteNames(const NameSet& names)
+			{
+				WriteU32(static_cast<uint32_t>(names.GetSize()));
+				for (const auto& name : names.GetNames())
+				{
+					WriteU32(static_cast<uint32_t>(name.size()));
+					Write(name.data(), name.size());
+				}
+			}
+		};
+
+		struct CapabilityReader
+		{
+			const uint8_t* data;
+			size_t size;
+			bool failed = false;
+
+			const uint8_t* Read(size_t count)
+			{
+				if (failed || count > size)
+				{
+					failed = true;
+					return nullptr;
+				}
+
+				const uint8_t* bytes = data;
+				data += count;
+				size -= count;
+				return bytes;
+			}
+
+			uint32_t ReadU32()
+			{
+				uint32_t value = 0;
+				if (const uint8_t* bytes = Read(sizeof(value)))
+					std::memcpy(&value, bytes, sizeof(value));
+				return value;
+			}
+
+			void ReadNames(NameSet* namesOut)
+			{
+				const uint32_t count = ReadU32();
+				for (uint32_t i = 0; i < count && !failed; i++)
+				{
+					const uint32_t length = ReadU32();
+					if (const uint8_t* bytes = Read(length))
+						namesOut->Insert(std::string_view(reinterpret_cast<const char*>(bytes), length));
+				}
+			}
+		};
+
+		VKHL_INLINE void SaveCapabilityCache(const CapabilitySnapshot& snapshot, Hash key)
+		{
+			VKHL_TRACE_ZONE("vkhl::SaveCapabilityCache");
+
+			CapabilityWriter writer;
+			writer.Write(s_capabilityCacheMagic, sizeof(s_capabilityCacheMagic));
+			writer.Write(&key, sizeof(key));
+			writer.WriteU32(snapshot.apiVersion);
+
+			writer.WriteNames(snapshot.layers);
+			for (const auto& layerExtensions : snapshot.layerExtensions)
+				writer.WriteNames(layerExtensions);
+			writer.WriteNames(snapshot.extensions);
+
+			WriteFileAtomic(g_capabilityCachePath, writer.data.data(), writer.data.size());
+		}
+
+		VKHL_INLINE bool LoadCapabilityCache(Hash key, CapabilitySnapshot* snapshotOut)
+		{
+			VKHL_TRACE_ZONE("vkhl::LoadCapabilityCache");
+
+			MappedFile file;
+			if (!MapFile(g_capabilityCachePath, &file))
+				return false;
+
+			CapabilityReader reader{ static_cast<const uint8_t*>(file.data), file.size };
+
+			Hash fileKey = 0;
+			const uint8_t* magic = reader.Read(sizeof(s_capabilityCacheMagic));
+			if (const uint8_t* bytes = reader.Read(sizeof(fileKey)))
+				std::memcpy(&fileKey, bytes, sizeof(fileKey));
+
+			if (reader.failed || std::memcmp(magic, s_capabilityCacheMagic, sizeof(s_capabilityCacheMagic)) != 0 || fileKey != key)
+			{
+				UnmapFile(&file);
+				return false;
+			}
+
+			snapshotOut->apiVersion = reader.ReadU32();
+
+			reader.ReadNames(&snapshotOut->layers);
+			snapshotOut->layerExtensions.resize(snapshotOut->layers.GetSize());
+			for (auto& layerExtensions : snapshotOut->layerExtensions)
+				reader.ReadNames(&layerExtensions);
+			reader.ReadNames(&snapshotOut->extensions);
+
+			UnmapFile(&file);
+			return !reader.failed;
+		}
+
+		VKHL_INLINE SmartResult EnumerateCapabilities(CapabilitySnapshot* snapshotOut)
+		{
+			VKHL_TRACE_ZONE("vkhl::EnumerateCapabilities");
+
+			VkResult result = VK_SUCCESS;
+
+			// Get version
+			snapshotOut->apiVersion = VK_API_VERSION_1_0;
+			if (g_globalDispatch.vkEnumerateInstanceVersion) // If the function couldn't be found then we are using Vulkan 1.0
+			{
+				CHECK_VK_CALL(g_globalDispatch.vkEnumerateInstanceVersion(&snapshotOut->apiVersion),
+					"Failed to get instance version with error %s\n");
+			}
+
+			// Get layers
+			std::vector<VkLayerProperties> layers;
+			{
+				VKHL_TRACE_ZONE("vkEnumerateInstanceLayerProperties");
+
+				uint32_t layerCount = 0;
+				CHECK_VK_CALL(g_globalDispatch.vkEnumerateInstanceLayerProperties(&layerCount, nullptr),
+					"Failed to get number of instance layers with error %s\n");
+
+				layers.resize(layerCount);
+				CHECK_VK_CALL(g_globalDispatch.vkEnumerateInstanceLayerProperties(&layerCount, layers.data()),
+					"Failed to get instance layers with error %s\n");
+			}
+
+			std::vector<VkExtensionProperties> extensions;
+			for (const auto& layerProperties : layers)
+				snapshotOut->layers.Insert(layerProperties.layerName);
+
+			// Get extensions, first from the implementation, then from each layer
+			snapshotOut->layerExtensions.resize(snapshotOut->layers.GetSize());
+			for (uint32_t layer = 0; layer <= snapshotOut->layers.GetSize(); layer++)
+			{
+				VKHL_TRACE_ZONE("vkEnumerateInstanceExtensionProperties");
+
+				const bool implementation = layer == snapshotOut->layers.GetSize();
+				const char* layerName = implementation ? nullptr : snapshotOut->layers.GetNames()[layer].c_str();
+
+				uint32_t extensionCount = 0;
+				CHECK_VK_CALL(g_globalDispatch.vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, nullptr),
+					"Failed to get number of instance extensions with error %s\n");
+
+				extensions.resize(extensionCount);
+				CHECK_VK_CALL(g_globalDispatch.vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, extensions.data()),
+					"Failed to get instance extensions with error %s\n");
+
+				NameSet& names = implementation ? snapshotOut->extensions : snapshotOut->layerExtensions[layer];
+				for (uint32_t i = 0; i < extensionCount; i++)
+					names.Insert(extensions[i].extensionName);
+			}
+
+			return VK_SUCCESS;
+		}
+	}
+
+	VKHL_INLINE SmartResult GetCapabilitySnapshot(const CapabilitySnapshot** snapshotOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::GetCapabilitySnapshot");
+
+		auto& state = detail::GetCapabilityState();
+		std::lock_guard lock(state.mutex);
+
+		if (state.snapshot)
+		{
+			*snapshotOut = state.snapshot.get();
+			return VK_SUCCESS;
+		}
+
+		VkResult result = LoadGlobalDispatch().GetAndReset();
+		if (result < 0)
+			return result;
+
+		auto snapshot = std::make_unique<CapabilitySnapshot>();
+
+		if (g_capabilityCachePath)
+		{
+			state.cacheKey = detail::GetCapabilityCacheKey();
+			if (!detail::LoadCapabilityCache(state.cacheKey, snapshot.get()))
+			{
+				snapshot = std::make_unique<CapabilitySnapshot>();
+				result = detail::EnumerateCapabilities(snapshot.get()).GetAndReset();
+				if (result < 0)
+					return result;
+
+				detail::SaveCapabilityCache(*snapshot, state.cacheKey);
+			}
+		}
+		else
+		{
+			result = detail::EnumerateCapabilities(snapshot.get()).GetAndReset();
+			if (result < 0)
+				return result;
+		}
+
+		state.snapshot = std::move(snapshot);
+		*snapshotOut = state.snapshot.get();
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void ResetCapabilitySnapshot()
+	{
+		VKHL_TRACE_ZONE("vkhl::ResetCapabilitySnapshot");
+
+		auto& state = detail::GetCapabilityState();
+		std::lock_guard lock(state.mutex);
+		state.snapshot.reset();
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
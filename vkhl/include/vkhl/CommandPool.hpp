@@ -0,0 +1,288 @@
+#pragma once
+
+#ifndef VKHL_COMMANDPOOL_HPP
+#define VKHL_COMMANDPOOL_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "ThreadCache.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Hands out command buffers from one VkCommandPool per (thread, queue family, frame in flight).
+	// Acquire takes no locks while the thread is among the last few recyclers it used, and pools are only ever reset whole, in BeginFrame.
+	// Pools live until Destroy, so record from long lived worker threads rather than short lived ones
+	class CommandPoolRecycler
+	{
+	public:
+		CommandPoolRecycler() = default;
+		CommandPoolRecycler(const CommandPoolRecycler&) = delete;
+		CommandPoolRecycler& operator=(const CommandPoolRecycler&) = delete;
+		~CommandPoolRecycler() { Destroy(); }
+
+		// queueFamilies are the families command buffers will be acquired for, usually the ones SelectPhyicalDevice returned
+		SmartResult Init(const DeviceDispatch& dispatch, std::span<const uint32_t> queueFamilies, uint32_t framesInFlight);
+		// Destroys every pool, the device must be done with all of their command buffers
+		void Destroy();
+
+		// Starts recording into frameIndex % framesInFlight, resetting its pools on every thread.
+		// If fence isn't VK_NULL_HANDLE it is waited on first, otherwise the caller must know the frame's work is done.
+		// No thread may record while this runs
+		SmartResult BeginFrame(uint64_t frameIndex, VkFence fence = VK_NULL_HANDLE);
+
+		// Returns a command buffer for the current frame from the calling thread's pool, lock free after the first call on a thread.
+		// The command buffer is only valid until the same frame slot comes around again in BeginFrame
+		SmartResult Acquire(uint32_t queueFamilyIndex, VkCommandBufferLevel level, VkCommandBuffer* commandBufferOut);
+		Expected<VkCommandBuffer> Acquire(uint32_t queueFamilyIndex, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY)
+		{
+			VkCommandBuffer commandBuffer;
+			VkResult result = Acquire(queueFamilyIndex, level, &commandBuffer).GetAndReset();
+			if (result < 0)
+				return result;
+			return commandBuffer;
+		}
+
+		uint32_t GetFramesInFlight() const { return m_framesInFlight; }
+		uint32_t GetCurrentFrame() const { return m_currentFrame.load(std::memory_order_relaxed); }
+
+	private:
+		struct Pool
+		{
+			VkCommandPool pool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> buffers[2]; // Indexed by VkCommandBufferLevel
+			uint32_t used[2] = {};
+		};
+
+		// Everything one thread owns, pools[frame * familyCount + family]
+		struct ThreadPools
+		{
+			std::thread::id owner;
+			std::unique_ptr<Pool[]> pools;
+		};
+
+		SmartResult GetThreadPools(ThreadPools** poolsOut);
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		std::vector<uint32_t> m_queueFamilies;
+		uint32_t m_framesInFlight = 0;
+		std::atomic<uint32_t> m_currentFrame = 0;
+		uint64_t m_id = 0; // Unique per Init, so a thread's cached pools can't be mistaken for another recycler's
+
+		std::mutex m_threadsMutex;
+		std::vector<std::unique_ptr<ThreadPools>> m_threads;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	VKHL_INLINE SmartResult CommandPoolRecycler::Init(const DeviceDispatch& dispatch, std::span<const uint32_t> queueFamilies, uint32_t framesInFlight)
+	{
+		VKHL_TRACE_ZONE("vkhl::CommandPoolRecycler::Init");
+
+		m_dispatch = &dispatch;
+		m_queueFamilies.assign(queueFamilies.begin(), queueFamilies.end());
+		m_framesInFlight = std::max(framesInFlight, 1u);
+		m_currentFrame = 0;
+		m_id = detail::NewThreadCacheId();
+
+		// The same family may be listed more than once, keep one set of pools for it
+		std::sort(m_queueFamilies.begin(), m_queueFamilies.end());
+		m_queueFamilies.erase(std::unique(m_queueFamilies.begin(), m_queueFamilies.end()), m_queueFamilies.end());
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void CommandPoolRecycler::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::CommandPoolRecycler::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		std::lock_guard lock(m_threadsMutex);
+		const size_t poolCount = m_framesInFlight * m_queueFamilies.size();
+		for (auto& thread : m_threads)
+		{
+			for (size_t i = 0; i < poolCount; i++)
+			{
+				if (thread->pools[i].pool)
+					m_dispatch->vkDestroyCommandPool(m_dispatch->device, thread->pools[i].pool, GetAllocationCallbacks());
+			}
+		}
+
+		m_threads.clear();
+		m_id = 0;
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE SmartResult CommandPoolRecycler::BeginFrame(uint64_t frameIndex, VkFence fence)
+	{
+		VKHL_TRACE_ZONE("vkhl::CommandPoolRecycler::BeginFrame");
+
+		VkResult result = VK_SUCCESS;
+
+		if (fence)
+		{
+			CHECK_VK_CALL(m_dispatch->vkWaitForFences(m_dispatch->device, 1, &fence, VK_TRUE, UINT64_MAX),
+				"Failed to wait for frame fence with error %s\n");
+		}
+
+		const uint32_t frame = static_cast<uint32_t>(frameIndex % m_framesInFlight);
+		const size_t familyCount = m_queueFamilies.size();
+
+		std::lock_guard lock(m_threadsMutex);
+		for (auto& thread : m_threads)
+		{
+			for (size_t family = 0; family < familyCount; family++)
+			{
+				Pool& pool = thread->pools[frame * familyCount + family];
+				if (!pool.pool || (pool.used[0] == 0 && pool.used[1] == 0))
+					continue;
+
+				// Resetting the pool resets every buffer in it, and lets the driver keep the memory for next time
+				CHECK_VK_CALL(m_dispatch->vkResetCommandPool(m_dispatch->device, pool.pool, 0),
+					"Failed to reset command pool with error %s\n");
+				pool.used[0] = 0;
+				pool.used[1] = 0;
+			}
+		}
+
+		m_currentFrame.store(frame, std::memory_order_relaxed);
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult CommandPoolRecycler::GetThreadPools(ThreadPools** poolsOut)
+	{
+		// Recyclers the thread used recently skip the lock
+		if (void* pools = detail::ThreadCache<CommandPoolRecycler>::Find(m_id))
+		{
+			*poolsOut = static_cast<ThreadPools*>(pools);
+			return VK_SUCCESS;
+		}
+
+		// The thread may have pools from before it switched to other recyclers, otherwise they're made on first use
+		const std::thread::id threadId = std::this_thread::get_id();
+		ThreadPools* found = nullptr;
+		{
+			std::lock_guard lock(m_threadsMutex);
+			for (auto& thread : m_threads)
+			{
+				if (thread->owner == threadId)
+				{
+					found = thread.get();
+					break;
+				}
+			}
+
+			if (!found)
+			{
+				auto thread = std::make_unique<ThreadPools>();
+				thread->owner = threadId;
+				thread->pools = std::make_unique<Pool[]>(m_framesInFlight * m_queueFamilies.size());
+				m_threads.push_back(std::move(thread));
+				found = m_threads.back().get();
+			}
+		}
+
+		detail::ThreadCache<CommandPoolRecycler>::Insert(m_id, found);
+		*poolsOut = found;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult CommandPoolRecycler::Acquire(uint32_t queueFamilyIndex, VkCommandBufferLevel level, VkCommandBuffer* commandBufferOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::CommandPoolRecycler::Acquire");
+
+		VkResult result = VK_SUCCESS;
+
+		size_t family = 0;
+		while (family < m_queueFamilies.size() && m_queueFamilies[family] != queueFamilyIndex)
+			family++;
+
+		if (family == m_queueFamilies.size())
+		{
+			PrintError("Queue family %u was not given to the command pool recycler\n", queueFamilyIndex);
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		ThreadPools* thread;
+		result = GetThreadPools(&thread).GetAndReset();
+		if (result < 0)
+			return result;
+
+		const uint32_t frame = m_currentFrame.load(std::memory_order_relaxed);
+		Pool& pool = thread->pools[frame * m_queueFamilies.size() + family];
+
+		if (!pool.pool)
+		{
+			// Transient, and without VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT since buffers are never reset one at a time
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+			CHECK_VK_CALL(m_dispatch->vkCreateCommandPool(m_dispatch->device, &poolInfo, GetAllocationCallbacks(), &pool.pool),
+				"Failed to create command pool with error %s\n");
+		}
+
+		auto& buffers = pool.buffers[level];
+		uint32_t& used = pool.used[level];
+
+		if (used == buffers.size())
+		{
+			// Grow in batches so allocation stays off the common path
+			const uint32_t count = std::max<uint32_t>(static_cast<uint32_t>(buffers.size()), 8);
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = pool.pool;
+			allocInfo.level = level;
+			allocInfo.commandBufferCount = count;
+
+			buffers.resize(used + count);
+			result = m_dispatch->vkAllocateCommandBuffers(m_dispatch->device, &allocInfo, &buffers[used]);
+			if (result < 0)
+			{
+				buffers.resize(used);
+				PrintError("Failed to allocate command buffers with error %s\n", string_VkResult(result));
+				return result;
+			}
+		}
+
+		*commandBufferOut = buffers[used++];
+		return VK_SUCCESS;
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -5,6 +5,9 @@
 
 #include <utility>
 #include <optional>
+#include <new>
+#include <cstddef>
+#include <type_traits>
 #include <vulkan/vulkan_core.h>
 
 namespace vkhl
@@ -38,8 +41,9 @@ namespace vkhl
 		Defer() = default;
 		Defer(const Defer&) = delete;
 		Defer(Defer&& rhs)
+			:m_func(std::move(rhs.m_func))
 		{
-			std::swap(m_func, rhs.m_func);
+			rhs.m_func = std::nullopt;
 		}
 
 		Defer(const FuncT& func)
@@ -49,11 +53,37 @@ namespace vkhl
 
 		~Defer() { Destroy(); }
 
+		Defer& operator=(const Defer&) = delete;
+
+		// Runs the function this held, then takes over rhs's
+		Defer& operator=(Defer&& rhs)
+		{
+			if (this != &rhs)
+			{
+				Destroy();
+				// Lambdas can't be assigned, so construct in place instead of swapping
+				if (rhs.m_func.has_value())
+				{
+					m_func.emplace(std::move(*rhs.m_func));
+					rhs.m_func = std::nullopt;
+				}
+			}
+			return *this;
+		}
+
 		void Cancel()
 		{
 			m_func = std::nullopt;
 		}
 
+		// Gives up the function without running it, i.e. to hand it to a DeletionQueue
+		std::optional<FuncT> Release()
+		{
+			std::optional<FuncT> func = std::move(m_func);
+			m_func = std::nullopt;
+			return func;
+		}
+
 		void Destroy()
 		{
 			if (m_func.has_value())
@@ -66,6 +96,111 @@ namespace vkhl
 	private:
 		std::optional<FuncT> m_func = std::nullopt;
 	};
+
+	// A type erased function taking no arguments, for keeping Defer and FuncArgBinding functions of different types together.
+	// Functions up to InlineSize bytes are stored inline, so capturing a few handles doesn't allocate
+	class DeferredFunction
+	{
+	public:
+		static constexpr size_t InlineSize = 48;
+
+		DeferredFunction() = default;
+		DeferredFunction(const DeferredFunction&) = delete;
+		DeferredFunction& operator=(const DeferredFunction&) = delete;
+
+		DeferredFunction(DeferredFunction&& rhs) noexcept
+		{
+			MoveFrom(rhs);
+		}
+
+#if __cpp_concepts
+		template<CallableNoArgs FuncT> requires (!std::is_same_v<FuncT, DeferredFunction>)
+#else
+		template<typename FuncT>
+#endif
+		DeferredFunction(FuncT func)
+		{
+			if constexpr (sizeof(FuncT) <= InlineSize && alignof(FuncT) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<FuncT>)
+			{
+				new (m_storage) FuncT(std::move(func));
+				m_ops = &InlineOps<FuncT>::ops;
+			}
+			else
+			{
+				*reinterpret_cast<FuncT**>(m_storage) = new FuncT(std::move(func));
+				m_ops = &HeapOps<FuncT>::ops;
+			}
+		}
+
+		~DeferredFunction() { Reset(); }
+
+		DeferredFunction& operator=(DeferredFunction&& rhs) noexcept
+		{
+			if (this != &rhs)
+			{
+				Reset();
+				MoveFrom(rhs);
+			}
+			return *this;
+		}
+
+		void operator()() { m_ops->call(m_storage); }
+		explicit operator bool() const { return m_ops != nullptr; }
+
+		// Drops the function without running it
+		void Reset()
+		{
+			if (m_ops)
+			{
+				m_ops->destroy(m_storage);
+				m_ops = nullptr;
+			}
+		}
+
+	private:
+		struct Ops
+		{
+			void (*call)(void* storage);
+			void (*move)(void* dst, void* src); // Move constructs dst from src, then destroys src
+			void (*destroy)(void* storage);
+		};
+
+		template<typename FuncT>
+		struct InlineOps
+		{
+			static constexpr Ops ops = {
+				[](void* storage) { (*static_cast<FuncT*>(storage))(); },
+				[](void* dst, void* src) {
+					new (dst) FuncT(std::move(*static_cast<FuncT*>(src)));
+					static_cast<FuncT*>(src)->~FuncT();
+				},
+				[](void* storage) { static_cast<FuncT*>(storage)->~FuncT(); }
+			};
+		};
+
+		template<typename FuncT>
+		struct HeapOps
+		{
+			static constexpr Ops ops = {
+				[](void* storage) { (**static_cast<FuncT**>(storage))(); },
+				[](void* dst, void* src) { *static_cast<FuncT**>(dst) = *static_cast<FuncT**>(src); },
+				[](void* storage) { delete *static_cast<FuncT**>(storage); }
+			};
+		};
+
+		void MoveFrom(DeferredFunction& rhs)
+		{
+			if (rhs.m_ops)
+			{
+				rhs.m_ops->move(m_storage, rhs.m_storage);
+				m_ops = rhs.m_ops;
+				rhs.m_ops = nullptr;
+			}
+		}
+
+		alignas(std::max_align_t) unsigned char m_storage[InlineSize];
+		const Ops* m_ops = nullptr;
+	};
 }
 
 #endif
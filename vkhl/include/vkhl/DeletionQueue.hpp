@@ -0,0 +1,194 @@
+#pragma once
+
+#ifndef VKHL_DELETIONQUEUE_HPP
+#define VKHL_DELETIONQUEUE_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Error.hpp"
+#include "Defer.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <algorithm>
+#include <bit>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Holds functions, usually destroying a resource, until the GPU is done with what they destroy.
+	// Each function is tagged with a progress value (a frame index, or a QueueScheduler ticket value),
+	// and Collect runs every function whose value has been reached, so nothing has to wait for the device to go idle.
+	// Any thread can Enqueue without taking a lock, Collect must only be called from one thread at a time
+	class DeletionQueue
+	{
+	public:
+		DeletionQueue() = default;
+		DeletionQueue(const DeletionQueue&) = delete;
+		DeletionQueue& operator=(const DeletionQueue&) = delete;
+		~DeletionQueue() { Destroy(); }
+
+		// capacity is rounded up to a power of 2. If more functions are waiting to be collected they go to a locked overflow list
+		SmartResult Init(uint32_t capacity = 4096);
+		// Runs every function still queued, the GPU must be done with all of them
+		void Destroy();
+
+		// Runs func once Collect is called with a completedValue of at least value
+		void Enqueue(uint64_t value, DeferredFunction func);
+
+		template<typename FuncT>
+		void Enqueue(uint64_t value, Defer<FuncT>&& defer)
+		{
+			if (std::optional<FuncT> func = defer.Release())
+				Enqueue(value, DeferredFunction(std::move(*func)));
+		}
+
+		// Runs every function whose value is at most completedValue, the ones from each thread in the order it enqueued them. Returns how many ran
+		size_t Collect(uint64_t completedValue);
+		// Runs everything regardless of its value, i.e. after vkDeviceWaitIdle
+		size_t CollectAll() { return Collect(UINT64_MAX); }
+
+	private:
+		struct Entry
+		{
+			uint64_t value;
+			DeferredFunction func;
+		};
+
+		// Bounded multi producer ring, a slot can be written once its sequence equals the position being written
+		struct Slot
+		{
+			std::atomic<uint64_t> sequence;
+			Entry entry;
+		};
+
+		std::unique_ptr<Slot[]> m_slots;
+		uint64_t m_mask = 0;
+		alignas(64) std::atomic<uint64_t> m_tail = 0;	// Next position to write
+		alignas(64) uint64_t m_head = 0;				// Next position to read, only touched by Collect
+
+		std::mutex m_overflowMutex;
+		std::vector<Entry> m_overflow;
+		std::atomic<bool> m_hasOverflow = false;
+
+		std::vector<Entry> m_pending; // Taken out of the ring, but not reached yet. Only touched by Collect
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE SmartResult DeletionQueue::Init(uint32_t capacity)
+	{
+		VKHL_TRACE_ZONE("vkhl::DeletionQueue::Init");
+
+		const uint64_t size = std::bit_ceil(std::max(capacity, 2u));
+
+		m_slots = std::make_unique<Slot[]>(size);
+		for (uint64_t i = 0; i < size; i++)
+			m_slots[i].sequence.store(i, std::memory_order_relaxed);
+
+		m_mask = size - 1;
+		m_tail.store(0, std::memory_order_relaxed);
+		m_head = 0;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void DeletionQueue::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::DeletionQueue::Destroy");
+
+		if (!m_slots)
+			return;
+
+		CollectAll();
+		m_slots.reset();
+		m_pending.clear();
+	}
+
+	VKHL_INLINE void DeletionQueue::Enqueue(uint64_t value, DeferredFunction func)
+	{
+		VKHL_TRACE_ZONE("vkhl::DeletionQueue::Enqueue");
+
+		// Once something overflowed, keep going there until Collect empties it, so a thread's functions stay in order
+		uint64_t position = m_tail.load(std::memory_order_relaxed);
+		while (!m_hasOverflow.load(std::memory_order_acquire))
+		{
+			Slot& slot = m_slots[position & m_mask];
+			const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+			if (sequence == position)
+			{
+				// Free, claim it
+				if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					slot.entry.value = value;
+					slot.entry.func = std::move(func);
+					slot.sequence.store(position + 1, std::memory_order_release); // Lets Collect read it
+					return;
+				}
+			}
+			else if (sequence < position) // Full, Collect hasn't read this slot since the last time around
+				break;
+			else // Another thread claimed it first
+				position = m_tail.load(std::memory_order_relaxed);
+		}
+
+		std::lock_guard lock(m_overflowMutex);
+		m_overflow.push_back({ value, std::move(func) });
+		m_hasOverflow.store(true, std::memory_order_release);
+	}
+
+	VKHL_INLINE size_t DeletionQueue::Collect(uint64_t completedValue)
+	{
+		VKHL_TRACE_ZONE("vkhl::DeletionQueue::Collect");
+
+		// A thread only goes to overflow once the ring is full, so take the ring first to keep the order
+		for (;;)
+		{
+			Slot& slot = m_slots[m_head & m_mask];
+			if (slot.sequence.load(std::memory_order_acquire) != m_head + 1)
+				break;
+
+			m_pending.push_back(std::move(slot.entry));
+			slot.sequence.store(m_head + m_mask + 1, std::memory_order_release); // Free for the next time around
+			m_head++;
+		}
+
+		// A slot still being written stops the ring short, the overflow has to wait for it
+		if (m_hasOverflow.load(std::memory_order_acquire) && m_head == m_tail.load(std::memory_order_acquire))
+		{
+			std::lock_guard lock(m_overflowMutex);
+			for (auto& entry : m_overflow)
+				m_pending.push_back(std::move(entry));
+			m_overflow.clear();
+			m_hasOverflow.store(false, std::memory_order_relaxed);
+		}
+
+		// Run the ones that are done in one batch, keeping the rest in order
+		size_t ran = 0;
+		auto kept = m_pending.begin();
+		for (auto& entry : m_pending)
+		{
+			if (entry.value <= completedValue)
+			{
+				entry.func();
+				entry.func.Reset();
+				ran++;
+			}
+			else
+				*kept++ = std::move(entry);
+		}
+
+		m_pending.erase(kept, m_pending.end());
+		return ran;
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
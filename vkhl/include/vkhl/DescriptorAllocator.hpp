@@ -0,0 +1,647 @@
+#pragma once
+
+#ifndef VKHL_DESCRIPTORALLOCATOR_HPP
+#define VKHL_DESCRIPTORALLOCATOR_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Hash.hpp"
+#include "ThreadCache.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+#include <cmath>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Descriptor types tracked by the allocator, VK_DESCRIPTOR_TYPE_SAMPLER up to VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT
+	inline constexpr uint32_t DescriptorTypeCount = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT + 1;
+
+	struct DescriptorSetLayoutInfo
+	{
+		VkDescriptorSetLayout layout;
+		uint32_t descriptorCounts[DescriptorTypeCount]; // Descriptors one set takes of each VkDescriptorType
+	};
+
+	// Creates each distinct VkDescriptorSetLayout once. Layouts are keyed on their flags, bindings (in any order),
+	// immutable samplers and VkDescriptorSetLayoutBindingFlagsCreateInfo. Only the descriptor types DescriptorAllocator sizes pools for
+	// (VK_DESCRIPTOR_TYPE_SAMPLER to VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT) are accepted. Thread safe
+	class DescriptorLayoutCache
+	{
+	public:
+		DescriptorLayoutCache() = default;
+		DescriptorLayoutCache(const DescriptorLayoutCache&) = delete;
+		DescriptorLayoutCache& operator=(const DescriptorLayoutCache&) = delete;
+		~DescriptorLayoutCache() { Destroy(); }
+
+		SmartResult Init(const DeviceDispatch& dispatch);
+		void Destroy();
+
+		// layoutOut stays valid until Destroy. Layouts with other structs in pNext are created every time, since they can't be keyed
+		SmartResult Get(const VkDescriptorSetLayoutCreateInfo& createInfo, const DescriptorSetLayoutInfo** layoutOut);
+
+	private:
+		struct Key
+		{
+			VkDescriptorSetLayoutCreateFlags flags;
+			std::vector<VkDescriptorSetLayoutBinding> bindings; // Sorted by binding, pImmutableSamplers is cleared
+			std::vector<VkDescriptorBindingFlags> bindingFlags;
+			std::vector<VkSampler> immutableSamplers;
+
+			bool operator==(const Key& other) const;
+		};
+
+		struct Entry
+		{
+			Key key;
+			DescriptorSetLayoutInfo info;
+		};
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		std::shared_mutex m_mutex;
+		std::unordered_multimap<Hash, std::unique_ptr<Entry>> m_layouts;
+		std::vector<std::unique_ptr<Entry>> m_uncached;
+	};
+
+	// Size of the descriptor pools the allocator creates
+	struct DescriptorPoolShape
+	{
+		uint32_t maxSets;
+		uint32_t descriptorCounts[DescriptorTypeCount];
+	};
+
+	struct DescriptorAllocatorCreateInfo
+	{
+		uint32_t framesInFlight = 2;
+		uint32_t initialMaxSets = 256; // The descriptor counts start at a typical mix for this many sets
+	};
+
+	// Allocates descriptor sets from pools owned by (thread, frame in flight), which are only ever reset whole in BeginFrame.
+	// Allocate takes no locks while the allocator is among the last few the thread used, and only calls the driver to allocate the set, or when a pool runs out.
+	// Pool sizes follow how many descriptors of each type the busiest thread used in recent frames.
+	// Layouts made with VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT aren't supported
+	class DescriptorAllocator
+	{
+	public:
+		DescriptorAllocator() = default;
+		DescriptorAllocator(const DescriptorAllocator&) = delete;
+		DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+		~DescriptorAllocator() { Destroy(); }
+
+		SmartResult Init(const DeviceDispatch& dispatch, const DescriptorAllocatorCreateInfo& createInfo = {});
+		// Destroys every pool, the device must be done with all of their sets
+		void Destroy();
+
+		// Starts allocating from frameIndex % framesInFlight, resetting its pools on every thread and retuning the pool sizes.
+		// If fence isn't VK_NULL_HANDLE it is waited on first, otherwise the caller must know the frame's work is done.
+		// No thread may allocate while this runs
+		SmartResult BeginFrame(uint64_t frameIndex, VkFence fence = VK_NULL_HANDLE);
+
+		// The set is valid until the same frame slot comes around again in BeginFrame. pNext is passed to VkDescriptorSetAllocateInfo
+		SmartResult Allocate(const DescriptorSetLayoutInfo& layout, VkDescriptorSet* setOut, const void* pNext = nullptr);
+		Expected<VkDescriptorSet> Allocate(const DescriptorSetLayoutInfo& layout, const void* pNext = nullptr)
+		{
+			VkDescriptorSet set;
+			VkResult result = Allocate(layout, &set, pNext).GetAndReset();
+			if (result < 0)
+				return result;
+			return set;
+		}
+
+		const DescriptorPoolShape& GetPoolShape() const { return m_shape; }
+
+	private:
+		struct Pool
+		{
+			VkDescriptorPool pool;
+			uint32_t generation; // Shape the pool was made with, pools of old shapes are destroyed on reset
+		};
+
+		struct FramePools
+		{
+			std::vector<Pool> used;	// Allocating from back()
+			std::vector<Pool> free;	// Already reset
+			uint32_t sets = 0;
+			uint32_t descriptorCounts[DescriptorTypeCount] = {};
+		};
+
+		struct ThreadPools
+		{
+			std::thread::id owner;
+			std::unique_ptr<FramePools[]> frames;
+		};
+
+		SmartResult GetThreadPools(ThreadPools** poolsOut);
+		SmartResult NextPool(FramePools& frame, const DescriptorSetLayoutInfo& layout, bool* createdOut);
+		void Retune(const FramePools& busiest);
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		uint32_t m_framesInFlight = 0;
+		std::atomic<uint32_t> m_currentFrame = 0;
+		uint64_t m_id = 0; // Unique per Init, so a thread's cached pools can't be mistaken for another allocator's
+
+		DescriptorPoolShape m_minimumShape{};
+		DescriptorPoolShape m_shape{};
+		uint32_t m_generation = 0;
+		uint32_t m_samples = 0;
+		float m_averageSets = 0;
+		float m_averageCounts[DescriptorTypeCount] = {};
+
+		std::mutex m_threadsMutex;
+		std::vector<std::unique_ptr<ThreadPools>> m_threads;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	namespace detail
+	{
+		// Descriptors per set in a typical frame, scaled by maxSets for the first pools
+		VKHL_INLINE_VAR constexpr float g_defaultDescriptorRatios[DescriptorTypeCount] = {
+			0.5f,	// SAMPLER
+			4.0f,	// COMBINED_IMAGE_SAMPLER
+			4.0f,	// SAMPLED_IMAGE
+			1.0f,	// STORAGE_IMAGE
+			1.0f,	// UNIFORM_TEXEL_BUFFER
+			1.0f,	// STORAGE_TEXEL_BUFFER
+			2.0f,	// UNIFORM_BUFFER
+			2.0f,	// STORAGE_BUFFER
+			1.0f,	// UNIFORM_BUFFER_DYNAMIC
+			1.0f,	// STORAGE_BUFFER_DYNAMIC
+			0.5f	// INPUT_ATTACHMENT
+		};
+	}
+
+	// ----- DescriptorLayoutCache -----
+
+	VKHL_INLINE bool DescriptorLayoutCache::Key::operator==(const Key& other) const
+	{
+		if (flags != other.flags || bindings.size() != other.bindings.size() || bindingFlags != other.bindingFlags || immutableSamplers != other.immutableSamplers)
+			return false;
+
+		for (size_t i = 0; i < bindings.size(); i++)
+		{
+			const auto& a = bindings[i];
+			const auto& b = other.bindings[i];
+			if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags)
+				return false;
+		}
+
+		return true;
+	}
+
+	VKHL_INLINE SmartResult DescriptorLayoutCache::Init(const DeviceDispatch& dispatch)
+	{
+		VKHL_TRACE_ZONE("vkhl::DescriptorLayoutCache::Init");
+
+		m_dispatch = &dispatch;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void DescriptorLayoutCache::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::DescriptorLayoutCache::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		std::unique_lock lock(m_mutex);
+		for (auto& [hash, entry] : m_layouts)
+			m_dispatch->vkDestroyDescriptorSetLayout(m_dispatch->device, entry->info.layout, GetAllocationCallbacks());
+		for (auto& entry : m_uncached)
+			m_dispatch->vkDestroyDescriptorSetLayout(m_dispatch->device, entry->info.layout, GetAllocationCallbacks());
+
+		m_layouts.clear();
+		m_uncached.clear();
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE SmartResult DescriptorLayoutCache::Get(const VkDescriptorSetLayoutCreateInfo& createInfo, const DescriptorSetLayoutInfo** layoutOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::DescriptorLayoutCache::Get");
+
+		VkResult result = VK_SUCCESS;
+
+		// DescriptorAllocator only sizes its pools for the core types up to input attachments
+		for (uint32_t i = 0; i < createInfo.bindingCount; i++)
+		{
+			const VkDescriptorType type = createInfo.pBindings[i].descriptorType;
+			if (static_cast<uint32_t>(type) >= DescriptorTypeCount)
+			{
+				PrintError("Descriptor type %s can't be allocated from DescriptorAllocator's pools, make layouts with it yourself\n", string_VkDescriptorType(type));
+				return VK_ERROR_FEATURE_NOT_PRESENT;
+			}
+		}
+
+		// Only binding flags can be part of the key
+		const VkDescriptorSetLayoutBindingFlagsCreateInfo* flagsInfo = nullptr;
+		bool cacheable = true;
+		for (auto next = static_cast<const VkBaseInStructure*>(createInfo.pNext); next; next = next->pNext)
+		{
+			if (next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO)
+				flagsInfo = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(next);
+			else
+				cacheable = false;
+		}
+
+		auto entry = std::make_unique<Entry>();
+		Key& key = entry->key;
+		key.flags = createInfo.flags;
+
+		std::vector<uint32_t> order(createInfo.bindingCount);
+		for (uint32_t i = 0; i < createInfo.bindingCount; i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+				return createInfo.pBindings[a].binding < createInfo.pBindings[b].binding;
+			});
+
+		Hash hash = HashCombine(0, key.flags);
+		for (uint32_t i : order)
+		{
+			VkDescriptorSetLayoutBinding binding = createInfo.pBindings[i];
+			if (binding.pImmutableSamplers)
+				key.immutableSamplers.insert(key.immutableSamplers.end(), binding.pImmutableSamplers, binding.pImmutableSamplers + binding.descriptorCount);
+			binding.pImmutableSamplers = nullptr;
+			key.bindings.push_back(binding);
+
+			if (flagsInfo && flagsInfo->bindingCount != 0)
+				key.bindingFlags.push_back(flagsInfo->pBindingFlags[i]);
+
+			hash = HashCombine(hash, binding.binding);
+			hash = HashCombine(hash, binding.descriptorType);
+			hash = HashCombine(hash, binding.descriptorCount);
+			hash = HashCombine(hash, binding.stageFlags);
+			hash = HashCombine(hash, key.bindingFlags.empty() ? 0 : key.bindingFlags.back());
+		}
+
+		for (auto sampler : key.immutableSamplers)
+			hash = HashCombine(hash, reinterpret_cast<uint64_t>(sampler));
+
+		if (cacheable)
+		{
+			std::shared_lock lock(m_mutex);
+			auto [begin, end] = m_layouts.equal_range(hash);
+			for (auto it = begin; it != end; ++it)
+			{
+				if (it->second->key == key)
+				{
+					*layoutOut = &it->second->info;
+					return VK_SUCCESS;
+				}
+			}
+		}
+
+		// Not found, make it outside the lock. If another thread made the same layout meanwhile, theirs wins
+		DescriptorSetLayoutInfo& info = entry->info;
+		std::fill(std::begin(info.descriptorCounts), std::end(info.descriptorCounts), 0u);
+		for (const auto& binding : key.bindings)
+			info.descriptorCounts[binding.descriptorType] += binding.descriptorCount;
+
+		CHECK_VK_CALL(m_dispatch->vkCreateDescriptorSetLayout(m_dispatch->device, &createInfo, GetAllocationCallbacks(), &info.layout),
+			"Failed to create descriptor set layout with error %s\n");
+
+		std::unique_lock lock(m_mutex);
+		if (!cacheable)
+		{
+			m_uncached.push_back(std::move(entry));
+			*layoutOut = &m_uncached.back()->info;
+			return VK_SUCCESS;
+		}
+
+		auto [begin, end] = m_layouts.equal_range(hash);
+		for (auto it = begin; it != end; ++it)
+		{
+			if (it->second->key == key)
+			{
+				m_dispatch->vkDestroyDescriptorSetLayout(m_dispatch->device, info.layout, GetAllocationCallbacks());
+				*layoutOut = &it->second->info;
+				return VK_SUCCESS;
+			}
+		}
+
+		*layoutOut = &m_layouts.emplace(hash, std::move(entry))->second->info;
+		return VK_SUCCESS;
+	}
+
+	// ----- DescriptorAllocator -----
+
+	VKHL_INLINE SmartResult DescriptorAllocator::Init(const DeviceDispatch& dispatch, const DescriptorAllocatorCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::DescriptorAllocator::Init");
+
+		m_dispatch = &dispatch;
+		m_framesInFlight = std::max(createInfo.framesInFlight, 1u);
+		m_currentFrame = 0;
+		m_id = detail::NewThreadCacheId();
+
+		m_minimumShape.maxSets = std::max(createInfo.initialMaxSets, 1u);
+		for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+			m_minimumShape.descriptorCounts[type] = static_cast<uint32_t>(std::ceil(m_minimumShape.maxSets * detail::g_defaultDescriptorRatios[type]));
+
+		m_shape = m_minimumShape;
+		m_generation = 0;
+		m_samples = 0;
+		m_averageSets = 0;
+		std::fill(std::begin(m_averageCounts), std::end(m_averageCounts), 0.0f);
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void DescriptorAllocator::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::DescriptorAllocator::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		std::lock_guard lock(m_threadsMutex);
+		for (auto& thread : m_threads)
+		{
+			for (uint32_t frame = 0; frame < m_framesInFlight; frame++)
+			{
+				for (auto& pool : thread->frames[frame].used)
+					m_dispatch->vkDestroyDescriptorPool(m_dispatch->device, pool.pool, GetAllocationCallbacks());
+				for (auto& pool : thread->frames[frame].free)
+					m_dispatch->vkDestroyDescriptorPool(m_dispatch->device, pool.pool, GetAllocationCallbacks());
+			}
+		}
+
+		m_threads.clear();
+		m_id = 0;
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE void DescriptorAllocator::Retune(const FramePools& busiest)
+	{
+		// Moving average of the busiest thread, so one heavy frame doesn't resize every pool
+		const float weight = m_samples == 0 ? 1.0f : 0.125f;
+		m_samples++;
+		m_averageSets += (busiest.sets - m_averageSets) * weight;
+		for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+			m_averageCounts[type] += (busiest.descriptorCounts[type] - m_averageCounts[type]) * weight;
+
+		// Reshaping recreates the pools, so only do it when a pool no longer fits a frame or is mostly unused.
+		// New shapes get half again the average, so small changes in usage don't reshape again
+		auto needed = [](float average) { return static_cast<uint32_t>(std::ceil(average * 1.1f)); };
+		auto planned = [](float average) { return static_cast<uint32_t>(std::ceil(average * 1.5f)); };
+
+		bool grow = needed(m_averageSets) > m_shape.maxSets;
+		bool shrink = std::max(m_minimumShape.maxSets, planned(m_averageSets)) * 4 < m_shape.maxSets;
+		for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+		{
+			grow |= needed(m_averageCounts[type]) > m_shape.descriptorCounts[type];
+			shrink |= planned(m_averageCounts[type]) * 4 < m_shape.descriptorCounts[type];
+		}
+
+		if (!grow && !shrink)
+			return;
+
+		// Types that aren't used drop out of the pools
+		m_shape.maxSets = std::max(m_minimumShape.maxSets, planned(m_averageSets));
+		for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+			m_shape.descriptorCounts[type] = planned(m_averageCounts[type]);
+		m_generation++;
+	}
+
+	VKHL_INLINE SmartResult DescriptorAllocator::BeginFrame(uint64_t frameIndex, VkFence fence)
+	{
+		VKHL_TRACE_ZONE("vkhl::DescriptorAllocator::BeginFrame");
+
+		VkResult result = VK_SUCCESS;
+
+		if (fence)
+		{
+			CHECK_VK_CALL(m_dispatch->vkWaitForFences(m_dispatch->device, 1, &fence, VK_TRUE, UINT64_MAX),
+				"Failed to wait for frame fence with error %s\n");
+		}
+
+		const uint32_t frameSlot = static_cast<uint32_t>(frameIndex % m_framesInFlight);
+
+		std::lock_guard lock(m_threadsMutex);
+
+		// Gather what the busiest thread used in this slot last time, to size the pools
+		FramePools busiest;
+		bool used = false;
+		for (auto& thread : m_threads)
+		{
+			FramePools& frame = thread->frames[frameSlot];
+			if (frame.sets == 0)
+				continue;
+
+			used = true;
+			busiest.sets = std::max(busiest.sets, frame.sets);
+			for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+				busiest.descriptorCounts[type] = std::max(busiest.descriptorCounts[type], frame.descriptorCounts[type]);
+		}
+
+		if (used)
+			Retune(busiest);
+
+		for (auto& thread : m_threads)
+		{
+			FramePools& frame = thread->frames[frameSlot];
+
+			// Pools of an old shape are replaced as they come back
+			auto recycle = [&](const Pool& pool) -> VkResult {
+				if (pool.generation != m_generation)
+				{
+					m_dispatch->vkDestroyDescriptorPool(m_dispatch->device, pool.pool, GetAllocationCallbacks());
+					return VK_SUCCESS;
+				}
+
+				VkResult result = m_dispatch->vkResetDescriptorPool(m_dispatch->device, pool.pool, 0);
+				if (result < 0)
+				{
+					PrintError("Failed to reset descriptor pool with error %s\n", string_VkResult(result));
+					return result;
+				}
+
+				frame.free.push_back(pool);
+				return VK_SUCCESS;
+			};
+
+			std::vector<Pool> pools;
+			pools.swap(frame.free);
+			pools.insert(pools.end(), frame.used.begin(), frame.used.end());
+			frame.used.clear();
+
+			for (const auto& pool : pools)
+			{
+				result = recycle(pool);
+				if (result < 0)
+					return result;
+			}
+
+			frame.sets = 0;
+			std::fill(std::begin(frame.descriptorCounts), std::end(frame.descriptorCounts), 0u);
+		}
+
+		m_currentFrame.store(frameSlot, std::memory_order_relaxed);
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult DescriptorAllocator::GetThreadPools(ThreadPools** poolsOut)
+	{
+		// Allocators the thread used recently skip the lock
+		if (void* pools = detail::ThreadCache<DescriptorAllocator>::Find(m_id))
+		{
+			*poolsOut = static_cast<ThreadPools*>(pools);
+			return VK_SUCCESS;
+		}
+
+		// The thread may have pools from before it switched to other allocators, otherwise they're made on first use
+		const std::thread::id threadId = std::this_thread::get_id();
+		ThreadPools* found = nullptr;
+		{
+			std::lock_guard lock(m_threadsMutex);
+			for (auto& thread : m_threads)
+			{
+				if (thread->owner == threadId)
+				{
+					found = thread.get();
+					break;
+				}
+			}
+
+			if (!found)
+			{
+				auto thread = std::make_unique<ThreadPools>();
+				thread->owner = threadId;
+				thread->frames = std::make_unique<FramePools[]>(m_framesInFlight);
+				m_threads.push_back(std::move(thread));
+				found = m_threads.back().get();
+			}
+		}
+
+		detail::ThreadCache<DescriptorAllocator>::Insert(m_id, found);
+		*poolsOut = found;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult DescriptorAllocator::NextPool(FramePools& frame, const DescriptorSetLayoutInfo& layout, bool* createdOut)
+	{
+		VkResult result = VK_SUCCESS;
+
+		if (!frame.free.empty())
+		{
+			frame.used.push_back(frame.free.back());
+			frame.free.pop_back();
+			*createdOut = false;
+			return VK_SUCCESS;
+		}
+
+		// The shape may have dropped a type this layout uses, make room for some sets of it until the next retune picks it up
+		VkDescriptorPoolSize sizes[DescriptorTypeCount];
+		uint32_t sizeCount = 0;
+		for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+		{
+			const uint32_t count = std::max(m_shape.descriptorCounts[type], layout.descriptorCounts[type] * 16);
+			if (count != 0)
+				sizes[sizeCount++] = { static_cast<VkDescriptorType>(type), count };
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = m_shape.maxSets;
+		poolInfo.poolSizeCount = sizeCount;
+		poolInfo.pPoolSizes = sizes;
+
+		Pool pool{ VK_NULL_HANDLE, m_generation };
+		CHECK_VK_CALL(m_dispatch->vkCreateDescriptorPool(m_dispatch->device, &poolInfo, GetAllocationCallbacks(), &pool.pool),
+			"Failed to create descriptor pool with error %s\n");
+
+		frame.used.push_back(pool);
+		*createdOut = true;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult DescriptorAllocator::Allocate(const DescriptorSetLayoutInfo& layout, VkDescriptorSet* setOut, const void* pNext)
+	{
+		VKHL_TRACE_ZONE("vkhl::DescriptorAllocator::Allocate");
+
+		VkResult result = VK_SUCCESS;
+
+		ThreadPools* thread;
+		result = GetThreadPools(&thread).GetAndReset();
+		if (result < 0)
+			return result;
+
+		FramePools& frame = thread->frames[m_currentFrame.load(std::memory_order_relaxed)];
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext = pNext;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout.layout;
+
+		bool created = false;
+		if (frame.used.empty())
+		{
+			result = NextPool(frame, layout, &created).GetAndReset();
+			if (result < 0)
+				return result;
+		}
+
+		for (;;)
+		{
+			allocInfo.descriptorPool = frame.used.back().pool;
+			result = m_dispatch->vkAllocateDescriptorSets(m_dispatch->device, &allocInfo, setOut);
+			if (result >= 0)
+				break;
+
+			if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+			{
+				PrintError("Failed to allocate descriptor set with error %s\n", string_VkResult(result));
+				return result;
+			}
+
+			if (created)
+			{
+				// A fresh pool can't fit the set, so the pools are the wrong shape for it
+				PrintError("Descriptor set doesn't fit in an empty descriptor pool, failed with error %s\n", string_VkResult(result));
+				return result;
+			}
+
+			result = NextPool(frame, layout, &created).GetAndReset();
+			if (result < 0)
+				return result;
+		}
+
+		frame.sets++;
+		for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+			frame.descriptorCounts[type] += layout.descriptorCounts[type];
+
+		return VK_SUCCESS;
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -0,0 +1,487 @@
+#pragma once
+
+#ifndef VKHL_DEVICE_HPP
+#define VKHL_DEVICE_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <utility>
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Common.hpp"
+#include "Dispatch.hpp"
+#include "PhysicalDevice.hpp"
+#include "Capabilities.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Which feature struct a DeviceFeature lives in
+	enum class DeviceFeatureStruct : uint8_t
+	{
+		Vulkan10, // VkPhysicalDeviceFeatures
+		Vulkan11, // VkPhysicalDeviceVulkan11Features
+		Vulkan12, // VkPhysicalDeviceVulkan12Features
+		Vulkan13, // VkPhysicalDeviceVulkan13Features
+	};
+
+	// A VkBool32 member of one of the core feature structs, make these with the VKHL_FEATURE_* macros
+	struct DeviceFeature
+	{
+		DeviceFeatureStruct structure;
+		uint32_t offset;
+		const char* name; // Used in error messages
+	};
+
+#define VKHL_FEATURE_10(member) vkhl::DeviceFeature{ vkhl::DeviceFeatureStruct::Vulkan10, offsetof(VkPhysicalDeviceFeatures, member), #member }
+#define VKHL_FEATURE_11(member) vkhl::DeviceFeature{ vkhl::DeviceFeatureStruct::Vulkan11, offsetof(VkPhysicalDeviceVulkan11Features, member), #member }
+#define VKHL_FEATURE_12(member) vkhl::DeviceFeature{ vkhl::DeviceFeatureStruct::Vulkan12, offsetof(VkPhysicalDeviceVulkan12Features, member), #member }
+#define VKHL_FEATURE_13(member) vkhl::DeviceFeature{ vkhl::DeviceFeatureStruct::Vulkan13, offsetof(VkPhysicalDeviceVulkan13Features, member), #member }
+
+	struct DeviceCreateInfo
+	{
+		std::span<std::pair<const char*, FeatureRequirement>> extensions;
+		std::span<std::pair<DeviceFeature, FeatureRequirement>> features;
+
+		// Enables timeline semaphores, synchronization2, buffer device address, descriptor indexing
+		// maintenance4/5 and shader module identifiers where the device has them, and VK_EXT_memory_budget. Check DeviceInfo for what was enabled
+		bool performanceFeatures = true;
+
+		const void* pNext = nullptr; // Chained after vkhl's feature structs
+
+		// Every physical device of a group from SelectPhysicalDeviceGroup, physicalDevice must be one of them. Empty for a single device
+		std::span<const VkPhysicalDevice> deviceGroup;
+
+		// Loaded for the new device instead of g_deviceDispatch, give each device its own when using several
+		DeviceDispatch* dispatch = nullptr;
+	};
+
+	struct DeviceInfo
+	{
+		Version apiVersion; // Lower of the instance and device versions
+		std::vector<std::string> extensions;
+
+		// Enabled features, pNext is cleared. The structs newer than apiVersion are all VK_FALSE
+		VkPhysicalDeviceFeatures features;
+		VkPhysicalDeviceVulkan11Features features11;
+		VkPhysicalDeviceVulkan12Features features12;
+		VkPhysicalDeviceVulkan13Features features13;
+
+		// Performance features, true if enabled either through core or through an extension
+		bool timelineSemaphore;
+		bool synchronization2;
+		bool bufferDeviceAddress;
+		bool descriptorIndexing;
+		bool maintenance4;
+		bool maintenance5;
+		bool shaderModuleIdentifier; // Also means pipelineCreationCacheControl is on
+
+		std::vector<VkQueue> queues; // One per PhysicalDeviceInfo::queueAssignments
+	};
+
+	// Creates a device with the queues in physicalDeviceInfo.queueAssignments, then loads g_deviceDispatch (or createInfo.dispatch) for it.
+	// physicalDeviceInfo must come from SelectPhyicalDevice for physicalDevice. Uses g_instanceDispatch
+	// Params:
+	//	physicalDevice = The selected VkPhysicalDevice
+	//	physicalDeviceInfo = The PhysicalDeviceInfo returned with it
+	//	createInfo = Extensions and features to enable
+	//	deviceOut -> VkDevice
+	//	infoOut (optional) -> A DeviceInfo struct with what was enabled, and the queues
+	VKHL_INLINE SmartResult CreateDevice(VkPhysicalDevice physicalDevice, const PhysicalDeviceInfo& physicalDeviceInfo, const DeviceCreateInfo& createInfo, VkDevice* deviceOut, DeviceInfo* infoOut = nullptr);
+
+	// Calls vkDestroyDevice with global allocation callbacks, and clears g_deviceDispatch if it belongs to device.
+	// dispatch must be the table CreateDevice loaded for device
+	VKHL_INLINE void DestroyDevice(VkDevice device, const DeviceDispatch& dispatch = g_deviceDispatch);
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	namespace detail
+	{
+		// Every feature struct vkhl knows about, chained for the device's version and extensions
+		struct DeviceFeatureChain
+		{
+			VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+			VkPhysicalDeviceVulkan11Features features11{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
+			VkPhysicalDeviceVulkan12Features features12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+			VkPhysicalDeviceVulkan13Features features13{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+			VkPhysicalDeviceSynchronization2Features synchronization2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES };
+			VkPhysicalDeviceMaintenance4Features maintenance4{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_4_FEATURES };
+#ifdef VK_KHR_maintenance5
+			VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR };
+#endif
+#ifdef VK_EXT_shader_module_identifier
+			VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT shaderModuleIdentifier{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT };
+#endif
+
+			// Extension structs are only chained when the extension is enabled, and only where core doesn't cover them
+			void Link(Version apiVersion, const NameSet& extensions, const void* tail)
+			{
+				const void** next = const_cast<const void**>(&features2.pNext);
+				auto append = [&next](auto& structure) {
+					*next = &structure;
+					next = const_cast<const void**>(&structure.pNext);
+				};
+
+				if (apiVersion >= VK_API_VERSION_1_2)
+				{
+					append(features11);
+					append(features12);
+				}
+
+				if (apiVersion >= VK_API_VERSION_1_3)
+					append(features13);
+				else
+				{
+					if (extensions.Contains(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+						append(synchronization2);
+					if (extensions.Contains(VK_KHR_MAINTENANCE_4_EXTENSION_NAME))
+						append(maintenance4);
+				}
+
+#ifdef VK_KHR_maintenance5
+				if (extensions.Contains(VK_KHR_MAINTENANCE_5_EXTENSION_NAME))
+					append(maintenance5);
+#endif
+#ifdef VK_EXT_shader_module_identifier
+				if (extensions.Contains(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME))
+					append(shaderModuleIdentifier);
+#endif
+
+				*next = tail;
+			}
+
+			VkBool32* GetFeature(DeviceFeature feature)
+			{
+				uint8_t* base = nullptr;
+				switch (feature.structure)
+				{
+				case DeviceFeatureStruct::Vulkan10: base = reinterpret_cast<uint8_t*>(&features2.features); break;
+				case DeviceFeatureStruct::Vulkan11: base = reinterpret_cast<uint8_t*>(&features11); break;
+				case DeviceFeatureStruct::Vulkan12: base = reinterpret_cast<uint8_t*>(&features12); break;
+				case DeviceFeatureStruct::Vulkan13: base = reinterpret_cast<uint8_t*>(&features13); break;
+				}
+				return reinterpret_cast<VkBool32*>(base + feature.offset);
+			}
+		};
+
+		// Feature structs that only exist past a version can't be enabled on older devices
+		constexpr Version GetDeviceFeatureVersion(DeviceFeatureStruct structure)
+		{
+			switch (structure)
+			{
+			case DeviceFeatureStruct::Vulkan11: return VK_API_VERSION_1_2; // VkPhysicalDeviceVulkan11Features was added in 1.2
+			case DeviceFeatureStruct::Vulkan12: return VK_API_VERSION_1_2;
+			case DeviceFeatureStruct::Vulkan13: return VK_API_VERSION_1_3;
+			default: return VK_API_VERSION_1_0;
+			}
+		}
+	}
+
+	VKHL_INLINE SmartResult CreateDevice(VkPhysicalDevice physicalDevice, const PhysicalDeviceInfo& physicalDeviceInfo, const DeviceCreateInfo& createInfo, VkDevice* deviceOut, DeviceInfo* infoOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::CreateDevice");
+
+		VkResult result = VK_SUCCESS;
+
+		const Version apiVersion = std::min(g_instanceDispatch.apiVersion, physicalDeviceInfo.properties.apiVersion);
+
+		// Get available extensions
+		NameSet availableExtensions;
+		{
+			uint32_t availableExtCount = 0;
+			CHECK_VK_CALL(g_instanceDispatch.vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &availableExtCount, nullptr),
+				"Failed to get number of device extensions with error %s\n");
+
+			std::vector<VkExtensionProperties> extensionProperties{ availableExtCount };
+			CHECK_VK_CALL(g_instanceDispatch.vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &availableExtCount, extensionProperties.data()),
+				"Failed to get device extensions with error %s\n");
+
+			for (const auto& extension : extensionProperties)
+				availableExtensions.Insert(extension.extensionName);
+		}
+
+		// Check extension availablility
+		NameSet enabledExtensions;
+		for (auto extension : createInfo.extensions)
+		{
+			if (!availableExtensions.Contains(extension.first))
+			{
+				// Not found
+				if (extension.second == RequireFeature)
+				{
+					PrintError("Device extension %s was required but not found\n", extension.first);
+					result = VK_ERROR_EXTENSION_NOT_PRESENT;
+				}
+				else if (extension.second == RequestFeature)
+					PrintWarning("Device extension %s was requested but not found, continuing\n", extension.first);
+			}
+			else if (extension.second != DisableFeature) // Found
+				enabledExtensions.Insert(extension.first);
+		}
+
+		// Extension features are read through vkGetPhysicalDeviceFeatures2, core from 1.1 or loaded from VK_KHR_get_physical_device_properties2
+		const bool features2 = apiVersion >= VK_API_VERSION_1_1 || g_instanceDispatch.vkGetPhysicalDeviceFeatures2;
+
+		// Extensions that provide performance features the device version doesn't have in core, each only with the extensions it depends on
+		if (createInfo.performanceFeatures)
+		{
+			std::vector<const char*> performanceExtensions;
+			if (apiVersion < VK_API_VERSION_1_3 && features2)
+			{
+				performanceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+				performanceExtensions.push_back(VK_KHR_MAINTENANCE_4_EXTENSION_NAME);
+			}
+#ifdef VK_KHR_maintenance5
+			// Needs dynamic rendering, which is left to the caller to enable on devices older than 1.3 as it has dependencies of its own
+			if (apiVersion >= VK_API_VERSION_1_3 || (apiVersion >= VK_API_VERSION_1_1 && enabledExtensions.Contains(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)))
+				performanceExtensions.push_back(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+#endif
+			// No features, lets MemoryBudget read the heap budgets
+			if (apiVersion >= VK_API_VERSION_1_1)
+				performanceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+#ifdef VK_EXT_shader_module_identifier
+			// Needs pipeline creation cache control, which is only core from 1.3
+			if (apiVersion >= VK_API_VERSION_1_3)
+				performanceExtensions.push_back(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME);
+#endif
+
+			for (const char* extension : performanceExtensions)
+			{
+				const bool disabled = std::any_of(createInfo.extensions.begin(), createInfo.extensions.end(), [extension](const auto& requested) {
+					return requested.second == DisableFeature && std::string_view(requested.first) == extension;
+				});
+
+				if (!disabled && availableExtensions.Contains(extension))
+					enabledExtensions.Insert(extension);
+			}
+		}
+
+		// Get supported features
+		detail::DeviceFeatureChain supported;
+		supported.Link(apiVersion, enabledExtensions, nullptr);
+		if (g_instanceDispatch.vkGetPhysicalDeviceFeatures2 && features2)
+			g_instanceDispatch.vkGetPhysicalDeviceFeatures2(physicalDevice, &supported.features2);
+		else
+			g_instanceDispatch.vkGetPhysicalDeviceFeatures(physicalDevice, &supported.features2.features);
+
+		// Check feature availability
+		detail::DeviceFeatureChain enabled;
+		for (auto [feature, requirement] : createInfo.features)
+		{
+			if (requirement == DisableFeature)
+				continue;
+
+			if (apiVersion < detail::GetDeviceFeatureVersion(feature.structure) || !*supported.GetFeature(feature))
+			{
+				// Not found
+				if (requirement == RequireFeature)
+				{
+					PrintError("Device feature %s was required but not supported\n", feature.name);
+					result = VK_ERROR_FEATURE_NOT_PRESENT;
+				}
+				else // requirement == RequestFeature
+					PrintWarning("Device feature %s was requested but not supported, continuing\n", feature.name);
+			}
+			else // Found
+				*enabled.GetFeature(feature) = VK_TRUE;
+		}
+
+		// Return if the result was set to error, after printing every missing extension and feature
+		if (result < 0)
+			return result;
+
+		bool timelineSemaphore = false, synchronization2 = false, bufferDeviceAddress = false, descriptorIndexing = false, maintenance4 = false, maintenance5 = false, shaderModuleIdentifier = false;
+		if (createInfo.performanceFeatures)
+		{
+			// Turns on a feature if the device has it, returns whether it's on
+			auto enable = [](VkBool32& enabledFeature, VkBool32 supportedFeature) {
+				enabledFeature |= supportedFeature;
+				return enabledFeature == VK_TRUE;
+			};
+
+			if (apiVersion >= VK_API_VERSION_1_2)
+			{
+				auto& on = enabled.features12;
+				const auto& has = supported.features12;
+				timelineSemaphore = enable(on.timelineSemaphore, has.timelineSemaphore);
+				bufferDeviceAddress = enable(on.bufferDeviceAddress, has.bufferDeviceAddress);
+
+				// Descriptor indexing, and the parts of it bindless descriptor sets need
+				descriptorIndexing = enable(on.descriptorIndexing, has.descriptorIndexing);
+				enable(on.runtimeDescriptorArray, has.runtimeDescriptorArray);
+				enable(on.descriptorBindingPartiallyBound, has.descriptorBindingPartiallyBound);
+				enable(on.descriptorBindingVariableDescriptorCount, has.descriptorBindingVariableDescriptorCount);
+				enable(on.descriptorBindingUpdateUnusedWhilePending, has.descriptorBindingUpdateUnusedWhilePending);
+				enable(on.descriptorBindingSampledImageUpdateAfterBind, has.descriptorBindingSampledImageUpdateAfterBind);
+				enable(on.descriptorBindingStorageImageUpdateAfterBind, has.descriptorBindingStorageImageUpdateAfterBind);
+				enable(on.descriptorBindingStorageBufferUpdateAfterBind, has.descriptorBindingStorageBufferUpdateAfterBind);
+				enable(on.shaderSampledImageArrayNonUniformIndexing, has.shaderSampledImageArrayNonUniformIndexing);
+				enable(on.shaderStorageImageArrayNonUniformIndexing, has.shaderStorageImageArrayNonUniformIndexing);
+				enable(on.shaderStorageBufferArrayNonUniformIndexing, has.shaderStorageBufferArrayNonUniformIndexing);
+			}
+
+			if (apiVersion >= VK_API_VERSION_1_3)
+			{
+				synchronization2 = enable(enabled.features13.synchronization2, supported.features13.synchronization2);
+				maintenance4 = enable(enabled.features13.maintenance4, supported.features13.maintenance4);
+			}
+			else
+			{
+				if (enabledExtensions.Contains(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+					synchronization2 = enable(enabled.synchronization2.synchronization2, supported.synchronization2.synchronization2);
+				if (enabledExtensions.Contains(VK_KHR_MAINTENANCE_4_EXTENSION_NAME))
+					maintenance4 = enable(enabled.maintenance4.maintenance4, supported.maintenance4.maintenance4);
+			}
+
+#ifdef VK_KHR_maintenance5
+			if (enabledExtensions.Contains(VK_KHR_MAINTENANCE_5_EXTENSION_NAME))
+				maintenance5 = enable(enabled.maintenance5.maintenance5, supported.maintenance5.maintenance5);
+#endif
+#ifdef VK_EXT_shader_module_identifier
+			// Identifiers are used with VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT, which needs pipeline creation cache control
+			if (enabledExtensions.Contains(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME) &&
+				enable(enabled.features13.pipelineCreationCacheControl, supported.features13.pipelineCreationCacheControl))
+				shaderModuleIdentifier = enable(enabled.shaderModuleIdentifier.shaderModuleIdentifier, supported.shaderModuleIdentifier.shaderModuleIdentifier);
+#endif
+		}
+
+		// Device groups are chained before the caller's structs
+		const void* pNext = createInfo.pNext;
+		VkDeviceGroupDeviceCreateInfo groupInfo{};
+		if (!createInfo.deviceGroup.empty())
+		{
+			groupInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO;
+			groupInfo.pNext = createInfo.pNext;
+			groupInfo.physicalDeviceCount = static_cast<uint32_t>(createInfo.deviceGroup.size());
+			groupInfo.pPhysicalDevices = createInfo.deviceGroup.data();
+			pNext = &groupInfo;
+		}
+
+		enabled.Link(apiVersion, enabledExtensions, pNext);
+
+		// Queues, as many from each family as the assignments need
+		std::vector<float> priorities;
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+		for (uint32_t family = 0; family < physicalDeviceInfo.queueFamilies.size(); family++)
+		{
+			const uint32_t queueCount = physicalDeviceInfo.queueFamilies[family].assignedQueueCount;
+			if (queueCount == 0)
+				continue;
+
+			priorities.resize(std::max<size_t>(priorities.size(), queueCount), 1.0f);
+
+			VkDeviceQueueCreateInfo queueCreateInfo{};
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.queueFamilyIndex = family;
+			queueCreateInfo.queueCount = queueCount;
+			queueCreateInfos.push_back(queueCreateInfo);
+		}
+
+		if (queueCreateInfos.empty())
+		{
+			PrintError("No queues were assigned, select the physical device with at least one PhysicalDeviceQueueFamilySelectionInfo\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		for (auto& queueCreateInfo : queueCreateInfos)
+			queueCreateInfo.pQueuePriorities = priorities.data();
+
+		std::vector<const char*> extensions_cstr;
+		extensions_cstr.reserve(enabledExtensions.GetSize());
+		for (const auto& extension : enabledExtensions.GetNames())
+			extensions_cstr.push_back(extension.c_str());
+
+		VkDeviceCreateInfo deviceInfo{};
+		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+		deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
+		deviceInfo.enabledExtensionCount = static_cast<uint32_t>(extensions_cstr.size());
+		deviceInfo.ppEnabledExtensionNames = extensions_cstr.data();
+
+		// Features2 can only be chained if the instance supports it
+		if (g_instanceDispatch.vkGetPhysicalDeviceFeatures2 && features2)
+			deviceInfo.pNext = &enabled.features2;
+		else
+		{
+			deviceInfo.pNext = pNext;
+			deviceInfo.pEnabledFeatures = &enabled.features2.features;
+		}
+
+		CHECK_VK_CALL(g_instanceDispatch.vkCreateDevice(physicalDevice, &deviceInfo, GetAllocationCallbacks(), deviceOut),
+			"Failed to create device with error %s\n");
+
+		DeviceDispatch& dispatch = createInfo.dispatch ? *createInfo.dispatch : g_deviceDispatch;
+		result = LoadDeviceDispatch(*deviceOut, &dispatch).GetAndReset();
+		if (result < 0)
+			return result;
+
+		// Write the device info
+		if (infoOut)
+		{
+			infoOut->apiVersion = apiVersion;
+			infoOut->extensions = enabledExtensions.GetNames();
+
+			infoOut->features = enabled.features2.features;
+			infoOut->features11 = enabled.features11;
+			infoOut->features12 = enabled.features12;
+			infoOut->features13 = enabled.features13;
+			infoOut->features11.pNext = nullptr;
+			infoOut->features12.pNext = nullptr;
+			infoOut->features13.pNext = nullptr;
+
+			infoOut->timelineSemaphore = timelineSemaphore;
+			infoOut->synchronization2 = synchronization2;
+			infoOut->bufferDeviceAddress = bufferDeviceAddress;
+			infoOut->descriptorIndexing = descriptorIndexing;
+			infoOut->maintenance4 = maintenance4;
+			infoOut->maintenance5 = maintenance5;
+			infoOut->shaderModuleIdentifier = shaderModuleIdentifier;
+
+			infoOut->queues.resize(physicalDeviceInfo.queueAssignments.size());
+			for (size_t i = 0; i < physicalDeviceInfo.queueAssignments.size(); i++)
+			{
+				const auto& assignment = physicalDeviceInfo.queueAssignments[i];
+				dispatch.vkGetDeviceQueue(*deviceOut, assignment.queueFamilyIndex, assignment.queueIndex, &infoOut->queues[i]);
+			}
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void DestroyDevice(VkDevice device, const DeviceDispatch& dispatch)
+	{
+		VKHL_TRACE_ZONE("vkhl::DestroyDevice");
+
+		dispatch.vkDestroyDevice(device, GetAllocationCallbacks());
+
+		if (g_deviceDispatch.device == device)
+			g_deviceDispatch = {};
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
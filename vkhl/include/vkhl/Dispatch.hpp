@@ -0,0 +1,319 @@
+#pragma once
+
+#ifndef VKHL_DISPATCH_HPP
+#define VKHL_DISPATCH_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include "Definitions.h"
+#include "Error.hpp"
+#include "Common.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <mutex>
+
+#ifdef VKHL_DYNAMIC_LOADER
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+#endif // VKHL_DYNAMIC_LOADER
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+// Functions that can be loaded without an instance
+#define VKHL_GLOBAL_FUNCTIONS(X)					\
+	X(vkCreateInstance)								\
+	X(vkEnumerateInstanceVersion)					\
+	X(vkEnumerateInstanceLayerProperties)			\
+	X(vkEnumerateInstanceExtensionProperties)
+
+// Functions loaded with vkGetInstanceProcAddr(instance, ...)
+#define VKHL_INSTANCE_FUNCTIONS(X)					\
+	X(vkDestroyInstance)							\
+	X(vkEnumeratePhysicalDevices)					\
+	X(vkEnumeratePhysicalDeviceGroups)				\
+	X(vkGetPhysicalDeviceProperties)				\
+	X(vkGetPhysicalDeviceFeatures)					\
+	X(vkGetPhysicalDeviceQueueFamilyProperties)		\
+	X(vkGetPhysicalDeviceMemoryProperties)			\
+	X(vkGetPhysicalDeviceFeatures2)					\
+	X(vkGetPhysicalDeviceProperties2)				\
+	X(vkGetPhysicalDeviceMemoryProperties2)			\
+	X(vkEnumerateDeviceExtensionProperties)			\
+	X(vkCreateDevice)								\
+	X(vkCreateDebugUtilsMessengerEXT)				\
+	X(vkDestroyDebugUtilsMessengerEXT)				\
+	X(vkGetDeviceProcAddr)
+
+// Core instance functions that were an extension first, loaded from the extension name if the core one is missing
+#define VKHL_INSTANCE_ALIASES(X)													\
+	X(vkGetPhysicalDeviceFeatures2, vkGetPhysicalDeviceFeatures2KHR)				\
+	X(vkGetPhysicalDeviceProperties2, vkGetPhysicalDeviceProperties2KHR)			\
+	X(vkGetPhysicalDeviceMemoryProperties2, vkGetPhysicalDeviceMemoryProperties2KHR)	\
+	X(vkEnumeratePhysicalDeviceGroups, vkEnumeratePhysicalDeviceGroupsKHR)
+
+// Functions loaded with vkGetDeviceProcAddr, these skip the loader trampoline
+#define VKHL_DEVICE_FUNCTIONS(X)					\
+	X(vkDestroyDevice)								\
+	X(vkGetDeviceQueue)								\
+	X(vkDeviceWaitIdle)								\
+	X(vkQueueSubmit)								\
+	X(vkQueueWaitIdle)								\
+	X(vkCreateFence)								\
+	X(vkDestroyFence)								\
+	X(vkResetFences)								\
+	X(vkGetFenceStatus)								\
+	X(vkWaitForFences)								\
+	X(vkCreateSemaphore)							\
+	X(vkDestroySemaphore)							\
+	X(vkGetSemaphoreCounterValue)					\
+	X(vkWaitSemaphores)								\
+	X(vkSignalSemaphore)							\
+	X(vkAllocateMemory)								\
+	X(vkFreeMemory)									\
+	X(vkMapMemory)									\
+	X(vkUnmapMemory)								\
+	X(vkFlushMappedMemoryRanges)					\
+	X(vkInvalidateMappedMemoryRanges)				\
+	X(vkCreateBuffer)								\
+	X(vkDestroyBuffer)								\
+	X(vkCreateImage)								\
+	X(vkDestroyImage)								\
+	X(vkGetBufferMemoryRequirements)				\
+	X(vkGetImageMemoryRequirements)					\
+	X(vkBindBufferMemory)							\
+	X(vkGetBufferDeviceAddress)						\
+	X(vkBindImageMemory)							\
+	X(vkCreatePipelineCache)						\
+	X(vkDestroyPipelineCache)						\
+	X(vkGetPipelineCacheData)						\
+	X(vkMergePipelineCaches)						\
+	X(vkCreateShaderModule)							\
+	X(vkDestroyShaderModule)						\
+	X(vkGetShaderModuleCreateInfoIdentifierEXT)		\
+	X(vkCreateGraphicsPipelines)					\
+	X(vkCreateComputePipelines)						\
+	X(vkDestroyPipeline)							\
+	X(vkCreateDescriptorSetLayout)					\
+	X(vkDestroyDescriptorSetLayout)					\
+	X(vkCreateDescriptorPool)						\
+	X(vkDestroyDescriptorPool)						\
+	X(vkResetDescriptorPool)						\
+	X(vkAllocateDescriptorSets)						\
+	X(vkUpdateDescriptorSets)						\
+	X(vkCreateQueryPool)							\
+	X(vkDestroyQueryPool)							\
+	X(vkGetQueryPoolResults)						\
+	X(vkResetQueryPool)								\
+	X(vkCreateCommandPool)							\
+	X(vkDestroyCommandPool)							\
+	X(vkResetCommandPool)							\
+	X(vkAllocateCommandBuffers)						\
+	X(vkFreeCommandBuffers)							\
+	X(vkBeginCommandBuffer)							\
+	X(vkEndCommandBuffer)							\
+	X(vkCmdBindPipeline)							\
+	X(vkCmdBindDescriptorSets)						\
+	X(vkCmdPushConstants)							\
+	X(vkCmdDraw)									\
+	X(vkCmdDrawIndexed)								\
+	X(vkCmdDispatch)								\
+	X(vkCmdCopyBuffer)								\
+	X(vkCmdCopyBufferToImage)						\
+	X(vkCmdResetQueryPool)							\
+	X(vkCmdWriteTimestamp)							\
+	X(vkCmdPipelineBarrier)							\
+	X(vkCmdPipelineBarrier2)
+
+// Core device functions that were an extension first, loaded from the extension name if the core one is missing
+#define VKHL_DEVICE_ALIASES(X)														\
+	X(vkGetSemaphoreCounterValue, vkGetSemaphoreCounterValueKHR)					\
+	X(vkWaitSemaphores, vkWaitSemaphoresKHR)										\
+	X(vkSignalSemaphore, vkSignalSemaphoreKHR)										\
+	X(vkResetQueryPool, vkResetQueryPoolEXT)										\
+	X(vkCmdPipelineBarrier2, vkCmdPipelineBarrier2KHR)								\
+	X(vkGetBufferDeviceAddress, vkGetBufferDeviceAddressKHR)
+
+namespace vkhl
+{
+#define VKHL_DECLARE_FUNCTION(name) PFN_##name name = nullptr;
+
+	struct GlobalDispatch
+	{
+		void* library = nullptr; // Handle to the loader, only used with VKHL_DYNAMIC_LOADER
+		PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+		VKHL_GLOBAL_FUNCTIONS(VKHL_DECLARE_FUNCTION)
+	};
+
+	struct InstanceDispatch
+	{
+		VkInstance instance = VK_NULL_HANDLE;
+		Version apiVersion = 0;
+		VKHL_INSTANCE_FUNCTIONS(VKHL_DECLARE_FUNCTION)
+	};
+
+	struct DeviceDispatch
+	{
+		VkDevice device = VK_NULL_HANDLE;
+		VKHL_DEVICE_FUNCTIONS(VKHL_DECLARE_FUNCTION)
+	};
+
+#undef VKHL_DECLARE_FUNCTION
+
+	// Entry points into the loader, filled by LoadGlobalDispatch
+	VKHL_INLINE_VAR GlobalDispatch g_globalDispatch{};
+
+	// Table used by every vkhl function taking a VkInstance, filled by CreateInstance
+	VKHL_INLINE_VAR InstanceDispatch g_instanceDispatch{};
+
+	// Table used by every vkhl function taking a VkDevice, fill it with LoadDeviceDispatch
+	VKHL_INLINE_VAR DeviceDispatch g_deviceDispatch{};
+
+	// Finds vkGetInstanceProcAddr and the global functions, safe to call more than once.
+	// With VKHL_DYNAMIC_LOADER the loader library is opened here on first use, otherwise the linked loader is used.
+	VKHL_INLINE SmartResult LoadGlobalDispatch();
+
+	// Fills dispatchOut with the instance level functions of instance.
+	// Call this with &g_instanceDispatch if the instance was not made with CreateInstance.
+	// apiVersion is the version the instance was created with
+	VKHL_INLINE SmartResult LoadInstanceDispatch(VkInstance instance, Version apiVersion, InstanceDispatch* dispatchOut);
+
+	// Fills dispatchOut with the device level functions of device, loaded from vkGetDeviceProcAddr
+	VKHL_INLINE SmartResult LoadDeviceDispatch(VkDevice device, DeviceDispatch* dispatchOut, const InstanceDispatch& instanceDispatch = g_instanceDispatch);
+
+	// Closes the loader library opened by LoadGlobalDispatch, all dispatch tables are invalid afterwards.
+	// Not thread safe, nothing else may use vkhl while this runs
+	VKHL_INLINE void UnloadGlobalDispatch();
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE SmartResult LoadGlobalDispatch()
+	{
+		VKHL_TRACE_ZONE("vkhl::LoadGlobalDispatch");
+
+		static std::mutex s_loadMutex;
+		std::lock_guard lock(s_loadMutex);
+
+		if (g_globalDispatch.vkGetInstanceProcAddr) // Already loaded
+			return VK_SUCCESS;
+
+#ifdef VKHL_DYNAMIC_LOADER
+#if defined(_WIN32)
+		HMODULE library = LoadLibraryA("vulkan-1.dll");
+		if (library)
+			g_globalDispatch.vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(GetProcAddress(library, "vkGetInstanceProcAddr"));
+#else
+#if defined(__APPLE__)
+		void* library = dlopen("libvulkan.1.dylib", RTLD_NOW | RTLD_LOCAL);
+#else
+		void* library = dlopen("libvulkan.so.1", RTLD_NOW | RTLD_LOCAL);
+		if (!library)
+			library = dlopen("libvulkan.so", RTLD_NOW | RTLD_LOCAL);
+#endif
+		if (library)
+			g_globalDispatch.vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(dlsym(library, "vkGetInstanceProcAddr"));
+#endif
+		g_globalDispatch.library = reinterpret_cast<void*>(library);
+#else
+		g_globalDispatch.vkGetInstanceProcAddr = vkGetInstanceProcAddr;
+#endif // VKHL_DYNAMIC_LOADER
+
+		if (!g_globalDispatch.vkGetInstanceProcAddr)
+		{
+			PrintError("Failed to load the Vulkan loader\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+#define VKHL_LOAD_FUNCTION(name) g_globalDispatch.name = reinterpret_cast<PFN_##name>(g_globalDispatch.vkGetInstanceProcAddr(nullptr, #name));
+		VKHL_GLOBAL_FUNCTIONS(VKHL_LOAD_FUNCTION)
+#undef VKHL_LOAD_FUNCTION
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult LoadInstanceDispatch(VkInstance instance, Version apiVersion, InstanceDispatch* dispatchOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::LoadInstanceDispatch");
+
+		VkResult result = LoadGlobalDispatch().GetAndReset();
+		if (result < 0)
+			return result;
+
+		dispatchOut->instance = instance;
+		dispatchOut->apiVersion = apiVersion;
+
+#define VKHL_LOAD_FUNCTION(name) dispatchOut->name = reinterpret_cast<PFN_##name>(g_globalDispatch.vkGetInstanceProcAddr(instance, #name));
+		VKHL_INSTANCE_FUNCTIONS(VKHL_LOAD_FUNCTION)
+#undef VKHL_LOAD_FUNCTION
+
+#define VKHL_LOAD_ALIAS(name, alias) if (!dispatchOut->name) dispatchOut->name = reinterpret_cast<PFN_##name>(g_globalDispatch.vkGetInstanceProcAddr(instance, #alias));
+		VKHL_INSTANCE_ALIASES(VKHL_LOAD_ALIAS)
+#undef VKHL_LOAD_ALIAS
+
+		if (!dispatchOut->vkDestroyInstance)
+		{
+			PrintError("Failed to load instance functions\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult LoadDeviceDispatch(VkDevice device, DeviceDispatch* dispatchOut, const InstanceDispatch& instanceDispatch)
+	{
+		VKHL_TRACE_ZONE("vkhl::LoadDeviceDispatch");
+
+		if (!instanceDispatch.vkGetDeviceProcAddr)
+		{
+			PrintError("Instance dispatch table must be loaded before loading a device dispatch table\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		dispatchOut->device = device;
+
+#define VKHL_LOAD_FUNCTION(name) dispatchOut->name = reinterpret_cast<PFN_##name>(instanceDispatch.vkGetDeviceProcAddr(device, #name));
+		VKHL_DEVICE_FUNCTIONS(VKHL_LOAD_FUNCTION)
+#undef VKHL_LOAD_FUNCTION
+
+#define VKHL_LOAD_ALIAS(name, alias) if (!dispatchOut->name) dispatchOut->name = reinterpret_cast<PFN_##name>(instanceDispatch.vkGetDeviceProcAddr(device, #alias));
+		VKHL_DEVICE_ALIASES(VKHL_LOAD_ALIAS)
+#undef VKHL_LOAD_ALIAS
+
+		if (!dispatchOut->vkDestroyDevice)
+		{
+			PrintError("Failed to load device functions\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void UnloadGlobalDispatch()
+	{
+		VKHL_TRACE_ZONE("vkhl::UnloadGlobalDispatch");
+
+#ifdef VKHL_DYNAMIC_LOADER
+		if (g_globalDispatch.library)
+		{
+#ifdef _WIN32
+			FreeLibrary(reinterpret_cast<HMODULE>(g_globalDispatch.library));
+#else
+			dlclose(g_globalDispatch.library);
+#endif
+		}
+#endif // VKHL_DYNAMIC_LOADER
+
+		g_globalDispatch = {};
+		g_instanceDispatch = {};
+		g_deviceDispatch = {};
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -5,65 +5,142 @@
 
 #include <iostream>
 #include <cstdarg>
+#include <cassert>
+#include <utility>
+#include <type_traits>
+#include <source_location>
 
 #include <vulkan/vulkan_core.h>
 #include <vulkan/vk_enum_string_helper.h>
 
+#include "Definitions.h"
+
 namespace vkhl
 {
 
 	using PrintFunc = void(*)(const char* format, va_list args);
 
-	void DefaultPrintFunc(const char* format, va_list args) { vprintf(format, args); }
+	VKHL_INLINE void DefaultPrintFunc(const char* format, va_list args);
 
 	// Set to nullptr to disable error messages
-	PrintFunc g_printErrorFunc = DefaultPrintFunc;
+	VKHL_INLINE_VAR PrintFunc g_printErrorFunc = DefaultPrintFunc;
 
 	// Set to nullptr to disable warning messages
-	PrintFunc g_printWarningFunc = DefaultPrintFunc;
+	VKHL_INLINE_VAR PrintFunc g_printWarningFunc = DefaultPrintFunc;
+
+	VKHL_INLINE void PrintError(const char* format, ...);
+	VKHL_INLINE void PrintWarning(const char* format, ...);
 
-	void PrintError(const char* format, ...)
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE void DefaultPrintFunc(const char* format, va_list args) { vprintf(format, args); }
+
+	VKHL_INLINE void PrintError(const char* format, ...)
 	{
 		std::va_list varargs;
 		va_start(varargs, format);
 
 		if (g_printErrorFunc)
 			g_printErrorFunc(format, varargs);
+
+		va_end(varargs);
 	}
 
-	void PrintWarning(const char* format, ...)
+	VKHL_INLINE void PrintWarning(const char* format, ...)
 	{
 		std::va_list varargs;
 		va_start(varargs, format);
 
 		if (g_printWarningFunc)
 			g_printWarningFunc(format, varargs);
+
+		va_end(varargs);
 	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+	// What SmartResult does with errors nobody handled, picked by VKHL_RESULT_POLICY.
+	// It changes the type of every vkhl function, so set it with the VKHL_RESULT_POLICY CMake option to keep it the same everywhere
 
-	// Prints Error if unhandled
-	class SmartResult
+	// A plain VkResult, trivially copyable and destructible so it is returned in a register
+	struct ResultPolicyRelease
+	{
+		struct Location
+		{
+			static constexpr Location current() { return {}; }
+		};
+	};
+
+	// Prints unhandled errors with where they were returned from
+	struct ResultPolicyDebug
+	{
+		using Location = std::source_location;
+	};
+
+#ifndef VKHL_RESULT_POLICY
+#define VKHL_RESULT_POLICY ResultPolicyDebug
+#endif
+
+	template<typename PolicyT>
+	class BasicResult;
+
+	template<>
+	class [[nodiscard]] BasicResult<ResultPolicyRelease>
 	{
 	public:
-		SmartResult() = default;
-		SmartResult(const SmartResult&) = default;
-		SmartResult& operator=(const SmartResult&) = default;
+		constexpr BasicResult() = default;
 
-		SmartResult(VkResult result)
+		constexpr BasicResult(VkResult result, ResultPolicyRelease::Location = {})
 			:m_result(result)
 		{}
 
-		SmartResult& operator=(VkResult result)
+		constexpr BasicResult& operator=(VkResult result)
+		{
+			m_result = result;
+			return *this;
+		}
+
+		constexpr VkResult Get() const { return m_result; }
+		constexpr void Reset() { m_result = VK_SUCCESS; }
+
+		constexpr VkResult GetAndReset()
+		{
+			auto oldResult = m_result;
+			m_result = VK_SUCCESS;
+			return oldResult;
+		}
+
+	private:
+		VkResult m_result = VK_SUCCESS;
+	};
+
+	static_assert(std::is_trivially_copyable_v<BasicResult<ResultPolicyRelease>> && std::is_trivially_destructible_v<BasicResult<ResultPolicyRelease>>);
+
+	template<>
+	class [[nodiscard]] BasicResult<ResultPolicyDebug>
+	{
+	public:
+		BasicResult() = default;
+		BasicResult(const BasicResult&) = default;
+		BasicResult& operator=(const BasicResult&) = default;
+
+		// The default argument is evaluated where the VkResult is converted, i.e. the return statement
+		BasicResult(VkResult result, const std::source_location& location = std::source_location::current())
+			:m_result(result), m_location(location)
+		{}
+
+		BasicResult& operator=(VkResult result)
 		{
 			m_result = result;
+			return *this;
 		}
 
-		~SmartResult()
+		~BasicResult()
 		{
 			if (m_result < 0)
-				PrintError("Unhandled Vulkan error: %s\n", string_VkResult(m_result));
+				PrintError("Unhandled Vulkan error: %s, returned from %s:%u in %s\n",
+					string_VkResult(m_result), m_location.file_name(), static_cast<unsigned>(m_location.line()), m_location.function_name());
 		}
 
-		VkResult Get() { return m_result; }
+		VkResult Get() const { return m_result; }
 		void Reset() { m_result = VK_SUCCESS; }
 
 		VkResult GetAndReset()
@@ -74,7 +151,63 @@ namespace vkhl
 		}
 
 	private:
-		VkResult m_result;
+		VkResult m_result = VK_SUCCESS;
+		std::source_location m_location;
+	};
+
+	// Returned by every vkhl function that can fail
+	using SmartResult = BasicResult<VKHL_RESULT_POLICY>;
+
+	// Like std::expected, either the value a function made or the error it failed with. An unhandled error is treated like one in SmartResult.
+	// T is usually a handle, and must be default constructible
+	template<typename T, typename PolicyT = VKHL_RESULT_POLICY>
+	class [[nodiscard]] Expected
+	{
+	public:
+		Expected(const T& value)
+			:m_value(value)
+		{}
+
+		Expected(T&& value)
+			:m_value(std::move(value))
+		{}
+
+		// result must be an error
+		Expected(BasicResult<PolicyT> result)
+			:m_result(result)
+		{
+			assert(result.Get() < 0);
+			result.Reset();
+		}
+
+		Expected(VkResult result, const typename PolicyT::Location& location = PolicyT::Location::current())
+			:m_result(result, location)
+		{
+			assert(result < 0);
+		}
+
+		bool HasValue() const { return m_result.Get() >= 0; }
+		explicit operator bool() const { return HasValue(); }
+
+		// Only valid if HasValue
+		T& Value() { assert(HasValue()); return m_value; }
+		const T& Value() const { assert(HasValue()); return m_value; }
+		T& operator*() { return Value(); }
+		const T& operator*() const { return Value(); }
+		T* operator->() { return &Value(); }
+		const T* operator->() const { return &Value(); }
+
+		T ValueOr(T fallback) const { return HasValue() ? m_value : fallback; }
+
+		// Marks the error as handled, VK_SUCCESS if there is a value
+		VkResult Error() { return m_result.GetAndReset(); }
+
+		// Passes the error on as a SmartResult, which takes over reporting it
+		BasicResult<PolicyT> TakeError() { BasicResult<PolicyT> result = m_result; m_result.Reset(); return result; }
+
+	private:
+		T m_value{};
+		BasicResult<PolicyT> m_result;
 	};
 }
 
@@ -0,0 +1,1043 @@
+#pragma once
+
+#ifndef VKHL_FRAMEGRAPH_HPP
+#define VKHL_FRAMEGRAPH_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Device.hpp"
+#include "CommandPool.hpp"
+#include "QueueScheduler.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Index of an imported image or buffer, only valid until FrameGraph::Reset
+	using FrameResource = uint32_t;
+
+	// What happened to a resource before the graph, and after it with FrameGraph::GetFinalState
+	struct FrameResourceState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;		// Images only, VK_IMAGE_LAYOUT_UNDEFINED discards the contents
+		uint32_t queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;	// Family that owns the resource, VK_QUEUE_FAMILY_IGNORED if none does yet. Released on a queue of it before the first use if that is on another family
+		VkPipelineStageFlags2 stageMask = VK_PIPELINE_STAGE_2_NONE;	// Stages of the last accesses, the first use in the graph waits for them
+		VkAccessFlags2 accessMask = VK_ACCESS_2_NONE;			// Writes among those accesses
+	};
+
+	struct FrameImageInfo
+	{
+		VkImage image;
+		VkImageSubresourceRange range; // Tracked as a whole, import subresources separately to give them different layouts
+		FrameResourceState state;
+		bool concurrent = false; // VK_SHARING_MODE_CONCURRENT, never transferred between families
+	};
+
+	struct FrameBufferInfo
+	{
+		VkBuffer buffer;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = VK_WHOLE_SIZE;
+		FrameResourceState state;
+		bool concurrent = false;
+	};
+
+	// Common ways a pass uses a resource, see MakeFrameResourceUse
+	enum class FrameAccess : uint8_t
+	{
+		IndirectRead,
+		IndexRead,
+		VertexRead,
+		UniformRead,
+		SampledRead,		// Sampled in fragment shaders
+		ComputeSampledRead,
+		StorageRead,		// Storage image or buffer in compute shaders
+		StorageWrite,
+		StorageReadWrite,
+		ColorAttachmentWrite,
+		DepthAttachmentWrite,
+		DepthAttachmentRead,
+		TransferRead,
+		TransferWrite,
+		Present,
+	};
+
+	// How one pass uses one resource. A resource a pass both reads and writes is one use with both accesses
+	struct FrameResourceUse
+	{
+		FrameResource resource;
+		VkPipelineStageFlags2 stageMask;
+		VkAccessFlags2 accessMask;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED; // Images only
+	};
+
+	VKHL_INLINE FrameResourceUse MakeFrameResourceUse(FrameResource resource, FrameAccess access);
+
+	// Records a pass into commandBuffer, the barriers it needs are already recorded
+	using FramePassFunc = void(*)(VkCommandBuffer commandBuffer, void* usrPtr);
+
+	struct FramePassInfo
+	{
+		const char* name;
+		uint32_t queue; // QueueScheduler queue to run on, i.e. the graphics, compute or transfer assignment from SelectPhyicalDevice
+		std::span<const FrameResourceUse> uses;
+		FramePassFunc record;
+		void* usrPtr = nullptr;
+	};
+
+	struct FrameGraphStats
+	{
+		uint32_t passCount;
+		uint32_t submitCount;		// One per run of passes on the same queue
+		uint32_t barrierCount;		// vkCmdPipelineBarrier2 calls, at most one per pass boundary
+		uint32_t imageBarrierCount;
+		uint32_t bufferBarrierCount;
+		uint32_t ownershipTransferCount;
+	};
+
+	// Passes declare the resources they read and write, the graph orders them, works out every layout transition,
+	// queue family ownership transfer and cross queue wait, and records all barriers of a pass boundary in one vkCmdPipelineBarrier2.
+	// Hazards that need no layout or ownership change are merged into one global memory barrier instead of one barrier per resource.
+	// Requires synchronization2 (DeviceInfo::synchronization2). Build the graph from one thread, Reset it each frame to reuse its memory
+	class FrameGraph
+	{
+	public:
+		FrameGraph() = default;
+		FrameGraph(const FrameGraph&) = delete;
+		FrameGraph& operator=(const FrameGraph&) = delete;
+		~FrameGraph() { Destroy(); }
+
+		// Passes are submitted through scheduler, with command buffers from commandPools, which must cover the families of the queues used
+		SmartResult Init(const DeviceDispatch& dispatch, const DeviceInfo& deviceInfo, QueueScheduler& scheduler, CommandPoolRecycler& commandPools);
+		void Destroy();
+
+		FrameResource ImportImage(const FrameImageInfo& imageInfo);
+		FrameResource ImportBuffer(const FrameBufferInfo& bufferInfo);
+
+		// Passes may be reordered, but never across a pass they share a written resource with. Returns the pass index
+		uint32_t AddPass(const FramePassInfo& passInfo);
+
+		// Orders the passes and plans their barriers, Execute calls it if it wasn't called
+		SmartResult Compile();
+		// Records and submits every pass. waits apply to the first submit on each queue.
+		// ticketsOut (optional) gets the last ticket of every queue that was submitted to
+		SmartResult Execute(std::span<const QueueTicketWait> waits = {}, std::vector<QueueTicket>* ticketsOut = nullptr);
+
+		// State of resource after the graph, import it with this next frame. Valid after Compile
+		FrameResourceState GetFinalState(FrameResource resource) const;
+		const FrameGraphStats& GetStats() const { return m_stats; }
+
+		// Forgets every pass and resource, keeps the memory
+		void Reset();
+
+	private:
+		static constexpr uint32_t None = ~0u;
+		static constexpr uint32_t MaxQueues = 8;
+
+		struct Resource
+		{
+			VkImage image;
+			VkBuffer buffer;
+			VkImageSubresourceRange range;
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			FrameResourceState initialState;
+			bool concurrent;
+
+			// Used by Compile
+			VkImageLayout layout;
+			uint32_t queueFamilyIndex;
+			VkPipelineStageFlags2 writeStages;	// Last write or layout transition, reads wait for it
+			VkAccessFlags2 writeAccess;
+			VkPipelineStageFlags2 readStages;	// Reads since then that already see it, writes wait for them
+			VkAccessFlags2 readAccess;
+			uint32_t lastWrite;				// Position in m_order
+			uint32_t lastUse;
+			uint32_t queueLastUse[MaxQueues];	// Last position on each queue since the last write
+			uint32_t readers;				// Head of the reader list in m_readers, for ordering
+			uint32_t releaseBatch;			// Batch releasing it from the family it was imported with, None if it needs none
+		};
+
+		struct Pass
+		{
+			const char* name;
+			uint32_t queue;
+			uint32_t firstUse;
+			uint32_t useCount;
+			FramePassFunc record;
+			void* usrPtr;
+
+			// Used by Compile
+			uint32_t batch;
+			uint32_t dependencies; // Unscheduled passes this one waits for
+		};
+
+		struct Batch
+		{
+			uint32_t queue;
+			uint32_t firstPosition; // Into m_order
+			uint32_t positionCount;
+			bool release; // Only releases imported resources from their old family, these come before the passes
+		};
+
+		// A barrier recorded at a slot, 2 * position is before the pass at position, 2 * position + 1 after it
+		template<typename BarrierT>
+		struct SlotBarrier
+		{
+			uint32_t slot;
+			BarrierT barrier;
+		};
+
+		struct BatchWait
+		{
+			uint32_t batch;
+			uint32_t waitBatch;
+			VkPipelineStageFlags2 stageMask;
+		};
+
+		struct ReaderNode
+		{
+			uint32_t pass;
+			uint32_t next;
+		};
+
+		SmartResult Schedule();
+		SmartResult PlanImportReleases();
+		void PlanBarriers();
+		void PlanUse(uint32_t position, const FrameResourceUse& use);
+		void AddWait(uint32_t batch, uint32_t waitBatch, VkPipelineStageFlags2 stageMask);
+		void RecordSlots(VkCommandBuffer commandBuffer, uint32_t firstSlot, uint32_t lastSlot, size_t* imageIndex, size_t* bufferIndex);
+		void RecordImportReleases(VkCommandBuffer commandBuffer, uint32_t batch);
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		QueueScheduler* m_scheduler = nullptr;
+		CommandPoolRecycler* m_commandPools = nullptr;
+
+		std::vector<Resource> m_resources;
+		std::vector<Pass> m_passes;
+		std::vector<FrameResourceUse> m_uses;
+		bool m_compiled = false;
+
+		// Compile results, reused between frames
+		std::vector<uint32_t> m_order;			// Pass indices in submission order
+		std::vector<Batch> m_batches;
+		std::vector<BatchWait> m_batchWaits;
+		std::vector<VkMemoryBarrier2> m_memoryBarriers; // One per slot, stageMasks of 0 record nothing
+		std::vector<SlotBarrier<VkImageMemoryBarrier2>> m_imageBarriers;
+		std::vector<SlotBarrier<VkBufferMemoryBarrier2>> m_bufferBarriers;
+		std::vector<SlotBarrier<VkImageMemoryBarrier2>> m_releaseImageBarriers; // slot is the release batch
+		std::vector<SlotBarrier<VkBufferMemoryBarrier2>> m_releaseBufferBarriers;
+		std::vector<ReaderNode> m_readers;
+		std::vector<std::pair<uint32_t, uint32_t>> m_edges;
+		std::vector<uint32_t> m_ready;
+		FrameGraphStats m_stats{};
+
+		// Scratch for recording
+		std::vector<VkImageMemoryBarrier2> m_recordImageBarriers;
+		std::vector<VkBufferMemoryBarrier2> m_recordBufferBarriers;
+		std::vector<QueueTicket> m_batchTickets;
+		std::vector<QueueTicketWait> m_submitWaits;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	namespace detail
+	{
+		inline constexpr VkAccessFlags2 FrameWriteAccess = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+			VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT |
+			VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+		// vkQueueSubmit only takes the stages that fit in 32 bits
+		inline VkPipelineStageFlags ToSubmitStageMask(VkPipelineStageFlags2 stageMask)
+		{
+			if (stageMask == 0 || (stageMask >> 32) != 0)
+				return VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			return static_cast<VkPipelineStageFlags>(stageMask);
+		}
+	}
+
+	VKHL_INLINE FrameResourceUse MakeFrameResourceUse(FrameResource resource, FrameAccess access)
+	{
+		switch (access)
+		{
+		case FrameAccess::IndirectRead:
+			return { resource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT };
+		case FrameAccess::IndexRead:
+			return { resource, VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT };
+		case FrameAccess::VertexRead:
+			return { resource, VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT };
+		case FrameAccess::UniformRead:
+			return { resource, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_UNIFORM_READ_BIT };
+		case FrameAccess::SampledRead:
+			return { resource, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		case FrameAccess::ComputeSampledRead:
+			return { resource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		case FrameAccess::StorageRead:
+			return { resource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		case FrameAccess::StorageWrite:
+			return { resource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		case FrameAccess::StorageReadWrite:
+			return { resource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		case FrameAccess::ColorAttachmentWrite:
+			return { resource, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		case FrameAccess::DepthAttachmentWrite:
+			return { resource, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		case FrameAccess::DepthAttachmentRead:
+			return { resource, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+		case FrameAccess::TransferRead:
+			return { resource, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+		case FrameAccess::TransferWrite:
+			return { resource, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+		case FrameAccess::Present:
+			// vkQueuePresentKHR waits on a semaphore, the barrier only needs the layout
+			return { resource, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+		}
+
+		return { resource, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	}
+
+	VKHL_INLINE SmartResult FrameGraph::Init(const DeviceDispatch& dispatch, const DeviceInfo& deviceInfo, QueueScheduler& scheduler, CommandPoolRecycler& commandPools)
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::Init");
+
+		if (!deviceInfo.synchronization2 || !dispatch.vkCmdPipelineBarrier2)
+		{
+			PrintError("FrameGraph needs synchronization2, create the device with performanceFeatures\n");
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		if (deviceInfo.queues.size() > MaxQueues)
+		{
+			PrintError("FrameGraph supports up to %u queues, the device has %zu\n", MaxQueues, deviceInfo.queues.size());
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		m_dispatch = &dispatch;
+		m_scheduler = &scheduler;
+		m_commandPools = &commandPools;
+		Reset();
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void FrameGraph::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::Destroy");
+
+		Reset();
+		m_dispatch = nullptr;
+		m_scheduler = nullptr;
+		m_commandPools = nullptr;
+	}
+
+	VKHL_INLINE void FrameGraph::Reset()
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::Reset");
+
+		m_resources.clear();
+		m_passes.clear();
+		m_uses.clear();
+		m_compiled = false;
+		m_stats = {};
+	}
+
+	VKHL_INLINE FrameResource FrameGraph::ImportImage(const FrameImageInfo& imageInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::ImportImage");
+
+		Resource resource{};
+		resource.image = imageInfo.image;
+		resource.range = imageInfo.range;
+		resource.initialState = imageInfo.state;
+		resource.concurrent = imageInfo.concurrent;
+		m_resources.push_back(resource);
+		m_compiled = false;
+		return static_cast<FrameResource>(m_resources.size() - 1);
+	}
+
+	VKHL_INLINE FrameResource FrameGraph::ImportBuffer(const FrameBufferInfo& bufferInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::ImportBuffer");
+
+		Resource resource{};
+		resource.buffer = bufferInfo.buffer;
+		resource.offset = bufferInfo.offset;
+		resource.size = bufferInfo.size;
+		resource.initialState = bufferInfo.state;
+		resource.initialState.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		resource.concurrent = bufferInfo.concurrent;
+		m_resources.push_back(resource);
+		m_compiled = false;
+		return static_cast<FrameResource>(m_resources.size() - 1);
+	}
+
+	VKHL_INLINE uint32_t FrameGraph::AddPass(const FramePassInfo& passInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::AddPass");
+
+		Pass pass{};
+		pass.name = passInfo.name;
+		pass.queue = passInfo.queue;
+		pass.firstUse = static_cast<uint32_t>(m_uses.size());
+		pass.useCount = static_cast<uint32_t>(passInfo.uses.size());
+		pass.record = passInfo.record;
+		pass.usrPtr = passInfo.usrPtr;
+
+		m_uses.insert(m_uses.end(), passInfo.uses.begin(), passInfo.uses.end());
+		m_passes.push_back(pass);
+		m_compiled = false;
+		return static_cast<uint32_t>(m_passes.size() - 1);
+	}
+
+	VKHL_INLINE SmartResult FrameGraph::Compile()
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::Compile");
+
+		VkResult result = VK_SUCCESS;
+
+		const uint32_t queueCount = std::min(m_scheduler->GetQueueCount(), MaxQueues);
+		for (const auto& pass : m_passes)
+		{
+			if (pass.queue >= queueCount)
+			{
+				PrintError("Pass %s uses queue %u, but there are only %u\n", pass.name, pass.queue, queueCount);
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+
+			for (uint32_t i = 0; i < pass.useCount; i++)
+			{
+				if (m_uses[pass.firstUse + i].resource >= m_resources.size())
+				{
+					PrintError("Pass %s uses a resource that wasn't imported\n", pass.name);
+					return VK_ERROR_INITIALIZATION_FAILED;
+				}
+			}
+		}
+
+		result = Schedule().GetAndReset();
+		if (result < 0)
+			return result;
+
+		PlanBarriers();
+		m_compiled = true;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult FrameGraph::Schedule()
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::Schedule");
+
+		// A pass depends on the last writer of everything it uses, and a write (or layout change) also on every reader since
+		m_edges.clear();
+		m_readers.clear();
+		for (auto& resource : m_resources)
+		{
+			resource.layout = resource.initialState.layout;
+			resource.lastWrite = None;
+			resource.readers = None;
+		}
+
+		for (uint32_t passIndex = 0; passIndex < m_passes.size(); passIndex++)
+		{
+			const Pass& pass = m_passes[passIndex];
+			for (uint32_t i = 0; i < pass.useCount; i++)
+			{
+				const FrameResourceUse& use = m_uses[pass.firstUse + i];
+				Resource& resource = m_resources[use.resource];
+
+				const bool transition = resource.image && use.layout != resource.layout;
+				if (resource.lastWrite != None && resource.lastWrite != passIndex)
+					m_edges.emplace_back(resource.lastWrite, passIndex);
+
+				if ((use.accessMask & detail::FrameWriteAccess) || transition)
+				{
+					for (uint32_t node = resource.readers; node != None; node = m_readers[node].next)
+					{
+						if (m_readers[node].pass != passIndex)
+							m_edges.emplace_back(m_readers[node].pass, passIndex);
+					}
+
+					resource.lastWrite = passIndex;
+					resource.readers = None;
+					if (resource.image)
+						resource.layout = use.layout;
+				}
+				else
+				{
+					m_readers.push_back({ passIndex, resource.readers });
+					resource.readers = static_cast<uint32_t>(m_readers.size() - 1);
+				}
+			}
+		}
+
+		std::sort(m_edges.begin(), m_edges.end());
+		m_edges.erase(std::unique(m_edges.begin(), m_edges.end()), m_edges.end());
+
+		for (auto& pass : m_passes)
+			pass.dependencies = 0;
+		for (const auto& [from, to] : m_edges)
+			m_passes[to].dependencies++;
+
+		// Edges only point forward, so declaration order is always valid.
+		// Staying on the previous pass's queue while something there is ready makes fewer, longer submits
+		m_order.clear();
+		m_ready.clear();
+		for (uint32_t passIndex = 0; passIndex < m_passes.size(); passIndex++)
+		{
+			if (m_passes[passIndex].dependencies == 0)
+				m_ready.push_back(passIndex);
+		}
+
+		uint32_t currentQueue = None;
+		while (!m_ready.empty())
+		{
+			auto next = std::find_if(m_ready.begin(), m_ready.end(), [this, currentQueue](uint32_t passIndex) {
+				return m_passes[passIndex].queue == currentQueue;
+			});
+			if (next == m_ready.end())
+				next = m_ready.begin();
+
+			const uint32_t passIndex = *next;
+			m_ready.erase(next);
+			m_order.push_back(passIndex);
+			currentQueue = m_passes[passIndex].queue;
+
+			// Edges are sorted by source, and m_ready is kept sorted so ties go to the pass declared first
+			auto edge = std::lower_bound(m_edges.begin(), m_edges.end(), std::make_pair(passIndex, 0u));
+			for (; edge != m_edges.end() && edge->first == passIndex; ++edge)
+			{
+				if (--m_passes[edge->second].dependencies == 0)
+					m_ready.insert(std::upper_bound(m_ready.begin(), m_ready.end(), edge->second), edge->second);
+			}
+		}
+
+		VkResult result = PlanImportReleases().GetAndReset();
+		if (result < 0)
+			return result;
+
+		// Runs of the same queue become one submit
+		const size_t releaseBatchCount = m_batches.size();
+		for (uint32_t position = 0; position < m_order.size(); position++)
+		{
+			Pass& pass = m_passes[m_order[position]];
+			if (m_batches.size() == releaseBatchCount || m_batches.back().queue != pass.queue)
+				m_batches.push_back({ pass.queue, position, 0, false });
+
+			m_batches.back().positionCount++;
+			pass.batch = static_cast<uint32_t>(m_batches.size() - 1);
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult FrameGraph::PlanImportReleases()
+	{
+		// Resources imported with an owner other than the family of their first use have to be released on a queue of the owner first.
+		// Those releases go in one submit per owning queue, ahead of the passes
+		m_batches.clear();
+		for (auto& resource : m_resources)
+		{
+			resource.releaseBatch = None;
+			resource.lastUse = None; // Marks resources already seen, PlanBarriers resets it
+		}
+
+		for (uint32_t position = 0; position < m_order.size(); position++)
+		{
+			const Pass& pass = m_passes[m_order[position]];
+			const uint32_t queueFamilyIndex = m_scheduler->GetQueueFamilyIndex(pass.queue);
+			for (uint32_t i = 0; i < pass.useCount; i++)
+			{
+				const FrameResourceUse& use = m_uses[pass.firstUse + i];
+				Resource& resource = m_resources[use.resource];
+				if (resource.lastUse != None)
+					continue;
+				resource.lastUse = position;
+
+				const FrameResourceState& state = resource.initialState;
+				if (resource.concurrent || state.queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED || state.queueFamilyIndex == queueFamilyIndex ||
+					(resource.image && state.layout == VK_IMAGE_LAYOUT_UNDEFINED))
+					continue;
+
+				uint32_t releaseQueue = None;
+				for (uint32_t queue = 0; queue < std::min(m_scheduler->GetQueueCount(), MaxQueues) && releaseQueue == None; queue++)
+				{
+					if (m_scheduler->GetQueueFamilyIndex(queue) == state.queueFamilyIndex)
+						releaseQueue = queue;
+				}
+
+				if (releaseQueue == None)
+				{
+					PrintError("Resource %u is owned by queue family %u, which has no queue to release it on. Import it with that family's queue in the scheduler, "
+						"or with VK_QUEUE_FAMILY_IGNORED if its contents can be dropped\n", use.resource, state.queueFamilyIndex);
+					return VK_ERROR_INITIALIZATION_FAILED;
+				}
+
+				auto batch = std::find_if(m_batches.begin(), m_batches.end(), [releaseQueue](const Batch& batch) { return batch.queue == releaseQueue; });
+				if (batch == m_batches.end())
+					batch = m_batches.insert(m_batches.end(), { releaseQueue, 0, 0, true });
+				resource.releaseBatch = static_cast<uint32_t>(batch - m_batches.begin());
+			}
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void FrameGraph::PlanBarriers()
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::PlanBarriers");
+
+		m_batchWaits.clear();
+		m_imageBarriers.clear();
+		m_bufferBarriers.clear();
+		m_releaseImageBarriers.clear();
+		m_releaseBufferBarriers.clear();
+		m_memoryBarriers.assign(m_order.size() * 2, { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 });
+		m_stats = {};
+		m_stats.passCount = static_cast<uint32_t>(m_passes.size());
+		m_stats.submitCount = static_cast<uint32_t>(m_batches.size());
+
+		for (auto& resource : m_resources)
+		{
+			const FrameResourceState& state = resource.initialState;
+			resource.layout = state.layout;
+			resource.queueFamilyIndex = resource.concurrent ? VK_QUEUE_FAMILY_IGNORED : state.queueFamilyIndex;
+
+			// Accesses before the graph count as a write if they wrote, otherwise only later writes wait for them
+			const bool wrote = state.accessMask & detail::FrameWriteAccess;
+			resource.writeStages = wrote ? state.stageMask : VK_PIPELINE_STAGE_2_NONE;
+			resource.writeAccess = wrote ? state.accessMask & detail::FrameWriteAccess : VK_ACCESS_2_NONE;
+			resource.readStages = wrote ? VK_PIPELINE_STAGE_2_NONE : state.stageMask;
+			resource.readAccess = VK_ACCESS_2_NONE;
+
+			resource.lastWrite = None;
+			resource.lastUse = None;
+			std::fill(std::begin(resource.queueLastUse), std::end(resource.queueLastUse), None);
+		}
+
+		for (uint32_t position = 0; position < m_order.size(); position++)
+		{
+			const Pass& pass = m_passes[m_order[position]];
+			for (uint32_t i = 0; i < pass.useCount; i++)
+				PlanUse(position, m_uses[pass.firstUse + i]);
+		}
+
+		// Sorted by slot, so recording walks them in order
+		auto bySlot = [](const auto& a, const auto& b) { return a.slot < b.slot; };
+		std::stable_sort(m_imageBarriers.begin(), m_imageBarriers.end(), bySlot);
+		std::stable_sort(m_bufferBarriers.begin(), m_bufferBarriers.end(), bySlot);
+
+		m_stats.imageBarrierCount = static_cast<uint32_t>(m_imageBarriers.size() + m_releaseImageBarriers.size());
+		m_stats.bufferBarrierCount = static_cast<uint32_t>(m_bufferBarriers.size() + m_releaseBufferBarriers.size());
+
+		// One call per boundary: after a pass and before the next one in the same submit share it
+		size_t imageIndex = 0, bufferIndex = 0;
+		auto countBoundary = [&](uint32_t firstSlot, uint32_t lastSlot) {
+			bool any = false;
+			for (uint32_t slot = firstSlot; slot <= lastSlot; slot++)
+				any = any || m_memoryBarriers[slot].srcStageMask || m_memoryBarriers[slot].dstStageMask;
+
+			for (; imageIndex < m_imageBarriers.size() && m_imageBarriers[imageIndex].slot <= lastSlot; imageIndex++)
+				any = true;
+			for (; bufferIndex < m_bufferBarriers.size() && m_bufferBarriers[bufferIndex].slot <= lastSlot; bufferIndex++)
+				any = true;
+
+			m_stats.barrierCount += any;
+		};
+
+		for (const auto& batch : m_batches)
+		{
+			if (batch.release)
+			{
+				m_stats.barrierCount++;
+				continue;
+			}
+
+			for (uint32_t i = 0; i < batch.positionCount; i++)
+			{
+				const uint32_t position = batch.firstPosition + i;
+				countBoundary(i == 0 ? position * 2 : position * 2 - 1, position * 2);
+			}
+
+			const uint32_t lastSlot = (batch.firstPosition + batch.positionCount) * 2 - 1;
+			countBoundary(lastSlot, lastSlot);
+		}
+	}
+
+	VKHL_INLINE void FrameGraph::AddWait(uint32_t batch, uint32_t waitBatch, VkPipelineStageFlags2 stageMask)
+	{
+		if (waitBatch == batch)
+			return;
+
+		for (auto& wait : m_batchWaits)
+		{
+			if (wait.batch == batch && wait.waitBatch == waitBatch)
+			{
+				wait.stageMask |= stageMask;
+				return;
+			}
+		}
+
+		m_batchWaits.push_back({ batch, waitBatch, stageMask });
+	}
+
+	VKHL_INLINE void FrameGraph::PlanUse(uint32_t position, const FrameResourceUse& use)
+	{
+		const Pass& pass = m_passes[m_order[position]];
+		Resource& resource = m_resources[use.resource];
+		const uint32_t queueFamilyIndex = m_scheduler->GetQueueFamilyIndex(pass.queue);
+
+		const bool isImage = resource.image != VK_NULL_HANDLE;
+		const bool write = use.accessMask & detail::FrameWriteAccess;
+		const VkImageLayout newLayout = isImage ? use.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+		const bool transition = isImage && newLayout != resource.layout;
+		const uint32_t beforeSlot = position * 2;
+
+		// Images in VK_IMAGE_LAYOUT_UNDEFINED have nothing worth keeping, so they can change family without a transfer
+		const bool transfer = resource.queueFamilyIndex != VK_QUEUE_FAMILY_IGNORED && resource.queueFamilyIndex != queueFamilyIndex &&
+			!(isImage && resource.layout == VK_IMAGE_LAYOUT_UNDEFINED);
+
+		// Other queues: wait for the last write there, and a write also for every use since
+		bool crossQueue = false;
+		if (resource.lastWrite != None && m_passes[m_order[resource.lastWrite]].queue != pass.queue)
+		{
+			AddWait(pass.batch, m_passes[m_order[resource.lastWrite]].batch, use.stageMask);
+			crossQueue = true;
+		}
+		if (write || transition || transfer)
+		{
+			for (uint32_t queue = 0; queue < MaxQueues; queue++)
+			{
+				if (queue != pass.queue && resource.queueLastUse[queue] != None)
+				{
+					AddWait(pass.batch, m_passes[m_order[resource.queueLastUse[queue]]].batch, use.stageMask);
+					crossQueue = true;
+				}
+			}
+		}
+
+		if (transfer)
+		{
+			// Release after the last use on the old family, or in the release submit if it wasn't used yet.
+			// Acquire before this pass, both with the same layouts
+			const bool imported = resource.lastUse == None;
+			const uint32_t releaseSlot = imported ? resource.releaseBatch : resource.lastUse * 2 + 1;
+			if (imported)
+				AddWait(pass.batch, resource.releaseBatch, use.stageMask);
+
+			const VkPipelineStageFlags2 releaseStages = resource.writeStages | resource.readStages;
+			if (isImage)
+			{
+				VkImageMemoryBarrier2 barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+				barrier.srcStageMask = releaseStages;
+				barrier.srcAccessMask = resource.writeAccess;
+				barrier.oldLayout = resource.layout;
+				barrier.newLayout = newLayout;
+				barrier.srcQueueFamilyIndex = resource.queueFamilyIndex;
+				barrier.dstQueueFamilyIndex = queueFamilyIndex;
+				barrier.image = resource.image;
+				barrier.subresourceRange = resource.range;
+				(imported ? m_releaseImageBarriers : m_imageBarriers).push_back({ releaseSlot, barrier });
+
+				barrier.srcStageMask = use.stageMask; // Chains with the semaphore wait
+				barrier.srcAccessMask = VK_ACCESS_2_NONE;
+				barrier.dstStageMask = use.stageMask;
+				barrier.dstAccessMask = use.accessMask;
+				m_imageBarriers.push_back({ beforeSlot, barrier });
+			}
+			else
+			{
+				VkBufferMemoryBarrier2 barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+				barrier.srcStageMask = releaseStages;
+				barrier.srcAccessMask = resource.writeAccess;
+				barrier.srcQueueFamilyIndex = resource.queueFamilyIndex;
+				barrier.dstQueueFamilyIndex = queueFamilyIndex;
+				barrier.buffer = resource.buffer;
+				barrier.offset = resource.offset;
+				barrier.size = resource.size;
+				(imported ? m_releaseBufferBarriers : m_bufferBarriers).push_back({ releaseSlot, barrier });
+
+				barrier.srcStageMask = use.stageMask;
+				barrier.srcAccessMask = VK_ACCESS_2_NONE;
+				barrier.dstStageMask = use.stageMask;
+				barrier.dstAccessMask = use.accessMask;
+				m_bufferBarriers.push_back({ beforeSlot, barrier });
+			}
+
+			m_stats.ownershipTransferCount++;
+		}
+		else if (crossQueue)
+		{
+			// The semaphore wait already made everything visible, only a layout change is left
+			if (transition)
+			{
+				VkImageMemoryBarrier2 barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+				barrier.srcStageMask = use.stageMask;
+				barrier.dstStageMask = use.stageMask;
+				barrier.dstAccessMask = use.accessMask;
+				barrier.oldLayout = resource.layout;
+				barrier.newLayout = newLayout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = resource.image;
+				barrier.subresourceRange = resource.range;
+				m_imageBarriers.push_back({ beforeSlot, barrier });
+			}
+		}
+		else
+		{
+			// Same queue: writes wait for everything since the last write, reads only for the write, and only if they don't see it yet
+			VkPipelineStageFlags2 srcStages = VK_PIPELINE_STAGE_2_NONE;
+			VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+			if (write || transition)
+			{
+				srcStages = resource.writeStages | resource.readStages;
+				srcAccess = resource.writeAccess;
+			}
+			else if ((use.stageMask & ~resource.readStages) || (use.accessMask & ~resource.readAccess))
+			{
+				srcStages = resource.writeStages;
+				srcAccess = resource.writeAccess;
+			}
+
+			if (transition)
+			{
+				VkImageMemoryBarrier2 barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+				barrier.srcStageMask = srcStages;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstStageMask = use.stageMask;
+				barrier.dstAccessMask = use.accessMask;
+				barrier.oldLayout = resource.layout;
+				barrier.newLayout = newLayout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = resource.image;
+				barrier.subresourceRange = resource.range;
+				m_imageBarriers.push_back({ beforeSlot, barrier });
+			}
+			else if (srcStages)
+			{
+				// No layout change, so it joins the one global barrier of the boundary
+				VkMemoryBarrier2& barrier = m_memoryBarriers[beforeSlot];
+				barrier.srcStageMask |= srcStages;
+				barrier.srcAccessMask |= srcAccess;
+				barrier.dstStageMask |= use.stageMask;
+				barrier.dstAccessMask |= use.accessMask;
+			}
+		}
+
+		// After a barrier the resource is visible to this use, and the next ones chain from its stages
+		if (write || transition || transfer || crossQueue)
+		{
+			resource.writeStages = use.stageMask;
+			resource.writeAccess = use.accessMask & detail::FrameWriteAccess;
+			resource.readStages = write ? VK_PIPELINE_STAGE_2_NONE : use.stageMask;
+			resource.readAccess = write ? VK_ACCESS_2_NONE : use.accessMask;
+		}
+		else
+		{
+			resource.readStages |= use.stageMask;
+			resource.readAccess |= use.accessMask;
+		}
+
+		if (write || transition || transfer)
+		{
+			resource.lastWrite = position;
+			std::fill(std::begin(resource.queueLastUse), std::end(resource.queueLastUse), None);
+		}
+
+		resource.queueLastUse[pass.queue] = position;
+		resource.lastUse = position;
+		resource.layout = isImage ? newLayout : resource.layout;
+		if (!resource.concurrent)
+			resource.queueFamilyIndex = queueFamilyIndex;
+	}
+
+	VKHL_INLINE void FrameGraph::RecordSlots(VkCommandBuffer commandBuffer, uint32_t firstSlot, uint32_t lastSlot, size_t* imageIndex, size_t* bufferIndex)
+	{
+		VkMemoryBarrier2 memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+		for (uint32_t slot = firstSlot; slot <= lastSlot; slot++)
+		{
+			memoryBarrier.srcStageMask |= m_memoryBarriers[slot].srcStageMask;
+			memoryBarrier.srcAccessMask |= m_memoryBarriers[slot].srcAccessMask;
+			memoryBarrier.dstStageMask |= m_memoryBarriers[slot].dstStageMask;
+			memoryBarrier.dstAccessMask |= m_memoryBarriers[slot].dstAccessMask;
+		}
+
+		m_recordImageBarriers.clear();
+		for (; *imageIndex < m_imageBarriers.size() && m_imageBarriers[*imageIndex].slot <= lastSlot; ++*imageIndex)
+			m_recordImageBarriers.push_back(m_imageBarriers[*imageIndex].barrier);
+
+		m_recordBufferBarriers.clear();
+		for (; *bufferIndex < m_bufferBarriers.size() && m_bufferBarriers[*bufferIndex].slot <= lastSlot; ++*bufferIndex)
+			m_recordBufferBarriers.push_back(m_bufferBarriers[*bufferIndex].barrier);
+
+		const bool hasMemoryBarrier = memoryBarrier.srcStageMask || memoryBarrier.dstStageMask;
+		if (!hasMemoryBarrier && m_recordImageBarriers.empty() && m_recordBufferBarriers.empty())
+			return;
+
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.memoryBarrierCount = hasMemoryBarrier ? 1 : 0;
+		dependencyInfo.pMemoryBarriers = &memoryBarrier;
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(m_recordBufferBarriers.size());
+		dependencyInfo.pBufferMemoryBarriers = m_recordBufferBarriers.data();
+		dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(m_recordImageBarriers.size());
+		dependencyInfo.pImageMemoryBarriers = m_recordImageBarriers.data();
+		m_dispatch->vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+
+	VKHL_INLINE void FrameGraph::RecordImportReleases(VkCommandBuffer commandBuffer, uint32_t batch)
+	{
+		m_recordImageBarriers.clear();
+		for (const auto& release : m_releaseImageBarriers)
+		{
+			if (release.slot == batch)
+				m_recordImageBarriers.push_back(release.barrier);
+		}
+
+		m_recordBufferBarriers.clear();
+		for (const auto& release : m_releaseBufferBarriers)
+		{
+			if (release.slot == batch)
+				m_recordBufferBarriers.push_back(release.barrier);
+		}
+
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(m_recordBufferBarriers.size());
+		dependencyInfo.pBufferMemoryBarriers = m_recordBufferBarriers.data();
+		dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(m_recordImageBarriers.size());
+		dependencyInfo.pImageMemoryBarriers = m_recordImageBarriers.data();
+		m_dispatch->vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+
+	VKHL_INLINE SmartResult FrameGraph::Execute(std::span<const QueueTicketWait> waits, std::vector<QueueTicket>* ticketsOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::Execute");
+
+		VkResult result = VK_SUCCESS;
+		if (!m_compiled)
+		{
+			result = Compile().GetAndReset();
+			if (result < 0)
+				return result;
+		}
+
+		m_batchTickets.assign(m_batches.size(), {});
+		bool queueStarted[MaxQueues] = {};
+		size_t imageIndex = 0, bufferIndex = 0;
+
+		for (uint32_t batchIndex = 0; batchIndex < m_batches.size(); batchIndex++)
+		{
+			const Batch& batch = m_batches[batchIndex];
+
+			VkCommandBuffer commandBuffer;
+			result = m_commandPools->Acquire(m_scheduler->GetQueueFamilyIndex(batch.queue), VK_COMMAND_BUFFER_LEVEL_PRIMARY, &commandBuffer).GetAndReset();
+			if (result < 0)
+				return result;
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+			result = m_dispatch->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+			if (result < 0)
+			{
+				PrintError("Failed to begin frame graph command buffer with error %s\n", string_VkResult(result));
+				return result;
+			}
+
+			if (batch.release)
+				RecordImportReleases(commandBuffer, batchIndex);
+			else
+			{
+				for (uint32_t i = 0; i < batch.positionCount; i++)
+				{
+					const uint32_t position = batch.firstPosition + i;
+					const Pass& pass = m_passes[m_order[position]];
+
+					// The previous pass's releases share the boundary with this pass's barriers
+					RecordSlots(commandBuffer, i == 0 ? position * 2 : position * 2 - 1, position * 2, &imageIndex, &bufferIndex);
+
+					if (pass.record)
+					{
+						VKHL_TRACE_ZONE(pass.name);
+						pass.record(commandBuffer, pass.usrPtr);
+					}
+				}
+
+				// Releases after the last pass of the submit
+				const uint32_t lastSlot = (batch.firstPosition + batch.positionCount) * 2 - 1;
+				RecordSlots(commandBuffer, lastSlot, lastSlot, &imageIndex, &bufferIndex);
+			}
+
+			result = m_dispatch->vkEndCommandBuffer(commandBuffer);
+			if (result < 0)
+			{
+				PrintError("Failed to end frame graph command buffer with error %s\n", string_VkResult(result));
+				return result;
+			}
+
+			m_submitWaits.clear();
+			if (!queueStarted[batch.queue])
+				m_submitWaits.insert(m_submitWaits.end(), waits.begin(), waits.end());
+			queueStarted[batch.queue] = true;
+
+			for (const auto& wait : m_batchWaits)
+			{
+				if (wait.batch == batchIndex)
+					m_submitWaits.push_back({ m_batchTickets[wait.waitBatch], detail::ToSubmitStageMask(wait.stageMask) });
+			}
+
+			QueueSubmitInfo submitInfo{};
+			submitInfo.commandBuffers = { &commandBuffer, 1 };
+			submitInfo.waits = m_submitWaits;
+
+			result = m_scheduler->Submit(batch.queue, submitInfo, &m_batchTickets[batchIndex]).GetAndReset();
+			if (result < 0)
+				return result;
+		}
+
+		if (ticketsOut)
+		{
+			ticketsOut->clear();
+			for (uint32_t batchIndex = static_cast<uint32_t>(m_batches.size()); batchIndex-- > 0;)
+			{
+				const auto sameQueue = [this, batchIndex](const QueueTicket& ticket) { return ticket.queue == m_batchTickets[batchIndex].queue; };
+				if (std::none_of(ticketsOut->begin(), ticketsOut->end(), sameQueue))
+					ticketsOut->push_back(m_batchTickets[batchIndex]);
+			}
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE FrameResourceState FrameGraph::GetFinalState(FrameResource resource) const
+	{
+		VKHL_TRACE_ZONE("vkhl::FrameGraph::GetFinalState");
+
+		const Resource& tracked = m_resources[resource];
+		if (!m_compiled)
+			return tracked.initialState;
+
+		return { tracked.layout, tracked.queueFamilyIndex, tracked.writeStages | tracked.readStages, tracked.writeAccess };
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
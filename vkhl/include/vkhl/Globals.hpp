@@ -12,6 +12,12 @@
 namespace vkhl
 {
 	VKHL_INLINE_VAR std::optional<VkAllocationCallbacks> g_allocator = std::nullopt;
+
+	// Returns a pointer to g_allocator, or nullptr if it isn't set
+	inline const VkAllocationCallbacks* GetAllocationCallbacks()
+	{
+		return g_allocator.has_value() ? &g_allocator.value() : nullptr;
+	}
 }
 
 #endif
@@ -0,0 +1,461 @@
+#pragma once
+
+#ifndef VKHL_GPUPROFILER_HPP
+#define VKHL_GPUPROFILER_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <optional>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "PhysicalDevice.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+#include <cstdio>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	struct GpuProfilerCreateInfo
+	{
+		uint32_t framesInFlight = 2;
+		uint32_t maxZonesPerFrame = 1024;	// Zones past this are dropped, each one takes 2 queries
+		bool hostQueryReset = false;		// The hostQueryReset feature is enabled, so BeginFrame resets queries instead of RecordReset
+	};
+
+	// Returned by BeginZone, hand it to EndZone on the same command buffer
+	struct GpuZone
+	{
+		uint32_t index = UINT32_MAX; // UINT32_MAX if the zone isn't recorded
+	};
+
+	struct GpuZoneResult
+	{
+		const char* name;
+		uint32_t queueFamilyIndex;
+		uint64_t frameIndex;
+		double start;		// Nanoseconds since the earliest zone of the first frame resolved on the queue family
+		double duration;	// Nanoseconds
+	};
+
+	// Times GPU work with timestamp queries, one VkQueryPool per frame in flight.
+	// Results are read when a frame's slot comes around again in BeginFrame, without waiting, so zones the GPU hasn't finished are dropped.
+	// Queue families need timestampValidBits, so request them with PhysicalDeviceQueueFamilySelectionInfo::minTimestampBits
+	class GpuProfiler
+	{
+	public:
+		GpuProfiler() = default;
+		GpuProfiler(const GpuProfiler&) = delete;
+		GpuProfiler& operator=(const GpuProfiler&) = delete;
+		~GpuProfiler() { Destroy(); }
+
+		SmartResult Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const GpuProfilerCreateInfo& createInfo = {});
+		void Destroy();
+
+		// Reads the results left in frameIndex % framesInFlight, then starts recording into it.
+		// Call once the frame's previous work is done, i.e. after waiting on the same fence as CommandPoolRecycler::BeginFrame.
+		// No thread may record zones while this runs
+		SmartResult BeginFrame(uint64_t frameIndex);
+		// Without hostQueryReset, records the reset of this frame's queries. The command buffer must be submitted before any with zones in them
+		void RecordReset(VkCommandBuffer commandBuffer);
+
+		// name must stay valid until the results are read, a string literal is best. Any thread can record zones, each on its own command buffer.
+		// Zones may nest, but must begin and end on the same command buffer in the same frame
+		GpuZone BeginZone(VkCommandBuffer commandBuffer, uint32_t queueFamilyIndex, const char* name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		void EndZone(VkCommandBuffer commandBuffer, GpuZone zone, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+		// Zones of the frame last read by BeginFrame, in the order they began
+		std::span<const GpuZoneResult> GetFrameResults() const { return m_frameResults; }
+
+		// While capturing, every resolved zone is kept for the Chrome trace. Starting a capture drops the last one
+		void SetCapture(bool capture);
+		// Captured zones in the Chrome trace event format, one track per queue family. Open with chrome://tracing or Perfetto
+		std::string GetChromeTrace() const;
+		bool WriteChromeTrace(const char* path) const;
+
+		float GetTimestampPeriod() const { return m_timestampPeriod; }
+
+	private:
+		struct ZoneRecord
+		{
+			const char* name;
+			uint32_t queueFamilyIndex;
+		};
+
+		struct Frame
+		{
+			VkQueryPool pool = VK_NULL_HANDLE;
+			uint64_t frameIndex = 0;
+			std::atomic<uint32_t> zoneCount = 0;
+			uint32_t resetCount = 0; // Queries to reset before the pool is written again
+			std::unique_ptr<ZoneRecord[]> zones;
+		};
+
+		SmartResult Resolve(Frame& frame);
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		float m_timestampPeriod = 0.0f;
+		uint32_t m_framesInFlight = 0;
+		uint32_t m_maxZones = 0;
+		bool m_hostQueryReset = false;
+
+		std::unique_ptr<Frame[]> m_frames;
+		std::atomic<uint32_t> m_currentFrame = 0;
+		std::atomic<bool> m_overflowWarned = false;
+
+		// Where a queue family's timeline is, so zones can be placed on it even after the valid timestamp bits wrap
+		struct FamilyClock
+		{
+			uint64_t base;		// Earliest timestamp of the last frame resolved
+			double baseTime;	// Nanoseconds from the start of the trace to base
+		};
+
+		std::vector<uint64_t> m_familyMasks;					// Valid timestamp bits per queue family, 0 if it can't write timestamps
+		std::vector<std::optional<FamilyClock>> m_familyClocks;	// Unset until a zone on the family is resolved, the trace starts there
+
+		std::vector<uint64_t> m_queryData;
+		std::vector<std::optional<uint64_t>> m_frameStarts;	// Earliest timestamp per queue family in the frame being resolved
+		std::vector<GpuZoneResult> m_frameResults;
+		std::vector<GpuZoneResult> m_captured;
+		bool m_capturing = false;
+	};
+
+	// Times the commands recorded while it is in scope
+	class GpuScope
+	{
+	public:
+		GpuScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, uint32_t queueFamilyIndex, const char* name)
+			:m_profiler(profiler), m_commandBuffer(commandBuffer), m_zone(profiler.BeginZone(commandBuffer, queueFamilyIndex, name))
+		{
+		}
+
+		GpuScope(const GpuScope&) = delete;
+		GpuScope& operator=(const GpuScope&) = delete;
+		~GpuScope() { m_profiler.EndZone(m_commandBuffer, m_zone); }
+
+	private:
+		GpuProfiler& m_profiler;
+		VkCommandBuffer m_commandBuffer;
+		GpuZone m_zone;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	namespace detail
+	{
+		// Ticks from one timestamp to another, negative if to is earlier. Only the bits in mask are valid,
+		// so the difference wraps with them and anything more than half the range apart reads as the other direction
+		VKHL_INLINE int64_t GetTimestampDelta(uint64_t from, uint64_t to, uint64_t mask)
+		{
+			const uint64_t forward = (to - from) & mask;
+			if (forward <= (mask >> 1))
+				return static_cast<int64_t>(forward);
+			return -static_cast<int64_t>((from - to) & mask);
+		}
+	}
+
+	VKHL_INLINE SmartResult GpuProfiler::Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const GpuProfilerCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::Init");
+
+		VkResult result = VK_SUCCESS;
+
+		if (createInfo.hostQueryReset && !dispatch.vkResetQueryPool)
+		{
+			PrintError("hostQueryReset was requested, but vkResetQueryPool wasn't loaded\n");
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		m_dispatch = &dispatch;
+		m_timestampPeriod = physicalDeviceInfo.properties.limits.timestampPeriod;
+		m_framesInFlight = std::max(createInfo.framesInFlight, 1u);
+		m_maxZones = std::max(createInfo.maxZonesPerFrame, 1u);
+		m_hostQueryReset = createInfo.hostQueryReset;
+		m_currentFrame = 0;
+		m_overflowWarned = false;
+
+		m_familyMasks.clear();
+		for (auto& family : physicalDeviceInfo.queueFamilies)
+		{
+			const uint32_t bits = family.properties.timestampValidBits;
+			m_familyMasks.push_back(bits >= 64 ? UINT64_MAX : (uint64_t(1) << bits) - 1);
+		}
+		m_familyClocks.assign(m_familyMasks.size(), std::nullopt);
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = m_maxZones * 2;
+
+		m_frames = std::make_unique<Frame[]>(m_framesInFlight);
+		for (uint32_t i = 0; i < m_framesInFlight; i++)
+		{
+			Frame& frame = m_frames[i];
+			frame.zones = std::make_unique<ZoneRecord[]>(m_maxZones);
+			frame.resetCount = poolInfo.queryCount; // Queries start out undefined
+
+			result = dispatch.vkCreateQueryPool(dispatch.device, &poolInfo, GetAllocationCallbacks(), &frame.pool);
+			if (result < 0)
+			{
+				PrintError("Failed to create timestamp query pool with error %s\n", string_VkResult(result));
+				Destroy();
+				return result;
+			}
+		}
+
+		if (m_hostQueryReset)
+		{
+			for (uint32_t i = 0; i < m_framesInFlight; i++)
+			{
+				dispatch.vkResetQueryPool(dispatch.device, m_frames[i].pool, 0, m_frames[i].resetCount);
+				m_frames[i].resetCount = 0;
+			}
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void GpuProfiler::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		for (uint32_t i = 0; i < m_framesInFlight; i++)
+		{
+			if (m_frames[i].pool)
+				m_dispatch->vkDestroyQueryPool(m_dispatch->device, m_frames[i].pool, GetAllocationCallbacks());
+		}
+
+		m_frames.reset();
+		m_frameResults.clear();
+		m_captured.clear();
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE SmartResult GpuProfiler::BeginFrame(uint64_t frameIndex)
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::BeginFrame");
+
+		VkResult result = VK_SUCCESS;
+
+		const uint32_t frameSlot = static_cast<uint32_t>(frameIndex % m_framesInFlight);
+		Frame& frame = m_frames[frameSlot];
+
+		result = Resolve(frame).GetAndReset();
+		if (result < 0)
+			return result;
+
+		const uint32_t used = std::min(frame.zoneCount.load(std::memory_order_relaxed), m_maxZones) * 2;
+		frame.resetCount = std::max(frame.resetCount, used);
+		frame.zoneCount.store(0, std::memory_order_relaxed);
+		frame.frameIndex = frameIndex;
+
+		if (m_hostQueryReset && frame.resetCount)
+		{
+			m_dispatch->vkResetQueryPool(m_dispatch->device, frame.pool, 0, frame.resetCount);
+			frame.resetCount = 0;
+		}
+
+		m_overflowWarned.store(false, std::memory_order_relaxed);
+		m_currentFrame.store(frameSlot, std::memory_order_relaxed);
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void GpuProfiler::RecordReset(VkCommandBuffer commandBuffer)
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::RecordReset");
+
+		Frame& frame = m_frames[m_currentFrame.load(std::memory_order_relaxed)];
+		if (!frame.resetCount)
+			return;
+
+		m_dispatch->vkCmdResetQueryPool(commandBuffer, frame.pool, 0, frame.resetCount);
+		frame.resetCount = 0;
+	}
+
+	VKHL_INLINE GpuZone GpuProfiler::BeginZone(VkCommandBuffer commandBuffer, uint32_t queueFamilyIndex, const char* name, VkPipelineStageFlagBits stage)
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::BeginZone");
+
+		if (queueFamilyIndex >= m_familyMasks.size() || !m_familyMasks[queueFamilyIndex])
+			return {};
+
+		Frame& frame = m_frames[m_currentFrame.load(std::memory_order_relaxed)];
+		const uint32_t index = frame.zoneCount.fetch_add(1, std::memory_order_relaxed);
+		if (index >= m_maxZones)
+		{
+			if (!m_overflowWarned.exchange(true, std::memory_order_relaxed))
+				PrintWarning("More than %u GPU zones in a frame, the rest are dropped\n", m_maxZones);
+			return {};
+		}
+
+		frame.zones[index] = { name, queueFamilyIndex };
+		m_dispatch->vkCmdWriteTimestamp(commandBuffer, stage, frame.pool, index * 2);
+		return { index };
+	}
+
+	VKHL_INLINE void GpuProfiler::EndZone(VkCommandBuffer commandBuffer, GpuZone zone, VkPipelineStageFlagBits stage)
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::EndZone");
+
+		if (zone.index == UINT32_MAX)
+			return;
+
+		Frame& frame = m_frames[m_currentFrame.load(std::memory_order_relaxed)];
+		m_dispatch->vkCmdWriteTimestamp(commandBuffer, stage, frame.pool, zone.index * 2 + 1);
+	}
+
+	VKHL_INLINE SmartResult GpuProfiler::Resolve(Frame& frame)
+	{
+		VkResult result = VK_SUCCESS;
+
+		m_frameResults.clear();
+
+		const uint32_t zoneCount = std::min(frame.zoneCount.load(std::memory_order_relaxed), m_maxZones);
+		if (!zoneCount)
+			return VK_SUCCESS;
+
+		// Each query is a (timestamp, availability) pair. No wait bit, VK_NOT_READY just means some zones aren't finished
+		m_queryData.resize(size_t(zoneCount) * 4);
+		CHECK_VK_CALL(m_dispatch->vkGetQueryPoolResults(m_dispatch->device, frame.pool, 0, zoneCount * 2, m_queryData.size() * sizeof(uint64_t),
+			m_queryData.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT),
+			"Failed to get timestamp query results with error %s\n");
+
+		// Zones are in the order they were recorded, not executed, so find where each family's work in the frame began
+		m_frameStarts.assign(m_familyMasks.size(), std::nullopt);
+		for (uint32_t i = 0; i < zoneCount; i++)
+		{
+			const uint64_t* data = &m_queryData[size_t(i) * 4];
+			if (!data[1] || !data[3])
+				continue;
+
+			const uint32_t family = frame.zones[i].queueFamilyIndex;
+			auto& frameStart = m_frameStarts[family];
+			if (!frameStart || detail::GetTimestampDelta(*frameStart, data[0], m_familyMasks[family]) < 0)
+				frameStart = data[0];
+		}
+
+		// Move each clock up to this frame, so the differences below stay well inside the valid bits
+		for (uint32_t family = 0; family < m_familyMasks.size(); family++)
+		{
+			if (!m_frameStarts[family])
+				continue;
+
+			auto& clock = m_familyClocks[family];
+			if (!clock)
+				clock = FamilyClock{ *m_frameStarts[family], 0.0 };
+			else
+			{
+				clock->baseTime += double(detail::GetTimestampDelta(clock->base, *m_frameStarts[family], m_familyMasks[family])) * m_timestampPeriod;
+				clock->base = *m_frameStarts[family];
+			}
+		}
+
+		for (uint32_t i = 0; i < zoneCount; i++)
+		{
+			const uint64_t* data = &m_queryData[size_t(i) * 4];
+			if (!data[1] || !data[3])
+				continue;
+
+			const ZoneRecord& zone = frame.zones[i];
+			const uint64_t mask = m_familyMasks[zone.queueFamilyIndex];
+			const FamilyClock& clock = *m_familyClocks[zone.queueFamilyIndex];
+
+			GpuZoneResult zoneResult{};
+			zoneResult.name = zone.name;
+			zoneResult.queueFamilyIndex = zone.queueFamilyIndex;
+			zoneResult.frameIndex = frame.frameIndex;
+			zoneResult.start = clock.baseTime + double(detail::GetTimestampDelta(clock.base, data[0], mask)) * m_timestampPeriod;
+			zoneResult.duration = double((data[2] - data[0]) & mask) * m_timestampPeriod;
+			m_frameResults.push_back(zoneResult);
+		}
+
+		if (m_capturing)
+			m_captured.insert(m_captured.end(), m_frameResults.begin(), m_frameResults.end());
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void GpuProfiler::SetCapture(bool capture)
+	{
+		if (capture && !m_capturing)
+			m_captured.clear();
+
+		m_capturing = capture;
+	}
+
+	VKHL_INLINE std::string GpuProfiler::GetChromeTrace() const
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::GetChromeTrace");
+
+		std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		char buffer[256];
+
+		// Name each queue family's track
+		bool first = true;
+		for (uint32_t family = 0; family < m_familyMasks.size(); family++)
+		{
+			if (!m_familyClocks[family])
+				continue;
+
+			std::snprintf(buffer, sizeof(buffer), "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU queue family %u\"}}",
+				first ? "" : ",", family, family);
+			json += buffer;
+			first = false;
+		}
+
+		// Trace times are in microseconds
+		for (auto& zone : m_captured)
+		{
+			json += first ? "{\"ph\":\"X\",\"name\":" : ",{\"ph\":\"X\",\"name\":";
+			detail::AppendJsonString(json, zone.name);
+
+			std::snprintf(buffer, sizeof(buffer), ",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+				zone.queueFamilyIndex, zone.start / 1000.0, zone.duration / 1000.0, static_cast<unsigned long long>(zone.frameIndex));
+			json += buffer;
+			first = false;
+		}
+
+		json += "]}\n";
+		return json;
+	}
+
+	VKHL_INLINE bool GpuProfiler::WriteChromeTrace(const char* path) const
+	{
+		VKHL_TRACE_ZONE("vkhl::GpuProfiler::WriteChromeTrace");
+
+		const std::string json = GetChromeTrace();
+		return WriteFileAtomic(path, json.data(), json.size());
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
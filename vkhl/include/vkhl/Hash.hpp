@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef VKHL_HASH_HPP
+#define VKHL_HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace vkhl
+{
+	using Hash = uint64_t;
+
+	// FNV-1a, meant for short strings like layer and extension names
+	constexpr Hash HashString(std::string_view string, Hash seed = 14695981039346656037ull)
+	{
+		Hash hash = seed;
+		for (char c : string)
+		{
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	constexpr Hash HashCombine(Hash seed, Hash value)
+	{
+		value *= 0x9e3779b97f4a7c15ull;
+		value ^= value >> 32;
+		return (seed ^ value) * 0xbf58476d1ce4e5b9ull;
+	}
+
+	// Reads 8 bytes at a time, meant for larger blobs like file contents
+	inline Hash HashBytes(const void* data, size_t size, Hash seed = 0)
+	{
+		const auto* bytes = static_cast<const uint8_t*>(data);
+		Hash hash = seed ^ (size * 0x9e3779b97f4a7c15ull);
+
+		for (; size >= 8; bytes += 8, size -= 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes, 8);
+			hash = HashCombine(hash, word);
+		}
+
+		uint64_t tail = 0;
+		std::memcpy(&tail, bytes, size);
+		hash = HashCombine(hash, tail);
+
+		// Final mix so every input bit affects every output bit
+		hash ^= hash >> 31;
+		hash *= 0x94d049bb133111ebull;
+		hash ^= hash >> 29;
+		return hash;
+	}
+}
+
+#endif
@@ -0,0 +1,478 @@
+#pragma once
+
+#ifndef VKHL_HOSTALLOCATOR_HPP
+#define VKHL_HOSTALLOCATOR_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Returns allocation callbacks backed by the vkhl host allocator:
+	//	Small allocations come from size class pools, with a cache per thread so most calls take no locks
+	//	VK_SYSTEM_ALLOCATION_SCOPE_COMMAND allocations come from a per thread bump arena, which resets itself once all of its allocations are freed
+	//	Everything else goes to malloc
+	VKHL_INLINE VkAllocationCallbacks GetHostAllocatorCallbacks();
+
+	// Sets g_allocator to GetHostAllocatorCallbacks(), call this before CreateInstance
+	VKHL_INLINE void InstallHostAllocator();
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	namespace detail
+	{
+		// Placed right before every pointer handed out, so free and realloc know where the memory came from
+		struct alignas(16) HostAllocationHeader
+		{
+			uint32_t sizeClass;	// Index of the pool, or one of the special classes below
+			uint32_t offset;	// Bytes from the start of the underlying block to the user pointer
+			uint64_t size;		// Requested size
+		};
+
+		constexpr size_t g_hostHeaderSize = sizeof(HostAllocationHeader);
+
+		// Block sizes of the pools, the header is part of the block
+		constexpr uint32_t g_hostSizeClasses[] = { 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096 };
+		constexpr uint32_t g_hostSizeClassCount = sizeof(g_hostSizeClasses) / sizeof(g_hostSizeClasses[0]);
+		constexpr uint32_t g_hostLargeClass = 0xFFFF'FFFE;
+		constexpr uint32_t g_hostCommandClass = 0xFFFF'FFFF;
+
+		constexpr size_t g_hostPoolChunkSize = 64 * 1024;		// Pools grow by this much at a time
+		constexpr uint32_t g_hostTransferBatch = 32;			// Blocks moved between a thread cache and the depot at a time
+		constexpr uint32_t g_hostThreadCacheLimit = 2 * g_hostTransferBatch;
+
+		constexpr size_t g_hostArenaChunkSize = 64 * 1024;		// Must be a power of two, chunks are aligned to their size
+		constexpr size_t g_hostArenaMaxAllocation = g_hostArenaChunkSize / 4;
+
+		struct HostFreeBlock
+		{
+			HostFreeBlock* next;
+		};
+
+		// Shared pool storage, only touched when a thread cache runs empty or overflows
+		struct HostPoolDepot
+		{
+			struct SizeClass
+			{
+				std::mutex mutex;
+				HostFreeBlock* head = nullptr;
+			};
+
+			SizeClass classes[g_hostSizeClassCount];
+		};
+
+		// Start of every arena chunk, found by masking a pointer with the chunk size
+		struct alignas(16) HostArenaChunk
+		{
+			std::atomic<uint32_t> references;	// Live allocations, plus one while the owning thread is alive
+			uint32_t offset;					// Bump pointer, only used by the owning thread
+		};
+
+		struct HostCommandArena
+		{
+			std::vector<HostArenaChunk*> chunks;
+			HostArenaChunk* current = nullptr;
+		};
+
+		struct HostThreadCache
+		{
+			HostFreeBlock* lists[g_hostSizeClassCount] = {};
+			uint32_t counts[g_hostSizeClassCount] = {};
+			HostCommandArena arena;
+		};
+
+		// Never destroyed, drivers can still free memory while static objects are being torn down
+		inline HostPoolDepot& GetHostPoolDepot()
+		{
+			static HostPoolDepot* s_depot = new HostPoolDepot();
+			return *s_depot;
+		}
+
+		// Trivially destructible, so they stay valid while other thread locals are destroyed
+		VKHL_INLINE_VAR thread_local HostThreadCache* t_hostThreadCache = nullptr;
+		VKHL_INLINE_VAR thread_local bool t_hostThreadCacheDestroyed = false;
+
+		inline void ReturnToDepot(uint32_t sizeClass, HostFreeBlock* first, HostFreeBlock* last)
+		{
+			auto& depotClass = GetHostPoolDepot().classes[sizeClass];
+			std::lock_guard lock(depotClass.mutex);
+			last->next = depotClass.head;
+			depotClass.head = first;
+		}
+
+		inline void* AllocateArenaChunk()
+		{
+#ifdef _WIN32
+			return _aligned_malloc(g_hostArenaChunkSize, g_hostArenaChunkSize);
+#else
+			return std::aligned_alloc(g_hostArenaChunkSize, g_hostArenaChunkSize);
+#endif
+		}
+
+		inline void FreeArenaChunk(HostArenaChunk* chunk)
+		{
+#ifdef _WIN32
+			_aligned_free(chunk);
+#else
+			std::free(chunk);
+#endif
+		}
+
+		struct HostThreadCacheOwner
+		{
+			HostThreadCache cache;
+
+			HostThreadCacheOwner() { t_hostThreadCache = &cache; }
+
+			~HostThreadCacheOwner()
+			{
+				t_hostThreadCache = nullptr;
+				t_hostThreadCacheDestroyed = true;
+
+				// Give the cached blocks back so other threads can use them
+				for (uint32_t sizeClass = 0; sizeClass < g_hostSizeClassCount; sizeClass++)
+				{
+					HostFreeBlock* first = cache.lists[sizeClass];
+					if (!first)
+						continue;
+
+					HostFreeBlock* last = first;
+					while (last->next)
+						last = last->next;
+					ReturnToDepot(sizeClass, first, last);
+				}
+
+				// Drop the owner reference, chunks which still have live allocations are freed by whoever frees the last one
+				for (auto chunk : cache.arena.chunks)
+				{
+					if (chunk->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+						FreeArenaChunk(chunk);
+				}
+			}
+		};
+
+		// Returns nullptr once the thread has started exiting
+		inline HostThreadCache* GetHostThreadCache()
+		{
+			if (t_hostThreadCache)
+				return t_hostThreadCache;
+			if (t_hostThreadCacheDestroyed)
+				return nullptr;
+
+			static thread_local HostThreadCacheOwner s_owner;
+			return t_hostThreadCache;
+		}
+
+		inline uint32_t GetHostSizeClass(size_t blockSize)
+		{
+			for (uint32_t sizeClass = 0; sizeClass < g_hostSizeClassCount; sizeClass++)
+			{
+				if (blockSize <= g_hostSizeClasses[sizeClass])
+					return sizeClass;
+			}
+			return g_hostLargeClass;
+		}
+
+		inline size_t AlignUp(size_t value, size_t alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+
+		// Space needed for the header, padding and the allocation itself
+		inline size_t GetHostBlockSize(size_t size, size_t alignment)
+		{
+			return size + g_hostHeaderSize + (alignment > g_hostHeaderSize ? alignment - g_hostHeaderSize : 0);
+		}
+
+		// Places the header and returns the user pointer inside of block
+		inline void* PlaceHostAllocation(void* block, size_t size, size_t alignment, uint32_t sizeClass)
+		{
+			const auto blockAddress = reinterpret_cast<uintptr_t>(block);
+			const auto userAddress = AlignUp(blockAddress + g_hostHeaderSize, alignment < g_hostHeaderSize ? g_hostHeaderSize : alignment);
+
+			auto header = reinterpret_cast<HostAllocationHeader*>(userAddress - g_hostHeaderSize);
+			header->sizeClass = sizeClass;
+			header->offset = static_cast<uint32_t>(userAddress - blockAddress);
+			header->size = size;
+
+			return reinterpret_cast<void*>(userAddress);
+		}
+
+		inline HostAllocationHeader* GetHostAllocationHeader(void* memory)
+		{
+			return reinterpret_cast<HostAllocationHeader*>(reinterpret_cast<uintptr_t>(memory) - g_hostHeaderSize);
+		}
+
+		// Takes a batch from the depot, or carves a new chunk if the depot is empty
+		inline HostFreeBlock* RefillSizeClass(uint32_t sizeClass, uint32_t* countOut)
+		{
+			auto& depotClass = GetHostPoolDepot().classes[sizeClass];
+			const uint32_t blockSize = g_hostSizeClasses[sizeClass];
+
+			{
+				std::lock_guard lock(depotClass.mutex);
+				if (depotClass.head)
+				{
+					HostFreeBlock* first = depotClass.head;
+					HostFreeBlock* last = first;
+					uint32_t count = 1;
+					while (count < g_hostTransferBatch && last->next)
+					{
+						last = last->next;
+						count++;
+					}
+
+					depotClass.head = last->next;
+					last->next = nullptr;
+					*countOut = count;
+					return first;
+				}
+			}
+
+			// Pool chunks are kept for the life of the process
+			auto chunk = static_cast<uint8_t*>(std::malloc(g_hostPoolChunkSize));
+			if (!chunk)
+				return nullptr;
+
+			const uint32_t count = static_cast<uint32_t>(g_hostPoolChunkSize / blockSize);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				auto block = reinterpret_cast<HostFreeBlock*>(chunk + i * blockSize);
+				block->next = (i + 1 < count) ? reinterpret_cast<HostFreeBlock*>(chunk + (i + 1) * blockSize) : nullptr;
+			}
+
+			*countOut = count;
+			return reinterpret_cast<HostFreeBlock*>(chunk);
+		}
+
+		inline void* AllocatePoolBlock(uint32_t sizeClass)
+		{
+			HostThreadCache* cache = GetHostThreadCache();
+			if (!cache) // Thread is exiting, go straight to the depot
+			{
+				uint32_t count;
+				HostFreeBlock* first = RefillSizeClass(sizeClass, &count);
+				if (first && first->next)
+				{
+					HostFreeBlock* last = first->next;
+					while (last->next)
+						last = last->next;
+					ReturnToDepot(sizeClass, first->next, last);
+				}
+				return first;
+			}
+
+			if (!cache->lists[sizeClass])
+			{
+				cache->lists[sizeClass] = RefillSizeClass(sizeClass, &cache->counts[sizeClass]);
+				if (!cache->lists[sizeClass])
+					return nullptr;
+			}
+
+			HostFreeBlock* block = cache->lists[sizeClass];
+			cache->lists[sizeClass] = block->next;
+			cache->counts[sizeClass]--;
+			return block;
+		}
+
+		inline void FreePoolBlock(uint32_t sizeClass, void* block)
+		{
+			auto freeBlock = static_cast<HostFreeBlock*>(block);
+
+			HostThreadCache* cache = GetHostThreadCache();
+			if (!cache)
+			{
+				freeBlock->next = nullptr;
+				ReturnToDepot(sizeClass, freeBlock, freeBlock);
+				return;
+			}
+
+			freeBlock->next = cache->lists[sizeClass];
+			cache->lists[sizeClass] = freeBlock;
+			cache->counts[sizeClass]++;
+
+			// Too many cached, move a batch to the depot
+			if (cache->counts[sizeClass] > g_hostThreadCacheLimit)
+			{
+				HostFreeBlock* first = cache->lists[sizeClass];
+				HostFreeBlock* last = first;
+				for (uint32_t i = 1; i < g_hostTransferBatch; i++)
+					last = last->next;
+
+				cache->lists[sizeClass] = last->next;
+				cache->counts[sizeClass] -= g_hostTransferBatch;
+				ReturnToDepot(sizeClass, first, last);
+			}
+		}
+
+		inline void* AllocateArenaBlock(HostCommandArena& arena, size_t blockSize)
+		{
+			blockSize = AlignUp(blockSize, 16);
+
+			if (!arena.current || arena.current->offset + blockSize > g_hostArenaChunkSize)
+			{
+				arena.current = nullptr;
+
+				// Bulk reset: a chunk with only the owner reference left has no live allocations
+				for (auto chunk : arena.chunks)
+				{
+					if (chunk->references.load(std::memory_order_acquire) == 1)
+					{
+						chunk->offset = sizeof(HostArenaChunk);
+						arena.current = chunk;
+						break;
+					}
+				}
+
+				if (!arena.current)
+				{
+					void* memory = AllocateArenaChunk();
+					if (!memory)
+						return nullptr;
+
+					auto chunk = new(memory) HostArenaChunk{};
+					chunk->references.store(1, std::memory_order_relaxed);
+					chunk->offset = sizeof(HostArenaChunk);
+					arena.chunks.push_back(chunk);
+					arena.current = chunk;
+				}
+			}
+			else if (arena.current->references.load(std::memory_order_acquire) == 1)
+				arena.current->offset = sizeof(HostArenaChunk); // Everything in the current chunk was freed, start over
+
+			void* block = reinterpret_cast<uint8_t*>(arena.current) + arena.current->offset;
+			arena.current->offset += static_cast<uint32_t>(blockSize);
+			arena.current->references.fetch_add(1, std::memory_order_relaxed);
+			return block;
+		}
+
+		inline void FreeArenaBlock(void* block)
+		{
+			auto chunk = reinterpret_cast<HostArenaChunk*>(reinterpret_cast<uintptr_t>(block) & ~(g_hostArenaChunkSize - 1));
+			if (chunk->references.fetch_sub(1, std::memory_order_acq_rel) == 1) // Owning thread already exited
+				FreeArenaChunk(chunk);
+		}
+
+		inline void* HostAllocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+		{
+			if (size == 0)
+				return nullptr;
+
+			const size_t blockSize = GetHostBlockSize(size, alignment);
+
+			if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && blockSize <= g_hostArenaMaxAllocation)
+			{
+				if (HostThreadCache* cache = GetHostThreadCache())
+				{
+					void* block = AllocateArenaBlock(cache->arena, blockSize);
+					return block ? PlaceHostAllocation(block, size, alignment, g_hostCommandClass) : nullptr;
+				}
+			}
+
+			const uint32_t sizeClass = GetHostSizeClass(blockSize);
+			if (sizeClass != g_hostLargeClass)
+			{
+				void* block = AllocatePoolBlock(sizeClass);
+				return block ? PlaceHostAllocation(block, size, alignment, sizeClass) : nullptr;
+			}
+
+			void* block = std::malloc(blockSize);
+			return block ? PlaceHostAllocation(block, size, alignment, g_hostLargeClass) : nullptr;
+		}
+
+		inline void HostFree(void* memory)
+		{
+			if (!memory)
+				return;
+
+			const HostAllocationHeader* header = GetHostAllocationHeader(memory);
+			void* block = static_cast<uint8_t*>(memory) - header->offset;
+
+			if (header->sizeClass == g_hostCommandClass)
+				FreeArenaBlock(block);
+			else if (header->sizeClass == g_hostLargeClass)
+				std::free(block);
+			else
+				FreePoolBlock(header->sizeClass, block);
+		}
+
+		inline void* HostReallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+		{
+			if (!original)
+				return HostAllocate(size, alignment, scope);
+
+			if (size == 0)
+			{
+				HostFree(original);
+				return nullptr;
+			}
+
+			HostAllocationHeader* header = GetHostAllocationHeader(original);
+
+			// Grow or shrink in place if the block is big enough and the alignment still holds
+			if (header->sizeClass < g_hostSizeClassCount &&
+				(reinterpret_cast<uintptr_t>(original) & (alignment - 1)) == 0 &&
+				header->offset + size <= g_hostSizeClasses[header->sizeClass])
+			{
+				header->size = size;
+				return original;
+			}
+
+			void* memory = HostAllocate(size, alignment, scope);
+			if (!memory)
+				return nullptr;
+
+			std::memcpy(memory, original, static_cast<size_t>(header->size < size ? header->size : size));
+			HostFree(original);
+			return memory;
+		}
+
+		inline void* VKAPI_PTR HostAllocationCallback(void*, size_t size, size_t alignment, VkSystemAllocationScope scope)
+		{
+			return HostAllocate(size, alignment, scope);
+		}
+
+		inline void* VKAPI_PTR HostReallocationCallback(void*, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+		{
+			return HostReallocate(original, size, alignment, scope);
+		}
+
+		inline void VKAPI_PTR HostFreeCallback(void*, void* memory)
+		{
+			HostFree(memory);
+		}
+	}
+
+	VKHL_INLINE VkAllocationCallbacks GetHostAllocatorCallbacks()
+	{
+		VkAllocationCallbacks callbacks{};
+		callbacks.pfnAllocation = detail::HostAllocationCallback;
+		callbacks.pfnReallocation = detail::HostReallocationCallback;
+		callbacks.pfnFree = detail::HostFreeCallback;
+		return callbacks;
+	}
+
+	VKHL_INLINE void InstallHostAllocator()
+	{
+		VKHL_TRACE_ZONE("vkhl::InstallHostAllocator");
+
+		g_allocator = GetHostAllocatorCallbacks();
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -9,15 +9,20 @@
 #include <utility>
 #include <optional>
 #include <vector>
+#include <string>
 
 #include "Definitions.h"
 #include "Globals.hpp"
 #include "Error.hpp"
 #include "Common.hpp"
+#include "Dispatch.hpp"
+#include "Capabilities.hpp"
+#include "Trace.hpp"
 
 #ifdef VKHL_INCLUDE_IMPLEMENTION
 
 #include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
 
 #endif // VKHL_INCLUDE_IMPLEMENTION
 
@@ -43,12 +48,13 @@ namespace vkhl
 	};
 
 	// instanceOut must point to a VkInstance; infoOut is optional
+	// Also loads g_instanceDispatch for the new instance. Layers and extensions are checked against GetCapabilitySnapshot
 	VKHL_INLINE SmartResult CreateInstance(const InstanceCreateInfo& createInfo, VkInstance* instanceOut, InstanceInfo* infoOut = nullptr);
 	
-	// infoOut must point to an InstanceInfo
+	// infoOut must point to an InstanceInfo, filled from GetCapabilitySnapshot
 	VKHL_INLINE SmartResult GetInstanceInfo(InstanceInfo* infoOut);
 
-	// Calls vkDestroyInstance with global allocation callbacks
+	// Calls vkDestroyInstance with global allocation callbacks, and clears g_instanceDispatch if it belongs to instance
 	VKHL_INLINE void DestroyInstance(VkInstance instance);
 
 #ifdef VKHL_INCLUDE_IMPLEMENTION
@@ -64,19 +70,18 @@ namespace vkhl
 
 	VKHL_INLINE SmartResult CreateInstance(const InstanceCreateInfo& createInfo, VkInstance* instanceOut, InstanceInfo* infoOut)
 	{
-		VkResult result = VK_SUCCESS;
+		VKHL_TRACE_ZONE("vkhl::CreateInstance");
 
-		uint32_t supportedVersion = VK_VERSION_1_0, apiVersion;
-		const auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
-		if (enumerateInstanceVersion) // If the function couldn't be found then we are using Vulkan 1.0
-		{
-			result = enumerateInstanceVersion(&supportedVersion);
-			if (result < 0)
-			{
-				PrintError("Failed to get instance version with error %s\n", string_VkResult(result));
-				return result;
-			}
-		}
+		VkResult result = LoadGlobalDispatch().GetAndReset();
+		if (result < 0)
+			return result;
+
+		const CapabilitySnapshot* capabilities;
+		result = GetCapabilitySnapshot(&capabilities).GetAndReset();
+		if (result < 0)
+			return result;
+
+		uint32_t supportedVersion = capabilities->apiVersion, apiVersion = 0;
 		
 		if (supportedVersion < createInfo.minApiVersion) // Insufficient version
 		{
@@ -99,44 +104,24 @@ namespace vkhl
 			layers.reserve(createInfo.layers.size());
 		
 		// Check layer availablility
+		for (auto layer : createInfo.layers)
 		{
-			// Get available layers
-			uint32_t availableLayerCount = 0;
-			CHECK_VK_CALL(vkEnumerateInstanceLayerProperties(&availableLayerCount, nullptr),
-				"Failed to get number of instance layers with error %s\n");
-
-			std::vector<VkLayerProperties> availableLayers{ availableLayerCount };
-			CHECK_VK_CALL(vkEnumerateInstanceLayerProperties(&availableLayerCount, availableLayers.data()),
-				"Failed to get instance layers with error %s\n");
-
-			if (!createInfo.layers.empty())
+			if (!capabilities->HasLayer(layer.first))
 			{
-				for (auto layer : createInfo.layers)
+				// Not found
+				if (layer.second == RequireFeature)
 				{
-					const auto iter = std::find_if(availableLayers.begin(), availableLayers.end(),
-						[&layer](VkLayerProperties other) {
-							return strncmp(layer.first, other.layerName, VK_MAX_EXTENSION_NAME_SIZE - 1) == 0;
-						});
-
-					if (iter == availableLayers.end())
-					{
-						// Not found
-						if (layer.second == RequireFeature)
-						{
-							PrintError("Layer %s was required but not found\n", layer.first);
-							result = VK_ERROR_EXTENSION_NOT_PRESENT;
-						}
-						else // layer.second == RequestFeature
-							PrintWarning("Layer %s was requested but not found, continuing\n", layer.first);
-					}
-					else // Found
-					{
-						layers_cstr.push_back(layer.first);
-						if (infoOut)
-							layers.push_back(layer.first);
-					}
-
+					PrintError("Layer %s was required but not found\n", layer.first);
+					result = VK_ERROR_EXTENSION_NOT_PRESENT;
 				}
+				else // layer.second == RequestFeature
+					PrintWarning("Layer %s was requested but not found, continuing\n", layer.first);
+			}
+			else // Found
+			{
+				layers_cstr.push_back(layer.first);
+				if (infoOut)
+					layers.push_back(layer.first);
 			}
 		}
 
@@ -149,63 +134,26 @@ namespace vkhl
 		if (infoOut)
 			extensions.reserve(createInfo.extensions.size());
 
-		// Check extension availablility
+		// Check extension availablility, extensions of the enabled layers count too
+		for (auto extension : createInfo.extensions)
 		{
-			// Get available extensions
-			uint32_t availableExtCount = 0;
-			CHECK_VK_CALL(vkEnumerateInstanceExtensionProperties(nullptr, &availableExtCount, nullptr),
-				"Failed to get number of instance extensions with error %s\n");
-
-			std::vector<VkExtensionProperties> availableExtensions{ availableExtCount };
-			CHECK_VK_CALL(vkEnumerateInstanceExtensionProperties(nullptr, &availableExtCount, availableExtensions.data()),
-				"Failed to get instance extensions with error %s\n");
-
-			// Get available extensions for each of the present layers
-			for (auto layer : layers)
+			if (!capabilities->HasExtension(extension.first, layers_cstr))
 			{
-				uint32_t layerExtCount = 0;
-				CHECK_VK_CALL(vkEnumerateInstanceExtensionProperties(nullptr, &layerExtCount, nullptr),
-					"Failed to get number of layer %s extensions with error %s\n", layer);
-				if (layerExtCount > 0)
+				// Not found
+				if (extension.second == RequireFeature)
 				{
-					// Append the new extensions to the the end of the array (insert at index of old size, a.k.a. availableExtCount)
-					availableExtensions.resize(availableExtCount + layerExtCount);
-					CHECK_VK_CALL(vkEnumerateInstanceExtensionProperties(nullptr, &layerExtCount, &availableExtensions[availableExtCount]),
-						"Failed to get layer %s extensions with error %s\n", layer);
-					availableExtCount += layerExtCount;
+					PrintError("Extension %s was required but not found\n", extension.first);
+					result = VK_ERROR_EXTENSION_NOT_PRESENT;
 				}
+				else // extension.second == RequestFeature
+					PrintWarning("Extension %s was requested but not found, continuing\n", extension.first);
 			}
-		
-
-			if (!createInfo.extensions.empty())
+			else // Found
 			{
-				for (auto extension : createInfo.extensions)
-				{
-					const auto iter = std::find_if(availableExtensions.begin(), availableExtensions.end(),
-						[&extension](VkExtensionProperties other) {
-							return strncmp(extension.first, other.extensionName, VK_MAX_EXTENSION_NAME_SIZE - 1) == 0;
-						});
-
-					if (iter == availableExtensions.end())
-					{
-						// Not found
-						if (extension.second == RequireFeature)
-						{
-							PrintError("Extension %s was required but not found\n", extension.first);
-							result = VK_ERROR_EXTENSION_NOT_PRESENT;
-						}
-						else // extension.second == RequestFeature
-							PrintWarning("Extension %s was requested but not found, continuing\n", extension.first);
-					}
-					else // Found
-					{
-						extensions_cstr.push_back(extension.first);
-						
-						if (infoOut)
-							extensions.push_back(extension.first);
-					}
-
-				}
+				extensions_cstr.push_back(extension.first);
+				
+				if (infoOut)
+					extensions.push_back(extension.first);
 			}
 		}
 
@@ -235,13 +183,20 @@ namespace vkhl
 		if (g_allocator.has_value())
 			allocator = &g_allocator.value();
 
-		result = vkCreateInstance(&instanceInfo, allocator, instanceOut);
+		{
+			VKHL_TRACE_ZONE("vkCreateInstance");
+			result = g_globalDispatch.vkCreateInstance(&instanceInfo, allocator, instanceOut);
+		}
 		if (result < 0)
 		{
 			PrintError("Failed to create instance with error %s\n", string_VkResult(result));
 			return result;
 		}
 
+		result = LoadInstanceDispatch(*instanceOut, apiVersion, &g_instanceDispatch).GetAndReset();
+		if (result < 0)
+			return result;
+
 		// Write the instance info
 		if (infoOut)
 		{
@@ -255,73 +210,32 @@ namespace vkhl
 
 	VKHL_INLINE SmartResult GetInstanceInfo(InstanceInfo* infoOut)
 	{
-		VkResult result = VK_SUCCESS;
-
-		// Get version
-		uint32_t supportedVersion = VK_VERSION_1_0;
-		const auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
-		if (enumerateInstanceVersion) // If the function couldn't be found then we are using Vulkan 1.0
-		{
-			result = enumerateInstanceVersion(&supportedVersion);
-			if (result < 0)
-			{
-				PrintError("Failed to get instance version with error %s\n", string_VkResult(result));
-				return result;
-			}
-		}
-
-		// Get layers
-		std::vector<std::string> layers;
-		// Check layer availablility
-		{
-			// Get available layers
-			uint32_t availableLayerCount = 0;
-			CHECK_VK_CALL(vkEnumerateInstanceLayerProperties(&availableLayerCount, nullptr),
-				"Failed to get number of instance layers with error %s\n");
-
-			std::vector<VkLayerProperties> availableLayers{ availableLayerCount };
-			CHECK_VK_CALL(vkEnumerateInstanceLayerProperties(&availableLayerCount, availableLayers.data()),
-				"Failed to get instance layers with error %s\n");
-
-			// Extract the layer names
-			layers.reserve(availableLayerCount);
-			for (const auto& layerProperties : availableLayers)
-				layers.push_back(layerProperties.layerName);
-		}
+		VKHL_TRACE_ZONE("vkhl::GetInstanceInfo");
 
-		// Get extensions
-		std::vector<std::string> extensions;
-		// Check extension availablility
-		{
-			// Get available extensions
-			uint32_t availableExtCount = 0;
-			CHECK_VK_CALL(vkEnumerateInstanceExtensionProperties(nullptr, &availableExtCount, nullptr),
-				"Failed to get number of instance extensions with error %s\n");
-
-			std::vector<VkExtensionProperties> availableExtensions{ availableExtCount };
-			CHECK_VK_CALL(vkEnumerateInstanceExtensionProperties(nullptr, &availableExtCount, availableExtensions.data()),
-				"Failed to get instance extensions with error %s\n");
-
-			// Extract the extension names
-			extensions.reserve(availableExtCount);
-			for (const auto& extProperties : availableExtensions)
-				extensions.push_back(extProperties.extensionName);
-		}
+		const CapabilitySnapshot* capabilities;
+		VkResult result = GetCapabilitySnapshot(&capabilities).GetAndReset();
+		if (result < 0)
+			return result;
 
-		infoOut->apiVersion = supportedVersion;
-		infoOut->layers = std::move(layers);
-		infoOut->extensions = std::move(extensions);
+		infoOut->apiVersion = capabilities->apiVersion;
+		infoOut->layers = capabilities->layers.GetNames();
+		infoOut->extensions = capabilities->extensions.GetNames();
 
 		return VK_SUCCESS;
 	}
 
 	VKHL_INLINE void DestroyInstance(VkInstance instance)
 	{
+		VKHL_TRACE_ZONE("vkhl::DestroyInstance");
+
 		VkAllocationCallbacks* allocator = nullptr;
 		if (g_allocator.has_value())
 			allocator = &g_allocator.value();
 
-		vkDestroyInstance(instance, allocator);
+		g_instanceDispatch.vkDestroyInstance(instance, allocator);
+
+		if (g_instanceDispatch.instance == instance)
+			g_instanceDispatch = {};
 	}
 
 #undef CHECK_VK_CALL
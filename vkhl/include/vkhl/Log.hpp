@@ -0,0 +1,849 @@
+#pragma once
+
+#ifndef VKHL_LOG_HPP
+#define VKHL_LOG_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <cstring>
+#include <cstddef>
+#include <string_view>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	struct AsyncLogCreateInfo
+	{
+		std::FILE* output = stdout;
+		uint32_t bufferSize = 256 * 1024;	// Bytes per logging thread, messages are dropped while it is full
+		uint32_t rateLimit = 20;			// Messages per second with the same format from one thread, 0 for no limit
+		uint32_t flushInterval = 10;		// Milliseconds between writes
+		bool deduplicate = true;			// Collapses a message repeated back to back into a count
+	};
+
+	// Replaces g_printErrorFunc and g_printWarningFunc with functions that copy the format and its arguments into a per thread
+	// ring without taking a lock, and formats and writes them on a background thread. Strings (%s, up to their precision) are copied,
+	// so they may be freed as soon as PrintError returns. Messages from one thread stay in order, messages from different threads may not.
+	// Returns false if the log was already started
+	VKHL_INLINE bool StartAsyncLog(const AsyncLogCreateInfo& createInfo = {});
+
+	// Writes everything logged so far, then puts back the print functions from before StartAsyncLog.
+	// No other thread may be printing while this runs
+	VKHL_INLINE void StopAsyncLog();
+
+	// Returns once everything logged before the call has been written
+	VKHL_INLINE void FlushAsyncLog();
+
+	// Routes VK_EXT_debug_utils messages of the given severities through PrintError (errors) and PrintWarning (everything else),
+	// so with the async log, validation message storms are rate limited per message id instead of formatted on the calling thread.
+	// VK_EXT_debug_utils must be enabled on instance, which must have been made with CreateInstance (or loaded into g_instanceDispatch)
+	VKHL_INLINE SmartResult CreateDebugMessenger(VkInstance instance, VkDebugUtilsMessengerEXT* messengerOut,
+		VkDebugUtilsMessageSeverityFlagsEXT severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT);
+
+	VKHL_INLINE void DestroyDebugMessenger(VkInstance instance, VkDebugUtilsMessengerEXT messenger);
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	namespace detail
+	{
+		enum class LogLevel : uint32_t
+		{
+			Padding,	// Unused space at the end of a ring, skip to the start
+			Error,
+			Warning,
+		};
+
+		// One conversion of a printf format, i.e. "%-8.*llu"
+		struct LogSpec
+		{
+			const char* begin;		// The '%'
+			const char* end;		// One past the conversion
+			const char* length;		// First length modifier character, or the conversion if there is none
+			char conversion;		// 0 if the format is cut off or uses something unknown
+			int precision;			// -1 if there is none or it is an argument
+			bool widthArg;			// '*' width
+			bool precisionArg;		// '*' precision
+			bool longArg;			// l, ll, j, z, t, L or q
+		};
+
+		// cursor must point to a '%'
+		VKHL_INLINE LogSpec ParseLogSpec(const char* cursor)
+		{
+			LogSpec spec{};
+			spec.begin = cursor++;
+			spec.precision = -1;
+
+			while (*cursor && std::strchr("-+ #0'", *cursor))
+				cursor++;
+
+			if (*cursor == '*')
+			{
+				spec.widthArg = true;
+				cursor++;
+			}
+			while (*cursor >= '0' && *cursor <= '9')
+				cursor++;
+
+			if (*cursor == '.')
+			{
+				cursor++;
+				if (*cursor == '*')
+				{
+					spec.precisionArg = true;
+					cursor++;
+				}
+				else
+					spec.precision = 0;
+
+				while (*cursor >= '0' && *cursor <= '9')
+				{
+					spec.precision = std::min(spec.precision * 10 + (*cursor - '0'), 1 << 24);
+					cursor++;
+				}
+			}
+
+			spec.length = cursor;
+			while (*cursor && std::strchr("hljztLq", *cursor))
+			{
+				spec.longArg |= *cursor != 'h';
+				cursor++;
+			}
+
+			if (*cursor && std::strchr("diuoxXcspfFeEgGaAn%", *cursor))
+			{
+				spec.conversion = *cursor;
+				cursor++;
+			}
+
+			spec.end = cursor;
+			return spec;
+		}
+
+		// Variable size, followed by its arguments and then the strings: the format, then the ones the arguments point at
+		struct LogRecord
+		{
+			uint32_t size;				// Including the header, a multiple of 8
+			LogLevel level;
+			uint32_t suppressed;		// Similar messages the rate limit dropped before this one
+			uint32_t argCount;
+			bool formatted;				// The message was formatted on the calling thread, it is the only string
+		};
+
+		// Arguments are stored widened, so formatting doesn't need to know the original type
+		union LogArg
+		{
+			int64_t i;
+			uint64_t u;
+			double f;
+			const void* p;
+			uint64_t stringOffset; // Into the strings after the arguments
+		};
+
+		constexpr uint32_t MaxLogArgs = 32;
+		constexpr uint32_t LogRateSlots = 64;
+
+		// Single producer, single consumer byte ring. Written only by its thread, read only by the log thread
+		struct LogBuffer
+		{
+			std::unique_ptr<uint64_t[]> data; // uint64_t so records stay aligned
+			uint64_t size = 0;
+			alignas(64) std::atomic<uint64_t> head = 0;	// Written up to, only moved by the owning thread
+			alignas(64) std::atomic<uint64_t> tail = 0;	// Read up to, only moved by the log thread
+			std::atomic<uint32_t> dropped = 0;
+
+			// Rate limit per message key, direct mapped so a collision just restarts the count. Only touched by the owning thread
+			struct RateSlot
+			{
+				uint64_t key = 0;
+				uint64_t windowStart = 0;
+				uint32_t count = 0;
+				uint32_t suppressed = 0;
+			} rates[LogRateSlots];
+		};
+
+		struct AsyncLogState
+		{
+			AsyncLogCreateInfo createInfo;
+			uint64_t generation = 0;
+			PrintFunc previousErrorFunc = nullptr;
+			PrintFunc previousWarningFunc = nullptr;
+
+			std::mutex mutex; // Guards everything below
+			std::condition_variable wake;
+			std::condition_variable flushed;
+			std::vector<std::unique_ptr<LogBuffer>> buffers;
+			uint64_t flushRequested = 0;
+			uint64_t flushCompleted = 0;
+			bool stop = false;
+
+			std::thread thread;
+
+			// Only touched by the log thread
+			std::string output;
+			std::string lastMessage;
+			uint32_t repeats = 0;
+		};
+
+		VKHL_INLINE_VAR std::atomic<AsyncLogState*> g_asyncLog = nullptr;
+
+		// Buffers belong to one StartAsyncLog, so the cached one is only valid for its generation
+		struct LogBufferCache
+		{
+			uint64_t generation = 0;
+			LogBuffer* buffer = nullptr;
+		};
+
+		VKHL_INLINE LogBuffer* GetLogBuffer(AsyncLogState& state)
+		{
+			thread_local LogBufferCache t_cache;
+			if (t_cache.generation != state.generation)
+			{
+				auto buffer = std::make_unique<LogBuffer>();
+				buffer->size = (std::max(state.createInfo.bufferSize, 1024u) + 7) / 8 * 8;
+				buffer->data = std::make_unique<uint64_t[]>(buffer->size / 8);
+
+				std::lock_guard lock(state.mutex);
+				t_cache = { state.generation, buffer.get() };
+				state.buffers.push_back(std::move(buffer));
+			}
+
+			return t_cache.buffer;
+		}
+
+		VKHL_INLINE uint64_t GetLogTime()
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		// Returns false if the message is over the rate limit, otherwise how many were suppressed before it
+		VKHL_INLINE bool CheckLogRate(const AsyncLogState& state, LogBuffer& buffer, uint64_t key, uint32_t* suppressedOut)
+		{
+			*suppressedOut = 0;
+			if (state.createInfo.rateLimit == 0)
+				return true;
+
+			LogBuffer::RateSlot& slot = buffer.rates[(key ^ (key >> 17)) % LogRateSlots];
+			const uint64_t now = GetLogTime();
+
+			if (slot.key != key)
+				slot = { key, now, 0, 0 };
+			else if (now - slot.windowStart >= 1000000000ull)
+			{
+				slot.windowStart = now;
+				slot.count = 0;
+			}
+
+			if (slot.count >= state.createInfo.rateLimit)
+			{
+				slot.suppressed++;
+				return false;
+			}
+
+			slot.count++;
+			*suppressedOut = slot.suppressed;
+			slot.suppressed = 0;
+			return true;
+		}
+
+		// Copies the arguments of format out of args, returns false if the format needs more than MaxLogArgs or something unknown.
+		// stringLimitsOut gets the most characters printed of each string, which may not be null terminated within its precision
+		VKHL_INLINE bool CaptureLogArgs(const char* format, va_list args, LogArg* argsOut, const char** stringsOut, size_t* stringLimitsOut, uint32_t* argCountOut)
+		{
+			uint32_t count = 0;
+			for (const char* cursor = std::strchr(format, '%'); cursor; cursor = std::strchr(cursor, '%'))
+			{
+				const LogSpec spec = ParseLogSpec(cursor);
+				cursor = spec.end;
+
+				if (spec.conversion == 0)
+					return false;
+				if (spec.conversion == '%')
+					continue;
+				if (count + spec.widthArg + spec.precisionArg + 1 > MaxLogArgs)
+					return false;
+
+				if (spec.widthArg)
+				{
+					stringsOut[count] = nullptr;
+					argsOut[count++].i = va_arg(args, int);
+				}
+
+				int precision = spec.precision;
+				if (spec.precisionArg)
+				{
+					precision = va_arg(args, int);
+					stringsOut[count] = nullptr;
+					argsOut[count++].i = precision;
+				}
+
+				LogArg& arg = argsOut[count];
+				stringsOut[count] = nullptr;
+				count++;
+
+				const std::string_view length(spec.length, spec.end - 1 - spec.length);
+				switch (spec.conversion)
+				{
+				case 'd': case 'i':
+					if (length == "l")			arg.i = va_arg(args, long);
+					else if (length == "ll" || length == "q")	arg.i = va_arg(args, long long);
+					else if (length == "j")		arg.i = va_arg(args, intmax_t);
+					else if (length == "z" || length == "t")	arg.i = va_arg(args, ptrdiff_t);
+					else						arg.i = va_arg(args, int);
+					break;
+
+				case 'u': case 'o': case 'x': case 'X':
+					if (length == "l")			arg.u = va_arg(args, unsigned long);
+					else if (length == "ll" || length == "q")	arg.u = va_arg(args, unsigned long long);
+					else if (length == "j")		arg.u = va_arg(args, uintmax_t);
+					else if (length == "z" || length == "t")	arg.u = va_arg(args, size_t);
+					else						arg.u = va_arg(args, unsigned int);
+					break;
+
+				case 'c':
+					if (spec.longArg)
+						return false; // Wide characters
+					arg.i = va_arg(args, int);
+					break;
+
+				case 's':
+					if (spec.longArg)
+						return false;
+					stringsOut[count - 1] = va_arg(args, const char*);
+					stringLimitsOut[count - 1] = precision >= 0 ? static_cast<size_t>(precision) : SIZE_MAX; // A negative '*' precision is none
+					if (!stringsOut[count - 1])
+						stringsOut[count - 1] = "(null)";
+					break;
+
+				case 'p':
+					arg.p = va_arg(args, const void*);
+					break;
+
+				case 'n':
+					va_arg(args, void*); // Nothing is written back, the message is formatted later
+					count--;
+					break;
+
+				default: // Floating point
+					if (length == "L")
+						arg.f = static_cast<double>(va_arg(args, long double));
+					else
+						arg.f = va_arg(args, double);
+					break;
+				}
+			}
+
+			*argCountOut = count;
+			return true;
+		}
+
+		// Writes a record into buffer, or counts it as dropped if it doesn't fit. format is nullptr if strings[0] is the formatted message,
+		// otherwise it must fit in the record whole, the caller formats longer ones itself
+		VKHL_INLINE void PushLogRecord(LogBuffer& buffer, LogLevel level, const char* format, size_t formatLength, uint32_t suppressed,
+			const LogArg* args, const char* const* strings, const size_t* stringLimits, uint32_t argCount)
+		{
+			// A single message may take at most half of the ring, longer strings are cut short
+			const uint64_t maxSize = buffer.size / 2;
+
+			uint64_t stringSize = format ? formatLength + 1 : 0;
+			uint64_t headerSize = sizeof(LogRecord) + argCount * sizeof(LogArg);
+			uint32_t stringLengths[MaxLogArgs];
+			for (uint32_t i = 0; i < argCount; i++)
+			{
+				if (!strings[i])
+					continue;
+
+				const uint64_t available = maxSize > headerSize + stringSize + 8 ? maxSize - headerSize - stringSize - 8 : 0;
+				stringLengths[i] = static_cast<uint32_t>(strnlen(strings[i], static_cast<size_t>(std::min<uint64_t>(stringLimits[i], available))));
+				stringSize += stringLengths[i] + 1;
+			}
+
+			const uint64_t recordSize = (headerSize + stringSize + 7) & ~uint64_t(7);
+
+			const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+			const uint64_t offset = head % buffer.size;
+			const uint64_t padding = offset + recordSize > buffer.size ? buffer.size - offset : 0; // Records never wrap
+
+			if (head + padding + recordSize - buffer.tail.load(std::memory_order_acquire) > buffer.size)
+			{
+				buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			char* data = reinterpret_cast<char*>(buffer.data.get());
+			if (padding)
+			{
+				LogRecord skip{};
+				skip.size = static_cast<uint32_t>(padding);
+				skip.level = LogLevel::Padding;
+				std::memcpy(data + offset, &skip, std::min<uint64_t>(padding, sizeof(skip)));
+			}
+
+			char* record = data + (head + padding) % buffer.size;
+			char* recordArgs = record + sizeof(LogRecord);
+			char* recordStrings = record + headerSize;
+
+			LogRecord header{};
+			header.size = static_cast<uint32_t>(recordSize);
+			header.level = level;
+			header.suppressed = suppressed;
+			header.argCount = argCount;
+			header.formatted = !format;
+			std::memcpy(record, &header, sizeof(header));
+
+			uint64_t stringOffset = 0;
+			if (format)
+			{
+				std::memcpy(recordStrings, format, formatLength + 1);
+				stringOffset = formatLength + 1;
+			}
+
+			for (uint32_t i = 0; i < argCount; i++)
+			{
+				LogArg arg = args[i];
+				if (strings[i])
+				{
+					arg.stringOffset = stringOffset;
+					std::memcpy(recordStrings + stringOffset, strings[i], stringLengths[i]);
+					recordStrings[stringOffset + stringLengths[i]] = '\0';
+					stringOffset += stringLengths[i] + 1;
+				}
+				std::memcpy(recordArgs + i * sizeof(LogArg), &arg, sizeof(arg));
+			}
+
+			buffer.head.store(head + padding + recordSize, std::memory_order_release);
+		}
+
+		// key groups messages for the rate limit, the format pointer for PrintError and the message id for validation messages
+		VKHL_INLINE void PushAsyncLog(LogLevel level, uint64_t key, const char* format, va_list args)
+		{
+			AsyncLogState* state = g_asyncLog.load(std::memory_order_acquire);
+			if (!state) // Stopped, print right away
+			{
+				std::vprintf(format, args);
+				return;
+			}
+
+			LogBuffer* buffer = GetLogBuffer(*state);
+
+			uint32_t suppressed;
+			if (!CheckLogRate(*state, *buffer, key, &suppressed))
+				return;
+
+			va_list argsCopy;
+			va_copy(argsCopy, args);
+
+			LogArg capturedArgs[MaxLogArgs];
+			const char* strings[MaxLogArgs];
+			size_t stringLimits[MaxLogArgs];
+			uint32_t argCount;
+
+			// The format is copied too, it may be built at runtime and freed once PrintError returns
+			const size_t formatLength = std::strlen(format);
+			if (formatLength < buffer->size / 4 && CaptureLogArgs(format, argsCopy, capturedArgs, strings, stringLimits, &argCount))
+				PushLogRecord(*buffer, level, format, formatLength, suppressed, capturedArgs, strings, stringLimits, argCount);
+			else
+			{
+				// Too long or unusual to capture, so format it here instead
+				char message[1024];
+				std::vsnprintf(message, sizeof(message), format, args);
+
+				capturedArgs[0].stringOffset = 0;
+				strings[0] = message;
+				stringLimits[0] = SIZE_MAX;
+				PushLogRecord(*buffer, level, nullptr, 0, suppressed, capturedArgs, strings, stringLimits, 1);
+			}
+
+			va_end(argsCopy);
+		}
+
+		VKHL_INLINE void AsyncPrintError(const char* format, va_list args)
+		{
+			PushAsyncLog(LogLevel::Error, reinterpret_cast<uintptr_t>(format), format, args);
+		}
+
+		VKHL_INLINE void AsyncPrintWarning(const char* format, va_list args)
+		{
+			PushAsyncLog(LogLevel::Warning, reinterpret_cast<uintptr_t>(format), format, args);
+		}
+
+		// Like PrintError or PrintWarning, but rate limited by key instead of the format
+		VKHL_INLINE void PrintKeyed(LogLevel level, uint64_t key, const char* format, ...)
+		{
+			std::va_list varargs;
+			va_start(varargs, format);
+
+			PrintFunc func = level == LogLevel::Error ? g_printErrorFunc : g_printWarningFunc;
+			if (func == AsyncPrintError || func == AsyncPrintWarning)
+				PushAsyncLog(level, key, format, varargs);
+			else if (func)
+				func(format, varargs);
+
+			va_end(varargs);
+		}
+
+		// Formats a single conversion with snprintf, spec has its length modifier replaced to match value
+		template<typename T>
+		VKHL_INLINE void AppendLogSpec(std::string& output, const char* spec, const int* stars, uint32_t starCount, T value)
+		{
+			char text[256];
+			const auto format = [&](char* out, size_t size) {
+				switch (starCount)
+				{
+				case 0:		return std::snprintf(out, size, spec, value);
+				case 1:		return std::snprintf(out, size, spec, stars[0], value);
+				default:	return std::snprintf(out, size, spec, stars[0], stars[1], value);
+				}
+			};
+
+			const int length = format(text, sizeof(text));
+			if (length < 0)
+				return;
+
+			if (static_cast<size_t>(length) < sizeof(text))
+				output.append(text, length);
+			else
+			{
+				const size_t start = output.size();
+				output.resize(start + length + 1);
+				format(output.data() + start, length + 1);
+				output.resize(start + length);
+			}
+		}
+
+		VKHL_INLINE void FormatLogRecord(std::string& output, const LogRecord& record)
+		{
+			const char* args = reinterpret_cast<const char*>(&record) + sizeof(LogRecord);
+			const char* strings = args + record.argCount * sizeof(LogArg);
+
+			if (record.formatted)
+			{
+				output += strings;
+				return;
+			}
+
+			const char* cursor = strings;
+			uint32_t argIndex = 0;
+			const auto nextArg = [&]() {
+				LogArg arg;
+				std::memcpy(&arg, args + argIndex++ * sizeof(LogArg), sizeof(arg));
+				return arg;
+			};
+
+			while (const char* percent = std::strchr(cursor, '%'))
+			{
+				output.append(cursor, percent);
+
+				const LogSpec spec = ParseLogSpec(percent);
+				cursor = spec.end;
+
+				if (spec.conversion == '%')
+				{
+					output += '%';
+					continue;
+				}
+				if (spec.conversion == 'n')
+					continue;
+
+				int stars[2];
+				uint32_t starCount = 0;
+				if (spec.widthArg)
+					stars[starCount++] = static_cast<int>(nextArg().i);
+				if (spec.precisionArg)
+					stars[starCount++] = static_cast<int>(nextArg().i);
+
+				// Flags, width and precision as written, then the length of the widened argument
+				char specText[64];
+				const size_t prefixLength = std::min<size_t>(spec.length - spec.begin, sizeof(specText) - 4);
+				std::memcpy(specText, spec.begin, prefixLength);
+				char* specEnd = specText + prefixLength;
+
+				const LogArg arg = nextArg();
+				switch (spec.conversion)
+				{
+				case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+					*specEnd++ = 'l';
+					*specEnd++ = 'l';
+					*specEnd++ = spec.conversion;
+					*specEnd = '\0';
+					if (spec.conversion == 'd' || spec.conversion == 'i')
+						AppendLogSpec(output, specText, stars, starCount, static_cast<long long>(arg.i));
+					else
+						AppendLogSpec(output, specText, stars, starCount, static_cast<unsigned long long>(arg.u));
+					break;
+
+				case 'c':
+					*specEnd++ = 'c';
+					*specEnd = '\0';
+					AppendLogSpec(output, specText, stars, starCount, static_cast<int>(arg.i));
+					break;
+
+				case 's':
+					*specEnd++ = 's';
+					*specEnd = '\0';
+					AppendLogSpec(output, specText, stars, starCount, strings + arg.stringOffset);
+					break;
+
+				case 'p':
+					*specEnd++ = 'p';
+					*specEnd = '\0';
+					AppendLogSpec(output, specText, stars, starCount, arg.p);
+					break;
+
+				default:
+					*specEnd++ = spec.conversion;
+					*specEnd = '\0';
+					AppendLogSpec(output, specText, stars, starCount, arg.f);
+					break;
+				}
+			}
+
+			output += cursor;
+		}
+
+		VKHL_INLINE void FlushLogRepeats(AsyncLogState& state)
+		{
+			if (state.repeats == 0)
+				return;
+
+			char text[64];
+			std::snprintf(text, sizeof(text), "(last message repeated %u times)\n", state.repeats);
+			state.output += text;
+			state.repeats = 0;
+		}
+
+		// Formats everything in buffer into state.output
+		VKHL_INLINE void DrainLogBuffer(AsyncLogState& state, LogBuffer& buffer)
+		{
+			const char* data = reinterpret_cast<const char*>(buffer.data.get());
+			std::string message;
+
+			uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+			const uint64_t head = buffer.head.load(std::memory_order_acquire);
+
+			while (tail != head)
+			{
+				LogRecord record;
+				std::memcpy(&record, data + tail % buffer.size, sizeof(uint32_t) * 2); // Padding may be too short for the whole header
+				if (record.level != LogLevel::Padding)
+				{
+					const LogRecord& fullRecord = *reinterpret_cast<const LogRecord*>(data + tail % buffer.size);
+
+					message.clear();
+					if (fullRecord.suppressed)
+					{
+						char text[96];
+						std::snprintf(text, sizeof(text), "(%u similar messages were suppressed by the rate limit)\n", fullRecord.suppressed);
+						message += text;
+					}
+					FormatLogRecord(message, fullRecord);
+
+					if (state.createInfo.deduplicate && message == state.lastMessage)
+						state.repeats++;
+					else
+					{
+						FlushLogRepeats(state);
+						state.output += message;
+						state.lastMessage.swap(message);
+					}
+				}
+
+				tail += record.size;
+			}
+
+			buffer.tail.store(tail, std::memory_order_release);
+
+			if (const uint32_t dropped = buffer.dropped.exchange(0, std::memory_order_relaxed))
+			{
+				char text[96];
+				std::snprintf(text, sizeof(text), "(%u log messages were dropped, a thread's log buffer was full)\n", dropped);
+				state.output += text;
+			}
+		}
+
+		VKHL_INLINE void RunAsyncLog(AsyncLogState* state)
+		{
+			VKHL_TRACE_THREAD_NAME("vkhl log");
+
+			std::vector<LogBuffer*> buffers;
+			std::unique_lock lock(state->mutex);
+			for (;;)
+			{
+				state->wake.wait_for(lock, std::chrono::milliseconds(state->createInfo.flushInterval), [state] {
+					return state->stop || state->flushRequested != state->flushCompleted;
+				});
+
+				const bool stop = state->stop;
+				const uint64_t flushRequested = state->flushRequested;
+
+				buffers.clear();
+				for (auto& buffer : state->buffers)
+					buffers.push_back(buffer.get());
+
+				lock.unlock();
+
+				for (LogBuffer* buffer : buffers)
+					DrainLogBuffer(*state, *buffer);
+
+				// Without this a repeated message would only be counted when something else is logged
+				if (stop || flushRequested != state->flushCompleted)
+					FlushLogRepeats(*state);
+
+				if (!state->output.empty())
+				{
+					std::fwrite(state->output.data(), 1, state->output.size(), state->createInfo.output);
+					std::fflush(state->createInfo.output);
+					state->output.clear();
+				}
+
+				lock.lock();
+				if (flushRequested != state->flushCompleted)
+				{
+					state->flushCompleted = flushRequested;
+					state->flushed.notify_all();
+				}
+
+				if (stop)
+					return;
+			}
+		}
+
+		VKHL_INLINE VkBool32 VKAPI_CALL DebugMessengerCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT,
+			const VkDebugUtilsMessengerCallbackDataEXT* callbackData, void*)
+		{
+			const LogLevel level = severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT ? LogLevel::Error : LogLevel::Warning;
+
+			// Validation messages share one format, so rate limit them by id
+			const uint64_t key = (uint64_t(1) << 63) | static_cast<uint32_t>(callbackData->messageIdNumber);
+			PrintKeyed(level, key, "%s: %s\n", callbackData->pMessageIdName ? callbackData->pMessageIdName : "Vulkan", callbackData->pMessage);
+
+			return VK_FALSE;
+		}
+	}
+
+	VKHL_INLINE bool StartAsyncLog(const AsyncLogCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::StartAsyncLog");
+
+		static std::atomic<uint64_t> s_nextGeneration = 1;
+
+		if (detail::g_asyncLog.load(std::memory_order_acquire))
+		{
+			PrintWarning("The async log was already started\n");
+			return false;
+		}
+
+		auto state = new detail::AsyncLogState{};
+		state->createInfo = createInfo;
+		state->generation = s_nextGeneration.fetch_add(1, std::memory_order_relaxed);
+		state->previousErrorFunc = g_printErrorFunc;
+		state->previousWarningFunc = g_printWarningFunc;
+		state->thread = std::thread(detail::RunAsyncLog, state);
+
+		detail::g_asyncLog.store(state, std::memory_order_release);
+
+		// Keep messages disabled if they were
+		if (g_printErrorFunc)
+			g_printErrorFunc = detail::AsyncPrintError;
+		if (g_printWarningFunc)
+			g_printWarningFunc = detail::AsyncPrintWarning;
+
+		return true;
+	}
+
+	VKHL_INLINE void StopAsyncLog()
+	{
+		VKHL_TRACE_ZONE("vkhl::StopAsyncLog");
+
+		detail::AsyncLogState* state = detail::g_asyncLog.load(std::memory_order_acquire);
+		if (!state)
+			return;
+
+		if (g_printErrorFunc == detail::AsyncPrintError)
+			g_printErrorFunc = state->previousErrorFunc;
+		if (g_printWarningFunc == detail::AsyncPrintWarning)
+			g_printWarningFunc = state->previousWarningFunc;
+
+		{
+			std::lock_guard lock(state->mutex);
+			state->stop = true;
+		}
+		state->wake.notify_one();
+		state->thread.join();
+
+		detail::g_asyncLog.store(nullptr, std::memory_order_release);
+		delete state;
+	}
+
+	VKHL_INLINE void FlushAsyncLog()
+	{
+		VKHL_TRACE_ZONE("vkhl::FlushAsyncLog");
+
+		detail::AsyncLogState* state = detail::g_asyncLog.load(std::memory_order_acquire);
+		if (!state)
+			return;
+
+		std::unique_lock lock(state->mutex);
+		const uint64_t target = ++state->flushRequested;
+		state->wake.notify_one();
+		state->flushed.wait(lock, [state, target] { return state->flushCompleted >= target; });
+	}
+
+	VKHL_INLINE SmartResult CreateDebugMessenger(VkInstance instance, VkDebugUtilsMessengerEXT* messengerOut, VkDebugUtilsMessageSeverityFlagsEXT severities)
+	{
+		VKHL_TRACE_ZONE("vkhl::CreateDebugMessenger");
+
+		if (!g_instanceDispatch.vkCreateDebugUtilsMessengerEXT)
+		{
+			PrintError("vkCreateDebugUtilsMessengerEXT wasn't loaded, enable %s on the instance\n", VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			return VK_ERROR_EXTENSION_NOT_PRESENT;
+		}
+
+		VkDebugUtilsMessengerCreateInfoEXT createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+		createInfo.messageSeverity = severities;
+		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		createInfo.pfnUserCallback = detail::DebugMessengerCallback;
+
+		VkResult result = g_instanceDispatch.vkCreateDebugUtilsMessengerEXT(instance, &createInfo, GetAllocationCallbacks(), messengerOut);
+		if (result < 0)
+		{
+			PrintError("Failed to create debug messenger with error %s\n", string_VkResult(result));
+			return result;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void DestroyDebugMessenger(VkInstance instance, VkDebugUtilsMessengerEXT messenger)
+	{
+		VKHL_TRACE_ZONE("vkhl::DestroyDebugMessenger");
+
+		if (messenger != VK_NULL_HANDLE)
+			g_instanceDispatch.vkDestroyDebugUtilsMessengerEXT(instance, messenger, GetAllocationCallbacks());
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
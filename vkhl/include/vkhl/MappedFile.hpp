@@ -0,0 +1,173 @@
+#pragma once
+
+#ifndef VKHL_MAPPEDFILE_HPP
+#define VKHL_MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Error.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <cstdio>
+#include <string>
+#include <atomic>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Read only view of a whole file
+	struct MappedFile
+	{
+		const void* data = nullptr;
+		size_t size = 0;
+
+		// Used by MapFile
+		void* file = nullptr;
+		void* mapping = nullptr;
+	};
+
+	// Maps path into memory, returns false if the file doesn't exist, is empty or can't be mapped
+	VKHL_INLINE bool MapFile(const char* path, MappedFile* fileOut);
+	VKHL_INLINE void UnmapFile(MappedFile* file);
+
+	// Writes data to a temporary file next to path (path.<pid>.<counter>.tmp), then renames it over path,
+	// so readers either see the old file or the whole new one
+	VKHL_INLINE bool WriteFileAtomic(const char* path, const void* data, size_t size);
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE bool MapFile(const char* path, MappedFile* fileOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::MapFile");
+
+		*fileOut = {};
+
+#ifdef _WIN32
+		// FILE_SHARE_DELETE lets WriteFileAtomic rename over a file that is still mapped
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!data)
+		{
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		fileOut->file = file;
+		fileOut->mapping = mapping;
+		fileOut->size = static_cast<size_t>(size.QuadPart);
+#else
+		int file = open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat status;
+		if (fstat(file, &status) != 0 || status.st_size == 0)
+		{
+			close(file);
+			return false;
+		}
+
+		void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		close(file); // The mapping keeps the file alive
+		if (data == MAP_FAILED)
+			return false;
+
+		fileOut->size = static_cast<size_t>(status.st_size);
+#endif
+
+		fileOut->data = data;
+		return true;
+	}
+
+	VKHL_INLINE void UnmapFile(MappedFile* file)
+	{
+		VKHL_TRACE_ZONE("vkhl::UnmapFile");
+
+		if (!file->data)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(file->data);
+		CloseHandle(reinterpret_cast<HANDLE>(file->mapping));
+		CloseHandle(reinterpret_cast<HANDLE>(file->file));
+#else
+		munmap(const_cast<void*>(file->data), file->size);
+#endif
+
+		*file = {};
+	}
+
+	VKHL_INLINE bool WriteFileAtomic(const char* path, const void* data, size_t size)
+	{
+		VKHL_TRACE_ZONE("vkhl::WriteFileAtomic");
+
+		// Unique per process and per call, so concurrent writers of the same path don't write into each other's temporary file
+		static std::atomic<uint32_t> s_tempCounter = 0;
+#ifdef _WIN32
+		const unsigned long processId = GetCurrentProcessId();
+#else
+		const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+		const std::string tempPath = std::string(path) + "." + std::to_string(processId) + "." + std::to_string(s_tempCounter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+
+		std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+		if (!file)
+		{
+			PrintWarning("Failed to open %s for writing\n", tempPath.c_str());
+			return false;
+		}
+
+		bool written = std::fwrite(data, 1, size, file) == size && std::fflush(file) == 0;
+#ifndef _WIN32
+		// Make sure the data is on disk before the rename makes it visible
+		written = written && fsync(fileno(file)) == 0;
+#endif
+		std::fclose(file);
+
+		std::error_code error;
+		if (written)
+			std::filesystem::rename(tempPath, path, error);
+
+		if (!written || error)
+		{
+			PrintWarning("Failed to write %s\n", path);
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+
+		return true;
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
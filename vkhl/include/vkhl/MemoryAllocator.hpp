@@ -0,0 +1,1118 @@
+#pragma once
+
+#ifndef VKHL_MEMORYALLOCATOR_HPP
+#define VKHL_MEMORYALLOCATOR_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Common.hpp"
+#include "Dispatch.hpp"
+#include "PhysicalDevice.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+#include <bit>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Two level segregated fit allocator over an abstract range, allocation and free are O(1).
+	// Only does the bookkeeping, so it can manage any kind of memory. Not thread safe
+	class TlsfAllocator
+	{
+	public:
+		static constexpr uint32_t InvalidNode = ~0u;
+
+		TlsfAllocator() = default;
+
+		void Init(VkDeviceSize size);
+
+		// Returns false if there is no free range big enough. nodeOut identifies the allocation for Free
+		bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offsetOut, uint32_t* nodeOut);
+		void Free(uint32_t node);
+
+		VkDeviceSize GetSize() const { return m_size; }
+		VkDeviceSize GetUsed() const { return m_used; }
+		uint32_t GetAllocationCount() const { return m_allocationCount; }
+		bool IsEmpty() const { return m_allocationCount == 0; }
+
+	private:
+		static constexpr uint32_t SecondLevelLog2 = 5;
+		static constexpr uint32_t SecondLevelCount = 1 << SecondLevelLog2;
+		static constexpr uint32_t SmallSizeLog2 = 8; // Sizes below this are spread linearly over first level 0
+		static constexpr uint32_t FirstLevelCount = 64 - SmallSizeLog2 + 1;
+
+		struct Node
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			uint32_t prevPhysical;
+			uint32_t nextPhysical;
+			uint32_t prevFree;
+			uint32_t nextFree;
+			bool free;
+		};
+
+		void Mapping(VkDeviceSize size, uint32_t* firstOut, uint32_t* secondOut) const;
+		uint32_t NewNode();
+		void InsertFree(uint32_t node);
+		void RemoveFree(uint32_t node);
+
+		std::vector<Node> m_nodes;
+		std::vector<uint32_t> m_unusedNodes;
+		uint64_t m_firstLevelBitmap = 0;
+		uint32_t m_secondLevelBitmaps[FirstLevelCount] = {};
+		uint32_t m_freeHeads[FirstLevelCount][SecondLevelCount] = {};
+		VkDeviceSize m_size = 0;
+		VkDeviceSize m_used = 0;
+		uint32_t m_allocationCount = 0;
+	};
+
+	enum class MemoryResourceKind : uint8_t
+	{
+		Linear,		// Buffers and linear images
+		Optimal,	// Images with VK_IMAGE_TILING_OPTIMAL, padded to bufferImageGranularity
+	};
+
+	struct MemoryAllocationInfo
+	{
+		VkMemoryRequirements requirements;
+		VkMemoryPropertyFlags requiredFlags;
+		VkMemoryPropertyFlags preferredFlags;
+		MemoryResourceKind kind = MemoryResourceKind::Linear;
+		bool dedicated = false; // Gives the allocation its own VkDeviceMemory
+	};
+
+	struct MemoryAllocation;
+
+	// One VkDeviceMemory and the allocations made from it
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t memoryTypeIndex;
+		bool dedicated;
+		void* mappedData;
+		TlsfAllocator tlsf;
+		std::vector<MemoryAllocation*> allocations;
+	};
+
+	struct MemoryAllocation
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t memoryTypeIndex;
+		void* mappedData; // nullptr unless the memory is host visible, already offset to the allocation
+
+		// Used by MemoryAllocator
+		MemoryBlock* block;
+		VkDeviceSize alignment;
+		uint32_t node;
+		uint32_t blockSlot;
+	};
+
+	struct MemoryAllocatorCreateInfo
+	{
+		VkDeviceSize blockSize = 0;		// Size of the VkDeviceMemory blocks that get sub-allocated, 0 picks one per heap
+		bool bufferDeviceAddress = false;	// Allocates blocks with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+	};
+
+	// Describes one allocation that BeginDefragmentation wants moved.
+	// Copy size bytes from src to dst (recreating and rebinding the resource), then pass the moves to EndDefragmentation
+	struct DefragmentationMove
+	{
+		MemoryAllocation* allocation;
+		VkDeviceMemory srcMemory;
+		VkDeviceSize srcOffset;
+		VkDeviceMemory dstMemory;
+		VkDeviceSize dstOffset;
+		VkDeviceSize size;
+
+		// Used by MemoryAllocator
+		MemoryBlock* dstBlock;
+		uint32_t dstNode;
+	};
+
+	struct MemoryHeapUsage
+	{
+		VkDeviceSize blockBytes;		// Bytes of VkDeviceMemory allocated from the heap
+		VkDeviceSize allocationBytes;	// Bytes handed out from those blocks
+	};
+
+	// Sub-allocates resources out of large VkDeviceMemory blocks, one set of blocks per memory type.
+	// Thread safe, each memory type has its own lock
+	class MemoryAllocator
+	{
+	public:
+		MemoryAllocator() = default;
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+		~MemoryAllocator() { Destroy(); }
+
+		// physicalDeviceInfo must come from SelectPhyicalDevice for the device that dispatch belongs to
+		SmartResult Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const MemoryAllocatorCreateInfo& createInfo = {});
+		// Frees every block, all allocations must be freed first
+		void Destroy();
+
+		// Returns the memory type with all of requiredFlags and as many of preferredFlags as possible, or ~0u if there is none
+		uint32_t FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags = 0) const;
+
+		// Fails with VK_ERROR_FEATURE_NOT_PRESENT if no memory type is compatible, and with an out of memory error if all of them are full
+		SmartResult Allocate(const MemoryAllocationInfo& allocationInfo, MemoryAllocation** allocationOut);
+		void Free(MemoryAllocation* allocation);
+
+		// Creates a buffer, allocates memory for it and binds it
+		SmartResult CreateBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkBuffer* bufferOut, MemoryAllocation** allocationOut);
+		void DestroyBuffer(VkBuffer buffer, MemoryAllocation* allocation);
+
+		// Creates an image, allocates memory for it and binds it
+		SmartResult CreateImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkImage* imageOut, MemoryAllocation** allocationOut);
+		void DestroyImage(VkImage image, MemoryAllocation* allocation);
+
+		// Flushes/invalidates the mapped range of a non coherent allocation, does nothing for coherent memory
+		SmartResult Flush(const MemoryAllocation* allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		SmartResult Invalidate(const MemoryAllocation* allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+		// Plans up to maxMoves moves out of the emptiest blocks of each memory type, so those blocks can be freed.
+		// Destination space is reserved until EndDefragmentation, the allocations being moved must not be freed in between
+		SmartResult BeginDefragmentation(uint32_t maxMoves, std::vector<DefragmentationMove>* movesOut);
+		// Applies the moves if applied is true, otherwise releases the reserved space
+		void EndDefragmentation(std::span<DefragmentationMove> moves, bool applied = true);
+
+		MemoryHeapUsage GetHeapUsage(uint32_t heapIndex) const;
+
+		const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return m_memoryProperties; }
+		const DeviceDispatch& GetDispatch() const { return *m_dispatch; }
+
+	private:
+		struct MemoryType
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<MemoryBlock>> blocks;
+		};
+
+		SmartResult AllocateFromType(uint32_t memoryTypeIndex, const MemoryAllocationInfo& allocationInfo, VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation** allocationOut);
+		SmartResult AllocateBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated, MemoryBlock** blockOut);
+		void FreeBlock(MemoryBlock* block);
+		void AttachAllocation(MemoryBlock* block, MemoryAllocation* allocation);
+		void DetachAllocation(MemoryAllocation* allocation);
+		VkMappedMemoryRange GetMappedRange(const MemoryAllocation* allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+		VkDeviceSize m_bufferImageGranularity = 1;
+		VkDeviceSize m_nonCoherentAtomSize = 1;
+		uint32_t m_maxMemoryAllocationCount = 0;
+		VkDeviceSize m_blockSizes[VK_MAX_MEMORY_HEAPS] = {};
+		bool m_bufferDeviceAddress = false;
+
+		std::unique_ptr<MemoryType[]> m_types;
+		mutable std::mutex m_usageMutex;
+		uint32_t m_deviceMemoryCount = 0;
+		MemoryHeapUsage m_heapUsage[VK_MAX_MEMORY_HEAPS] = {};
+	};
+
+	// One buffer with bump allocation, for per-frame data.
+	// Call Reset to use it as a linear allocator, or CloseEpoch/Retire to use it as a ring:
+	// everything allocated before CloseEpoch(value) is released by Retire(value) or any later value. Not thread safe
+	class LinearMemoryPool
+	{
+	public:
+		LinearMemoryPool() = default;
+		LinearMemoryPool(const LinearMemoryPool&) = delete;
+		LinearMemoryPool& operator=(const LinearMemoryPool&) = delete;
+		~LinearMemoryPool() { Destroy(); }
+
+		SmartResult Init(MemoryAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags = 0);
+		void Destroy();
+
+		// Returns false if the pool is full. mappedOut gets the host pointer if the memory is host visible
+		bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offsetOut, void** mappedOut = nullptr);
+
+		void Reset();
+		void CloseEpoch(uint64_t value);
+		void Retire(uint64_t completedValue);
+
+		VkBuffer GetBuffer() const { return m_buffer; }
+		const MemoryAllocation* GetAllocation() const { return m_allocation; }
+		VkDeviceSize GetSize() const { return m_size; }
+		VkDeviceSize GetUsed() const { return m_used; }
+
+	private:
+		struct Epoch
+		{
+			uint64_t value;
+			VkDeviceSize bytes;
+		};
+
+		MemoryAllocator* m_allocator = nullptr;
+		VkBuffer m_buffer = VK_NULL_HANDLE;
+		MemoryAllocation* m_allocation = nullptr;
+		VkDeviceSize m_size = 0;
+		VkDeviceSize m_head = 0;
+		VkDeviceSize m_used = 0;
+		VkDeviceSize m_openBytes = 0; // Bytes allocated since the last CloseEpoch
+		std::deque<Epoch> m_epochs;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// ----- TlsfAllocator -----
+
+	VKHL_INLINE void TlsfAllocator::Init(VkDeviceSize size)
+	{
+		m_nodes.clear();
+		m_unusedNodes.clear();
+		m_firstLevelBitmap = 0;
+		std::fill(std::begin(m_secondLevelBitmaps), std::end(m_secondLevelBitmaps), 0u);
+		for (auto& heads : m_freeHeads)
+			std::fill(std::begin(heads), std::end(heads), InvalidNode);
+		m_size = size;
+		m_used = 0;
+		m_allocationCount = 0;
+
+		// Start with a single free node covering everything
+		const uint32_t node = NewNode();
+		m_nodes[node] = { 0, size, InvalidNode, InvalidNode, InvalidNode, InvalidNode, true };
+		InsertFree(node);
+	}
+
+	VKHL_INLINE void TlsfAllocator::Mapping(VkDeviceSize size, uint32_t* firstOut, uint32_t* secondOut) const
+	{
+		if (size < (VkDeviceSize{ 1 } << SmallSizeLog2))
+		{
+			*firstOut = 0;
+			*secondOut = static_cast<uint32_t>(size >> (SmallSizeLog2 - SecondLevelLog2));
+			return;
+		}
+
+		const uint32_t log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+		*firstOut = log2 - SmallSizeLog2 + 1;
+		*secondOut = static_cast<uint32_t>(size >> (log2 - SecondLevelLog2)) ^ SecondLevelCount;
+	}
+
+	VKHL_INLINE uint32_t TlsfAllocator::NewNode()
+	{
+		if (!m_unusedNodes.empty())
+		{
+			const uint32_t node = m_unusedNodes.back();
+			m_unusedNodes.pop_back();
+			return node;
+		}
+
+		m_nodes.emplace_back();
+		return static_cast<uint32_t>(m_nodes.size() - 1);
+	}
+
+	VKHL_INLINE void TlsfAllocator::InsertFree(uint32_t node)
+	{
+		uint32_t first, second;
+		Mapping(m_nodes[node].size, &first, &second);
+
+		const uint32_t head = m_freeHeads[first][second];
+		m_nodes[node].free = true;
+		m_nodes[node].prevFree = InvalidNode;
+		m_nodes[node].nextFree = head;
+		if (head != InvalidNode)
+			m_nodes[head].prevFree = node;
+
+		m_freeHeads[first][second] = node;
+		m_firstLevelBitmap |= uint64_t{ 1 } << first;
+		m_secondLevelBitmaps[first] |= 1u << second;
+	}
+
+	VKHL_INLINE void TlsfAllocator::RemoveFree(uint32_t node)
+	{
+		uint32_t first, second;
+		Mapping(m_nodes[node].size, &first, &second);
+
+		const Node& freeNode = m_nodes[node];
+		if (freeNode.prevFree != InvalidNode)
+			m_nodes[freeNode.prevFree].nextFree = freeNode.nextFree;
+		else
+			m_freeHeads[first][second] = freeNode.nextFree;
+
+		if (freeNode.nextFree != InvalidNode)
+			m_nodes[freeNode.nextFree].prevFree = freeNode.prevFree;
+
+		if (m_freeHeads[first][second] == InvalidNode)
+		{
+			m_secondLevelBitmaps[first] &= ~(1u << second);
+			if (m_secondLevelBitmaps[first] == 0)
+				m_firstLevelBitmap &= ~(uint64_t{ 1 } << first);
+		}
+
+		m_nodes[node].free = false;
+	}
+
+	VKHL_INLINE bool TlsfAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offsetOut, uint32_t* nodeOut)
+	{
+		if (size == 0 || size > m_size)
+			return false;
+		if (alignment == 0)
+			alignment = 1;
+
+		// Search for a size that any node in the list can hold, including worst case alignment padding.
+		// Rounded up to the next list, so the list found never has nodes that are too small
+		VkDeviceSize searchSize = size + alignment - 1;
+		if (searchSize < (VkDeviceSize{ 1 } << SmallSizeLog2))
+			searchSize += (VkDeviceSize{ 1 } << (SmallSizeLog2 - SecondLevelLog2)) - 1;
+		else
+			searchSize += (VkDeviceSize{ 1 } << (std::bit_width(searchSize) - 1 - SecondLevelLog2)) - 1;
+
+		uint32_t node = InvalidNode;
+		uint32_t first, second;
+		Mapping(searchSize, &first, &second);
+		if (first < FirstLevelCount)
+		{
+			// Find the first non empty list at or above (first, second)
+			uint32_t secondBitmap = m_secondLevelBitmaps[first] & (~0u << second);
+			if (secondBitmap == 0)
+			{
+				const uint64_t firstBitmap = (first + 1 < 64) ? (m_firstLevelBitmap & (~uint64_t{ 0 } << (first + 1))) : 0;
+				if (firstBitmap != 0)
+				{
+					first = static_cast<uint32_t>(std::countr_zero(firstBitmap));
+					secondBitmap = m_secondLevelBitmaps[first];
+				}
+			}
+			if (secondBitmap != 0)
+				node = m_freeHeads[first][static_cast<uint32_t>(std::countr_zero(secondBitmap))];
+		}
+
+		// The rounded search skips the list the size itself maps to, which can still hold a node that fits,
+		// e.g. a single free node covering the whole range. Walk that list before giving up
+		if (node == InvalidNode)
+		{
+			Mapping(size, &first, &second);
+			for (uint32_t candidate = m_freeHeads[first][second]; candidate != InvalidNode; candidate = m_nodes[candidate].nextFree)
+			{
+				const VkDeviceSize candidateOffset = (m_nodes[candidate].offset + alignment - 1) / alignment * alignment;
+				if (candidateOffset + size <= m_nodes[candidate].offset + m_nodes[candidate].size)
+				{
+					node = candidate;
+					break;
+				}
+			}
+			if (node == InvalidNode)
+				return false;
+		}
+
+		RemoveFree(node);
+
+		// Split off the alignment padding in front
+		const VkDeviceSize alignedOffset = (m_nodes[node].offset + alignment - 1) / alignment * alignment;
+		const VkDeviceSize padding = alignedOffset - m_nodes[node].offset;
+		if (padding > 0)
+		{
+			const uint32_t paddingNode = NewNode();
+			m_nodes[paddingNode] = { m_nodes[node].offset, padding, m_nodes[node].prevPhysical, node, InvalidNode, InvalidNode, true };
+			if (m_nodes[node].prevPhysical != InvalidNode)
+				m_nodes[m_nodes[node].prevPhysical].nextPhysical = paddingNode;
+
+			m_nodes[node].prevPhysical = paddingNode;
+			m_nodes[node].offset = alignedOffset;
+			m_nodes[node].size -= padding;
+			InsertFree(paddingNode);
+		}
+
+		// Split off the rest
+		if (m_nodes[node].size > size)
+		{
+			const uint32_t restNode = NewNode();
+			m_nodes[restNode] = { alignedOffset + size, m_nodes[node].size - size, node, m_nodes[node].nextPhysical, InvalidNode, InvalidNode, true };
+			if (m_nodes[node].nextPhysical != InvalidNode)
+				m_nodes[m_nodes[node].nextPhysical].prevPhysical = restNode;
+
+			m_nodes[node].nextPhysical = restNode;
+			m_nodes[node].size = size;
+			InsertFree(restNode);
+		}
+
+		m_used += size;
+		m_allocationCount++;
+
+		*offsetOut = alignedOffset;
+		*nodeOut = node;
+		return true;
+	}
+
+	VKHL_INLINE void TlsfAllocator::Free(uint32_t node)
+	{
+		m_used -= m_nodes[node].size;
+		m_allocationCount--;
+
+		// Merge with the previous node
+		const uint32_t prev = m_nodes[node].prevPhysical;
+		if (prev != InvalidNode && m_nodes[prev].free)
+		{
+			RemoveFree(prev);
+			m_nodes[node].offset = m_nodes[prev].offset;
+			m_nodes[node].size += m_nodes[prev].size;
+			m_nodes[node].prevPhysical = m_nodes[prev].prevPhysical;
+			if (m_nodes[node].prevPhysical != InvalidNode)
+				m_nodes[m_nodes[node].prevPhysical].nextPhysical = node;
+			m_unusedNodes.push_back(prev);
+		}
+
+		// Merge with the next node
+		const uint32_t next = m_nodes[node].nextPhysical;
+		if (next != InvalidNode && m_nodes[next].free)
+		{
+			RemoveFree(next);
+			m_nodes[node].size += m_nodes[next].size;
+			m_nodes[node].nextPhysical = m_nodes[next].nextPhysical;
+			if (m_nodes[node].nextPhysical != InvalidNode)
+				m_nodes[m_nodes[node].nextPhysical].prevPhysical = node;
+			m_unusedNodes.push_back(next);
+		}
+
+		InsertFree(node);
+	}
+
+	// ----- MemoryAllocator -----
+
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	VKHL_INLINE SmartResult MemoryAllocator::Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const MemoryAllocatorCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::Init");
+
+		m_dispatch = &dispatch;
+		m_memoryProperties = physicalDeviceInfo.memoryProperties;
+		m_bufferImageGranularity = std::max<VkDeviceSize>(physicalDeviceInfo.properties.limits.bufferImageGranularity, 1);
+		m_nonCoherentAtomSize = std::max<VkDeviceSize>(physicalDeviceInfo.properties.limits.nonCoherentAtomSize, 1);
+		m_maxMemoryAllocationCount = physicalDeviceInfo.properties.limits.maxMemoryAllocationCount;
+		m_bufferDeviceAddress = createInfo.bufferDeviceAddress;
+		m_types = std::make_unique<MemoryType[]>(m_memoryProperties.memoryTypeCount);
+
+		// Default to 256MiB blocks, but keep small heaps from being taken up by a couple of blocks
+		for (uint32_t heap = 0; heap < m_memoryProperties.memoryHeapCount; heap++)
+		{
+			if (createInfo.blockSize != 0)
+				m_blockSizes[heap] = createInfo.blockSize;
+			else
+				m_blockSizes[heap] = std::min<VkDeviceSize>(VkDeviceSize{ 256 } << 20, std::bit_floor(m_memoryProperties.memoryHeaps[heap].size / 8));
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void MemoryAllocator::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::Destroy");
+
+		if (!m_types)
+			return;
+
+		for (uint32_t type = 0; type < m_memoryProperties.memoryTypeCount; type++)
+		{
+			for (auto& block : m_types[type].blocks)
+			{
+				if (!block->allocations.empty())
+					PrintWarning("Destroying memory allocator with %u live allocations\n", static_cast<uint32_t>(block->allocations.size()));
+				FreeBlock(block.get());
+			}
+		}
+
+		m_types.reset();
+	}
+
+	VKHL_INLINE uint32_t MemoryAllocator::FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags) const
+	{
+		uint32_t bestType = ~0u;
+		int bestScore = -1;
+
+		for (uint32_t type = 0; type < m_memoryProperties.memoryTypeCount; type++)
+		{
+			const VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[type].propertyFlags;
+			if (!(memoryTypeBits & (1u << type)) || (flags & requiredFlags) != requiredFlags)
+				continue;
+
+			// Preferred flags matter most, then fewer flags nobody asked for
+			const int score = std::popcount(flags & preferredFlags) * 32 - std::popcount(flags & ~(requiredFlags | preferredFlags));
+			if (score > bestScore)
+			{
+				bestScore = score;
+				bestType = type;
+			}
+		}
+
+		return bestType;
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::Allocate(const MemoryAllocationInfo& allocationInfo, MemoryAllocation** allocationOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::Allocate");
+
+		VkDeviceSize size = allocationInfo.requirements.size;
+		VkDeviceSize alignment = std::max<VkDeviceSize>(allocationInfo.requirements.alignment, 1);
+
+		// Giving optimal images whole granularity pages keeps them from sharing a page with linear resources
+		if (allocationInfo.kind == MemoryResourceKind::Optimal && m_bufferImageGranularity > 1)
+		{
+			alignment = std::max(alignment, m_bufferImageGranularity);
+			size = (size + m_bufferImageGranularity - 1) / m_bufferImageGranularity * m_bufferImageGranularity;
+		}
+
+		// Try the best memory type first, then fall back to the other compatible ones if it is out of memory
+		uint32_t memoryTypeBits = allocationInfo.requirements.memoryTypeBits;
+		uint32_t memoryTypeIndex = FindMemoryType(memoryTypeBits, allocationInfo.requiredFlags, allocationInfo.preferredFlags);
+		if (memoryTypeIndex == ~0u)
+		{
+			PrintError("No memory type matches memory type bits 0x%x with the required property flags 0x%x\n", memoryTypeBits, allocationInfo.requiredFlags);
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		for (; memoryTypeIndex != ~0u; memoryTypeIndex = FindMemoryType(memoryTypeBits, allocationInfo.requiredFlags, allocationInfo.preferredFlags))
+		{
+			result = AllocateFromType(memoryTypeIndex, allocationInfo, size, alignment, allocationOut).GetAndReset();
+			if (result != VK_ERROR_OUT_OF_DEVICE_MEMORY && result != VK_ERROR_OUT_OF_HOST_MEMORY)
+				return result;
+
+			memoryTypeBits &= ~(1u << memoryTypeIndex);
+		}
+
+		PrintError("Failed to allocate %llu bytes of device memory with error %s\n", static_cast<unsigned long long>(size), string_VkResult(result));
+		return result;
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::AllocateFromType(uint32_t memoryTypeIndex, const MemoryAllocationInfo& allocationInfo, VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation** allocationOut)
+	{
+		VkResult result = VK_SUCCESS;
+		MemoryType& type = m_types[memoryTypeIndex];
+		const VkDeviceSize blockSize = m_blockSizes[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+
+		auto allocation = std::make_unique<MemoryAllocation>();
+		allocation->memoryTypeIndex = memoryTypeIndex;
+		allocation->size = size;
+		allocation->alignment = alignment;
+
+		// Anything bigger than half a block wastes too much of it, give it its own memory
+		if (allocationInfo.dedicated || size > blockSize / 2)
+		{
+			MemoryBlock* block;
+			result = AllocateBlock(memoryTypeIndex, size, true, &block).GetAndReset();
+			if (result < 0)
+				return result;
+
+			// A fresh block always fits the whole allocation
+			[[maybe_unused]] const bool allocated = block->tlsf.Allocate(size, 1, &allocation->offset, &allocation->node);
+			assert(allocated);
+
+			std::lock_guard lock(type.mutex);
+			type.blocks.emplace_back(block);
+			AttachAllocation(block, allocation.get());
+			*allocationOut = allocation.release();
+			return VK_SUCCESS;
+		}
+
+		std::lock_guard lock(type.mutex);
+
+		// Newest blocks are at the back, older blocks tend to be fuller so search from the front
+		for (auto& block : type.blocks)
+		{
+			if (block->dedicated || block->size - block->tlsf.GetUsed() < size)
+				continue;
+
+			if (block->tlsf.Allocate(size, alignment, &allocation->offset, &allocation->node))
+			{
+				AttachAllocation(block.get(), allocation.get());
+				*allocationOut = allocation.release();
+				return VK_SUCCESS;
+			}
+		}
+
+		MemoryBlock* block;
+		result = AllocateBlock(memoryTypeIndex, blockSize, false, &block).GetAndReset();
+		if (result < 0)
+			return result;
+
+		type.blocks.emplace_back(block);
+		[[maybe_unused]] const bool allocated = block->tlsf.Allocate(size, alignment, &allocation->offset, &allocation->node);
+		assert(allocated);
+		AttachAllocation(block, allocation.get());
+		*allocationOut = allocation.release();
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::AllocateBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated, MemoryBlock** blockOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::AllocateBlock");
+
+		VkResult result = VK_SUCCESS;
+
+		{
+			std::lock_guard lock(m_usageMutex);
+			if (m_maxMemoryAllocationCount != 0 && m_deviceMemoryCount >= m_maxMemoryAllocationCount)
+			{
+				PrintError("Reached maxMemoryAllocationCount (%u)\n", m_maxMemoryAllocationCount);
+				return VK_ERROR_TOO_MANY_OBJECTS;
+			}
+		}
+
+		VkMemoryAllocateFlagsInfo flagsInfo{};
+		flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+		flagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+
+		VkMemoryAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.pNext = m_bufferDeviceAddress ? &flagsInfo : nullptr;
+		allocateInfo.allocationSize = size;
+		allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+		VkDeviceMemory memory;
+		result = m_dispatch->vkAllocateMemory(m_dispatch->device, &allocateInfo, GetAllocationCallbacks(), &memory);
+		if (result < 0)
+			return result; // The caller may retry with another memory type, so don't print here
+
+		void* mappedData = nullptr;
+		if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			result = m_dispatch->vkMapMemory(m_dispatch->device, memory, 0, VK_WHOLE_SIZE, 0, &mappedData);
+			if (result < 0)
+			{
+				PrintError("Failed to map device memory with error %s\n", string_VkResult(result));
+				m_dispatch->vkFreeMemory(m_dispatch->device, memory, GetAllocationCallbacks());
+				return result;
+			}
+		}
+
+		auto block = new MemoryBlock{ memory, size, memoryTypeIndex, dedicated, mappedData, {}, {} };
+		block->tlsf.Init(size);
+
+		{
+			std::lock_guard lock(m_usageMutex);
+			m_deviceMemoryCount++;
+			m_heapUsage[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].blockBytes += size;
+		}
+
+		*blockOut = block;
+		return VK_SUCCESS;
+	}
+
+	// Frees the VkDeviceMemory, the caller removes the block from its memory type
+	VKHL_INLINE void MemoryAllocator::FreeBlock(MemoryBlock* block)
+	{
+		if (block->mappedData)
+			m_dispatch->vkUnmapMemory(m_dispatch->device, block->memory);
+		m_dispatch->vkFreeMemory(m_dispatch->device, block->memory, GetAllocationCallbacks());
+
+		std::lock_guard lock(m_usageMutex);
+		m_deviceMemoryCount--;
+		m_heapUsage[m_memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex].blockBytes -= block->size;
+	}
+
+	VKHL_INLINE void MemoryAllocator::AttachAllocation(MemoryBlock* block, MemoryAllocation* allocation)
+	{
+		allocation->block = block;
+		allocation->memory = block->memory;
+		allocation->memoryTypeIndex = block->memoryTypeIndex;
+		allocation->mappedData = block->mappedData ? static_cast<uint8_t*>(block->mappedData) + allocation->offset : nullptr;
+		allocation->blockSlot = static_cast<uint32_t>(block->allocations.size());
+		block->allocations.push_back(allocation);
+
+		std::lock_guard lock(m_usageMutex);
+		m_heapUsage[m_memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex].allocationBytes += allocation->size;
+	}
+
+	VKHL_INLINE void MemoryAllocator::DetachAllocation(MemoryAllocation* allocation)
+	{
+		MemoryBlock* block = allocation->block;
+		block->tlsf.Free(allocation->node);
+
+		// Swap remove
+		MemoryAllocation* last = block->allocations.back();
+		block->allocations[allocation->blockSlot] = last;
+		last->blockSlot = allocation->blockSlot;
+		block->allocations.pop_back();
+
+		std::lock_guard lock(m_usageMutex);
+		m_heapUsage[m_memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex].allocationBytes -= allocation->size;
+	}
+
+	VKHL_INLINE void MemoryAllocator::Free(MemoryAllocation* allocation)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::Free");
+
+		if (!allocation)
+			return;
+
+		MemoryType& type = m_types[allocation->memoryTypeIndex];
+		std::lock_guard lock(type.mutex);
+
+		MemoryBlock* block = allocation->block;
+		DetachAllocation(allocation);
+		delete allocation;
+
+		if (!block->tlsf.IsEmpty())
+			return;
+
+		// Keep one empty block around so allocating and freeing in a loop doesn't hit the driver every time
+		const bool keep = !block->dedicated && std::count_if(type.blocks.begin(), type.blocks.end(), [](const auto& other) {
+			return !other->dedicated && other->tlsf.IsEmpty();
+		}) == 1;
+
+		if (keep)
+			return;
+
+		FreeBlock(block);
+		type.blocks.erase(std::find_if(type.blocks.begin(), type.blocks.end(), [block](const auto& other) { return other.get() == block; }));
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::CreateBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkBuffer* bufferOut, MemoryAllocation** allocationOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::CreateBuffer");
+
+		VkResult result = VK_SUCCESS;
+		CHECK_VK_CALL(m_dispatch->vkCreateBuffer(m_dispatch->device, &bufferInfo, GetAllocationCallbacks(), bufferOut),
+			"Failed to create buffer with error %s\n");
+
+		MemoryAllocationInfo allocationInfo{};
+		m_dispatch->vkGetBufferMemoryRequirements(m_dispatch->device, *bufferOut, &allocationInfo.requirements);
+		allocationInfo.requiredFlags = requiredFlags;
+		allocationInfo.preferredFlags = preferredFlags;
+
+		result = Allocate(allocationInfo, allocationOut).GetAndReset();
+		if (result < 0)
+		{
+			m_dispatch->vkDestroyBuffer(m_dispatch->device, *bufferOut, GetAllocationCallbacks());
+			return result;
+		}
+
+		result = m_dispatch->vkBindBufferMemory(m_dispatch->device, *bufferOut, (*allocationOut)->memory, (*allocationOut)->offset);
+		if (result < 0)
+		{
+			PrintError("Failed to bind buffer memory with error %s\n", string_VkResult(result));
+			DestroyBuffer(*bufferOut, *allocationOut);
+			return result;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void MemoryAllocator::DestroyBuffer(VkBuffer buffer, MemoryAllocation* allocation)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::DestroyBuffer");
+
+		m_dispatch->vkDestroyBuffer(m_dispatch->device, buffer, GetAllocationCallbacks());
+		Free(allocation);
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::CreateImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkImage* imageOut, MemoryAllocation** allocationOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::CreateImage");
+
+		VkResult result = VK_SUCCESS;
+		CHECK_VK_CALL(m_dispatch->vkCreateImage(m_dispatch->device, &imageInfo, GetAllocationCallbacks(), imageOut),
+			"Failed to create image with error %s\n");
+
+		MemoryAllocationInfo allocationInfo{};
+		m_dispatch->vkGetImageMemoryRequirements(m_dispatch->device, *imageOut, &allocationInfo.requirements);
+		allocationInfo.requiredFlags = requiredFlags;
+		allocationInfo.preferredFlags = preferredFlags;
+		allocationInfo.kind = (imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL) ? MemoryResourceKind::Optimal : MemoryResourceKind::Linear;
+
+		result = Allocate(allocationInfo, allocationOut).GetAndReset();
+		if (result < 0)
+		{
+			m_dispatch->vkDestroyImage(m_dispatch->device, *imageOut, GetAllocationCallbacks());
+			return result;
+		}
+
+		result = m_dispatch->vkBindImageMemory(m_dispatch->device, *imageOut, (*allocationOut)->memory, (*allocationOut)->offset);
+		if (result < 0)
+		{
+			PrintError("Failed to bind image memory with error %s\n", string_VkResult(result));
+			DestroyImage(*imageOut, *allocationOut);
+			return result;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void MemoryAllocator::DestroyImage(VkImage image, MemoryAllocation* allocation)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::DestroyImage");
+
+		m_dispatch->vkDestroyImage(m_dispatch->device, image, GetAllocationCallbacks());
+		Free(allocation);
+	}
+
+	VKHL_INLINE VkMappedMemoryRange MemoryAllocator::GetMappedRange(const MemoryAllocation* allocation, VkDeviceSize offset, VkDeviceSize size) const
+	{
+		if (size == VK_WHOLE_SIZE)
+			size = allocation->size - offset;
+
+		// Ranges must be aligned to nonCoherentAtomSize, and may not go past the end of the memory
+		VkDeviceSize begin = (allocation->offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+		VkDeviceSize end = (allocation->offset + offset + size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+		end = std::min(end, allocation->block->size);
+
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation->memory;
+		range.offset = begin;
+		range.size = (end == allocation->block->size) ? VK_WHOLE_SIZE : end - begin;
+		return range;
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::Flush(const MemoryAllocation* allocation, VkDeviceSize offset, VkDeviceSize size)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::Flush");
+
+		if (m_memoryProperties.memoryTypes[allocation->memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+			return VK_SUCCESS;
+
+		VkResult result = VK_SUCCESS;
+		const VkMappedMemoryRange range = GetMappedRange(allocation, offset, size);
+		CHECK_VK_CALL(m_dispatch->vkFlushMappedMemoryRanges(m_dispatch->device, 1, &range),
+			"Failed to flush mapped memory with error %s\n");
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::Invalidate(const MemoryAllocation* allocation, VkDeviceSize offset, VkDeviceSize size)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::Invalidate");
+
+		if (m_memoryProperties.memoryTypes[allocation->memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+			return VK_SUCCESS;
+
+		VkResult result = VK_SUCCESS;
+		const VkMappedMemoryRange range = GetMappedRange(allocation, offset, size);
+		CHECK_VK_CALL(m_dispatch->vkInvalidateMappedMemoryRanges(m_dispatch->device, 1, &range),
+			"Failed to invalidate mapped memory with error %s\n");
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult MemoryAllocator::BeginDefragmentation(uint32_t maxMoves, std::vector<DefragmentationMove>* movesOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::BeginDefragmentation");
+
+		movesOut->clear();
+
+		for (uint32_t typeIndex = 0; typeIndex < m_memoryProperties.memoryTypeCount && movesOut->size() < maxMoves; typeIndex++)
+		{
+			MemoryType& type = m_types[typeIndex];
+			std::lock_guard lock(type.mutex);
+
+			std::vector<MemoryBlock*> blocks;
+			for (auto& block : type.blocks)
+			{
+				if (!block->dedicated)
+					blocks.push_back(block.get());
+			}
+			if (blocks.size() < 2)
+				continue;
+
+			// Empty the least used blocks into the most used ones
+			std::sort(blocks.begin(), blocks.end(), [](const MemoryBlock* a, const MemoryBlock* b) {
+				return a->tlsf.GetUsed() < b->tlsf.GetUsed();
+			});
+
+			// Blocks that received moves can't be sources anymore, their reserved space would keep them alive
+			size_t lowestDst = blocks.size();
+			for (size_t srcIndex = 0; srcIndex < lowestDst && movesOut->size() < maxMoves; srcIndex++)
+			{
+				MemoryBlock* src = blocks[srcIndex];
+				bool emptied = true;
+
+				for (MemoryAllocation* allocation : src->allocations)
+				{
+					if (movesOut->size() >= maxMoves)
+					{
+						emptied = false;
+						break;
+					}
+
+					bool placed = false;
+					for (size_t dstIndex = blocks.size(); dstIndex-- > srcIndex + 1;)
+					{
+						MemoryBlock* dst = blocks[dstIndex];
+						DefragmentationMove move{};
+						if (dst->tlsf.Allocate(allocation->size, allocation->alignment, &move.dstOffset, &move.dstNode))
+						{
+							move.allocation = allocation;
+							move.srcMemory = allocation->memory;
+							move.srcOffset = allocation->offset;
+							move.dstMemory = dst->memory;
+							move.size = allocation->size;
+							move.dstBlock = dst;
+							movesOut->push_back(move);
+							lowestDst = std::min(lowestDst, dstIndex);
+							placed = true;
+							break;
+						}
+					}
+
+					if (!placed)
+						emptied = false;
+				}
+
+				// A block that couldn't be emptied becomes a destination instead of a source
+				if (!emptied)
+					break;
+			}
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void MemoryAllocator::EndDefragmentation(std::span<DefragmentationMove> moves, bool applied)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryAllocator::EndDefragmentation");
+
+		for (auto& move : moves)
+		{
+			MemoryAllocation* allocation = move.allocation;
+			MemoryType& type = m_types[allocation->memoryTypeIndex];
+
+			if (!applied)
+			{
+				std::lock_guard lock(type.mutex);
+				move.dstBlock->tlsf.Free(move.dstNode);
+				continue;
+			}
+
+			std::unique_ptr<MemoryBlock> srcBlock;
+			{
+				std::lock_guard lock(type.mutex);
+				MemoryBlock* block = allocation->block;
+				DetachAllocation(allocation);
+
+				allocation->offset = move.dstOffset;
+				allocation->node = move.dstNode;
+				AttachAllocation(move.dstBlock, allocation);
+
+				if (!block->tlsf.IsEmpty())
+					continue;
+
+				auto it = std::find_if(type.blocks.begin(), type.blocks.end(), [block](const auto& other) { return other.get() == block; });
+				srcBlock = std::move(*it);
+				type.blocks.erase(it);
+			}
+
+			FreeBlock(srcBlock.get());
+		}
+	}
+
+	VKHL_INLINE MemoryHeapUsage MemoryAllocator::GetHeapUsage(uint32_t heapIndex) const
+	{
+		std::lock_guard lock(m_usageMutex);
+		return m_heapUsage[heapIndex];
+	}
+
+	// ----- LinearMemoryPool -----
+
+	VKHL_INLINE SmartResult LinearMemoryPool::Init(MemoryAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags)
+	{
+		VKHL_TRACE_ZONE("vkhl::LinearMemoryPool::Init");
+
+		m_allocator = &allocator;
+		m_size = size;
+		Reset();
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		return allocator.CreateBuffer(bufferInfo, requiredFlags, preferredFlags, &m_buffer, &m_allocation);
+	}
+
+	VKHL_INLINE void LinearMemoryPool::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::LinearMemoryPool::Destroy");
+
+		if (m_allocator && m_buffer)
+			m_allocator->DestroyBuffer(m_buffer, m_allocation);
+
+		m_buffer = VK_NULL_HANDLE;
+		m_allocation = nullptr;
+	}
+
+	VKHL_INLINE bool LinearMemoryPool::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offsetOut, void** mappedOut)
+	{
+		if (alignment == 0)
+			alignment = 1;
+
+		VkDeviceSize offset = (m_head + alignment - 1) / alignment * alignment;
+		VkDeviceSize consumed = offset + size - m_head;
+
+		// Wrap around, the end of the buffer is wasted until the epoch it belongs to retires
+		if (offset + size > m_size)
+		{
+			offset = 0;
+			consumed = (m_size - m_head) + size;
+		}
+
+		// The free space is always the contiguous range starting at m_head
+		if (m_used + consumed > m_size)
+			return false;
+
+		m_head = offset + size;
+		m_used += consumed;
+		m_openBytes += consumed;
+
+		*offsetOut = offset;
+		if (mappedOut)
+			*mappedOut = m_allocation->mappedData ? static_cast<uint8_t*>(m_allocation->mappedData) + offset : nullptr;
+		return true;
+	}
+
+	VKHL_INLINE void LinearMemoryPool::Reset()
+	{
+		m_head = 0;
+		m_used = 0;
+		m_openBytes = 0;
+		m_epochs.clear();
+	}
+
+	VKHL_INLINE void LinearMemoryPool::CloseEpoch(uint64_t value)
+	{
+		m_epochs.push_back({ value, m_openBytes });
+		m_openBytes = 0;
+	}
+
+	VKHL_INLINE void LinearMemoryPool::Retire(uint64_t completedValue)
+	{
+		while (!m_epochs.empty() && m_epochs.front().value <= completedValue)
+		{
+			m_used -= m_epochs.front().bytes;
+			m_epochs.pop_front();
+		}
+
+		// Nothing is live anymore, start from the beginning again so allocations don't have to wrap
+		if (m_used == 0)
+			m_head = 0;
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -0,0 +1,305 @@
+#pragma once
+
+#ifndef VKHL_MEMORYBUDGET_HPP
+#define VKHL_MEMORYBUDGET_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <condition_variable>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Device.hpp"
+#include "MemoryAllocator.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <algorithm>
+#include <chrono>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	enum class MemoryPressure : uint8_t
+	{
+		Normal,
+		Elevated,	// Past MemoryBudgetCreateInfo::elevatedThreshold, a good time to stop prefetching
+		High,		// Past highThreshold, evict what isn't needed
+		Critical,	// Past criticalThreshold, the driver is about to page or fail allocations
+	};
+
+	struct MemoryHeapBudget
+	{
+		VkDeviceSize usage;		// Bytes this process uses from the heap
+		VkDeviceSize budget;	// Bytes it can use before the driver starts paging, shared with other processes
+		VkDeviceSize size;
+		VkMemoryHeapFlags flags;
+		MemoryPressure pressure;
+	};
+
+	// Called from the thread that polled, each time a heap changes pressure level. Must not call MemoryBudget::Update
+	using MemoryPressureFunc = void(*)(uint32_t heapIndex, MemoryPressure pressure, const MemoryHeapBudget& heap, void* usrPtr);
+
+	struct MemoryBudgetCreateInfo
+	{
+		// Usage falls back to the allocator's blocks when the device has no VK_EXT_memory_budget (budget is then 80% of the heap)
+		const MemoryAllocator* allocator = nullptr;
+
+		uint32_t pollInterval = 100; // In milliseconds, polled on a thread of its own. 0 only polls on Update
+
+		// Fractions of the budget where each pressure level starts. A level is only left once usage drops hysteresis below it
+		float elevatedThreshold = 0.75f;
+		float highThreshold = 0.9f;
+		float criticalThreshold = 0.97f;
+		float hysteresis = 0.03f;
+
+		MemoryPressureFunc pressureFunc = nullptr;
+		void* usrPtr = nullptr;
+	};
+
+	// Keeps a cached view of the usage and budget of each heap, from VK_EXT_memory_budget where CreateDevice enabled it.
+	// Reading it is lock free and never calls into the driver, so it can be checked before every streaming decision
+	class MemoryBudget
+	{
+	public:
+		MemoryBudget() = default;
+		MemoryBudget(const MemoryBudget&) = delete;
+		MemoryBudget& operator=(const MemoryBudget&) = delete;
+		~MemoryBudget() { Destroy(); }
+
+		// deviceInfo comes from CreateDevice for physicalDevice, it tells if VK_EXT_memory_budget was enabled
+		SmartResult Init(VkPhysicalDevice physicalDevice, const DeviceInfo& deviceInfo, const MemoryBudgetCreateInfo& createInfo = {});
+		// Stops polling, call before destroying the device or the allocator
+		void Destroy();
+
+		// Polls now, i.e. right after a large allocation. Thread safe
+		void Update();
+
+		// Thread safe and lock free, values are from the last poll
+		MemoryHeapBudget GetHeapBudget(uint32_t heapIndex) const;
+		// Highest pressure of the heaps that have all of heapFlags
+		MemoryPressure GetPressure(VkMemoryHeapFlags heapFlags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) const;
+
+		uint32_t GetHeapCount() const { return m_heapCount; }
+		bool HasBudgetExtension() const { return m_hasBudgetExtension; }
+
+	private:
+		struct Heap
+		{
+			std::atomic<VkDeviceSize> usage = 0;
+			std::atomic<VkDeviceSize> budget = 0;
+			std::atomic<MemoryPressure> pressure = MemoryPressure::Normal;
+			VkDeviceSize size = 0;
+			VkMemoryHeapFlags flags = 0;
+		};
+
+		MemoryPressure ClassifyUsage(double fraction) const;
+		void RunPolling();
+
+		VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+		MemoryBudgetCreateInfo m_createInfo;
+		bool m_hasBudgetExtension = false;
+		uint32_t m_heapCount = 0;
+		Heap m_heaps[VK_MAX_MEMORY_HEAPS];
+
+		std::atomic<uint32_t> m_sequence = 0; // Odd while Update is writing the heaps
+		std::mutex m_updateMutex;
+
+		std::mutex m_pollMutex;
+		std::condition_variable m_pollWake;
+		bool m_stopPolling = false;
+		std::thread m_pollThread;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE SmartResult MemoryBudget::Init(VkPhysicalDevice physicalDevice, const DeviceInfo& deviceInfo, const MemoryBudgetCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryBudget::Init");
+
+		if (!(createInfo.elevatedThreshold <= createInfo.highThreshold && createInfo.highThreshold <= createInfo.criticalThreshold))
+		{
+			PrintError("Memory pressure thresholds must go up from elevated to critical\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		m_physicalDevice = physicalDevice;
+		m_createInfo = createInfo;
+		m_createInfo.hysteresis = std::max(createInfo.hysteresis, 0.0f);
+
+		m_hasBudgetExtension = g_instanceDispatch.vkGetPhysicalDeviceMemoryProperties2 &&
+			std::find(deviceInfo.extensions.begin(), deviceInfo.extensions.end(), VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) != deviceInfo.extensions.end();
+		if (!m_hasBudgetExtension && !createInfo.allocator)
+			PrintWarning("VK_EXT_memory_budget isn't enabled and there is no allocator to count usage, memory pressure won't be reported\n");
+
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		g_instanceDispatch.vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+		m_heapCount = memoryProperties.memoryHeapCount;
+		for (uint32_t i = 0; i < m_heapCount; i++)
+		{
+			m_heaps[i].size = memoryProperties.memoryHeaps[i].size;
+			m_heaps[i].flags = memoryProperties.memoryHeaps[i].flags;
+			m_heaps[i].pressure.store(MemoryPressure::Normal, std::memory_order_relaxed);
+		}
+
+		// Valid values before the first poll interval passes
+		Update();
+
+		if (m_createInfo.pollInterval > 0)
+		{
+			m_stopPolling = false;
+			m_pollThread = std::thread(&MemoryBudget::RunPolling, this);
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void MemoryBudget::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryBudget::Destroy");
+
+		if (m_pollThread.joinable())
+		{
+			{
+				std::lock_guard lock(m_pollMutex);
+				m_stopPolling = true;
+			}
+			m_pollWake.notify_one();
+			m_pollThread.join();
+		}
+
+		m_heapCount = 0;
+	}
+
+	VKHL_INLINE MemoryPressure MemoryBudget::ClassifyUsage(double fraction) const
+	{
+		if (fraction >= m_createInfo.criticalThreshold)
+			return MemoryPressure::Critical;
+		if (fraction >= m_createInfo.highThreshold)
+			return MemoryPressure::High;
+		if (fraction >= m_createInfo.elevatedThreshold)
+			return MemoryPressure::Elevated;
+		return MemoryPressure::Normal;
+	}
+
+	VKHL_INLINE void MemoryBudget::Update()
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryBudget::Update");
+
+		std::lock_guard lock(m_updateMutex);
+
+		VkDeviceSize usage[VK_MAX_MEMORY_HEAPS] = {};
+		VkDeviceSize budget[VK_MAX_MEMORY_HEAPS] = {};
+		if (m_hasBudgetExtension)
+		{
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+			budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+			VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+			memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			memoryProperties.pNext = &budgetProperties;
+			g_instanceDispatch.vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memoryProperties);
+
+			std::copy(budgetProperties.heapUsage, budgetProperties.heapUsage + m_heapCount, usage);
+			std::copy(budgetProperties.heapBudget, budgetProperties.heapBudget + m_heapCount, budget);
+		}
+		else if (m_createInfo.allocator)
+		{
+			for (uint32_t i = 0; i < m_heapCount; i++)
+				usage[i] = m_createInfo.allocator->GetHeapUsage(i).blockBytes;
+		}
+
+		MemoryPressure pressures[VK_MAX_MEMORY_HEAPS];
+		bool changed[VK_MAX_MEMORY_HEAPS] = {};
+		for (uint32_t i = 0; i < m_heapCount; i++)
+		{
+			// Some drivers report no budget until something is allocated
+			if (budget[i] == 0)
+				budget[i] = m_heaps[i].size / 10 * 8;
+
+			// Raise the level right away, but only lower it once usage is hysteresis below the threshold
+			const double fraction = budget[i] ? static_cast<double>(usage[i]) / static_cast<double>(budget[i]) : 0.0;
+			const MemoryPressure previous = m_heaps[i].pressure.load(std::memory_order_relaxed);
+			pressures[i] = std::max(ClassifyUsage(fraction), std::min(previous, ClassifyUsage(fraction + m_createInfo.hysteresis)));
+			changed[i] = pressures[i] != previous;
+		}
+
+		m_sequence.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (uint32_t i = 0; i < m_heapCount; i++)
+		{
+			m_heaps[i].usage.store(usage[i], std::memory_order_relaxed);
+			m_heaps[i].budget.store(budget[i], std::memory_order_relaxed);
+			m_heaps[i].pressure.store(pressures[i], std::memory_order_relaxed);
+		}
+		m_sequence.fetch_add(1, std::memory_order_release);
+
+		if (!m_createInfo.pressureFunc)
+			return;
+
+		for (uint32_t i = 0; i < m_heapCount; i++)
+		{
+			if (changed[i])
+				m_createInfo.pressureFunc(i, pressures[i], { usage[i], budget[i], m_heaps[i].size, m_heaps[i].flags, pressures[i] }, m_createInfo.usrPtr);
+		}
+	}
+
+	VKHL_INLINE MemoryHeapBudget MemoryBudget::GetHeapBudget(uint32_t heapIndex) const
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryBudget::GetHeapBudget");
+
+		const Heap& heap = m_heaps[heapIndex];
+		MemoryHeapBudget result{ 0, 0, heap.size, heap.flags, MemoryPressure::Normal };
+
+		// Retry if Update wrote in between, so usage and budget are from the same poll
+		uint32_t sequence;
+		do
+		{
+			sequence = m_sequence.load(std::memory_order_acquire);
+			result.usage = heap.usage.load(std::memory_order_relaxed);
+			result.budget = heap.budget.load(std::memory_order_relaxed);
+			result.pressure = heap.pressure.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+		} while ((sequence & 1) || sequence != m_sequence.load(std::memory_order_relaxed));
+
+		return result;
+	}
+
+	VKHL_INLINE MemoryPressure MemoryBudget::GetPressure(VkMemoryHeapFlags heapFlags) const
+	{
+		VKHL_TRACE_ZONE("vkhl::MemoryBudget::GetPressure");
+
+		MemoryPressure pressure = MemoryPressure::Normal;
+		for (uint32_t i = 0; i < m_heapCount; i++)
+		{
+			if ((m_heaps[i].flags & heapFlags) == heapFlags)
+				pressure = std::max(pressure, m_heaps[i].pressure.load(std::memory_order_relaxed));
+		}
+
+		return pressure;
+	}
+
+	VKHL_INLINE void MemoryBudget::RunPolling()
+	{
+		VKHL_TRACE_THREAD_NAME("vkhl memory budget");
+
+		std::unique_lock lock(m_pollMutex);
+		while (!m_pollWake.wait_for(lock, std::chrono::milliseconds(m_createInfo.pollInterval), [this] { return m_stopPolling; }))
+		{
+			lock.unlock();
+			Update();
+			lock.lock();
+		}
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -8,16 +8,20 @@
 #include <span>
 #include <utility>
 #include <optional>
+#include <vector>
 
 #include "Definitions.h"
 #include "Globals.hpp"
 #include "Error.hpp"
 #include "Common.hpp"
+#include "Dispatch.hpp"
+#include "Trace.hpp"
 
 #ifdef VKHL_INCLUDE_IMPLEMENTION
 
 #include <vulkan/vk_enum_string_helper.h>
-#include <vector>
+#include <cstring>
+#include <algorithm>
 
 #endif // VKHL_INCLUDE_IMPLEMENTION
 
@@ -53,23 +57,99 @@ namespace vkhl
 		std::span<QueueFamilySelectionPredicate> customPredicates;
 	};
 
+	using PhysicalDeviceScoreFunc = float(*)(VkPhysicalDevice device, const VkPhysicalDeviceProperties& properties, void* usrPtr);
+
+	struct PhysicalDeviceScoreCallback
+	{
+		PhysicalDeviceScoreFunc func;
+		float weight;
+		void* usrPtr;
+	};
+
+	// Every criterion is scored from 0 to 1, then multiplied by its weight
+	struct PhysicalDeviceRankingInfo
+	{
+		float deviceTypeWeight = 100.0f;		// Discrete > integrated > virtual > CPU
+		float deviceLocalMemoryWeight = 20.0f;	// Largest device local heap, relative to the best candidate
+		float apiVersionWeight = 5.0f;			// Major.minor relative to the best candidate, a quarter less per minor version behind
+		float dedicatedComputeWeight = 10.0f;	// Has a compute family without graphics
+		float dedicatedTransferWeight = 10.0f;	// Has a transfer family without graphics or compute
+
+		std::span<PhysicalDeviceScoreCallback> scoreCallbacks; // Added to the total as func() * weight
+	};
+
+	// Update after bind descriptor arrays a device must support, i.e. GetBindlessHeapRequirements. All zero checks nothing.
+	// Needs Vulkan 1.2, and descriptor indexing, partially bound and update unused while pending descriptors
+	struct PhysicalDeviceDescriptorIndexingInfo
+	{
+		uint32_t minSampledImages;	// Per set and per stage
+		uint32_t minStorageImages;
+		uint32_t minStorageBuffers;
+		bool bufferDeviceAddress;
+	};
+
 	struct PhysicalDeviceSelectionInfo
 	{
 		std::span<PhysicalDeviceQueueFamilySelectionInfo> queueFamilyInfos;
 		std::span<PhysicalDeviceSelectionPredicate> customPredicates;
+		PhysicalDeviceDescriptorIndexingInfo descriptorIndexing{};
+		const PhysicalDeviceRankingInfo* ranking = nullptr; // nullptr selects the first device that passes, otherwise the best ranked
 	};
 
 	struct PhysicalDeviceQueueFamilyInfo
 	{
 		VkQueueFamilyProperties properties;
+		uint32_t assignedQueueCount; // Queues used by queueAssignments, create at least this many from the family
+	};
+
+	// Where one PhysicalDeviceQueueFamilySelectionInfo ended up
+	struct PhysicalDeviceQueueAssignment
+	{
+		uint32_t queueFamilyIndex;
+		uint32_t queueIndex;	// First queue in the family
+		uint32_t queueCount;	// minQueueCount, or 1
+		bool shared;			// Another request uses at least one of the same queues, so their work can't overlap
 	};
 
 	struct PhysicalDeviceInfo
 	{
+		VkPhysicalDeviceProperties properties;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
 		std::vector<PhysicalDeviceQueueFamilyInfo> queueFamilies; // Array of all queue families on device
+		std::vector<PhysicalDeviceQueueAssignment> queueAssignments; // One per selectionInfo.queueFamilyInfos
+	};
+
+	// Weighted scores of each criterion in PhysicalDeviceRankingInfo
+	struct PhysicalDeviceScore
+	{
+		float deviceType;
+		float deviceLocalMemory;
+		float apiVersion;
+		float dedicatedCompute;
+		float dedicatedTransfer;
+		float custom;
+		float total;
+	};
+
+	struct PhysicalDeviceCandidate
+	{
+		VkPhysicalDevice device;
+		std::vector<uint32_t> queueFamilies; // One per selectionInfo.queueFamilyInfos
+		PhysicalDeviceInfo info;
+		PhysicalDeviceScore score;
+	};
+
+	// Every device of one VkPhysicalDeviceGroup, all of which passed selection
+	struct PhysicalDeviceGroupInfo
+	{
+		std::vector<PhysicalDeviceCandidate> devices; // In the order of VkPhysicalDeviceGroupProperties::physicalDevices, device index i is devices[i]
+		bool subsetAllocation; // Memory can be allocated on a subset of the devices
 	};
 
 	// Selects a VkPhysicalDevice based on some features, limits, and custom predicates.
+	// Queue family requests are assigned together: families with the fewest capabilities that weren't asked for are preferred,
+	// and requests are spread over families and queues before any of them share a queue (see PhysicalDeviceInfo::queueAssignments).
+	// Uses g_instanceDispatch, which must be loaded for instance.
 	// Params:
 	//	instance = Vulkan instance
 	//	selectionInfo = A PhysicalDeviceSelectionInfo struct which describes how to select the physical device
@@ -78,6 +158,20 @@ namespace vkhl
 	//	infoOut (optional) -> A PhysicalDeviceInfo struct that contains info about the selected device
 	VKHL_INLINE SmartResult SelectPhyicalDevice(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, VkPhysicalDevice* deviceOut, uint32_t* queueFamiliesOut, PhysicalDeviceInfo* infoOut);
 
+	// Returns every device that passes selectionInfo, sorted from best to worst by rankingInfo.
+	// selectionInfo.ranking is ignored. Uses g_instanceDispatch, which must be loaded for instance.
+	VKHL_INLINE SmartResult RankPhysicalDevices(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, const PhysicalDeviceRankingInfo& rankingInfo, std::vector<PhysicalDeviceCandidate>* candidatesOut);
+
+	// Like SelectPhyicalDevice, but for using several GPUs at once: returns up to maxDevices devices that pass selectionInfo,
+	// each with its own queue assignments, to be made into one VkDevice each. Best ranked first if selectionInfo.ranking is set,
+	// otherwise in the order the loader reports them. Uses g_instanceDispatch, which must be loaded for instance.
+	VKHL_INLINE SmartResult SelectPhysicalDevices(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, uint32_t maxDevices, std::vector<PhysicalDeviceCandidate>* devicesOut);
+
+	// Selects the VkPhysicalDeviceGroup with the most devices that all pass selectionInfo, ties go to the best ranked group
+	// (by the sum of its devices' scores) if selectionInfo.ranking is set, otherwise to the first one.
+	// Make one VkDevice for the whole group with CreateDevice and DeviceCreateInfo::deviceGroup. Needs Vulkan 1.1 or VK_KHR_device_group_creation
+	VKHL_INLINE SmartResult SelectPhysicalDeviceGroup(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, PhysicalDeviceGroupInfo* groupOut);
+
 #ifdef VKHL_INCLUDE_IMPLEMENTION
 	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
 	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
@@ -89,101 +183,352 @@ namespace vkhl
 			return result;										\
 		}
 
-	VKHL_INLINE SmartResult SelectPhyicalDevice(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, VkPhysicalDevice* deviceOut, uint32_t* queueFamiliesOut, PhysicalDeviceInfo* infoOut)
+	namespace detail
 	{
-		VkResult result = VK_SUCCESS;
+		VKHL_INLINE bool IsQueueFamilySuitable(VkPhysicalDevice device, uint32_t index, const VkQueueFamilyProperties& queueFamily, const PhysicalDeviceQueueFamilySelectionInfo& queueInfo)
+		{
+			// Is this queue good?
+			if (((queueInfo.graphics == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) : true) &&
+				((queueInfo.transfer == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) : true) &&
+				((queueInfo.compute == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) : true) &&
+				((queueInfo.sparseBinding == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) : true) &&
+				((queueInfo.maxMinImageGranularity.width == 0) || (queueInfo.maxMinImageGranularity.width >= queueFamily.minImageTransferGranularity.width)) &&
+				((queueInfo.maxMinImageGranularity.height == 0) || (queueInfo.maxMinImageGranularity.height >= queueFamily.minImageTransferGranularity.height)) &&
+				((queueInfo.maxMinImageGranularity.depth == 0) || (queueInfo.maxMinImageGranularity.depth >= queueFamily.minImageTransferGranularity.depth)) &&
+				(queueInfo.minQueueCount <= queueFamily.queueCount) &&
+				(queueInfo.minTimestampBits <= queueFamily.timestampValidBits))
+			{
+				// Check custom predicates
+				for (const auto& predicate : queueInfo.customPredicates)
+				{
+					if (!predicate.func(device, index, predicate.usrPtr))
+						return false;
+				}
 
-		uint32_t deviceCount;
-		CHECK_VK_CALL(vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr),
-			"Failed to get number of physical devices with error %s\n");
-		std::vector<VkPhysicalDevice> devices{ deviceCount };
-		CHECK_VK_CALL(vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data()),
-			"Failed to get physical devices with error %s\n");
+				return true;
+			}
 
-		for (auto device : devices)
+			return false;
+		}
+
+		// Returns why device can't do indexingInfo, or nullptr if it can
+		VKHL_INLINE const char* CheckDescriptorIndexing(VkPhysicalDevice device, const PhysicalDeviceDescriptorIndexingInfo& indexingInfo)
 		{
-			uint32_t queueFamilyCount;
-			vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-			std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-			vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+			const uint32_t counts[] = { indexingInfo.minSampledImages, indexingInfo.minStorageImages, indexingInfo.minStorageBuffers };
+			const uint32_t total = counts[0] + counts[1] + counts[2];
+			if (total == 0 && !indexingInfo.bufferDeviceAddress)
+				return nullptr;
+
+			VkPhysicalDeviceProperties properties;
+			g_instanceDispatch.vkGetPhysicalDeviceProperties(device, &properties);
+			if (std::min(g_instanceDispatch.apiVersion, Version(properties.apiVersion)) < VK_API_VERSION_1_2 || !g_instanceDispatch.vkGetPhysicalDeviceFeatures2)
+				return "descriptor indexing needs Vulkan 1.2";
+
+			VkPhysicalDeviceVulkan12Features features12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+			VkPhysicalDeviceFeatures2 features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, &features12 };
+			g_instanceDispatch.vkGetPhysicalDeviceFeatures2(device, &features2);
+
+			if (indexingInfo.bufferDeviceAddress && !features12.bufferDeviceAddress)
+				return "bufferDeviceAddress isn't supported";
+			if (total == 0)
+				return nullptr;
+
+			if (!features12.descriptorIndexing || !features12.runtimeDescriptorArray || !features12.descriptorBindingPartiallyBound ||
+				!features12.descriptorBindingUpdateUnusedWhilePending)
+				return "descriptor indexing features aren't supported";
+
+			VkPhysicalDeviceDescriptorIndexingProperties indexing{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES };
+			VkPhysicalDeviceProperties2 properties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, &indexing };
+			g_instanceDispatch.vkGetPhysicalDeviceProperties2(device, &properties2);
+
+			const VkBool32 updateAfterBind[] = { features12.descriptorBindingSampledImageUpdateAfterBind,
+				features12.descriptorBindingStorageImageUpdateAfterBind, features12.descriptorBindingStorageBufferUpdateAfterBind };
+			const uint32_t setLimits[] = { indexing.maxDescriptorSetUpdateAfterBindSampledImages,
+				indexing.maxDescriptorSetUpdateAfterBindStorageImages, indexing.maxDescriptorSetUpdateAfterBindStorageBuffers };
+			const uint32_t stageLimits[] = { indexing.maxPerStageDescriptorUpdateAfterBindSampledImages,
+				indexing.maxPerStageDescriptorUpdateAfterBindStorageImages, indexing.maxPerStageDescriptorUpdateAfterBindStorageBuffers };
+			const char* tooMany[] = { "too many update after bind sampled images", "too many update after bind storage images",
+				"too many update after bind storage buffers" };
+
+			for (uint32_t type = 0; type < 3; type++)
+			{
+				if (counts[type] == 0)
+					continue;
+				if (!updateAfterBind[type])
+					return "update after bind isn't supported for every descriptor type";
+				if (counts[type] > setLimits[type] || counts[type] > stageLimits[type])
+					return tooMany[type];
+			}
+
+			if (total > indexing.maxPerStageUpdateAfterBindResources || total > indexing.maxUpdateAfterBindDescriptorsInAllPools)
+				return "too many update after bind descriptors in total";
+
+			return nullptr;
+		}
+
+		// Cost of a family having capabilities the request didn't ask for (so dedicated families win),
+		// or missing the ones it requested
+		VKHL_INLINE uint32_t GetQueueFamilyCost(VkQueueFlags flags, const PhysicalDeviceQueueFamilySelectionInfo& queueInfo)
+		{
+			const std::pair<VkQueueFlags, FeatureRequirement> capabilities[] = {
+				{ VK_QUEUE_GRAPHICS_BIT, queueInfo.graphics },
+				{ VK_QUEUE_COMPUTE_BIT, queueInfo.compute },
+				{ VK_QUEUE_SPARSE_BINDING_BIT, queueInfo.sparseBinding },
+			};
+			constexpr uint32_t weights[] = { 4, 2, 1 };
+
+			uint32_t cost = 0;
+			for (size_t i = 0; i < std::size(capabilities); i++)
+			{
+				const bool present = flags & capabilities[i].first;
+				if ((present && capabilities[i].second == DisableFeature) || (!present && capabilities[i].second == RequestFeature))
+					cost += weights[i];
+			}
+
+			return cost;
+		}
 
-			// Get queue indices
-			bool queueComplete = true;
-			std::vector<uint32_t> queueIndices;
-			queueIndices.reserve(selectionInfo.queueFamilyInfos.size());
+		// Depth first search over every family each request could use, most constrained request first.
+		// Candidates are sorted by cost, so the first full assignment is the greedy one and the rest of the budget improves on it
+		struct QueueAssignmentSolver
+		{
+			static constexpr uint32_t SharedQueueCost = 16;	// Per queue used by more than one request
+			static constexpr uint32_t SameFamilyCost = 1;	// Per other request in the same family
 
-			for (auto queueInfo : selectionInfo.queueFamilyInfos)
+			std::span<const VkQueueFamilyProperties> families;
+			std::span<const PhysicalDeviceQueueFamilySelectionInfo> requests;
+			std::vector<std::vector<std::pair<uint32_t, uint32_t>>> candidates; // (cost, family) for each request
+			std::vector<uint32_t> order;
+			std::vector<uint32_t> current, best;
+			std::vector<uint32_t> queuesUsed, requestsOnFamily;
+			uint32_t bestCost = ~0u;
+			uint32_t budget = 4096;
+
+			static uint32_t QueueCount(const PhysicalDeviceQueueFamilySelectionInfo& request) { return std::max(request.minQueueCount, 1u); }
+
+			void Search(size_t depth, uint32_t cost)
 			{
+				if (cost >= bestCost || budget == 0)
+					return;
+				budget--;
 
-				uint32_t index = 0;
-				for (const auto& queueFamily : queueFamilies)
+				if (depth == order.size())
 				{
-					// Is this queue good?
-					if (((queueInfo.graphics == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) : true) &&
-						((queueInfo.transfer == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) : true) &&
-						((queueInfo.compute == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) : true) &&
-						((queueInfo.sparseBinding == RequireFeature) ? (queueFamily.queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) : true) &&
-						((queueInfo.maxMinImageGranularity.width == 0) || (queueInfo.maxMinImageGranularity.width >= queueFamily.minImageTransferGranularity.width)) &&
-						((queueInfo.maxMinImageGranularity.height == 0) || (queueInfo.maxMinImageGranularity.height >= queueFamily.minImageTransferGranularity.height)) &&
-						((queueInfo.maxMinImageGranularity.depth == 0) || (queueInfo.maxMinImageGranularity.depth >= queueFamily.minImageTransferGranularity.depth)) &&
-						(queueInfo.minQueueCount <= queueFamily.queueCount) &&
-						(queueInfo.minTimestampBits <= queueFamily.timestampValidBits))
-					{
-						// Check custom predicates
-						bool allGood = true;
-						for (const auto& predicate : queueInfo.customPredicates)
-						{
-							if (!predicate.func(device, index, predicate.usrPtr))
-							{
-								allGood = false;
-								break;
-							}
-						}
-
-						if (allGood)
-						{
-							queueIndices.push_back(index);
-							break;
-						}
-					}
-
-					index++;
+					bestCost = cost;
+					best = current;
+					return;
 				}
 
-				if (index == queueFamilies.size())
+				const uint32_t request = order[depth];
+				const uint32_t count = QueueCount(requests[request]);
+				for (const auto& [familyCost, family] : candidates[request])
 				{
-					queueComplete = false;
-					break;
+					const uint32_t queueCount = families[family].queueCount;
+					const uint32_t overflowBefore = (queuesUsed[family] > queueCount) ? queuesUsed[family] - queueCount : 0;
+					const uint32_t overflowAfter = (queuesUsed[family] + count > queueCount) ? queuesUsed[family] + count - queueCount : 0;
+					const uint32_t addedCost = familyCost + (overflowAfter - overflowBefore) * SharedQueueCost + requestsOnFamily[family] * SameFamilyCost;
+
+					current[request] = family;
+					queuesUsed[family] += count;
+					requestsOnFamily[family]++;
+
+					Search(depth + 1, cost + addedCost);
+
+					queuesUsed[family] -= count;
+					requestsOnFamily[family]--;
 				}
 			}
+		};
 
-			if (!queueComplete)
-				continue;
+		// Returns true if device passes selectionInfo, assignmentsOut gets one entry per selectionInfo.queueFamilyInfos
+		VKHL_INLINE bool EvaluatePhysicalDevice(VkPhysicalDevice device, const PhysicalDeviceSelectionInfo& selectionInfo, std::span<const VkQueueFamilyProperties> queueFamilies, std::vector<PhysicalDeviceQueueAssignment>* assignmentsOut)
+		{
+			VKHL_TRACE_ZONE("vkhl::EvaluatePhysicalDevice");
+
+			const size_t requestCount = selectionInfo.queueFamilyInfos.size();
+
+			QueueAssignmentSolver solver;
+			solver.families = queueFamilies;
+			solver.requests = selectionInfo.queueFamilyInfos;
+			solver.candidates.resize(requestCount);
+
+			// Find every family each request could use
+			for (size_t request = 0; request < requestCount; request++)
+			{
+				const auto& queueInfo = selectionInfo.queueFamilyInfos[request];
+				for (uint32_t index = 0; index < queueFamilies.size(); index++)
+				{
+					if (IsQueueFamilySuitable(device, index, queueFamilies[index], queueInfo))
+						solver.candidates[request].push_back({ GetQueueFamilyCost(queueFamilies[index].queueFlags, queueInfo), index });
+				}
+
+				if (solver.candidates[request].empty())
+					return false;
+
+				std::stable_sort(solver.candidates[request].begin(), solver.candidates[request].end(), [](const auto& a, const auto& b) {
+					return a.first < b.first;
+				});
+				solver.order.push_back(static_cast<uint32_t>(request));
+			}
+
+			std::stable_sort(solver.order.begin(), solver.order.end(), [&solver](uint32_t a, uint32_t b) {
+				return solver.candidates[a].size() < solver.candidates[b].size();
+			});
+
+			solver.current.resize(requestCount);
+			solver.queuesUsed.resize(queueFamilies.size());
+			solver.requestsOnFamily.resize(queueFamilies.size());
+			solver.Search(0, 0);
+
+			// Hand out queue indices in request order, wrapping around once a family runs out
+			std::vector<std::vector<uint32_t>> queueUsers(queueFamilies.size());
+			for (size_t family = 0; family < queueFamilies.size(); family++)
+				queueUsers[family].resize(queueFamilies[family].queueCount);
+
+			std::fill(solver.queuesUsed.begin(), solver.queuesUsed.end(), 0);
+			assignmentsOut->resize(requestCount);
+			for (size_t request = 0; request < requestCount; request++)
+			{
+				const uint32_t family = solver.best[request];
+				const uint32_t count = QueueAssignmentSolver::QueueCount(selectionInfo.queueFamilyInfos[request]);
+				const uint32_t queueCount = queueFamilies[family].queueCount;
+
+				auto& assignment = (*assignmentsOut)[request];
+				assignment.queueFamilyIndex = family;
+				assignment.queueIndex = solver.queuesUsed[family] % queueCount;
+				assignment.queueCount = count;
+				if (assignment.queueIndex + count > queueCount) // Keep the queues of one request contiguous
+					assignment.queueIndex = 0;
+
+				solver.queuesUsed[family] += count;
+				for (uint32_t queue = 0; queue < count; queue++)
+					queueUsers[family][assignment.queueIndex + queue]++;
+			}
+
+			for (auto& assignment : *assignmentsOut)
+			{
+				assignment.shared = false;
+				for (uint32_t queue = 0; queue < assignment.queueCount; queue++)
+					assignment.shared |= queueUsers[assignment.queueFamilyIndex][assignment.queueIndex + queue] > 1;
+			}
+
+			if (const char* reason = CheckDescriptorIndexing(device, selectionInfo.descriptorIndexing))
+			{
+				VkPhysicalDeviceProperties properties;
+				g_instanceDispatch.vkGetPhysicalDeviceProperties(device, &properties);
+				PrintWarning("Physical device %s was skipped, %s\n", properties.deviceName, reason);
+				return false;
+			}
 
 			// Check custom predicates
-			bool deviceGood = true;
+			VKHL_TRACE_ZONE("vkhl::EvaluatePhysicalDevice custom predicates");
 			for (const auto& predicate : selectionInfo.customPredicates)
 			{
 				if (!predicate.func(device, predicate.usrPtr))
-				{
-					deviceGood = false;
-					break;
-				}
+					return false;
+			}
+
+			return true;
+		}
+
+		VKHL_INLINE void FillPhysicalDeviceInfo(VkPhysicalDevice device, std::span<const VkQueueFamilyProperties> queueFamilies, std::span<const PhysicalDeviceQueueAssignment> assignments, PhysicalDeviceInfo* infoOut)
+		{
+			g_instanceDispatch.vkGetPhysicalDeviceProperties(device, &infoOut->properties);
+			g_instanceDispatch.vkGetPhysicalDeviceMemoryProperties(device, &infoOut->memoryProperties);
+
+			// Queue infos
+			infoOut->queueFamilies.clear();
+			infoOut->queueFamilies.reserve(queueFamilies.size());
+			for (const auto& familyInfo : queueFamilies)
+				infoOut->queueFamilies.push_back({ familyInfo, 0 });
+
+			infoOut->queueAssignments.assign(assignments.begin(), assignments.end());
+			for (const auto& assignment : assignments)
+			{
+				auto& family = infoOut->queueFamilies[assignment.queueFamilyIndex];
+				family.assignedQueueCount = std::max(family.assignedQueueCount, assignment.queueIndex + assignment.queueCount);
+			}
+		}
+
+		VKHL_INLINE std::vector<VkQueueFamilyProperties> GetQueueFamilies(VkPhysicalDevice device)
+		{
+			uint32_t queueFamilyCount;
+			g_instanceDispatch.vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+			std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+			g_instanceDispatch.vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+			return queueFamilies;
+		}
+
+		VKHL_INLINE VkDeviceSize GetLargestDeviceLocalHeap(const VkPhysicalDeviceMemoryProperties& memoryProperties)
+		{
+			VkDeviceSize largest = 0;
+			for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+			{
+				if (memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+					largest = std::max(largest, memoryProperties.memoryHeaps[heap].size);
 			}
+			return largest;
+		}
+
+		// 1 for the best candidate's major.minor version, a quarter less for every minor version behind it, patch versions don't count
+		VKHL_INLINE float ScoreApiVersion(Version version, Version bestVersion)
+		{
+			if (VK_API_VERSION_MAJOR(version) != VK_API_VERSION_MAJOR(bestVersion))
+				return 0.0f;
+
+			const uint32_t behind = VK_API_VERSION_MINOR(bestVersion) - VK_API_VERSION_MINOR(version);
+			return std::max(0.0f, 1.0f - 0.25f * static_cast<float>(behind));
+		}
+	}
+
+	VKHL_INLINE SmartResult SelectPhyicalDevice(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, VkPhysicalDevice* deviceOut, uint32_t* queueFamiliesOut, PhysicalDeviceInfo* infoOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::SelectPhyicalDevice");
+
+		VkResult result = VK_SUCCESS;
 
-			if (!deviceGood)
+		if (selectionInfo.ranking)
+		{
+			std::vector<PhysicalDeviceCandidate> candidates;
+			result = RankPhysicalDevices(instance, selectionInfo, *selectionInfo.ranking, &candidates).GetAndReset();
+			if (result < 0)
+				return result;
+
+			if (candidates.empty())
+				return VK_ERROR_INITIALIZATION_FAILED;
+
+			auto& best = candidates.front();
+			*deviceOut = best.device;
+			std::memcpy(queueFamiliesOut, best.queueFamilies.data(), best.queueFamilies.size() * sizeof(uint32_t));
+			if (infoOut)
+				*infoOut = std::move(best.info);
+
+			return VK_SUCCESS;
+		}
+
+		uint32_t deviceCount;
+		CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr),
+			"Failed to get number of physical devices with error %s\n");
+		std::vector<VkPhysicalDevice> devices{ deviceCount };
+		CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data()),
+			"Failed to get physical devices with error %s\n");
+
+		std::vector<PhysicalDeviceQueueAssignment> assignments;
+		for (auto device : devices)
+		{
+			const auto queueFamilies = detail::GetQueueFamilies(device);
+			if (!detail::EvaluatePhysicalDevice(device, selectionInfo, queueFamilies, &assignments))
 				continue;
 
 			// Device
 			*deviceOut = device;
 			// Queue family indices
-			std::memcpy(queueFamiliesOut, queueIndices.data(), queueIndices.size() * sizeof(uint32_t));
+			for (size_t i = 0; i < assignments.size(); i++)
+				queueFamiliesOut[i] = assignments[i].queueFamilyIndex;
 
 			// Device info:
-			// Queue infos
-			infoOut->queueFamilies.reserve(queueFamilyCount);
-			for (const auto& familyInfo : queueFamilies)
-				infoOut->queueFamilies.push_back({ familyInfo });
+			if (infoOut)
+				detail::FillPhysicalDeviceInfo(device, queueFamilies, assignments, infoOut);
 
 			return VK_SUCCESS;
 		}
@@ -191,6 +536,204 @@ namespace vkhl
 		return VK_ERROR_INITIALIZATION_FAILED;
 	}
 
+	VKHL_INLINE SmartResult RankPhysicalDevices(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, const PhysicalDeviceRankingInfo& rankingInfo, std::vector<PhysicalDeviceCandidate>* candidatesOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::RankPhysicalDevices");
+
+		VkResult result = VK_SUCCESS;
+		candidatesOut->clear();
+
+		uint32_t deviceCount;
+		CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr),
+			"Failed to get number of physical devices with error %s\n");
+		std::vector<VkPhysicalDevice> devices{ deviceCount };
+		CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data()),
+			"Failed to get physical devices with error %s\n");
+
+		VkDeviceSize bestHeap = 0;
+		Version bestVersion = 0;
+
+		std::vector<PhysicalDeviceQueueAssignment> assignments;
+
+		for (auto device : devices)
+		{
+			const auto queueFamilies = detail::GetQueueFamilies(device);
+
+			PhysicalDeviceCandidate candidate{};
+			candidate.device = device;
+			if (!detail::EvaluatePhysicalDevice(device, selectionInfo, queueFamilies, &assignments))
+				continue;
+
+			detail::FillPhysicalDeviceInfo(device, queueFamilies, assignments, &candidate.info);
+			for (const auto& assignment : assignments)
+				candidate.queueFamilies.push_back(assignment.queueFamilyIndex);
+			const auto& properties = candidate.info.properties;
+			auto& score = candidate.score;
+
+			switch (properties.deviceType)
+			{
+			case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:		score.deviceType = 1.0f; break;
+			case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:	score.deviceType = 0.5f; break;
+			case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:		score.deviceType = 0.25f; break;
+			case VK_PHYSICAL_DEVICE_TYPE_CPU:				score.deviceType = 0.1f; break;
+			default:										score.deviceType = 0.0f; break;
+			}
+			score.deviceType *= rankingInfo.deviceTypeWeight;
+
+			for (const auto& queueFamily : queueFamilies)
+			{
+				const auto flags = queueFamily.queueFlags;
+				if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+					score.dedicatedCompute = rankingInfo.dedicatedComputeWeight;
+				if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+					score.dedicatedTransfer = rankingInfo.dedicatedTransferWeight;
+			}
+
+			for (const auto& callback : rankingInfo.scoreCallbacks)
+				score.custom += callback.func(device, properties, callback.usrPtr) * callback.weight;
+
+			bestHeap = std::max(bestHeap, detail::GetLargestDeviceLocalHeap(candidate.info.memoryProperties));
+			bestVersion = std::max(bestVersion, properties.apiVersion);
+
+			candidatesOut->push_back(std::move(candidate));
+		}
+
+		// Memory and version are scored relative to the best candidate, so they need every candidate first
+		for (auto& candidate : *candidatesOut)
+		{
+			auto& score = candidate.score;
+			const VkDeviceSize heap = detail::GetLargestDeviceLocalHeap(candidate.info.memoryProperties);
+
+			score.deviceLocalMemory = (bestHeap > 0) ? rankingInfo.deviceLocalMemoryWeight * static_cast<float>(static_cast<double>(heap) / static_cast<double>(bestHeap)) : 0.0f;
+			score.apiVersion = rankingInfo.apiVersionWeight * detail::ScoreApiVersion(candidate.info.properties.apiVersion, bestVersion);
+			score.total = score.deviceType + score.deviceLocalMemory + score.apiVersion + score.dedicatedCompute + score.dedicatedTransfer + score.custom;
+		}
+
+		// Stable, so equal scores keep the order the loader reported
+		std::stable_sort(candidatesOut->begin(), candidatesOut->end(), [](const PhysicalDeviceCandidate& a, const PhysicalDeviceCandidate& b) {
+			return a.score.total > b.score.total;
+		});
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult SelectPhysicalDevices(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, uint32_t maxDevices, std::vector<PhysicalDeviceCandidate>* devicesOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::SelectPhysicalDevices");
+
+		VkResult result = VK_SUCCESS;
+		devicesOut->clear();
+
+		if (selectionInfo.ranking)
+		{
+			result = RankPhysicalDevices(instance, selectionInfo, *selectionInfo.ranking, devicesOut).GetAndReset();
+			if (result < 0)
+				return result;
+		}
+		else
+		{
+			uint32_t deviceCount;
+			CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr),
+				"Failed to get number of physical devices with error %s\n");
+			std::vector<VkPhysicalDevice> devices{ deviceCount };
+			CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data()),
+				"Failed to get physical devices with error %s\n");
+
+			std::vector<PhysicalDeviceQueueAssignment> assignments;
+			for (auto device : devices)
+			{
+				if (devicesOut->size() >= maxDevices)
+					break;
+
+				const auto queueFamilies = detail::GetQueueFamilies(device);
+				if (!detail::EvaluatePhysicalDevice(device, selectionInfo, queueFamilies, &assignments))
+					continue;
+
+				PhysicalDeviceCandidate candidate{};
+				candidate.device = device;
+				detail::FillPhysicalDeviceInfo(device, queueFamilies, assignments, &candidate.info);
+				for (const auto& assignment : assignments)
+					candidate.queueFamilies.push_back(assignment.queueFamilyIndex);
+
+				devicesOut->push_back(std::move(candidate));
+			}
+		}
+
+		if (devicesOut->size() > maxDevices)
+			devicesOut->resize(maxDevices);
+
+		return devicesOut->empty() ? VK_ERROR_INITIALIZATION_FAILED : VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult SelectPhysicalDeviceGroup(VkInstance instance, const PhysicalDeviceSelectionInfo& selectionInfo, PhysicalDeviceGroupInfo* groupOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::SelectPhysicalDeviceGroup");
+
+		VkResult result = VK_SUCCESS;
+
+		if (!g_instanceDispatch.vkEnumeratePhysicalDeviceGroups)
+		{
+			PrintError("vkEnumeratePhysicalDeviceGroups wasn't loaded, it needs Vulkan 1.1 or %s\n", VK_KHR_DEVICE_GROUP_CREATION_EXTENSION_NAME);
+			return VK_ERROR_EXTENSION_NOT_PRESENT;
+		}
+
+		// Every device that passes on its own, a group passes if all of its devices are in here
+		std::vector<PhysicalDeviceCandidate> candidates;
+		result = SelectPhysicalDevices(instance, selectionInfo, UINT32_MAX, &candidates).GetAndReset();
+		if (result < 0)
+			return result;
+
+		uint32_t groupCount;
+		CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDeviceGroups(instance, &groupCount, nullptr),
+			"Failed to get number of physical device groups with error %s\n");
+		std::vector<VkPhysicalDeviceGroupProperties> groups(groupCount, { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES });
+		CHECK_VK_CALL(g_instanceDispatch.vkEnumeratePhysicalDeviceGroups(instance, &groupCount, groups.data()),
+			"Failed to get physical device groups with error %s\n");
+
+		const VkPhysicalDeviceGroupProperties* bestGroup = nullptr;
+		float bestScore = 0.0f;
+		for (const auto& group : groups)
+		{
+			float score = 0.0f;
+			bool passed = true;
+			for (uint32_t i = 0; i < group.physicalDeviceCount && passed; i++)
+			{
+				auto candidate = std::find_if(candidates.begin(), candidates.end(), [&group, i](const PhysicalDeviceCandidate& candidate) {
+					return candidate.device == group.physicalDevices[i];
+				});
+
+				passed = candidate != candidates.end();
+				if (passed)
+					score += candidate->score.total;
+			}
+
+			if (!passed || group.physicalDeviceCount == 0)
+				continue;
+
+			if (!bestGroup || group.physicalDeviceCount > bestGroup->physicalDeviceCount ||
+				(group.physicalDeviceCount == bestGroup->physicalDeviceCount && score > bestScore))
+			{
+				bestGroup = &group;
+				bestScore = score;
+			}
+		}
+
+		if (!bestGroup)
+			return VK_ERROR_INITIALIZATION_FAILED;
+
+		groupOut->subsetAllocation = bestGroup->subsetAllocation == VK_TRUE;
+		groupOut->devices.clear();
+		for (uint32_t i = 0; i < bestGroup->physicalDeviceCount; i++)
+		{
+			auto candidate = std::find_if(candidates.begin(), candidates.end(), [bestGroup, i](const PhysicalDeviceCandidate& candidate) {
+				return candidate.device == bestGroup->physicalDevices[i];
+			});
+			groupOut->devices.push_back(std::move(*candidate));
+		}
+
+		return VK_SUCCESS;
+	}
+
 #undef CHECK_VK_CALL
 #endif // VKHL_INCLUDE_IMPLEMENTION
 }
@@ -0,0 +1,242 @@
+#pragma once
+
+#ifndef VKHL_PIPELINECACHE_HPP
+#define VKHL_PIPELINECACHE_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "MappedFile.hpp"
+#include "PhysicalDevice.hpp"
+#include "ThreadCache.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <cstring>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	struct PipelineCacheCreateInfo
+	{
+		const char* path = nullptr;	// File to load from and save to, nullptr keeps the cache in memory
+		bool perThread = true;		// Gives each thread its own VkPipelineCache so pipeline creation doesn't contend on the cache lock
+	};
+
+	// A VkPipelineCache backed by a file, only loaded if it was written for the same device.
+	// The file stays mapped while the cache is alive, so the driver reads it straight from the page cache
+	class PipelineCache
+	{
+	public:
+		PipelineCache() = default;
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache& operator=(const PipelineCache&) = delete;
+		~PipelineCache() { Destroy(); }
+
+		// physicalDeviceInfo must come from SelectPhyicalDevice for the device that dispatch belongs to
+		SmartResult Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const PipelineCacheCreateInfo& createInfo = {});
+		// Destroys every cache without saving
+		void Destroy();
+
+		// Returns the cache the calling thread should pass to vkCreate*Pipelines, thread safe.
+		// Takes no locks while this is among the last few pipeline caches the thread used
+		VkPipelineCache Get();
+
+		// Merges the per-thread caches and writes the result to the file. Pipelines must not be created while this runs
+		SmartResult Save();
+
+		// True if the file existed and matched the device
+		bool WasLoaded() const { return m_file.data != nullptr; }
+
+	private:
+		SmartResult CreateCache(VkPipelineCache* cacheOut);
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		std::string m_path;
+		bool m_perThread = true;
+		MappedFile m_file;
+		uint64_t m_id = 0; // Unique per Init, keys the thread local lookup
+
+		std::mutex m_mutex;
+		VkPipelineCache m_mainCache = VK_NULL_HANDLE;
+		std::deque<std::pair<std::thread::id, VkPipelineCache>> m_threadCaches; // A deque so the thread local lookup can point into it
+	};
+
+	// Returns true if data starts with a pipeline cache header written by the device with the given properties
+	VKHL_INLINE bool IsPipelineCacheCompatible(const void* data, size_t size, const VkPhysicalDeviceProperties& properties);
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	VKHL_INLINE bool IsPipelineCacheCompatible(const void* data, size_t size, const VkPhysicalDeviceProperties& properties)
+	{
+		VkPipelineCacheHeaderVersionOne header;
+		if (size < sizeof(header))
+			return false;
+
+		std::memcpy(&header, data, sizeof(header));
+		return header.headerSize >= sizeof(header) &&
+			header.headerSize <= size &&
+			header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header.vendorID == properties.vendorID &&
+			header.deviceID == properties.deviceID &&
+			std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	VKHL_INLINE SmartResult PipelineCache::Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const PipelineCacheCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCache::Init");
+
+		m_dispatch = &dispatch;
+		m_path = createInfo.path ? createInfo.path : "";
+		m_perThread = createInfo.perThread;
+		m_id = detail::NewThreadCacheId();
+
+		if (!m_path.empty() && MapFile(m_path.c_str(), &m_file))
+		{
+			// Drivers are supposed to reject foreign data themselves, but not all of them do it gracefully
+			if (!IsPipelineCacheCompatible(m_file.data, m_file.size, physicalDeviceInfo.properties))
+			{
+				PrintWarning("Pipeline cache %s was written by another device or driver, ignoring it\n", m_path.c_str());
+				UnmapFile(&m_file);
+			}
+		}
+
+		return CreateCache(&m_mainCache);
+	}
+
+	VKHL_INLINE void PipelineCache::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCache::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		for (auto& [thread, cache] : m_threadCaches)
+			m_dispatch->vkDestroyPipelineCache(m_dispatch->device, cache, GetAllocationCallbacks());
+		m_threadCaches.clear();
+
+		if (m_mainCache)
+			m_dispatch->vkDestroyPipelineCache(m_dispatch->device, m_mainCache, GetAllocationCallbacks());
+		m_mainCache = VK_NULL_HANDLE;
+
+		UnmapFile(&m_file);
+		m_id = 0;
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE SmartResult PipelineCache::CreateCache(VkPipelineCache* cacheOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCache::CreateCache");
+
+		VkResult result = VK_SUCCESS;
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = m_file.size;
+		cacheInfo.pInitialData = m_file.data;
+
+		CHECK_VK_CALL(m_dispatch->vkCreatePipelineCache(m_dispatch->device, &cacheInfo, GetAllocationCallbacks(), cacheOut),
+			"Failed to create pipeline cache with error %s\n");
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE VkPipelineCache PipelineCache::Get()
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCache::Get");
+
+		if (!m_perThread)
+			return m_mainCache;
+
+		if (void* cache = detail::ThreadCache<PipelineCache>::Find(m_id))
+			return *static_cast<VkPipelineCache*>(cache);
+
+		// The thread may have a cache from before it switched to other pipeline caches
+		const auto thread = std::this_thread::get_id();
+		std::lock_guard lock(m_mutex);
+
+		for (auto& [owner, cache] : m_threadCaches)
+		{
+			if (owner == thread)
+			{
+				detail::ThreadCache<PipelineCache>::Insert(m_id, &cache);
+				return cache;
+			}
+		}
+
+		// Every thread cache starts from the file, so warm pipelines are found no matter which thread builds them
+		VkPipelineCache cache;
+		if (CreateCache(&cache).GetAndReset() < 0)
+			return m_mainCache;
+
+		m_threadCaches.emplace_back(thread, cache);
+		detail::ThreadCache<PipelineCache>::Insert(m_id, &m_threadCaches.back().second);
+		return cache;
+	}
+
+	VKHL_INLINE SmartResult PipelineCache::Save()
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCache::Save");
+
+		VkResult result = VK_SUCCESS;
+		std::lock_guard lock(m_mutex);
+
+		if (!m_threadCaches.empty())
+		{
+			std::vector<VkPipelineCache> caches;
+			caches.reserve(m_threadCaches.size());
+			for (auto& [thread, cache] : m_threadCaches)
+				caches.push_back(cache);
+
+			CHECK_VK_CALL(m_dispatch->vkMergePipelineCaches(m_dispatch->device, m_mainCache, static_cast<uint32_t>(caches.size()), caches.data()),
+				"Failed to merge pipeline caches with error %s\n");
+		}
+
+		if (m_path.empty())
+			return VK_SUCCESS;
+
+		size_t size = 0;
+		CHECK_VK_CALL(m_dispatch->vkGetPipelineCacheData(m_dispatch->device, m_mainCache, &size, nullptr),
+			"Failed to get pipeline cache size with error %s\n");
+
+		std::vector<uint8_t> data(size);
+		CHECK_VK_CALL(m_dispatch->vkGetPipelineCacheData(m_dispatch->device, m_mainCache, &size, data.data()),
+			"Failed to get pipeline cache data with error %s\n");
+
+		// The old file may still be mapped, renaming over it leaves the mapping pointing at the old data, which is fine
+		if (!WriteFileAtomic(m_path.c_str(), data.data(), size))
+		{
+			PrintError("Failed to save pipeline cache to %s\n", m_path.c_str());
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		return VK_SUCCESS;
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -0,0 +1,424 @@
+#pragma once
+
+#ifndef VKHL_PIPELINECOMPILER_HPP
+#define VKHL_PIPELINECOMPILER_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cstdint>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Hash.hpp"
+#include "PipelineCache.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	enum class PipelinePriority : uint8_t
+	{
+		Frame,		// Needed to draw the current frame
+		Prewarm,	// Might be needed later, only built when there is nothing more urgent
+	};
+
+	inline constexpr uint32_t PipelinePriorityCount = 2;
+
+	struct PipelineBuildInfo
+	{
+		Hash key; // Identifies the pipeline, i.e. a hash of its state. Requests with a key that was seen before share its build
+		PipelinePriority priority = PipelinePriority::Frame;
+
+		// Exactly one of these, everything they point to must stay valid until the build is done
+		const VkGraphicsPipelineCreateInfo* graphics = nullptr;
+		const VkComputePipelineCreateInfo* compute = nullptr;
+	};
+
+	struct PipelineCompilerCreateInfo
+	{
+		uint32_t workerCount = 0; // 0 uses one less than the hardware threads
+		PipelineCache* cache = nullptr; // Workers build with their own cache from it when it is per thread, merged by PipelineCache::Save
+	};
+
+	// Builds pipelines on a pool of worker threads. Each worker has a queue per priority and steals from the others when its own are empty,
+	// and every Frame request is built before any Prewarm one. Pipelines are owned by the compiler until Destroy. Thread safe
+	class PipelineCompiler
+	{
+	public:
+		PipelineCompiler() = default;
+		PipelineCompiler(const PipelineCompiler&) = delete;
+		PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+		~PipelineCompiler() { Destroy(); }
+
+		SmartResult Init(const DeviceDispatch& dispatch, const PipelineCompilerCreateInfo& createInfo = {});
+		// Drops the builds that haven't started, waits for the rest and destroys every pipeline.
+		// Wait calls on a dropped build return VK_ERROR_INITIALIZATION_FAILED, and calls already blocked in Wait or WaitIdle return before
+		// the builds are freed. No other call may start while it runs
+		void Destroy();
+
+		// Queues a build, or raises the priority of the one already queued for buildInfo.key.
+		// A key whose build failed is built again from buildInfo
+		SmartResult Request(const PipelineBuildInfo& buildInfo);
+
+		// Returns the pipeline if it is built, otherwise VK_NULL_HANDLE. Never blocks
+		VkPipeline TryGet(Hash key) const;
+		// Blocks until the pipeline is built. A build no worker has started yet is done on the calling thread instead of waiting for a turn.
+		// Returns the build's error if it failed, until the key is requested again
+		SmartResult Wait(Hash key, VkPipeline* pipelineOut);
+		// Blocks until every queued build is done, i.e. before PipelineCache::Save
+		void WaitIdle();
+
+		uint32_t GetWorkerCount() const { return m_workerCount; }
+
+	private:
+		enum class BuildState : uint8_t
+		{
+			Queued,
+			Building,
+			Done,
+		};
+
+		struct Build
+		{
+			Hash key;
+			const VkGraphicsPipelineCreateInfo* graphics;
+			const VkComputePipelineCreateInfo* compute;
+			std::atomic<BuildState> state = BuildState::Queued;
+			std::atomic<PipelinePriority> priority;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			VkResult result = VK_SUCCESS;
+		};
+
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<Build*> queues[PipelinePriorityCount];
+			std::thread thread;
+		};
+
+		void Push(Build* build, PipelinePriority priority);
+		Build* Pop(uint32_t workerIndex);
+		void RunBuild(Build* build);
+		void RunWorker(uint32_t workerIndex);
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		PipelineCache* m_cache = nullptr;
+		uint32_t m_workerCount = 0;
+		std::unique_ptr<Worker[]> m_workers;
+		std::atomic<uint32_t> m_nextWorker = 0;
+
+		mutable std::mutex m_buildsMutex;
+		std::unordered_map<Hash, std::unique_ptr<Build>> m_builds;
+
+		std::mutex m_wakeMutex;
+		std::condition_variable m_wake;		// Work was queued, or the workers should stop
+		std::condition_variable m_done;		// A build finished
+		std::atomic<uint32_t> m_queuedCount = 0;	// Entries in every queue, including ones for builds that already started
+		uint32_t m_pendingCount = 0;		// Builds that aren't done, guarded by m_wakeMutex
+		uint32_t m_waiterCount = 0;			// Threads in Wait or WaitIdle, guarded by m_wakeMutex. Destroy keeps the builds until they left
+		std::atomic<bool> m_stop = false;	// Set under m_wakeMutex
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE SmartResult PipelineCompiler::Init(const DeviceDispatch& dispatch, const PipelineCompilerCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCompiler::Init");
+
+		m_dispatch = &dispatch;
+		m_cache = createInfo.cache;
+		m_workerCount = createInfo.workerCount ? createInfo.workerCount : std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		m_stop = false;
+
+		m_workers = std::make_unique<Worker[]>(m_workerCount);
+		for (uint32_t i = 0; i < m_workerCount; i++)
+			m_workers[i].thread = std::thread(&PipelineCompiler::RunWorker, this, i);
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void PipelineCompiler::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCompiler::Destroy");
+
+		if (!m_workers)
+			return;
+
+		// Builds still in the queues are dropped, the ones running finish first. Held until the builds are gone, so no Wait can find one after
+		std::lock_guard buildsLock(m_buildsMutex);
+		{
+			std::unique_lock lock(m_wakeMutex);
+			m_stop = true;
+
+			// Dropped builds count as failed, so whoever waits on them wakes up
+			for (auto& [key, build] : m_builds)
+			{
+				BuildState expected = BuildState::Queued;
+				if (build->state.compare_exchange_strong(expected, BuildState::Done, std::memory_order_acq_rel))
+				{
+					build->graphics = nullptr;
+					build->compute = nullptr;
+					build->result = VK_ERROR_INITIALIZATION_FAILED;
+					m_pendingCount--;
+				}
+			}
+		}
+		m_wake.notify_all();
+		m_done.notify_all();
+
+		for (uint32_t i = 0; i < m_workerCount; i++)
+			m_workers[i].thread.join();
+		m_workers.reset();
+		m_workerCount = 0;
+
+		// Builds a Wait runs on its own thread finish too, then every waiter reads its build before it is freed
+		{
+			std::unique_lock lock(m_wakeMutex);
+			m_done.wait(lock, [this] { return m_pendingCount == 0 && m_waiterCount == 0; });
+		}
+
+		for (auto& [key, build] : m_builds)
+		{
+			if (build->pipeline)
+				m_dispatch->vkDestroyPipeline(m_dispatch->device, build->pipeline, GetAllocationCallbacks());
+		}
+
+		m_builds.clear();
+		m_queuedCount = 0;
+	}
+
+	VKHL_INLINE void PipelineCompiler::Push(Build* build, PipelinePriority priority)
+	{
+		// Spread over the workers, stealing evens out the rest
+		Worker& worker = m_workers[m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workerCount];
+		{
+			std::lock_guard lock(worker.mutex);
+			worker.queues[static_cast<uint32_t>(priority)].push_back(build);
+		}
+
+		{
+			std::lock_guard lock(m_wakeMutex);
+			m_queuedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		m_wake.notify_one();
+	}
+
+	VKHL_INLINE PipelineCompiler::Build* PipelineCompiler::Pop(uint32_t workerIndex)
+	{
+		for (uint32_t priority = 0; priority < PipelinePriorityCount; priority++)
+		{
+			// Own queue oldest first, then the newest from the others so the owners keep their order
+			for (uint32_t i = 0; i < m_workerCount; i++)
+			{
+				Worker& worker = m_workers[(workerIndex + i) % m_workerCount];
+				std::lock_guard lock(worker.mutex);
+
+				auto& queue = worker.queues[priority];
+				if (queue.empty())
+					continue;
+
+				Build* build;
+				if (i == 0)
+				{
+					build = queue.front();
+					queue.pop_front();
+				}
+				else
+				{
+					build = queue.back();
+					queue.pop_back();
+				}
+
+				m_queuedCount.fetch_sub(1, std::memory_order_relaxed);
+				return build;
+			}
+		}
+
+		return nullptr;
+	}
+
+	VKHL_INLINE void PipelineCompiler::RunBuild(Build* build)
+	{
+		// A raised priority queues the build twice, only the first one to get here builds it
+		BuildState expected = BuildState::Queued;
+		if (!build->state.compare_exchange_strong(expected, BuildState::Building, std::memory_order_acquire))
+			return;
+
+		VKHL_TRACE_ZONE("vkhl::PipelineCompiler::RunBuild");
+
+		const VkPipelineCache cache = m_cache ? m_cache->Get() : VK_NULL_HANDLE;
+		if (build->graphics)
+			build->result = m_dispatch->vkCreateGraphicsPipelines(m_dispatch->device, cache, 1, build->graphics, GetAllocationCallbacks(), &build->pipeline);
+		else
+			build->result = m_dispatch->vkCreateComputePipelines(m_dispatch->device, cache, 1, build->compute, GetAllocationCallbacks(), &build->pipeline);
+
+		if (build->result < 0)
+		{
+			PrintError("Failed to build pipeline %016llx with error %s\n", static_cast<unsigned long long>(build->key), string_VkResult(build->result));
+			build->pipeline = VK_NULL_HANDLE;
+		}
+
+		// The caller's structs may be gone once the build is done
+		build->graphics = nullptr;
+		build->compute = nullptr;
+
+		{
+			std::lock_guard lock(m_wakeMutex);
+			build->state.store(BuildState::Done, std::memory_order_release);
+			m_pendingCount--;
+		}
+		m_done.notify_all();
+	}
+
+	VKHL_INLINE void PipelineCompiler::RunWorker(uint32_t workerIndex)
+	{
+		VKHL_TRACE_THREAD_NAME("vkhl pipeline compiler");
+
+		for (;;)
+		{
+			if (m_stop.load(std::memory_order_relaxed))
+				return;
+
+			if (Build* build = Pop(workerIndex))
+			{
+				RunBuild(build);
+				continue;
+			}
+
+			std::unique_lock lock(m_wakeMutex);
+			m_wake.wait(lock, [this] { return m_stop || m_queuedCount.load(std::memory_order_relaxed) > 0; });
+			if (m_stop)
+				return;
+		}
+	}
+
+	VKHL_INLINE SmartResult PipelineCompiler::Request(const PipelineBuildInfo& buildInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCompiler::Request");
+
+		if (!buildInfo.graphics == !buildInfo.compute)
+		{
+			PrintError("A pipeline build needs either graphics or compute create info\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		Build* build;
+		{
+			std::lock_guard lock(m_buildsMutex);
+			auto [found, inserted] = m_builds.try_emplace(buildInfo.key);
+			if (!inserted)
+			{
+				build = found->second.get();
+				const BuildState state = build->state.load(std::memory_order_acquire);
+				if (state == BuildState::Done && build->result < 0)
+				{
+					// Try a failed build again instead of handing out VK_NULL_HANDLE for good. Nothing else touches a done build,
+					// and Wait reads it under m_wakeMutex
+					std::lock_guard wakeLock(m_wakeMutex);
+					build->graphics = buildInfo.graphics;
+					build->compute = buildInfo.compute;
+					build->result = VK_SUCCESS;
+					build->priority.store(buildInfo.priority, std::memory_order_relaxed);
+					build->state.store(BuildState::Queued, std::memory_order_release);
+					m_pendingCount++;
+				}
+				else
+				{
+					// Queue it again at the higher priority, whichever entry is popped first builds it
+					if (buildInfo.priority >= build->priority.load(std::memory_order_relaxed) || state != BuildState::Queued)
+						return VK_SUCCESS;
+
+					build->priority.store(buildInfo.priority, std::memory_order_relaxed);
+				}
+			}
+			else
+			{
+				found->second = std::make_unique<Build>();
+				build = found->second.get();
+				build->key = buildInfo.key;
+				build->graphics = buildInfo.graphics;
+				build->compute = buildInfo.compute;
+				build->priority.store(buildInfo.priority, std::memory_order_relaxed);
+
+				std::lock_guard wakeLock(m_wakeMutex);
+				m_pendingCount++;
+			}
+		}
+
+		Push(build, buildInfo.priority);
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE VkPipeline PipelineCompiler::TryGet(Hash key) const
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCompiler::TryGet");
+
+		std::lock_guard lock(m_buildsMutex);
+		auto found = m_builds.find(key);
+		if (found == m_builds.end() || found->second->state.load(std::memory_order_acquire) != BuildState::Done)
+			return VK_NULL_HANDLE;
+
+		return found->second->pipeline;
+	}
+
+	VKHL_INLINE SmartResult PipelineCompiler::Wait(Hash key, VkPipeline* pipelineOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCompiler::Wait");
+
+		Build* build;
+		{
+			std::lock_guard lock(m_buildsMutex);
+			auto found = m_builds.find(key);
+			if (found == m_builds.end())
+			{
+				PrintError("Pipeline %016llx was never requested\n", static_cast<unsigned long long>(key));
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+			build = found->second.get();
+
+			// Counted while the build can't be freed yet, Destroy waits for it
+			std::lock_guard wakeLock(m_wakeMutex);
+			m_waiterCount++;
+		}
+
+		// Builds are never removed before Destroy, so build stays valid. Its queue entries are skipped once it started
+		RunBuild(build);
+
+		std::unique_lock lock(m_wakeMutex);
+		m_done.wait(lock, [build] { return build->state.load(std::memory_order_acquire) == BuildState::Done; });
+
+		*pipelineOut = build->pipeline;
+		const VkResult result = build->result;
+		if (--m_waiterCount == 0 && m_stop)
+			m_done.notify_all();
+		return result;
+	}
+
+	VKHL_INLINE void PipelineCompiler::WaitIdle()
+	{
+		VKHL_TRACE_ZONE("vkhl::PipelineCompiler::WaitIdle");
+
+		std::unique_lock lock(m_wakeMutex);
+		m_waiterCount++;
+		m_done.wait(lock, [this] { return m_pendingCount == 0; });
+		if (--m_waiterCount == 0 && m_stop)
+			m_done.notify_all();
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -0,0 +1,505 @@
+#pragma once
+
+#ifndef VKHL_QUEUESCHEDULER_HPP
+#define VKHL_QUEUESCHEDULER_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "PhysicalDevice.hpp"
+#include "Device.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// A point on one queue's timeline, done once the queue's semaphore reaches value
+	struct QueueTicket
+	{
+		uint32_t queue;		// Index into PhysicalDeviceInfo::queueAssignments
+		uint64_t value;		// 0 is always complete
+	};
+
+	// Makes a submit wait for ticket, on any queue
+	struct QueueTicketWait
+	{
+		QueueTicket ticket;
+		VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	};
+
+	// Makes a submit wait for a binary semaphore, i.e. from vkAcquireNextImageKHR
+	struct QueueSemaphoreWait
+	{
+		VkSemaphore semaphore;
+		VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	};
+
+	struct QueueSubmitInfo
+	{
+		std::span<const VkCommandBuffer> commandBuffers;
+		std::span<const QueueTicketWait> waits;
+		std::span<const QueueSemaphoreWait> semaphoreWaits;
+		std::span<const VkSemaphore> signalSemaphores;	// Binary semaphores, i.e. for vkQueuePresentKHR
+		VkFence fence = VK_NULL_HANDLE;					// Only needed for APIs that take fences, tickets replace them otherwise
+	};
+
+	// Submits to the queues of a device, giving each its own timeline semaphore.
+	// Every submit signals the next value on its queue's timeline and hands it back as a QueueTicket, which the CPU can poll or wait on,
+	// and other submits can wait on to express cross queue dependencies.
+	// Binary semaphores and fences, still needed for swapchains, are recycled instead of being created per frame. Thread safe
+	class QueueScheduler
+	{
+	public:
+		QueueScheduler() = default;
+		QueueScheduler(const QueueScheduler&) = delete;
+		QueueScheduler& operator=(const QueueScheduler&) = delete;
+		~QueueScheduler() { Destroy(); }
+
+		// Queue i of the scheduler is physicalDeviceInfo.queueAssignments[i], using deviceInfo.queues[i].
+		// Shared assignments end up on the same timeline. Requires timeline semaphores (DeviceInfo::timelineSemaphore)
+		SmartResult Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const DeviceInfo& deviceInfo);
+		// Waits for every queue to reach its last ticket, then destroys the semaphores and fences
+		void Destroy();
+
+		SmartResult Submit(uint32_t queue, const QueueSubmitInfo& submitInfo, QueueTicket* ticketOut = nullptr);
+
+		bool IsComplete(QueueTicket ticket);
+		SmartResult Wait(std::span<const QueueTicket> tickets, uint64_t timeout = UINT64_MAX);
+		SmartResult Wait(QueueTicket ticket, uint64_t timeout = UINT64_MAX) { return Wait({ &ticket, 1 }, timeout); }
+		// Waits for the last submit on queue, cheaper than vkQueueWaitIdle since it doesn't take the queue's lock
+		SmartResult WaitIdle(uint32_t queue, uint64_t timeout = UINT64_MAX) { return Wait(GetLastTicket(queue), timeout); }
+
+		// Latest value the GPU has reached on queue, polls the semaphore
+		uint64_t GetCompletedValue(uint32_t queue);
+		QueueTicket GetLastTicket(uint32_t queue) const;
+
+		uint32_t GetQueueCount() const { return static_cast<uint32_t>(m_queueTimelines.size()); }
+		VkQueue GetQueue(uint32_t queue) const { return m_timelines[m_queueTimelines[queue]].queue; }
+		uint32_t GetQueueFamilyIndex(uint32_t queue) const { return m_timelines[m_queueTimelines[queue]].queueFamilyIndex; }
+		VkSemaphore GetSemaphore(uint32_t queue) const { return m_timelines[m_queueTimelines[queue]].semaphore; }
+
+		// Returns an unsignalled fence. Release it once it was submitted, it is reused once it signals.
+		// Pass submitted = false if it was never submitted
+		SmartResult AcquireFence(VkFence* fenceOut);
+		void ReleaseFence(VkFence fence, bool submitted = true);
+
+		// Returns an unsignalled binary semaphore. Release it with the ticket of the last submit that waits on it, it is reused after that ticket
+		SmartResult AcquireSemaphore(VkSemaphore* semaphoreOut);
+		void ReleaseSemaphore(VkSemaphore semaphore, QueueTicket lastUse);
+
+	private:
+		struct Timeline
+		{
+			VkQueue queue = VK_NULL_HANDLE;
+			uint32_t queueFamilyIndex = 0;
+			VkSemaphore semaphore = VK_NULL_HANDLE;
+			std::mutex submitMutex; // vkQueueSubmit needs the queue to be externally synchronized
+			std::atomic<uint64_t> submittedValue = 0;
+			std::atomic<uint64_t> completedValue = 0; // Cached, may be behind the semaphore
+		};
+
+		struct PendingSemaphore
+		{
+			VkSemaphore semaphore;
+			QueueTicket lastUse;
+		};
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		std::unique_ptr<Timeline[]> m_timelines;
+		uint32_t m_timelineCount = 0;
+		std::vector<uint32_t> m_queueTimelines; // Scheduler queue -> timeline
+
+		std::mutex m_poolMutex;
+		std::vector<VkFence> m_freeFences;
+		std::vector<VkFence> m_pendingFences;
+		std::vector<VkSemaphore> m_freeSemaphores;
+		std::vector<PendingSemaphore> m_pendingSemaphores;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	VKHL_INLINE SmartResult QueueScheduler::Init(const DeviceDispatch& dispatch, const PhysicalDeviceInfo& physicalDeviceInfo, const DeviceInfo& deviceInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::Init");
+
+		VkResult result = VK_SUCCESS;
+
+		if (!deviceInfo.timelineSemaphore)
+		{
+			PrintError("QueueScheduler needs timeline semaphores, create the device with performanceFeatures\n");
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		if (deviceInfo.queues.size() != physicalDeviceInfo.queueAssignments.size())
+		{
+			PrintError("deviceInfo doesn't have a queue for every queue assignment, it must come from CreateDevice with physicalDeviceInfo\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		m_dispatch = &dispatch;
+		m_timelines = std::make_unique<Timeline[]>(deviceInfo.queues.size());
+		m_timelineCount = 0;
+		m_queueTimelines.resize(deviceInfo.queues.size());
+
+		for (size_t i = 0; i < deviceInfo.queues.size(); i++)
+		{
+			// Shared assignments give the same VkQueue, which has to be one timeline
+			uint32_t timeline = 0;
+			while (timeline < m_timelineCount && m_timelines[timeline].queue != deviceInfo.queues[i])
+				timeline++;
+
+			m_queueTimelines[i] = timeline;
+			if (timeline < m_timelineCount)
+				continue;
+
+			VkSemaphoreTypeCreateInfo typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = 0;
+
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			semaphoreInfo.pNext = &typeInfo;
+
+			Timeline& newTimeline = m_timelines[m_timelineCount];
+			newTimeline.queue = deviceInfo.queues[i];
+			newTimeline.queueFamilyIndex = physicalDeviceInfo.queueAssignments[i].queueFamilyIndex;
+
+			result = dispatch.vkCreateSemaphore(dispatch.device, &semaphoreInfo, GetAllocationCallbacks(), &newTimeline.semaphore);
+			if (result < 0)
+			{
+				PrintError("Failed to create queue timeline semaphore with error %s\n", string_VkResult(result));
+				Destroy();
+				return result;
+			}
+
+			m_timelineCount++;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void QueueScheduler::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		// Semaphores and fences in the pools may still be in use
+		std::vector<VkSemaphore> semaphores;
+		std::vector<uint64_t> values;
+		for (uint32_t i = 0; i < m_timelineCount; i++)
+		{
+			semaphores.push_back(m_timelines[i].semaphore);
+			values.push_back(m_timelines[i].submittedValue);
+		}
+
+		if (!semaphores.empty())
+		{
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+			waitInfo.pSemaphores = semaphores.data();
+			waitInfo.pValues = values.data();
+			m_dispatch->vkWaitSemaphores(m_dispatch->device, &waitInfo, UINT64_MAX);
+		}
+
+		for (auto semaphore : semaphores)
+			m_dispatch->vkDestroySemaphore(m_dispatch->device, semaphore, GetAllocationCallbacks());
+
+		std::lock_guard lock(m_poolMutex);
+		for (auto fence : m_freeFences)
+			m_dispatch->vkDestroyFence(m_dispatch->device, fence, GetAllocationCallbacks());
+		for (auto fence : m_pendingFences)
+			m_dispatch->vkDestroyFence(m_dispatch->device, fence, GetAllocationCallbacks());
+		for (auto semaphore : m_freeSemaphores)
+			m_dispatch->vkDestroySemaphore(m_dispatch->device, semaphore, GetAllocationCallbacks());
+		for (auto& pending : m_pendingSemaphores)
+			m_dispatch->vkDestroySemaphore(m_dispatch->device, pending.semaphore, GetAllocationCallbacks());
+
+		m_freeFences.clear();
+		m_pendingFences.clear();
+		m_freeSemaphores.clear();
+		m_pendingSemaphores.clear();
+		m_timelines.reset();
+		m_timelineCount = 0;
+		m_queueTimelines.clear();
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE SmartResult QueueScheduler::Submit(uint32_t queue, const QueueSubmitInfo& submitInfo, QueueTicket* ticketOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::Submit");
+
+		VkResult result = VK_SUCCESS;
+		Timeline& timeline = m_timelines[m_queueTimelines[queue]];
+
+		// Timeline waits first, then binary ones. Only the latest value per timeline matters, and completed ones can be dropped
+		std::vector<VkSemaphore> waitSemaphores;
+		std::vector<uint64_t> waitValues;
+		std::vector<VkPipelineStageFlags> waitStages;
+		waitSemaphores.reserve(submitInfo.waits.size() + submitInfo.semaphoreWaits.size());
+
+		for (const auto& wait : submitInfo.waits)
+		{
+			if (IsComplete(wait.ticket))
+				continue;
+
+			const VkSemaphore semaphore = GetSemaphore(wait.ticket.queue);
+			auto existing = std::find(waitSemaphores.begin(), waitSemaphores.end(), semaphore);
+			if (existing != waitSemaphores.end())
+			{
+				const size_t index = existing - waitSemaphores.begin();
+				waitValues[index] = std::max(waitValues[index], wait.ticket.value);
+				waitStages[index] |= wait.stageMask;
+				continue;
+			}
+
+			waitSemaphores.push_back(semaphore);
+			waitValues.push_back(wait.ticket.value);
+			waitStages.push_back(wait.stageMask);
+		}
+
+		for (const auto& wait : submitInfo.semaphoreWaits)
+		{
+			waitSemaphores.push_back(wait.semaphore);
+			waitValues.push_back(0); // Ignored for binary semaphores
+			waitStages.push_back(wait.stageMask);
+		}
+
+		std::vector<VkSemaphore> signalSemaphores;
+		std::vector<uint64_t> signalValues;
+		signalSemaphores.reserve(submitInfo.signalSemaphores.size() + 1);
+		signalSemaphores.push_back(timeline.semaphore);
+		signalSemaphores.insert(signalSemaphores.end(), submitInfo.signalSemaphores.begin(), submitInfo.signalSemaphores.end());
+		signalValues.resize(signalSemaphores.size(), 0);
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+		timelineInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+		VkSubmitInfo vkSubmitInfo{};
+		vkSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		vkSubmitInfo.pNext = &timelineInfo;
+		vkSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		vkSubmitInfo.pWaitSemaphores = waitSemaphores.data();
+		vkSubmitInfo.pWaitDstStageMask = waitStages.data();
+		vkSubmitInfo.commandBufferCount = static_cast<uint32_t>(submitInfo.commandBuffers.size());
+		vkSubmitInfo.pCommandBuffers = submitInfo.commandBuffers.data();
+		vkSubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		vkSubmitInfo.pSignalSemaphores = signalSemaphores.data();
+
+		// The value is only taken under the lock, so values reach the queue in order
+		std::lock_guard lock(timeline.submitMutex);
+		const uint64_t value = timeline.submittedValue.load(std::memory_order_relaxed) + 1;
+		signalValues[0] = value;
+
+		CHECK_VK_CALL(m_dispatch->vkQueueSubmit(timeline.queue, 1, &vkSubmitInfo, submitInfo.fence),
+			"Failed to submit to queue with error %s\n");
+
+		timeline.submittedValue.store(value, std::memory_order_release);
+		if (ticketOut)
+			*ticketOut = { queue, value };
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE uint64_t QueueScheduler::GetCompletedValue(uint32_t queue)
+	{
+		Timeline& timeline = m_timelines[m_queueTimelines[queue]];
+
+		uint64_t value;
+		if (m_dispatch->vkGetSemaphoreCounterValue(m_dispatch->device, timeline.semaphore, &value) < 0)
+			return timeline.completedValue.load(std::memory_order_relaxed);
+
+		// Other threads may have stored a newer value already
+		uint64_t cached = timeline.completedValue.load(std::memory_order_relaxed);
+		while (cached < value && !timeline.completedValue.compare_exchange_weak(cached, value, std::memory_order_relaxed))
+			;
+
+		return std::max(cached, value);
+	}
+
+	VKHL_INLINE QueueTicket QueueScheduler::GetLastTicket(uint32_t queue) const
+	{
+		return { queue, m_timelines[m_queueTimelines[queue]].submittedValue.load(std::memory_order_acquire) };
+	}
+
+	VKHL_INLINE bool QueueScheduler::IsComplete(QueueTicket ticket)
+	{
+		// Try the cached value before going to the driver
+		if (ticket.value <= m_timelines[m_queueTimelines[ticket.queue]].completedValue.load(std::memory_order_relaxed))
+			return true;
+
+		return ticket.value <= GetCompletedValue(ticket.queue);
+	}
+
+	VKHL_INLINE SmartResult QueueScheduler::Wait(std::span<const QueueTicket> tickets, uint64_t timeout)
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::Wait");
+
+		VkResult result = VK_SUCCESS;
+
+		std::vector<VkSemaphore> semaphores;
+		std::vector<uint64_t> values;
+		for (auto ticket : tickets)
+		{
+			if (ticket.value > m_timelines[m_queueTimelines[ticket.queue]].submittedValue.load(std::memory_order_acquire))
+			{
+				PrintError("Waiting on a ticket that was never submitted\n");
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+
+			if (IsComplete(ticket))
+				continue;
+
+			semaphores.push_back(GetSemaphore(ticket.queue));
+			values.push_back(ticket.value);
+		}
+
+		if (semaphores.empty())
+			return VK_SUCCESS;
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+		waitInfo.pSemaphores = semaphores.data();
+		waitInfo.pValues = values.data();
+
+		CHECK_VK_CALL(m_dispatch->vkWaitSemaphores(m_dispatch->device, &waitInfo, timeout),
+			"Failed to wait for queue tickets with error %s\n");
+
+		return result; // VK_TIMEOUT if the timeout ran out
+	}
+
+	VKHL_INLINE SmartResult QueueScheduler::AcquireFence(VkFence* fenceOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::AcquireFence");
+
+		VkResult result = VK_SUCCESS;
+		std::lock_guard lock(m_poolMutex);
+
+		if (m_freeFences.empty() && !m_pendingFences.empty())
+		{
+			// Move every signalled fence to the free list, with one reset for all of them
+			auto signalled = std::partition(m_pendingFences.begin(), m_pendingFences.end(), [this](VkFence fence) {
+					return m_dispatch->vkGetFenceStatus(m_dispatch->device, fence) != VK_SUCCESS;
+				});
+
+			if (signalled != m_pendingFences.end())
+			{
+				const uint32_t count = static_cast<uint32_t>(m_pendingFences.end() - signalled);
+				CHECK_VK_CALL(m_dispatch->vkResetFences(m_dispatch->device, count, &*signalled),
+					"Failed to reset fences with error %s\n");
+
+				m_freeFences.insert(m_freeFences.end(), signalled, m_pendingFences.end());
+				m_pendingFences.erase(signalled, m_pendingFences.end());
+			}
+		}
+
+		if (!m_freeFences.empty())
+		{
+			*fenceOut = m_freeFences.back();
+			m_freeFences.pop_back();
+			return VK_SUCCESS;
+		}
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		CHECK_VK_CALL(m_dispatch->vkCreateFence(m_dispatch->device, &fenceInfo, GetAllocationCallbacks(), fenceOut),
+			"Failed to create fence with error %s\n");
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void QueueScheduler::ReleaseFence(VkFence fence, bool submitted)
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::ReleaseFence");
+
+		std::lock_guard lock(m_poolMutex);
+		if (submitted)
+			m_pendingFences.push_back(fence);
+		else
+			m_freeFences.push_back(fence);
+	}
+
+	VKHL_INLINE SmartResult QueueScheduler::AcquireSemaphore(VkSemaphore* semaphoreOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::AcquireSemaphore");
+
+		VkResult result = VK_SUCCESS;
+		std::lock_guard lock(m_poolMutex);
+
+		if (m_freeSemaphores.empty() && !m_pendingSemaphores.empty())
+		{
+			auto kept = m_pendingSemaphores.begin();
+			for (auto& pending : m_pendingSemaphores)
+			{
+				if (IsComplete(pending.lastUse))
+					m_freeSemaphores.push_back(pending.semaphore);
+				else
+					*kept++ = pending;
+			}
+
+			m_pendingSemaphores.erase(kept, m_pendingSemaphores.end());
+		}
+
+		if (!m_freeSemaphores.empty())
+		{
+			*semaphoreOut = m_freeSemaphores.back();
+			m_freeSemaphores.pop_back();
+			return VK_SUCCESS;
+		}
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		CHECK_VK_CALL(m_dispatch->vkCreateSemaphore(m_dispatch->device, &semaphoreInfo, GetAllocationCallbacks(), semaphoreOut),
+			"Failed to create semaphore with error %s\n");
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void QueueScheduler::ReleaseSemaphore(VkSemaphore semaphore, QueueTicket lastUse)
+	{
+		VKHL_TRACE_ZONE("vkhl::QueueScheduler::ReleaseSemaphore");
+
+		std::lock_guard lock(m_poolMutex);
+		m_pendingSemaphores.push_back({ semaphore, lastUse });
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
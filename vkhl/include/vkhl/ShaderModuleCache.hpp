@@ -0,0 +1,377 @@
+#pragma once
+
+#ifndef VKHL_SHADERMODULECACHE_HPP
+#define VKHL_SHADERMODULECACHE_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <span>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Device.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <cstring>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	struct ShaderModuleCacheCreateInfo
+	{
+		uint32_t maxUnusedModules = 256; // VkShaderModules kept after their last Release, the least recently released are destroyed first
+		bool moduleIdentifiers = true; // Use VK_EXT_shader_module_identifier if CreateDevice enabled it
+	};
+
+	// SPIR-V deduplicated by content hash, which is what identifies a shader in the cache.
+	// Files are mapped instead of read, and a VkShaderModule is only created on the first Acquire.
+	// Modules nobody uses are destroyed past maxUnusedModules, the SPIR-V stays mapped so they can be created again. Thread safe
+	class ShaderModuleCache
+	{
+	public:
+		ShaderModuleCache() = default;
+		ShaderModuleCache(const ShaderModuleCache&) = delete;
+		ShaderModuleCache& operator=(const ShaderModuleCache&) = delete;
+		~ShaderModuleCache() { Destroy(); }
+
+		// deviceInfo comes from CreateDevice for the device that dispatch belongs to
+		SmartResult Init(const DeviceDispatch& dispatch, const DeviceInfo& deviceInfo, const ShaderModuleCacheCreateInfo& createInfo = {});
+		// Destroys every module and unmaps every file, nothing may be acquired
+		void Destroy();
+
+		// Maps a SPIR-V file, a path that was loaded before isn't read again. hashOut identifies the shader
+		SmartResult Load(const char* path, Hash* hashOut);
+		// Copies SPIR-V from memory
+		SmartResult Add(std::span<const uint32_t> code, Hash* hashOut);
+
+		// Returns the shader's VkShaderModule, creating it if it doesn't exist. Every Acquire needs a Release
+		SmartResult Acquire(Hash shader, VkShaderModule* moduleOut);
+		void Release(Hash shader);
+
+		// Fills identifierOut with the shader's module identifier and returns true, or returns false if identifiers aren't enabled.
+		// Chain it into VkPipelineShaderStageCreateInfo with a VK_NULL_HANDLE module and create the pipeline with
+		// VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT. Only on VK_PIPELINE_COMPILE_REQUIRED does the full module need to be acquired
+		bool GetIdentifier(Hash shader, VkPipelineShaderStageModuleIdentifierCreateInfoEXT* identifierOut);
+
+		// Destroys every module that has no users
+		void Trim();
+
+		size_t GetShaderCount() const;
+		bool UsesIdentifiers() const { return m_useIdentifiers; }
+
+	private:
+		struct Shader
+		{
+			std::mutex mutex; // Held while the module or identifier is made, outside the cache lock
+			MappedFile file;
+			std::vector<uint32_t> ownedCode; // Used instead of file for Add
+			std::span<const uint32_t> code;
+
+			VkShaderModule module = VK_NULL_HANDLE;
+			uint32_t users = 0;
+			std::list<Shader*>::iterator unusedEntry;
+			bool unused = false; // In m_unused
+
+			VkShaderModuleIdentifierEXT identifier{};
+			bool identifierQueried = false;
+		};
+
+		SmartResult Insert(Hash hash, std::unique_ptr<Shader> shader, Hash* hashOut);
+		Shader* Find(Hash shader) const;
+		void DestroyModule(Shader* shader);
+		void Evict();
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		uint32_t m_maxUnusedModules = 256;
+		bool m_useIdentifiers = false;
+
+		mutable std::mutex m_mutex;
+		std::unordered_map<Hash, std::unique_ptr<Shader>> m_shaders;
+		std::unordered_map<std::string, Hash> m_paths;
+		std::list<Shader*> m_unused; // Shaders with a module and no users, least recently released first
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE SmartResult ShaderModuleCache::Init(const DeviceDispatch& dispatch, const DeviceInfo& deviceInfo, const ShaderModuleCacheCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::Init");
+
+		m_dispatch = &dispatch;
+		m_maxUnusedModules = createInfo.maxUnusedModules;
+		m_useIdentifiers = createInfo.moduleIdentifiers && deviceInfo.shaderModuleIdentifier && dispatch.vkGetShaderModuleCreateInfoIdentifierEXT;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void ShaderModuleCache::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::Destroy");
+
+		std::lock_guard lock(m_mutex);
+		for (auto& [hash, shader] : m_shaders)
+		{
+			if (shader->users > 0)
+				PrintWarning("Shader %016llx still has %u users, destroying it anyway\n", static_cast<unsigned long long>(hash), shader->users);
+
+			if (shader->module)
+				m_dispatch->vkDestroyShaderModule(m_dispatch->device, shader->module, GetAllocationCallbacks());
+			UnmapFile(&shader->file);
+		}
+
+		m_shaders.clear();
+		m_paths.clear();
+		m_unused.clear();
+	}
+
+	VKHL_INLINE SmartResult ShaderModuleCache::Load(const char* path, Hash* hashOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::Load");
+
+		{
+			std::lock_guard lock(m_mutex);
+			auto found = m_paths.find(path);
+			if (found != m_paths.end())
+			{
+				*hashOut = found->second;
+				return VK_SUCCESS;
+			}
+		}
+
+		auto shader = std::make_unique<Shader>();
+		if (!MapFile(path, &shader->file))
+		{
+			PrintError("Failed to map shader %s\n", path);
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		// SPIR-V is a stream of words, vkCreateShaderModule rejects anything else
+		if (shader->file.size % sizeof(uint32_t) != 0)
+		{
+			PrintError("Shader %s isn't SPIR-V, its size isn't a multiple of 4\n", path);
+			UnmapFile(&shader->file);
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		// Mappings are page aligned, so the words are aligned too
+		shader->code = { static_cast<const uint32_t*>(shader->file.data), shader->file.size / sizeof(uint32_t) };
+
+		const Hash hash = HashBytes(shader->code.data(), shader->code.size_bytes());
+		VkResult result = Insert(hash, std::move(shader), hashOut).GetAndReset();
+		if (result < 0)
+			return result;
+
+		std::lock_guard lock(m_mutex);
+		m_paths.emplace(path, hash);
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult ShaderModuleCache::Add(std::span<const uint32_t> code, Hash* hashOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::Add");
+
+		const Hash hash = HashBytes(code.data(), code.size_bytes());
+		{
+			// Skip the copy for code that is already in the cache
+			std::lock_guard lock(m_mutex);
+			const Shader* existing = Find(hash);
+			if (existing && existing->code.size() == code.size() && std::memcmp(existing->code.data(), code.data(), code.size_bytes()) == 0)
+			{
+				*hashOut = hash;
+				return VK_SUCCESS;
+			}
+		}
+
+		auto shader = std::make_unique<Shader>();
+		shader->ownedCode.assign(code.begin(), code.end());
+		shader->code = shader->ownedCode;
+		return Insert(hash, std::move(shader), hashOut);
+	}
+
+	VKHL_INLINE SmartResult ShaderModuleCache::Insert(Hash hash, std::unique_ptr<Shader> shader, Hash* hashOut)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto [found, inserted] = m_shaders.try_emplace(hash);
+		if (!inserted)
+		{
+			// Same content from somewhere else, keep the first copy
+			const Shader& existing = *found->second;
+			const bool same = existing.code.size() == shader->code.size() && std::memcmp(existing.code.data(), shader->code.data(), shader->code.size_bytes()) == 0;
+			UnmapFile(&shader->file);
+
+			if (!same)
+			{
+				PrintError("Two different shaders have the hash %016llx\n", static_cast<unsigned long long>(hash));
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+		}
+		else
+			found->second = std::move(shader);
+
+		*hashOut = hash;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE ShaderModuleCache::Shader* ShaderModuleCache::Find(Hash shader) const
+	{
+		auto found = m_shaders.find(shader);
+		return found != m_shaders.end() ? found->second.get() : nullptr;
+	}
+
+	VKHL_INLINE SmartResult ShaderModuleCache::Acquire(Hash shader, VkShaderModule* moduleOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::Acquire");
+
+		Shader* entry;
+		{
+			std::lock_guard lock(m_mutex);
+			entry = Find(shader);
+			if (!entry)
+			{
+				PrintError("Shader %016llx isn't in the cache\n", static_cast<unsigned long long>(shader));
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+
+			// A user keeps the module from being evicted
+			entry->users++;
+			if (entry->unused)
+			{
+				m_unused.erase(entry->unusedEntry);
+				entry->unused = false;
+			}
+		}
+
+		// Created outside the cache lock, so different shaders are created in parallel
+		std::lock_guard lock(entry->mutex);
+		if (!entry->module)
+		{
+			VkShaderModuleCreateInfo moduleInfo{};
+			moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			moduleInfo.codeSize = entry->code.size_bytes();
+			moduleInfo.pCode = entry->code.data();
+
+			const VkResult result = m_dispatch->vkCreateShaderModule(m_dispatch->device, &moduleInfo, GetAllocationCallbacks(), &entry->module);
+			if (result < 0)
+			{
+				PrintError("Failed to create shader module %016llx with error %s\n", static_cast<unsigned long long>(shader), string_VkResult(result));
+				entry->module = VK_NULL_HANDLE;
+
+				std::lock_guard cacheLock(m_mutex);
+				entry->users--;
+				return result;
+			}
+		}
+
+		*moduleOut = entry->module;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void ShaderModuleCache::Release(Hash shader)
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::Release");
+
+		std::lock_guard lock(m_mutex);
+		Shader* entry = Find(shader);
+		if (!entry || entry->users == 0)
+		{
+			PrintWarning("Shader %016llx was released more often than it was acquired\n", static_cast<unsigned long long>(shader));
+			return;
+		}
+
+		if (--entry->users == 0 && entry->module)
+		{
+			entry->unusedEntry = m_unused.insert(m_unused.end(), entry);
+			entry->unused = true;
+			Evict();
+		}
+	}
+
+	VKHL_INLINE bool ShaderModuleCache::GetIdentifier(Hash shader, VkPipelineShaderStageModuleIdentifierCreateInfoEXT* identifierOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::GetIdentifier");
+
+		if (!m_useIdentifiers)
+			return false;
+
+		Shader* entry;
+		{
+			std::lock_guard lock(m_mutex);
+			entry = Find(shader);
+		}
+
+		if (!entry)
+			return false;
+
+		// The driver hashes the SPIR-V without creating a module, and the result never changes
+		std::lock_guard lock(entry->mutex);
+		if (!entry->identifierQueried)
+		{
+			VkShaderModuleCreateInfo moduleInfo{};
+			moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			moduleInfo.codeSize = entry->code.size_bytes();
+			moduleInfo.pCode = entry->code.data();
+
+			entry->identifier.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_IDENTIFIER_EXT;
+			m_dispatch->vkGetShaderModuleCreateInfoIdentifierEXT(m_dispatch->device, &moduleInfo, &entry->identifier);
+			entry->identifierQueried = true;
+		}
+
+		if (entry->identifier.identifierSize == 0)
+			return false;
+
+		*identifierOut = {};
+		identifierOut->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT;
+		identifierOut->identifierSize = entry->identifier.identifierSize;
+		identifierOut->pIdentifier = entry->identifier.identifier;
+		return true;
+	}
+
+	VKHL_INLINE void ShaderModuleCache::Trim()
+	{
+		VKHL_TRACE_ZONE("vkhl::ShaderModuleCache::Trim");
+
+		std::lock_guard lock(m_mutex);
+		while (!m_unused.empty())
+			DestroyModule(m_unused.front());
+	}
+
+	VKHL_INLINE size_t ShaderModuleCache::GetShaderCount() const
+	{
+		std::lock_guard lock(m_mutex);
+		return m_shaders.size();
+	}
+
+	VKHL_INLINE void ShaderModuleCache::DestroyModule(Shader* shader)
+	{
+		// Without users nothing holds the shader's lock, so the module can be destroyed under the cache lock
+		m_dispatch->vkDestroyShaderModule(m_dispatch->device, shader->module, GetAllocationCallbacks());
+		shader->module = VK_NULL_HANDLE;
+
+		m_unused.erase(shader->unusedEntry);
+		shader->unused = false;
+	}
+
+	VKHL_INLINE void ShaderModuleCache::Evict()
+	{
+		while (m_unused.size() > m_maxUnusedModules)
+			DestroyModule(m_unused.front());
+	}
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef VKHL_THREADCACHE_HPP
+#define VKHL_THREADCACHE_HPP
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+#include "Definitions.h"
+
+namespace vkhl
+{
+	namespace detail
+	{
+		// Ids for objects that keep state per thread, never reused so a destroyed object's entries can't match a new one
+		inline uint64_t NewThreadCacheId()
+		{
+			static std::atomic<uint64_t> s_ids = 1;
+			return s_ids.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// The per thread state of the last few objects a thread used, most recent first.
+		// Owner is only a tag, so each class gets its own entries. Objects that fall out must keep their own
+		// std::thread::id lookup to find the state again, the cache only saves them the lock
+		template<typename Owner>
+		class ThreadCache
+		{
+		public:
+			static constexpr size_t Size = 8;
+
+			static void* Find(uint64_t id)
+			{
+				Entry* entries = Get();
+				for (size_t i = 0; i < Size; i++)
+				{
+					if (entries[i].id == id)
+					{
+						const Entry found = entries[i];
+						for (; i > 0; i--)
+							entries[i] = entries[i - 1];
+						entries[0] = found;
+						return found.value;
+					}
+				}
+
+				return nullptr;
+			}
+
+			static void Insert(uint64_t id, void* value)
+			{
+				Entry* entries = Get();
+				for (size_t i = Size - 1; i > 0; i--)
+					entries[i] = entries[i - 1];
+				entries[0] = { id, value };
+			}
+
+		private:
+			struct Entry
+			{
+				uint64_t id;
+				void* value;
+			};
+
+			static Entry* Get()
+			{
+				thread_local Entry t_entries[Size] = {};
+				return t_entries;
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,289 @@
+#pragma once
+
+#ifndef VKHL_TRACE_HPP
+#define VKHL_TRACE_HPP
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Error.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <cstdio>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+// CPU tracing, every vkhl function records a zone when VKHL_ENABLE_TRACING is defined, otherwise all of this compiles to nothing.
+// VKHL_ENABLE_TRACING must be the same everywhere vkhl is compiled, so set it with the VKHL_ENABLE_TRACING CMake option.
+//
+// VKHL_TRACE_ZONE(name) times the rest of the enclosing scope, name must be a string literal (or otherwise outlive the trace).
+// VKHL_TRACE_THREAD_NAME(name) names the calling thread's track in the exported trace.
+// Each thread keeps its last 65536 events, older ones are overwritten, so export shortly after what should be looked at.
+#ifdef VKHL_ENABLE_TRACING
+
+namespace vkhl
+{
+	struct TraceEvent
+	{
+		const char* name;
+		uint64_t start;	// Nanoseconds, from GetTraceTime
+		uint64_t end;
+	};
+
+	// Steady clock nanoseconds
+	VKHL_INLINE uint64_t GetTraceTime();
+
+	VKHL_INLINE void SetTraceThreadName(const char* name);
+
+	// Every thread's events in the Chrome trace event format, open with chrome://tracing or Perfetto.
+	// Threads may keep tracing while this runs, events they overwrite meanwhile are left out
+	VKHL_INLINE std::string GetTraceJson();
+	// Writes GetTraceJson with WriteFileAtomic
+	VKHL_INLINE bool WriteTraceJson(const char* path);
+
+	// Drops every event, no other thread may be tracing while this runs
+	VKHL_INLINE void ClearTrace();
+
+	// Records a zone from construction to destruction into the calling thread's buffer
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* name)
+			:m_name(name), m_start(GetTraceTime())
+		{
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+		~TraceScope();
+
+	private:
+		const char* m_name;
+		uint64_t m_start;
+	};
+}
+
+#define VKHL_TRACE_CONCAT_IMPL(a, b) a##b
+#define VKHL_TRACE_CONCAT(a, b) VKHL_TRACE_CONCAT_IMPL(a, b)
+
+#define VKHL_TRACE_ZONE(name) ::vkhl::TraceScope VKHL_TRACE_CONCAT(vkhlTraceZone, __LINE__)(name)
+#define VKHL_TRACE_THREAD_NAME(name) ::vkhl::SetTraceThreadName(name)
+
+#else
+
+#define VKHL_TRACE_ZONE(name) ((void)0)
+#define VKHL_TRACE_THREAD_NAME(name) ((void)0)
+
+#endif // VKHL_ENABLE_TRACING
+
+namespace vkhl
+{
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+#ifdef VKHL_ENABLE_TRACING
+	// From MappedFile.hpp, which needs this header first, so it is included at the end
+	VKHL_INLINE bool WriteFileAtomic(const char* path, const void* data, size_t size);
+#endif // VKHL_ENABLE_TRACING
+
+	namespace detail
+	{
+		// Also used by GpuProfiler's trace, so it doesn't depend on VKHL_ENABLE_TRACING
+		VKHL_INLINE void AppendJsonString(std::string& json, const char* string)
+		{
+			json += '"';
+			for (; *string; string++)
+			{
+				const char c = *string;
+				if (c == '"' || c == '\\')
+				{
+					json += '\\';
+					json += c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20)
+				{
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					json += escaped;
+				}
+				else
+					json += c;
+			}
+			json += '"';
+		}
+
+#ifdef VKHL_ENABLE_TRACING
+		// A ring written only by its thread, so recording takes no lock, and the newest events overwrite the oldest.
+		// Each slot is a seqlock, export keeps the events whose sequence didn't change while they were copied
+		struct TraceBuffer
+		{
+			static constexpr uint32_t Capacity = 1 << 16;
+
+			struct Slot
+			{
+				std::atomic<uint64_t> sequence;	// 2 * index + 1 while event index is written, 2 * index + 2 once it is done
+				std::atomic<const char*> name;
+				std::atomic<uint64_t> start;
+				std::atomic<uint64_t> end;
+			};
+
+			std::unique_ptr<Slot[]> slots = std::make_unique<Slot[]>(Capacity);
+			std::atomic<uint64_t> count = 0; // Events ever written, the ring holds the last Capacity of them
+			std::atomic<const char*> name = nullptr;
+			uint32_t threadId = 0;
+
+			// Copies the events still in the ring, oldest first. Returns how many were overwritten
+			uint64_t Read(std::vector<TraceEvent>& eventsOut) const
+			{
+				const uint64_t end = count.load(std::memory_order_acquire);
+				const uint64_t begin = end > Capacity ? end - Capacity : 0;
+				const size_t previousSize = eventsOut.size();
+
+				for (uint64_t index = begin; index < end; index++)
+				{
+					const Slot& slot = slots[index % Capacity];
+					const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+					if (sequence != 2 * index + 2)
+						continue;
+
+					const TraceEvent event = { slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed) };
+
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+						eventsOut.push_back(event);
+				}
+
+				return end - (eventsOut.size() - previousSize);
+			}
+		};
+
+		// Buffers outlive their threads, so events from finished threads can still be exported
+		VKHL_INLINE_VAR std::mutex g_traceMutex;
+		VKHL_INLINE_VAR std::vector<std::unique_ptr<TraceBuffer>> g_traceBuffers;
+
+		VKHL_INLINE TraceBuffer& GetTraceBuffer()
+		{
+			thread_local TraceBuffer* t_buffer = nullptr;
+			if (!t_buffer)
+			{
+				std::lock_guard lock(g_traceMutex);
+				g_traceBuffers.push_back(std::make_unique<TraceBuffer>());
+				t_buffer = g_traceBuffers.back().get();
+				t_buffer->threadId = static_cast<uint32_t>(g_traceBuffers.size());
+			}
+
+			return *t_buffer;
+		}
+#endif // VKHL_ENABLE_TRACING
+	}
+
+#ifdef VKHL_ENABLE_TRACING
+	VKHL_INLINE TraceScope::~TraceScope()
+	{
+		const uint64_t end = GetTraceTime();
+
+		detail::TraceBuffer& buffer = detail::GetTraceBuffer();
+		const uint64_t index = buffer.count.load(std::memory_order_relaxed);
+		detail::TraceBuffer::Slot& slot = buffer.slots[index % detail::TraceBuffer::Capacity];
+
+		slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release); // Readers see the odd sequence before any of the new event
+		slot.name.store(m_name, std::memory_order_relaxed);
+		slot.start.store(m_start, std::memory_order_relaxed);
+		slot.end.store(end, std::memory_order_relaxed);
+		slot.sequence.store(2 * index + 2, std::memory_order_release);
+
+		buffer.count.store(index + 1, std::memory_order_release);
+	}
+
+	VKHL_INLINE uint64_t GetTraceTime()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	VKHL_INLINE void SetTraceThreadName(const char* name)
+	{
+		detail::GetTraceBuffer().name.store(name, std::memory_order_relaxed);
+	}
+
+	VKHL_INLINE std::string GetTraceJson()
+	{
+		std::lock_guard lock(detail::g_traceMutex);
+
+		// Copy the rings first, they keep moving while the JSON is written
+		std::vector<std::vector<TraceEvent>> events(detail::g_traceBuffers.size());
+		uint64_t firstStart = UINT64_MAX;
+		for (size_t i = 0; i < detail::g_traceBuffers.size(); i++)
+		{
+			const auto& buffer = detail::g_traceBuffers[i];
+			if (const uint64_t overwritten = buffer->Read(events[i]))
+				PrintWarning("%llu trace events were overwritten on thread %u, only the last %u are kept\n",
+					static_cast<unsigned long long>(overwritten), buffer->threadId, detail::TraceBuffer::Capacity);
+
+			// Start the trace at the first event
+			for (const TraceEvent& event : events[i])
+				firstStart = std::min(firstStart, event.start);
+		}
+
+		std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		char text[128];
+		bool first = true;
+
+		for (size_t i = 0; i < detail::g_traceBuffers.size(); i++)
+		{
+			const auto& buffer = detail::g_traceBuffers[i];
+
+			if (const char* name = buffer->name.load(std::memory_order_relaxed))
+			{
+				std::snprintf(text, sizeof(text), "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",", buffer->threadId);
+				json += text;
+				detail::AppendJsonString(json, name);
+				json += "}}";
+				first = false;
+			}
+
+			// Trace times are in microseconds
+			for (const TraceEvent& event : events[i])
+			{
+				json += first ? "{\"ph\":\"X\",\"name\":" : ",{\"ph\":\"X\",\"name\":";
+				detail::AppendJsonString(json, event.name);
+
+				std::snprintf(text, sizeof(text), ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					buffer->threadId, double(event.start - firstStart) / 1000.0, double(event.end - event.start) / 1000.0);
+				json += text;
+				first = false;
+			}
+		}
+
+		json += "]}\n";
+		return json;
+	}
+
+	VKHL_INLINE bool WriteTraceJson(const char* path)
+	{
+		const std::string json = GetTraceJson();
+		return WriteFileAtomic(path, json.data(), json.size());
+	}
+
+	VKHL_INLINE void ClearTrace()
+	{
+		std::lock_guard lock(detail::g_traceMutex);
+		for (auto& buffer : detail::g_traceBuffers)
+			buffer->count.store(0, std::memory_order_relaxed);
+	}
+#endif // VKHL_ENABLE_TRACING
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#if defined(VKHL_INCLUDE_IMPLEMENTION) && defined(VKHL_ENABLE_TRACING)
+#include "MappedFile.hpp"
+#endif
+
+#endif
@@ -0,0 +1,721 @@
+#pragma once
+
+#ifndef VKHL_UPLOADMANAGER_HPP
+#define VKHL_UPLOADMANAGER_HPP
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Globals.hpp"
+#include "Error.hpp"
+#include "Dispatch.hpp"
+#include "Device.hpp"
+#include "MemoryAllocator.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <vulkan/vk_enum_string_helper.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <tuple>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Value of the upload manager's timeline semaphore once an upload is done, 0 means there is nothing to wait for
+	struct UploadToken
+	{
+		uint64_t value = 0;
+	};
+
+	struct UploadManagerCreateInfo
+	{
+		VkQueue queue;						// Queue uploads are submitted on, ideally a dedicated transfer queue
+		uint32_t queueFamilyIndex;			// Family of queue
+		VkDeviceSize stagingSize = 64 << 20;	// Size of the persistently mapped staging ring
+	};
+
+	struct UploadImageInfo
+	{
+		VkImage image;
+		VkBufferImageCopy region;	// bufferOffset, bufferRowLength and bufferImageHeight are set by the upload manager, data must be tightly packed
+		uint32_t texelBlockSize;	// Bytes per texel of the format, or per block of compressed formats. The staging offset is aligned to it
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; // Family the image is used on afterwards, VK_QUEUE_FAMILY_IGNORED to keep it on the upload queue
+	};
+
+	// Streams data to buffers and images through a ring of staging memory on its own queue.
+	// Uploads are gathered until Submit, which records them all into one command buffer, one copy command per destination.
+	// Resources used on another queue family are released by the upload queue, RecordAcquireBarriers records the other half.
+	// Requires timeline semaphores (DeviceInfo::timelineSemaphore). Thread safe
+	class UploadManager
+	{
+	public:
+		UploadManager() = default;
+		UploadManager(const UploadManager&) = delete;
+		UploadManager& operator=(const UploadManager&) = delete;
+		~UploadManager() { Destroy(); }
+
+		SmartResult Init(MemoryAllocator& allocator, const DeviceDispatch& dispatch, const DeviceInfo& deviceInfo, const UploadManagerCreateInfo& createInfo);
+		// Waits for every upload to finish, then frees everything
+		void Destroy();
+
+		// Copies data into the staging ring now, the copy into dstBuffer happens on the next Submit.
+		// Uploads bigger than the staging ring are split, if the ring is full this submits and waits for older uploads
+		SmartResult UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+
+		// Same as UploadBuffer but for one image subresource region. The image's previous contents are discarded (it goes from VK_IMAGE_LAYOUT_UNDEFINED),
+		// and size must fit in the staging ring. Regions of a subresource uploaded before the same Submit may be copied in several submits when the ring
+		// fills, the subresource then stays in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL until Submit moves it to finalLayout
+		SmartResult UploadImage(const UploadImageInfo& imageInfo, const void* data, VkDeviceSize size);
+
+		// Submits everything uploaded since the last Submit in one vkQueueSubmit. tokenOut (optional) completes once it is all done.
+		// If there is nothing to submit the token of the last submit is given
+		SmartResult Submit(UploadToken* tokenOut = nullptr);
+
+		// Records the acquire half of the ownership transfers to queueFamilyIndex from every submitted upload into commandBuffer.
+		// The submit of commandBuffer must wait for waitOut on GetSemaphore() (waitOut->value is 0 if nothing was recorded)
+		void RecordAcquireBarriers(VkCommandBuffer commandBuffer, uint32_t queueFamilyIndex, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask, UploadToken* waitOut);
+
+		bool IsComplete(UploadToken token);
+		SmartResult Wait(UploadToken token, uint64_t timeout = UINT64_MAX);
+
+		// Timeline semaphore signalled by the uploads, wait on it from another queue to overlap uploads with rendering
+		VkSemaphore GetSemaphore() const { return m_semaphore; }
+
+	private:
+		struct BufferCopy
+		{
+			VkBuffer buffer;
+			VkBufferCopy region;
+			uint32_t dstQueueFamilyIndex;
+		};
+
+		struct Submission
+		{
+			uint64_t value;
+			VkCommandBuffer commandBuffer;
+		};
+
+		template<typename Barrier>
+		struct PendingAcquire
+		{
+			uint64_t value;
+			Barrier barrier;
+		};
+
+		SmartResult AllocateStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize maxSize, VkDeviceSize* offsetOut, VkDeviceSize* sizeOut, void** mappedOut);
+		// Submits that aren't final leave images in TRANSFER_DST, the ring fills in the middle of uploads
+		SmartResult SubmitLocked(UploadToken* tokenOut, bool final);
+		SmartResult WaitLocked(uint64_t value, uint64_t timeout);
+		void Retire();
+
+		const DeviceDispatch* m_dispatch = nullptr;
+		VkQueue m_queue = VK_NULL_HANDLE;
+		uint32_t m_queueFamilyIndex = 0;
+
+		std::mutex m_mutex;
+		LinearMemoryPool m_staging;
+		VkCommandPool m_commandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> m_freeCommandBuffers;
+		VkSemaphore m_semaphore = VK_NULL_HANDLE;
+		uint64_t m_submittedValue = 0;
+		uint64_t m_completedValue = 0;
+
+		std::vector<BufferCopy> m_bufferCopies;
+		std::vector<UploadImageInfo> m_imageCopies;
+		std::vector<UploadImageInfo> m_openImages; // Subresources left in TRANSFER_DST by submits that weren't final
+		std::deque<Submission> m_submissions;
+		std::vector<PendingAcquire<VkBufferMemoryBarrier>> m_bufferAcquires;
+		std::vector<PendingAcquire<VkImageMemoryBarrier>> m_imageAcquires;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	// VA_ARGS must start with a printf string, then any extra arguments to send to printf.
+	// At the end of the printf call there is the stringified result, so make sure that is in the format at the end.
+#define CHECK_VK_CALL(call, ...)								\
+		result = call;											\
+		if (result < 0)											\
+		{														\
+			PrintError(__VA_ARGS__, string_VkResult(result));	\
+			return result;										\
+		}
+
+	namespace detail
+	{
+		VKHL_INLINE VkImageSubresourceRange GetUploadSubresourceRange(const VkImageSubresourceLayers& layers)
+		{
+			return { layers.aspectMask, layers.mipLevel, 1, layers.baseArrayLayer, layers.layerCount };
+		}
+
+		VKHL_INLINE bool IsSameUploadSubresource(const UploadImageInfo& a, const UploadImageInfo& b)
+		{
+			const auto& aLayers = a.region.imageSubresource;
+			const auto& bLayers = b.region.imageSubresource;
+			return a.image == b.image && aLayers.aspectMask == bLayers.aspectMask && aLayers.mipLevel == bLayers.mipLevel &&
+				aLayers.baseArrayLayer == bLayers.baseArrayLayer && aLayers.layerCount == bLayers.layerCount;
+		}
+	}
+
+	VKHL_INLINE SmartResult UploadManager::Init(MemoryAllocator& allocator, const DeviceDispatch& dispatch, const DeviceInfo& deviceInfo, const UploadManagerCreateInfo& createInfo)
+	{
+		VKHL_TRACE_ZONE("vkhl::UploadManager::Init");
+
+		VkResult result = VK_SUCCESS;
+
+		if (!deviceInfo.timelineSemaphore)
+		{
+			PrintError("UploadManager needs timeline semaphores, create the device with performanceFeatures\n");
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		m_dispatch = &dispatch;
+		m_queue = createInfo.queue;
+		m_queueFamilyIndex = createInfo.queueFamilyIndex;
+		m_submittedValue = 0;
+		m_completedValue = 0;
+
+		// Host coherent so nothing has to be flushed before submitting
+		result = m_staging.Init(allocator, createInfo.stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT).GetAndReset();
+		if (result < 0)
+		{
+			Destroy();
+			return result;
+		}
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = m_queueFamilyIndex;
+
+		result = dispatch.vkCreateCommandPool(dispatch.device, &poolInfo, GetAllocationCallbacks(), &m_commandPool);
+		if (result < 0)
+		{
+			PrintError("Failed to create upload command pool with error %s\n", string_VkResult(result));
+			Destroy();
+			return result;
+		}
+
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		result = dispatch.vkCreateSemaphore(dispatch.device, &semaphoreInfo, GetAllocationCallbacks(), &m_semaphore);
+		if (result < 0)
+		{
+			PrintError("Failed to create upload timeline semaphore with error %s\n", string_VkResult(result));
+			Destroy();
+			return result;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void UploadManager::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::UploadManager::Destroy");
+
+		if (!m_dispatch)
+			return;
+
+		std::lock_guard lock(m_mutex);
+
+		// Staging memory and command buffers may still be in use
+		if (m_semaphore && m_submittedValue > m_completedValue)
+			WaitLocked(m_submittedValue, UINT64_MAX).Reset();
+
+		if (m_semaphore)
+			m_dispatch->vkDestroySemaphore(m_dispatch->device, m_semaphore, GetAllocationCallbacks());
+		if (m_commandPool) // Frees the command buffers too
+			m_dispatch->vkDestroyCommandPool(m_dispatch->device, m_commandPool, GetAllocationCallbacks());
+		m_staging.Destroy();
+
+		m_semaphore = VK_NULL_HANDLE;
+		m_commandPool = VK_NULL_HANDLE;
+		m_freeCommandBuffers.clear();
+		m_submissions.clear();
+		m_bufferCopies.clear();
+		m_imageCopies.clear();
+		m_openImages.clear();
+		m_bufferAcquires.clear();
+		m_imageAcquires.clear();
+		m_dispatch = nullptr;
+	}
+
+	VKHL_INLINE void UploadManager::Retire()
+	{
+		uint64_t value;
+		if (m_dispatch->vkGetSemaphoreCounterValue(m_dispatch->device, m_semaphore, &value) < 0)
+			return;
+
+		m_completedValue = std::max(m_completedValue, value);
+		m_staging.Retire(m_completedValue);
+
+		while (!m_submissions.empty() && m_submissions.front().value <= m_completedValue)
+		{
+			m_freeCommandBuffers.push_back(m_submissions.front().commandBuffer);
+			m_submissions.pop_front();
+		}
+	}
+
+	VKHL_INLINE SmartResult UploadManager::WaitLocked(uint64_t value, uint64_t timeout)
+	{
+		VkResult result = VK_SUCCESS;
+
+		if (value > m_completedValue)
+		{
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &m_semaphore;
+			waitInfo.pValues = &value;
+
+			CHECK_VK_CALL(m_dispatch->vkWaitSemaphores(m_dispatch->device, &waitInfo, timeout),
+				"Failed to wait for uploads with error %s\n");
+			if (result == VK_TIMEOUT)
+				return result;
+		}
+
+		Retire();
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult UploadManager::AllocateStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize maxSize, VkDeviceSize* offsetOut, VkDeviceSize* sizeOut, void** mappedOut)
+	{
+		VkResult result = VK_SUCCESS;
+
+		size = std::min(size, maxSize);
+		if (size > m_staging.GetSize())
+		{
+			PrintError("Upload of %llu bytes doesn't fit in the %llu byte staging buffer\n",
+				static_cast<unsigned long long>(size), static_cast<unsigned long long>(m_staging.GetSize()));
+			return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		}
+
+		Retire();
+
+		while (!m_staging.Allocate(size, alignment, offsetOut, mappedOut))
+		{
+			// Pending copies hold staging memory that can only be freed once they are submitted
+			if (!m_bufferCopies.empty() || !m_imageCopies.empty())
+			{
+				result = SubmitLocked(nullptr, false).GetAndReset();
+				if (result < 0)
+					return result;
+			}
+
+			// Only alignment padding is left in the way, everything has retired
+			if (m_submissions.empty())
+			{
+				m_staging.Reset();
+				continue;
+			}
+
+			// Oldest first, it is the one whose memory is next to be reused
+			result = WaitLocked(m_submissions.front().value, UINT64_MAX).GetAndReset();
+			if (result < 0)
+				return result;
+		}
+
+		*sizeOut = size;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult UploadManager::UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, uint32_t dstQueueFamilyIndex)
+	{
+		VKHL_TRACE_ZONE("vkhl::UploadManager::UploadBuffer");
+
+		std::lock_guard lock(m_mutex);
+
+		if (dstQueueFamilyIndex == m_queueFamilyIndex)
+			dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+		// Split in half rings so a big upload can be staged while the previous part copies
+		const VkDeviceSize maxChunk = std::max<VkDeviceSize>(m_staging.GetSize() / 2, 4);
+		VkDeviceSize done = 0;
+		while (done < size)
+		{
+			VkDeviceSize offset, chunk;
+			void* mapped;
+			VkResult result = AllocateStaging(size - done, 4, maxChunk, &offset, &chunk, &mapped).GetAndReset();
+			if (result < 0)
+				return result;
+
+			std::memcpy(mapped, static_cast<const uint8_t*>(data) + done, chunk);
+			m_bufferCopies.push_back({ dstBuffer, { offset, dstOffset + done, chunk }, dstQueueFamilyIndex });
+			done += chunk;
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult UploadManager::UploadImage(const UploadImageInfo& imageInfo, const void* data, VkDeviceSize size)
+	{
+		VKHL_TRACE_ZONE("vkhl::UploadManager::UploadImage");
+
+		std::lock_guard lock(m_mutex);
+
+		if (imageInfo.texelBlockSize == 0)
+		{
+			PrintError("UploadImageInfo::texelBlockSize must be set\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		// vkCmdCopyBufferToImage needs the offset aligned to the texel block size and to 4
+		VkDeviceSize offset, allocated;
+		void* mapped;
+		VkResult result = AllocateStaging(size, std::lcm<VkDeviceSize>(imageInfo.texelBlockSize, 4), size, &offset, &allocated, &mapped).GetAndReset();
+		if (result < 0)
+			return result;
+
+		std::memcpy(mapped, data, size);
+
+		UploadImageInfo copy = imageInfo;
+		copy.region.bufferOffset = offset;
+		copy.region.bufferRowLength = 0;
+		copy.region.bufferImageHeight = 0;
+		if (copy.dstQueueFamilyIndex == m_queueFamilyIndex)
+			copy.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+		m_imageCopies.push_back(copy);
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE SmartResult UploadManager::Submit(UploadToken* tokenOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::UploadManager::Submit");
+
+		std::lock_guard lock(m_mutex);
+		return SubmitLocked(tokenOut, true);
+	}
+
+	VKHL_INLINE SmartResult UploadManager::SubmitLocked(UploadToken* tokenOut, bool final)
+	{
+		VkResult result = VK_SUCCESS;
+
+		if (m_bufferCopies.empty() && m_imageCopies.empty() && (!final || m_openImages.empty()))
+		{
+			if (tokenOut)
+				tokenOut->value = m_submittedValue;
+			return VK_SUCCESS;
+		}
+
+		Retire();
+
+		VkCommandBuffer commandBuffer;
+		if (!m_freeCommandBuffers.empty())
+		{
+			commandBuffer = m_freeCommandBuffers.back();
+			m_freeCommandBuffers.pop_back();
+		}
+		else
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = m_commandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+
+			CHECK_VK_CALL(m_dispatch->vkAllocateCommandBuffers(m_dispatch->device, &allocInfo, &commandBuffer),
+				"Failed to allocate upload command buffer with error %s\n");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		result = m_dispatch->vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		if (result < 0)
+		{
+			m_freeCommandBuffers.push_back(commandBuffer);
+			PrintError("Failed to begin upload command buffer with error %s\n", string_VkResult(result));
+			return result;
+		}
+
+		const uint64_t value = m_submittedValue + 1;
+		std::vector<VkBufferMemoryBarrier> bufferReleases;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+
+		// Sorted so regions of the same image are copied together, and copies to the same subresource only get one barrier
+		std::stable_sort(m_imageCopies.begin(), m_imageCopies.end(), [](const UploadImageInfo& a, const UploadImageInfo& b) {
+				const auto& aLayers = a.region.imageSubresource;
+				const auto& bLayers = b.region.imageSubresource;
+				return std::tie(a.image, aLayers.mipLevel, aLayers.baseArrayLayer, aLayers.aspectMask) < std::tie(b.image, bLayers.mipLevel, bLayers.baseArrayLayer, bLayers.aspectMask);
+			});
+
+		auto isOpen = [this](const UploadImageInfo& copy) {
+			return std::any_of(m_openImages.begin(), m_openImages.end(), [&copy](const UploadImageInfo& open) { return detail::IsSameUploadSubresource(open, copy); });
+		};
+
+		// Move every image into TRANSFER_DST in one barrier, subresources an earlier submit left there keep what it copied
+		VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		imageBarriers.reserve(m_imageCopies.size());
+		for (size_t i = 0; i < m_imageCopies.size(); i++)
+		{
+			const UploadImageInfo& copy = m_imageCopies[i];
+			if (i > 0 && detail::IsSameUploadSubresource(m_imageCopies[i - 1], copy))
+				continue;
+
+			const bool open = isOpen(copy);
+			if (open)
+				srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = open ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = open ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = copy.image;
+			barrier.subresourceRange = detail::GetUploadSubresourceRange(copy.region.imageSubresource);
+			imageBarriers.push_back(barrier);
+		}
+
+		if (!imageBarriers.empty())
+		{
+			m_dispatch->vkCmdPipelineBarrier(commandBuffer, srcStageMask, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+		}
+
+		// One copy command per destination, with all of its regions
+		std::stable_sort(m_bufferCopies.begin(), m_bufferCopies.end(), [](const BufferCopy& a, const BufferCopy& b) {
+				return a.buffer < b.buffer;
+			});
+
+		std::vector<VkBufferCopy> regions;
+		for (size_t i = 0; i < m_bufferCopies.size();)
+		{
+			const VkBuffer buffer = m_bufferCopies[i].buffer;
+
+			regions.clear();
+			for (; i < m_bufferCopies.size() && m_bufferCopies[i].buffer == buffer; i++)
+			{
+				const BufferCopy& copy = m_bufferCopies[i];
+				regions.push_back(copy.region);
+
+				if (copy.dstQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED)
+					continue;
+
+				VkBufferMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.srcQueueFamilyIndex = m_queueFamilyIndex;
+				barrier.dstQueueFamilyIndex = copy.dstQueueFamilyIndex;
+				barrier.buffer = buffer;
+				barrier.offset = copy.region.dstOffset;
+				barrier.size = copy.region.size;
+				bufferReleases.push_back(barrier);
+			}
+
+			m_dispatch->vkCmdCopyBuffer(commandBuffer, m_staging.GetBuffer(), buffer, static_cast<uint32_t>(regions.size()), regions.data());
+		}
+
+		std::vector<VkBufferImageCopy> imageRegions;
+		for (size_t i = 0; i < m_imageCopies.size();)
+		{
+			const VkImage image = m_imageCopies[i].image;
+
+			imageRegions.clear();
+			for (; i < m_imageCopies.size() && m_imageCopies[i].image == image; i++)
+				imageRegions.push_back(m_imageCopies[i].region);
+
+			m_dispatch->vkCmdCopyBufferToImage(commandBuffer, m_staging.GetBuffer(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(imageRegions.size()), imageRegions.data());
+		}
+
+		// Move images into their final layout, released to their new family if they have one.
+		// Submits that aren't final leave them in TRANSFER_DST, more regions of them may still be staged
+		imageBarriers.clear();
+		for (size_t i = 0; !final && i < m_imageCopies.size(); i++)
+		{
+			if (!isOpen(m_imageCopies[i]))
+				m_openImages.push_back(m_imageCopies[i]);
+		}
+
+		auto finishImage = [&](const UploadImageInfo& copy) {
+			const bool release = copy.dstQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED;
+
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = copy.finalLayout;
+			barrier.srcQueueFamilyIndex = release ? m_queueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = release ? copy.dstQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = copy.image;
+			barrier.subresourceRange = detail::GetUploadSubresourceRange(copy.region.imageSubresource);
+			imageBarriers.push_back(barrier);
+		};
+
+		if (final)
+		{
+			for (size_t i = 0; i < m_imageCopies.size(); i++)
+			{
+				if (i == 0 || !detail::IsSameUploadSubresource(m_imageCopies[i - 1], m_imageCopies[i]))
+					finishImage(m_imageCopies[i]);
+			}
+
+			// Subresources only earlier submits copied to
+			for (const auto& open : m_openImages)
+			{
+				if (std::none_of(m_imageCopies.begin(), m_imageCopies.end(), [&open](const UploadImageInfo& copy) { return detail::IsSameUploadSubresource(open, copy); }))
+					finishImage(open);
+			}
+
+			m_openImages.clear();
+		}
+
+		if (!bufferReleases.empty() || !imageBarriers.empty())
+		{
+			// Waiting on the semaphore makes the writes visible to other queues, the barrier only has to finish the transfer
+			m_dispatch->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(),
+				static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+		}
+
+		result = m_dispatch->vkEndCommandBuffer(commandBuffer);
+		if (result < 0)
+		{
+			m_freeCommandBuffers.push_back(commandBuffer);
+			PrintError("Failed to end upload command buffer with error %s\n", string_VkResult(result));
+			return result;
+		}
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &value;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &m_semaphore;
+
+		result = m_dispatch->vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE);
+		if (result < 0)
+		{
+			m_freeCommandBuffers.push_back(commandBuffer);
+			PrintError("Failed to submit uploads with error %s\n", string_VkResult(result));
+			return result;
+		}
+
+		m_submittedValue = value;
+		m_staging.CloseEpoch(value);
+		m_submissions.push_back({ value, commandBuffer });
+
+		// The acquire barriers have to match the release barriers
+		for (auto barrier : bufferReleases)
+		{
+			barrier.srcAccessMask = 0;
+			m_bufferAcquires.push_back({ value, barrier });
+		}
+
+		for (auto barrier : imageBarriers)
+		{
+			if (barrier.dstQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED)
+				continue;
+
+			barrier.srcAccessMask = 0;
+			m_imageAcquires.push_back({ value, barrier });
+		}
+
+		m_bufferCopies.clear();
+		m_imageCopies.clear();
+
+		if (tokenOut)
+			tokenOut->value = value;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void UploadManager::RecordAcquireBarriers(VkCommandBuffer commandBuffer, uint32_t queueFamilyIndex, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask, UploadToken* waitOut)
+	{
+		VKHL_TRACE_ZONE("vkhl::UploadManager::RecordAcquireBarriers");
+
+		std::lock_guard lock(m_mutex);
+
+		uint64_t value = 0;
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+
+		// Take the acquires for queueFamilyIndex out of the pending lists
+		auto takeAcquires = [&](auto& pending, auto& barriers) {
+			auto kept = pending.begin();
+			for (auto& acquire : pending)
+			{
+				if (acquire.barrier.dstQueueFamilyIndex != queueFamilyIndex)
+				{
+					*kept++ = acquire;
+					continue;
+				}
+
+				acquire.barrier.dstAccessMask = dstAccessMask;
+				barriers.push_back(acquire.barrier);
+				value = std::max(value, acquire.value);
+			}
+
+			pending.erase(kept, pending.end());
+		};
+
+		takeAcquires(m_bufferAcquires, bufferBarriers);
+		takeAcquires(m_imageAcquires, imageBarriers);
+
+		if (!bufferBarriers.empty() || !imageBarriers.empty())
+		{
+			m_dispatch->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask, 0,
+				0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+				static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+		}
+
+		waitOut->value = value;
+	}
+
+	VKHL_INLINE bool UploadManager::IsComplete(UploadToken token)
+	{
+		std::lock_guard lock(m_mutex);
+
+		if (token.value <= m_completedValue)
+			return true;
+
+		Retire();
+		return token.value <= m_completedValue;
+	}
+
+	VKHL_INLINE SmartResult UploadManager::Wait(UploadToken token, uint64_t timeout)
+	{
+		VKHL_TRACE_ZONE("vkhl::UploadManager::Wait");
+
+		std::lock_guard lock(m_mutex);
+
+		if (token.value > m_submittedValue)
+		{
+			PrintError("Waiting on an upload that was never submitted\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		return WaitLocked(token.value, timeout);
+	}
+
+#undef CHECK_VK_CALL
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
@@ -0,0 +1,173 @@
+#pragma once
+
+#ifndef VKHL_WORKDISTRIBUTOR_HPP
+#define VKHL_WORKDISTRIBUTOR_HPP
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "Error.hpp"
+#include "Trace.hpp"
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+
+#include <algorithm>
+#include <numeric>
+
+#endif // VKHL_INCLUDE_IMPLEMENTION
+
+namespace vkhl
+{
+	// Items [first, first + count) of a batch, for one device
+	struct WorkRange
+	{
+		uint64_t first;
+		uint64_t count;
+	};
+
+	// Splits batches of work over several devices (i.e. from SelectPhysicalDevices) in proportion to how fast each one is.
+	// Throughput starts from the given weights, and follows what Report measures with an exponential moving average,
+	// so a device that slows down (thermals, other work) gets less of the next batch. Not thread safe
+	class WorkDistributor
+	{
+	public:
+		WorkDistributor() = default;
+		WorkDistributor(const WorkDistributor&) = delete;
+		WorkDistributor& operator=(const WorkDistributor&) = delete;
+		~WorkDistributor() { Destroy(); }
+
+		// weights are the relative speed guessed for each device until it is measured, i.e. PhysicalDeviceCandidate::score.total.
+		// Empty weights treat every device the same. smoothing is how much each Report moves the estimate, from 0 to 1
+		SmartResult Init(uint32_t deviceCount, std::span<const float> weights = {}, float smoothing = 0.25f);
+		void Destroy();
+
+		// Fills one range per device, together they cover [0, itemCount) with no gaps. rangesOut must hold GetDeviceCount ranges
+		void Split(uint64_t itemCount, std::span<WorkRange> rangesOut) const;
+
+		// device finished itemCount items in nanoseconds, measured with GpuProfiler or timeline semaphore waits
+		void Report(uint32_t device, uint64_t itemCount, uint64_t nanoseconds);
+
+		// Estimated items per second, or the initial weight while no device was measured
+		double GetThroughput(uint32_t device) const { return m_devices[device].throughput; }
+		uint32_t GetDeviceCount() const { return static_cast<uint32_t>(m_devices.size()); }
+
+	private:
+		struct Device
+		{
+			double throughput;	// Items per second once anything was measured
+			bool measured;
+		};
+
+		std::vector<Device> m_devices;
+		float m_smoothing = 0.25f;
+		bool m_anyMeasured = false;
+	};
+
+#ifdef VKHL_INCLUDE_IMPLEMENTION
+	VKHL_INLINE SmartResult WorkDistributor::Init(uint32_t deviceCount, std::span<const float> weights, float smoothing)
+	{
+		VKHL_TRACE_ZONE("vkhl::WorkDistributor::Init");
+
+		if (deviceCount == 0 || (!weights.empty() && weights.size() != deviceCount))
+		{
+			PrintError("WorkDistributor needs at least one device, and one weight per device if weights are given\n");
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		m_devices.resize(deviceCount);
+		for (uint32_t i = 0; i < deviceCount; i++)
+			m_devices[i] = { weights.empty() ? 1.0 : std::max(static_cast<double>(weights[i]), 0.0), false };
+
+		// All zero weights would give nobody any work
+		if (std::none_of(m_devices.begin(), m_devices.end(), [](const Device& device) { return device.throughput > 0.0; }))
+		{
+			for (auto& device : m_devices)
+				device.throughput = 1.0;
+		}
+
+		m_smoothing = std::clamp(smoothing, 0.0f, 1.0f);
+		m_anyMeasured = false;
+		return VK_SUCCESS;
+	}
+
+	VKHL_INLINE void WorkDistributor::Destroy()
+	{
+		VKHL_TRACE_ZONE("vkhl::WorkDistributor::Destroy");
+
+		m_devices.clear();
+	}
+
+	VKHL_INLINE void WorkDistributor::Split(uint64_t itemCount, std::span<WorkRange> rangesOut) const
+	{
+		VKHL_TRACE_ZONE("vkhl::WorkDistributor::Split");
+
+		if (m_devices.empty())
+			return;
+
+		const double total = std::accumulate(m_devices.begin(), m_devices.end(), 0.0, [](double sum, const Device& device) {
+			return sum + device.throughput;
+		});
+
+		// Largest remainder, so the counts add up to itemCount exactly
+		uint64_t assigned = 0;
+		std::vector<std::pair<double, uint32_t>> remainders(m_devices.size());
+		for (uint32_t i = 0; i < m_devices.size(); i++)
+		{
+			const double share = static_cast<double>(itemCount) * m_devices[i].throughput / total;
+			rangesOut[i].count = std::min(static_cast<uint64_t>(share), itemCount - assigned);
+			remainders[i] = { share - static_cast<double>(rangesOut[i].count), i };
+			assigned += rangesOut[i].count;
+		}
+
+		std::stable_sort(remainders.begin(), remainders.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+		for (uint64_t i = 0; assigned < itemCount; i++, assigned++)
+			rangesOut[remainders[i % remainders.size()].second].count++;
+
+		uint64_t first = 0;
+		for (uint32_t i = 0; i < m_devices.size(); i++)
+		{
+			rangesOut[i].first = first;
+			first += rangesOut[i].count;
+		}
+	}
+
+	VKHL_INLINE void WorkDistributor::Report(uint32_t device, uint64_t itemCount, uint64_t nanoseconds)
+	{
+		VKHL_TRACE_ZONE("vkhl::WorkDistributor::Report");
+
+		if (itemCount == 0 || nanoseconds == 0)
+			return;
+
+		const double measured = static_cast<double>(itemCount) * 1e9 / static_cast<double>(nanoseconds);
+		Device& reported = m_devices[device];
+
+		if (!m_anyMeasured)
+		{
+			// Move the weights into items per second, so devices that weren't measured yet keep their relative speed.
+			// A device weighted 0 is compared to the average instead, so the others don't all end up at 0
+			double weight = reported.throughput;
+			if (weight <= 0.0)
+			{
+				for (const auto& other : m_devices)
+					weight += other.throughput / static_cast<double>(m_devices.size());
+			}
+
+			const double scale = measured / weight;
+			for (auto& other : m_devices)
+				other.throughput *= scale;
+			m_anyMeasured = true;
+		}
+
+		if (!reported.measured)
+			reported.throughput = measured;
+		else
+			reported.throughput += m_smoothing * (measured - reported.throughput);
+
+		reported.measured = true;
+	}
+#endif // VKHL_INCLUDE_IMPLEMENTION
+}
+
+#endif
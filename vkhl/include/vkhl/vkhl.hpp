@@ -21,8 +21,31 @@
 #ifndef VKHL_HPP
 #define VKHL_HPP
 
+#include "Capabilities.hpp"
+#include "CommandPool.hpp"
 #include "Defer.hpp"
+#include "DeletionQueue.hpp"
+#include "DescriptorAllocator.hpp"
+#include "BindlessHeap.hpp"
+#include "Device.hpp"
+#include "Dispatch.hpp"
+#include "GpuProfiler.hpp"
+#include "Hash.hpp"
+#include "HostAllocator.hpp"
 #include "Instance.hpp"
+#include "Log.hpp"
+#include "MemoryAllocator.hpp"
+#include "MemoryBudget.hpp"
+#include "MappedFile.hpp"
 #include "PhysicalDevice.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineCompiler.hpp"
+#include "FrameGraph.hpp"
+#include "QueueScheduler.hpp"
+#include "ShaderModuleCache.hpp"
+#include "Trace.hpp"
+#include "ThreadCache.hpp"
+#include "UploadManager.hpp"
+#include "WorkDistributor.hpp"
 
 #endif
@@ -0,0 +1,409 @@
+#include <vkhl/vkhl.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+
+// Run with VK_ICD_FILENAMES pointing at lavapipe (lvp_icd.*.json) or the stub ICD to get comparable numbers on any machine.
+// The stub ICD (<build dir>/vkhl_stub_icd/vkhl_stub_icd.json) is sized with VKHL_STUB_DEVICE_COUNT, VKHL_STUB_INSTANCE_EXTENSION_COUNT
+// and friends, see vkhl_stub_icd/src/icd.cpp, to measure how instance creation and device selection scale.
+// Every scenario uses fixed seeds and iteration counts, so runs only differ by the machine and the driver.
+//
+// Usage: vkhl_bench [--json <path>] [--filter <substring>] [--repetitions <count>]
+
+constexpr uint32_t g_batchSize = 4096;	// Commands recorded between command pool resets
+constexpr uint32_t g_seed = 1234;
+
+struct BenchResult
+{
+	std::string name;
+	uint64_t iterations;	// Per repetition
+	double median;			// Nanoseconds per iteration
+	double min;
+	double max;
+};
+
+struct BenchContext
+{
+	const char* filter = nullptr;
+	uint32_t repetitions = 10;
+	std::vector<BenchResult> results;
+};
+
+struct BenchDevice
+{
+	VkDevice device = VK_NULL_HANDLE;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+};
+
+// Runs run(iterations) once to warm up, then once per repetition. run returns how long the measured part took
+template<typename RunT>
+void Bench(BenchContext& context, const char* name, uint64_t iterations, RunT&& run)
+{
+	if (context.filter && !std::strstr(name, context.filter))
+		return;
+
+	run(iterations);
+
+	std::vector<double> samples;
+	for (uint32_t repetition = 0; repetition < context.repetitions; repetition++)
+	{
+		const std::chrono::nanoseconds elapsed = run(iterations);
+		samples.push_back(static_cast<double>(elapsed.count()) / static_cast<double>(iterations));
+	}
+
+	std::sort(samples.begin(), samples.end());
+	BenchResult result{ name, iterations, samples[samples.size() / 2], samples.front(), samples.back() };
+	std::printf("%-40s %12.1f ns (min %.1f, max %.1f)\n", name, result.median, result.min, result.max);
+	context.results.push_back(std::move(result));
+}
+
+// Times func called iterations times
+template<typename FuncT>
+auto TimeLoop(FuncT&& func)
+{
+	return [func](uint64_t iterations) mutable {
+		const auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < iterations; i++)
+			func();
+		return std::chrono::steady_clock::now() - start;
+	};
+}
+
+std::pair<const char*, vkhl::FeatureRequirement> g_instanceLayers[] = {
+	{ "VK_LAYER_KHRONOS_validation", vkhl::RequestFeature }
+};
+
+const vkhl::InstanceCreateInfo g_instanceCreateInfo{
+	.appName = "vkhl bench",
+	.engineName = "vkhl bench",
+	.appVersion = vkhl::MakeVersion(1, 0),
+	.engineVersion = vkhl::MakeVersion(1, 0),
+	.minApiVersion = vkhl::MakeVersion(1, 1),
+};
+
+void BenchInstance(BenchContext& context)
+{
+	auto createDestroy = [] {
+		VkInstance instance;
+		if (vkhl::CreateInstance(g_instanceCreateInfo, &instance).GetAndReset() >= 0)
+			vkhl::DestroyInstance(instance);
+	};
+
+	// Cold enumerates layers and extensions every time, the loader itself stays loaded
+	Bench(context, "create_instance_cold", 20, TimeLoop([&] {
+		vkhl::ResetCapabilitySnapshot();
+		createDestroy();
+	}));
+
+	// Capabilities come from the cache file instead of the loader
+	const std::string cachePath = (std::filesystem::temp_directory_path() / "vkhl_bench_capabilities.bin").string();
+	vkhl::g_capabilityCachePath = cachePath.c_str();
+	Bench(context, "create_instance_cached", 20, TimeLoop([&] {
+		vkhl::ResetCapabilitySnapshot();
+		createDestroy();
+	}));
+	vkhl::g_capabilityCachePath = nullptr;
+
+	std::error_code error;
+	std::filesystem::remove(cachePath, error);
+
+	// Capabilities are already in memory
+	Bench(context, "create_instance_warm", 50, TimeLoop(createDestroy));
+
+	// Asks for a layer that may not exist, so the check runs over the whole layer list
+	Bench(context, "create_instance_warm_layers", 50, TimeLoop([] {
+		vkhl::InstanceCreateInfo createInfo = g_instanceCreateInfo;
+		createInfo.layers = g_instanceLayers;
+
+		auto print = vkhl::g_printWarningFunc;
+		vkhl::g_printWarningFunc = nullptr;
+
+		VkInstance instance;
+		if (vkhl::CreateInstance(createInfo, &instance).GetAndReset() >= 0)
+			vkhl::DestroyInstance(instance);
+
+		vkhl::g_printWarningFunc = print;
+	}));
+
+	Bench(context, "get_instance_info", 1000, TimeLoop([] {
+		vkhl::InstanceInfo info;
+		vkhl::GetInstanceInfo(&info).Reset();
+	}));
+}
+
+void BenchSelection(BenchContext& context, VkInstance instance)
+{
+	// Several requests, so the assignment has to spread them over the families
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfos[3] = {
+		{ .graphics = vkhl::RequireFeature, .compute = vkhl::RequireFeature, .transfer = vkhl::RequireFeature },
+		{ .compute = vkhl::RequireFeature },
+		{ .transfer = vkhl::RequireFeature },
+	};
+
+	auto select = [&](const vkhl::PhysicalDeviceRankingInfo* ranking) {
+		return TimeLoop([&queueInfos, instance, ranking] {
+			VkPhysicalDevice physicalDevice;
+			uint32_t queueFamilies[3];
+			vkhl::PhysicalDeviceInfo info;
+			vkhl::SelectPhyicalDevice(instance, { .queueFamilyInfos = queueInfos, .ranking = ranking }, &physicalDevice, queueFamilies, &info).Reset();
+		});
+	};
+
+	vkhl::PhysicalDeviceRankingInfo ranking{};
+	Bench(context, "select_physical_device_first", 1000, select(nullptr));
+	Bench(context, "select_physical_device_ranked", 1000, select(&ranking));
+}
+
+void BenchAllocators(BenchContext& context, const vkhl::PhysicalDeviceInfo& physicalDeviceInfo)
+{
+	// Same sizes and free order every run
+	std::mt19937 random(g_seed);
+	std::vector<VkDeviceSize> sizes(4096);
+	for (auto& size : sizes)
+		size = VkDeviceSize(256) << std::uniform_int_distribution<uint32_t>(0, 12)(random);
+
+	std::vector<uint32_t> freeOrder(sizes.size());
+	for (uint32_t i = 0; i < freeOrder.size(); i++)
+		freeOrder[i] = i;
+	std::shuffle(freeOrder.begin(), freeOrder.end(), random);
+
+	// One iteration is an allocation and its free
+	vkhl::TlsfAllocator tlsf;
+	tlsf.Init(VkDeviceSize(4) << 30);
+	std::vector<uint32_t> nodes(sizes.size());
+	Bench(context, "tlsf_allocate_free", sizes.size(), [&](uint64_t) {
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < sizes.size(); i++)
+		{
+			VkDeviceSize offset;
+			tlsf.Allocate(sizes[i], 256, &offset, &nodes[i]);
+		}
+		for (uint32_t i : freeOrder)
+			tlsf.Free(nodes[i]);
+		return std::chrono::steady_clock::now() - start;
+	});
+
+	// The warm up allocates the blocks, after that only sub-allocation is measured
+	vkhl::MemoryAllocator allocator;
+	if (allocator.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, {}).GetAndReset() >= 0)
+	{
+		std::vector<vkhl::MemoryAllocation*> allocations(1024);
+		Bench(context, "memory_allocator_allocate_free", allocations.size(), [&](uint64_t) {
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < allocations.size(); i++)
+			{
+				vkhl::MemoryAllocationInfo allocationInfo{};
+				allocationInfo.requirements = { sizes[i] * 4, 256, ~0u };
+				allocationInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+				if (allocator.Allocate(allocationInfo, &allocations[i]).GetAndReset() < 0)
+					allocations[i] = nullptr;
+			}
+			for (uint32_t i : freeOrder)
+			{
+				if (i < allocations.size() && allocations[i])
+					allocator.Free(allocations[i]);
+			}
+			return std::chrono::steady_clock::now() - start;
+		});
+		allocator.Destroy();
+	}
+
+	const VkAllocationCallbacks callbacks = vkhl::GetHostAllocatorCallbacks();
+	std::vector<void*> memory(sizes.size());
+	Bench(context, "host_allocator_allocate_free", sizes.size(), [&](uint64_t) {
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < sizes.size(); i++)
+			memory[i] = callbacks.pfnAllocation(nullptr, sizes[i] / 16, 16, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+		for (uint32_t i : freeOrder)
+			callbacks.pfnFree(nullptr, memory[i]);
+		return std::chrono::steady_clock::now() - start;
+	});
+}
+
+void BenchDefer(BenchContext& context)
+{
+	// The compiler can't drop work on a volatile
+	volatile uint64_t counter = 0;
+
+	Bench(context, "direct_call", 1000000, TimeLoop([&] {
+		counter = counter + 1;
+	}));
+
+	Bench(context, "defer_scope", 1000000, TimeLoop([&] {
+		vkhl::Defer defer([&] { counter = counter + 1; });
+	}));
+
+	Bench(context, "deferred_function", 1000000, TimeLoop([&] {
+		vkhl::DeferredFunction func([&] { counter = counter + 1; });
+		func();
+	}));
+
+	vkhl::DeletionQueue queue;
+	queue.Init(4096).Reset();
+	Bench(context, "deletion_queue_enqueue_collect", 4096, [&](uint64_t iterations) {
+		const auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < iterations; i++)
+			queue.Enqueue(i, [&] { counter = counter + 1; });
+		queue.CollectAll();
+		return std::chrono::steady_clock::now() - start;
+	});
+}
+
+// Records empty pipeline barriers through cmdPipelineBarrier, one iteration per call
+auto RecordBarriers(const BenchDevice& bench, PFN_vkCmdPipelineBarrier cmdPipelineBarrier)
+{
+	return [&bench, cmdPipelineBarrier](uint64_t iterations) {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		std::chrono::nanoseconds total{ 0 };
+		for (uint64_t batch = 0; batch < iterations / g_batchSize; batch++)
+		{
+			vkhl::g_deviceDispatch.vkResetCommandPool(bench.device, bench.commandPool, 0);
+			vkhl::g_deviceDispatch.vkBeginCommandBuffer(bench.commandBuffer, &beginInfo);
+
+			const auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < g_batchSize; i++)
+				cmdPipelineBarrier(bench.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+			total += std::chrono::steady_clock::now() - start;
+
+			vkhl::g_deviceDispatch.vkEndCommandBuffer(bench.commandBuffer);
+		}
+
+		return total;
+	};
+}
+
+bool WriteJson(const char* path, const BenchContext& context, const vkhl::PhysicalDeviceInfo& physicalDeviceInfo)
+{
+	std::FILE* file = std::fopen(path, "w");
+	if (!file)
+	{
+		std::fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	const auto& properties = physicalDeviceInfo.properties;
+	const auto version = vkhl::MakeVersionStruct(properties.apiVersion);
+	std::fprintf(file, "{\n\t\"device\": \"%s\",\n\t\"apiVersion\": \"%u.%u.%u\",\n\t\"driverVersion\": %u,\n\t\"repetitions\": %u,\n\t\"results\": [",
+		properties.deviceName, version.major, version.minor, version.patch, properties.driverVersion, context.repetitions);
+
+	for (size_t i = 0; i < context.results.size(); i++)
+	{
+		const auto& result = context.results[i];
+		std::fprintf(file, "%s\n\t\t{ \"name\": \"%s\", \"unit\": \"ns\", \"iterations\": %llu, \"median\": %.2f, \"min\": %.2f, \"max\": %.2f }",
+			i ? "," : "", result.name.c_str(), static_cast<unsigned long long>(result.iterations), result.median, result.min, result.max);
+	}
+
+	std::fprintf(file, "\n\t]\n}\n");
+	return std::fclose(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	BenchContext context;
+	const char* jsonPath = nullptr;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!std::strcmp(argv[i], "--json"))
+			jsonPath = argv[i + 1];
+		else if (!std::strcmp(argv[i], "--filter"))
+			context.filter = argv[i + 1];
+		else if (!std::strcmp(argv[i], "--repetitions"))
+			context.repetitions = std::max(std::atoi(argv[i + 1]), 1);
+		else
+		{
+			std::fprintf(stderr, "Usage: vkhl_bench [--json <path>] [--filter <substring>] [--repetitions <count>]\n");
+			return 1;
+		}
+	}
+
+	// Before the instance below exists, since these replace g_instanceDispatch
+	BenchInstance(context);
+
+	VkInstance instance;
+	if (vkhl::CreateInstance(g_instanceCreateInfo, &instance).GetAndReset() < 0)
+		return 1;
+
+	vkhl::Defer deferDestroyInst([instance]() {
+		vkhl::DestroyInstance(instance);
+	});
+
+	BenchSelection(context, instance);
+
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfos[1] = {
+		{
+			.graphics = vkhl::RequireFeature,
+		}
+	};
+
+	VkPhysicalDevice physicalDevice;
+	uint32_t queueFamilyIndex;
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+
+	if (vkhl::SelectPhyicalDevice(instance, {
+		.queueFamilyInfos = queueInfos,
+		}, &physicalDevice, &queueFamilyIndex, &physicalDeviceInfo).GetAndReset() < 0)
+		return 1;
+
+	std::printf("Device: %s\n", physicalDeviceInfo.properties.deviceName);
+
+	float queuePriority = 1.0f;
+	VkDeviceQueueCreateInfo queueCreateInfo{};
+	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
+	queueCreateInfo.queueCount = 1;
+	queueCreateInfo.pQueuePriorities = &queuePriority;
+
+	VkDeviceCreateInfo deviceCreateInfo{};
+	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.queueCreateInfoCount = 1;
+	deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+
+	BenchDevice bench;
+	if (vkhl::g_instanceDispatch.vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &bench.device) < 0)
+		return 1;
+
+	vkhl::LoadDeviceDispatch(bench.device, &vkhl::g_deviceDispatch).Reset();
+	vkhl::Defer deferDestroyDevice([&bench]() {
+		vkhl::g_deviceDispatch.vkDestroyDevice(bench.device, nullptr);
+	});
+
+	BenchAllocators(context, physicalDeviceInfo);
+	BenchDefer(context);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+	vkhl::g_deviceDispatch.vkCreateCommandPool(bench.device, &poolInfo, nullptr, &bench.commandPool);
+	vkhl::Defer deferDestroyPool([&bench]() {
+		vkhl::g_deviceDispatch.vkDestroyCommandPool(bench.device, bench.commandPool, nullptr);
+	});
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = bench.commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+	vkhl::g_deviceDispatch.vkAllocateCommandBuffers(bench.device, &allocInfo, &bench.commandBuffer);
+
+	// Device functions from vkGetInstanceProcAddr go through the loader trampoline, the ones in g_deviceDispatch don't
+	const auto trampoline = reinterpret_cast<PFN_vkCmdPipelineBarrier>(vkhl::g_globalDispatch.vkGetInstanceProcAddr(instance, "vkCmdPipelineBarrier"));
+	Bench(context, "cmd_pipeline_barrier_trampoline", uint64_t(g_batchSize) * 64, RecordBarriers(bench, trampoline));
+	Bench(context, "cmd_pipeline_barrier_dispatch", uint64_t(g_batchSize) * 64, RecordBarriers(bench, vkhl::g_deviceDispatch.vkCmdPipelineBarrier));
+
+	if (jsonPath && !WriteJson(jsonPath, context, physicalDeviceInfo))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,1084 @@
+#include <vulkan/vulkan_core.h>
+#include <vulkan/vk_icd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+// A Vulkan driver with no GPU behind it, for testing and benchmarking vkhl deterministically.
+// Point the loader at it with VK_ICD_FILENAMES=<build dir>/vkhl_stub_icd.json, then size it with:
+//	VKHL_STUB_DEVICE_COUNT				Physical devices, their types cycle discrete, integrated, virtual, CPU (default 1)
+//	VKHL_STUB_DEVICE_GROUP_SIZE			Consecutive devices reported as one device group (default 1)
+//	VKHL_STUB_QUEUE_FAMILY_COUNT		Queue families per device, see GetQueueFamilyFlags (default 3)
+//	VKHL_STUB_QUEUE_COUNT				Queues per family (default 4)
+//	VKHL_STUB_INSTANCE_EXTENSION_COUNT	Made up instance extensions, on top of the real ones (default 0)
+//	VKHL_STUB_DEVICE_EXTENSION_COUNT	Made up device extensions (default 0)
+//	VKHL_STUB_TIMESTAMP_BITS			timestampValidBits of every queue family (default 64)
+// Layers can't come from a driver, the build writes VKHL_STUB_LAYER_COUNT layer manifests for VK_ADD_LAYER_PATH instead.
+//
+// Work completes as soon as it is submitted: fences and timeline semaphores are signaled by the submit itself.
+// Commands are ignored except for timestamps, which are written as they are recorded (see StubCmdWriteTimestamp). Memory is plain host memory
+
+#if defined(_WIN32)
+#define VKHL_STUB_EXPORT extern "C" __declspec(dllexport)
+#else
+#define VKHL_STUB_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+namespace
+{
+	struct StubConfig
+	{
+		uint32_t deviceCount;
+		uint32_t deviceGroupSize;
+		uint32_t queueFamilyCount;
+		uint32_t queueCount;
+		uint32_t timestampBits;
+		std::vector<VkExtensionProperties> instanceExtensions;
+		std::vector<VkExtensionProperties> deviceExtensions;
+	};
+
+	uint32_t GetEnvCount(const char* name, uint32_t fallback)
+	{
+		const char* value = std::getenv(name);
+		return value ? static_cast<uint32_t>(std::strtoul(value, nullptr, 10)) : fallback;
+	}
+
+	VkExtensionProperties MakeExtension(const char* name, uint32_t specVersion)
+	{
+		VkExtensionProperties extension{};
+		std::snprintf(extension.extensionName, sizeof(extension.extensionName), "%s", name);
+		extension.specVersion = specVersion;
+		return extension;
+	}
+
+	// Read once, the loader may enumerate extensions before any instance exists
+	const StubConfig& GetConfig()
+	{
+		static const StubConfig config = [] {
+			StubConfig config{};
+			config.deviceCount = GetEnvCount("VKHL_STUB_DEVICE_COUNT", 1);
+			config.deviceGroupSize = std::min(std::max(GetEnvCount("VKHL_STUB_DEVICE_GROUP_SIZE", 1), 1u), uint32_t(VK_MAX_DEVICE_GROUP_SIZE));
+			config.queueFamilyCount = std::max(GetEnvCount("VKHL_STUB_QUEUE_FAMILY_COUNT", 3), 1u);
+			config.queueCount = std::max(GetEnvCount("VKHL_STUB_QUEUE_COUNT", 4), 1u);
+			config.timestampBits = std::min(GetEnvCount("VKHL_STUB_TIMESTAMP_BITS", 64), 64u);
+
+			char name[VK_MAX_EXTENSION_NAME_SIZE];
+			config.instanceExtensions.push_back(MakeExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, 2));
+			for (uint32_t i = GetEnvCount("VKHL_STUB_INSTANCE_EXTENSION_COUNT", 0); i > 0; i--)
+			{
+				std::snprintf(name, sizeof(name), "VK_VKHL_stub_instance_extension_%u", i - 1);
+				config.instanceExtensions.push_back(MakeExtension(name, 1));
+			}
+
+			for (uint32_t i = GetEnvCount("VKHL_STUB_DEVICE_EXTENSION_COUNT", 0); i > 0; i--)
+			{
+				std::snprintf(name, sizeof(name), "VK_VKHL_stub_device_extension_%u", i - 1);
+				config.deviceExtensions.push_back(MakeExtension(name, 1));
+			}
+
+			return config;
+		}();
+
+		return config;
+	}
+
+	// Dispatchable handles start with space for the loader's dispatch table
+	struct StubPhysicalDevice
+	{
+		VK_LOADER_DATA loaderData;
+		uint32_t index;
+	};
+
+	struct StubInstance
+	{
+		VK_LOADER_DATA loaderData;
+		std::unique_ptr<StubPhysicalDevice[]> physicalDevices;
+	};
+
+	struct StubQueue
+	{
+		VK_LOADER_DATA loaderData;
+	};
+
+	struct StubDevice
+	{
+		VK_LOADER_DATA loaderData;
+		uint32_t physicalDeviceIndex;
+		std::unique_ptr<StubQueue[]> queues; // queues[family * queueCount + index]
+	};
+
+	struct StubCommandBuffer
+	{
+		VK_LOADER_DATA loaderData;
+	};
+
+	struct StubCommandPool
+	{
+		std::vector<StubCommandBuffer*> commandBuffers;
+	};
+
+	struct StubMemory
+	{
+		void* data;
+	};
+
+	struct StubResource
+	{
+		VkDeviceSize size;
+	};
+
+	struct StubFence
+	{
+		std::atomic<bool> signaled;
+	};
+
+	struct StubSemaphore
+	{
+		std::atomic<uint64_t> value;
+	};
+
+	// Only timestamp queries have results
+	struct StubQueryPool
+	{
+		std::unique_ptr<uint64_t[]> values;
+		std::unique_ptr<std::atomic<bool>[]> available;
+	};
+
+	// Non-dispatchable handles are 64 bit integers on 32 bit platforms, so cast through uintptr_t
+	template<typename HandleT, typename ObjectT>
+	HandleT ToHandle(ObjectT* object)
+	{
+		return (HandleT)(reinterpret_cast<uintptr_t>(object));
+	}
+
+	template<typename ObjectT, typename HandleT>
+	ObjectT* FromHandle(HandleT handle)
+	{
+		return reinterpret_cast<ObjectT*>((uintptr_t)handle);
+	}
+
+	// Handles that don't need any state, only have to be unique
+	template<typename HandleT>
+	HandleT NextHandle()
+	{
+		static std::atomic<uint64_t> s_next = 1;
+		return (HandleT)(s_next.fetch_add(1, std::memory_order_relaxed));
+	}
+
+	template<typename T>
+	VkResult FillArray(const std::vector<T>& items, uint32_t* countInOut, T* itemsOut)
+	{
+		if (!itemsOut)
+		{
+			*countInOut = static_cast<uint32_t>(items.size());
+			return VK_SUCCESS;
+		}
+
+		const uint32_t count = std::min(*countInOut, static_cast<uint32_t>(items.size()));
+		std::copy(items.begin(), items.begin() + count, itemsOut);
+		*countInOut = count;
+		return count < items.size() ? VK_INCOMPLETE : VK_SUCCESS;
+	}
+
+	bool HasExtension(const std::vector<VkExtensionProperties>& extensions, const char* name)
+	{
+		return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& extension) {
+			return std::strcmp(extension.extensionName, name) == 0;
+		});
+	}
+
+	// Family 0 can do everything, then dedicated compute, then dedicated transfer, then the pattern repeats
+	VkQueueFlags GetQueueFamilyFlags(uint32_t family)
+	{
+		switch (family % 3)
+		{
+		case 0:		return VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT | VK_QUEUE_SPARSE_BINDING_BIT;
+		case 1:		return VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+		default:	return VK_QUEUE_TRANSFER_BIT;
+		}
+	}
+
+	void GetProperties(uint32_t index, VkPhysicalDeviceProperties* properties)
+	{
+		static const VkPhysicalDeviceType types[] = {
+			VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU, VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU, VK_PHYSICAL_DEVICE_TYPE_CPU
+		};
+
+		*properties = {};
+		properties->apiVersion = VK_API_VERSION_1_3;
+		properties->driverVersion = VK_MAKE_API_VERSION(0, 1, 0, 0);
+		properties->vendorID = 0x10000; // Outside the PCI range, like other software drivers
+		properties->deviceID = index;
+		properties->deviceType = types[index % 4];
+		std::snprintf(properties->deviceName, sizeof(properties->deviceName), "vkhl stub device %u", index);
+		std::memcpy(properties->pipelineCacheUUID, "vkhl stub icd", 13);
+		properties->pipelineCacheUUID[15] = static_cast<uint8_t>(index);
+
+		VkPhysicalDeviceLimits& limits = properties->limits;
+		limits.maxImageDimension1D = 16384;
+		limits.maxImageDimension2D = 16384;
+		limits.maxImageDimension3D = 2048;
+		limits.maxImageDimensionCube = 16384;
+		limits.maxImageArrayLayers = 2048;
+		limits.maxTexelBufferElements = 1u << 27;
+		limits.maxUniformBufferRange = 65536;
+		limits.maxStorageBufferRange = 1u << 30;
+		limits.maxPushConstantsSize = 256;
+		limits.maxMemoryAllocationCount = 4096;
+		limits.maxSamplerAllocationCount = 4000;
+		limits.bufferImageGranularity = 1024;
+		limits.maxBoundDescriptorSets = 8;
+		limits.maxPerStageDescriptorSamplers = 1u << 20;
+		limits.maxPerStageDescriptorUniformBuffers = 1u << 20;
+		limits.maxPerStageDescriptorStorageBuffers = 1u << 20;
+		limits.maxPerStageDescriptorSampledImages = 1u << 20;
+		limits.maxPerStageDescriptorStorageImages = 1u << 20;
+		limits.maxPerStageDescriptorInputAttachments = 1u << 20;
+		limits.maxPerStageResources = 1u << 20;
+		limits.maxDescriptorSetSamplers = 1u << 20;
+		limits.maxDescriptorSetUniformBuffers = 1u << 20;
+		limits.maxDescriptorSetUniformBuffersDynamic = 16;
+		limits.maxDescriptorSetStorageBuffers = 1u << 20;
+		limits.maxDescriptorSetStorageBuffersDynamic = 16;
+		limits.maxDescriptorSetSampledImages = 1u << 20;
+		limits.maxDescriptorSetStorageImages = 1u << 20;
+		limits.maxDescriptorSetInputAttachments = 1u << 20;
+		limits.maxVertexInputAttributes = 32;
+		limits.maxVertexInputBindings = 32;
+		limits.maxComputeSharedMemorySize = 32768;
+		limits.maxComputeWorkGroupCount[0] = limits.maxComputeWorkGroupCount[1] = limits.maxComputeWorkGroupCount[2] = 65535;
+		limits.maxComputeWorkGroupInvocations = 1024;
+		limits.maxComputeWorkGroupSize[0] = limits.maxComputeWorkGroupSize[1] = 1024;
+		limits.maxComputeWorkGroupSize[2] = 64;
+		limits.maxViewports = 16;
+		limits.maxViewportDimensions[0] = limits.maxViewportDimensions[1] = 16384;
+		limits.minMemoryMapAlignment = 64;
+		limits.minTexelBufferOffsetAlignment = 16;
+		limits.minUniformBufferOffsetAlignment = 64;
+		limits.minStorageBufferOffsetAlignment = 16;
+		limits.maxFramebufferWidth = 16384;
+		limits.maxFramebufferHeight = 16384;
+		limits.maxFramebufferLayers = 2048;
+		limits.framebufferColorSampleCounts = VK_SAMPLE_COUNT_1_BIT | VK_SAMPLE_COUNT_4_BIT;
+		limits.framebufferDepthSampleCounts = VK_SAMPLE_COUNT_1_BIT | VK_SAMPLE_COUNT_4_BIT;
+		limits.maxColorAttachments = 8;
+		limits.timestampComputeAndGraphics = VK_TRUE;
+		limits.timestampPeriod = 1.0f;
+		limits.optimalBufferCopyOffsetAlignment = 4;
+		limits.optimalBufferCopyRowPitchAlignment = 4;
+		limits.nonCoherentAtomSize = 64;
+	}
+
+	// One device local heap, growing with the device index so ranking by heap size is deterministic, and one host heap
+	void GetMemoryProperties(uint32_t index, VkPhysicalDeviceMemoryProperties* memoryProperties)
+	{
+		*memoryProperties = {};
+		memoryProperties->memoryHeapCount = 2;
+		memoryProperties->memoryHeaps[0] = { VkDeviceSize(1 + index % 16) << 30, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+		memoryProperties->memoryHeaps[1] = { VkDeviceSize(16) << 30, 0 };
+
+		memoryProperties->memoryTypeCount = 4;
+		memoryProperties->memoryTypes[0] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+		memoryProperties->memoryTypes[1] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0 };
+		memoryProperties->memoryTypes[2] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+		memoryProperties->memoryTypes[3] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1 };
+	}
+
+	// Every feature is supported. Feature structs are a header followed by VkBool32s only
+	void SetAllFeatures(void* features, size_t size, size_t headerSize)
+	{
+		VkBool32* bools = reinterpret_cast<VkBool32*>(static_cast<char*>(features) + headerSize);
+		std::fill(bools, bools + (size - headerSize) / sizeof(VkBool32), VK_TRUE);
+	}
+
+	// Global functions
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubEnumerateInstanceVersion(uint32_t* pApiVersion)
+	{
+		*pApiVersion = VK_API_VERSION_1_3;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubEnumerateInstanceExtensionProperties(const char* pLayerName, uint32_t* pPropertyCount, VkExtensionProperties* pProperties)
+	{
+		if (pLayerName)
+			return VK_ERROR_LAYER_NOT_PRESENT;
+
+		return FillArray(GetConfig().instanceExtensions, pPropertyCount, pProperties);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateInstance(const VkInstanceCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkInstance* pInstance)
+	{
+		const StubConfig& config = GetConfig();
+		for (uint32_t i = 0; i < pCreateInfo->enabledExtensionCount; i++)
+		{
+			if (!HasExtension(config.instanceExtensions, pCreateInfo->ppEnabledExtensionNames[i]))
+				return VK_ERROR_EXTENSION_NOT_PRESENT;
+		}
+
+		auto instance = new StubInstance{};
+		set_loader_magic_value(instance);
+
+		instance->physicalDevices = std::make_unique<StubPhysicalDevice[]>(config.deviceCount);
+		for (uint32_t i = 0; i < config.deviceCount; i++)
+		{
+			set_loader_magic_value(&instance->physicalDevices[i]);
+			instance->physicalDevices[i].index = i;
+		}
+
+		*pInstance = reinterpret_cast<VkInstance>(instance);
+		return VK_SUCCESS;
+	}
+
+	// Instance functions
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyInstance(VkInstance instance, const VkAllocationCallbacks*)
+	{
+		delete reinterpret_cast<StubInstance*>(instance);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubEnumeratePhysicalDevices(VkInstance instance, uint32_t* pPhysicalDeviceCount, VkPhysicalDevice* pPhysicalDevices)
+	{
+		auto stubInstance = reinterpret_cast<StubInstance*>(instance);
+
+		std::vector<VkPhysicalDevice> devices(GetConfig().deviceCount);
+		for (uint32_t i = 0; i < devices.size(); i++)
+			devices[i] = reinterpret_cast<VkPhysicalDevice>(&stubInstance->physicalDevices[i]);
+
+		return FillArray(devices, pPhysicalDeviceCount, pPhysicalDevices);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubEnumeratePhysicalDeviceGroups(VkInstance instance, uint32_t* pPhysicalDeviceGroupCount, VkPhysicalDeviceGroupProperties* pPhysicalDeviceGroupProperties)
+	{
+		auto stubInstance = reinterpret_cast<StubInstance*>(instance);
+		const StubConfig& config = GetConfig();
+
+		std::vector<VkPhysicalDeviceGroupProperties> groups;
+		for (uint32_t first = 0; first < config.deviceCount; first += config.deviceGroupSize)
+		{
+			VkPhysicalDeviceGroupProperties group{};
+			group.physicalDeviceCount = std::min(config.deviceGroupSize, config.deviceCount - first);
+			for (uint32_t i = 0; i < group.physicalDeviceCount; i++)
+				group.physicalDevices[i] = reinterpret_cast<VkPhysicalDevice>(&stubInstance->physicalDevices[first + i]);
+			group.subsetAllocation = group.physicalDeviceCount > 1;
+			groups.push_back(group);
+		}
+
+		if (!pPhysicalDeviceGroupProperties)
+		{
+			*pPhysicalDeviceGroupCount = static_cast<uint32_t>(groups.size());
+			return VK_SUCCESS;
+		}
+
+		// The caller's sType and pNext stay as they were
+		const uint32_t count = std::min(*pPhysicalDeviceGroupCount, static_cast<uint32_t>(groups.size()));
+		for (uint32_t i = 0; i < count; i++)
+		{
+			std::copy(groups[i].physicalDevices, groups[i].physicalDevices + VK_MAX_DEVICE_GROUP_SIZE, pPhysicalDeviceGroupProperties[i].physicalDevices);
+			pPhysicalDeviceGroupProperties[i].physicalDeviceCount = groups[i].physicalDeviceCount;
+			pPhysicalDeviceGroupProperties[i].subsetAllocation = groups[i].subsetAllocation;
+		}
+
+		*pPhysicalDeviceGroupCount = count;
+		return count < groups.size() ? VK_INCOMPLETE : VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceProperties* pProperties)
+	{
+		GetProperties(reinterpret_cast<StubPhysicalDevice*>(physicalDevice)->index, pProperties);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceProperties2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceProperties2* pProperties)
+	{
+		GetProperties(reinterpret_cast<StubPhysicalDevice*>(physicalDevice)->index, &pProperties->properties);
+
+		for (auto next = static_cast<VkBaseOutStructure*>(pProperties->pNext); next; next = next->pNext)
+		{
+			if (next->sType != VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES)
+				continue;
+
+			// Update after bind limits, as high as the normal ones
+			auto indexing = reinterpret_cast<VkPhysicalDeviceDescriptorIndexingProperties*>(next);
+			indexing->maxUpdateAfterBindDescriptorsInAllPools = 1u << 20;
+			indexing->maxPerStageDescriptorUpdateAfterBindSamplers = 1u << 20;
+			indexing->maxPerStageDescriptorUpdateAfterBindUniformBuffers = 1u << 20;
+			indexing->maxPerStageDescriptorUpdateAfterBindStorageBuffers = 1u << 20;
+			indexing->maxPerStageDescriptorUpdateAfterBindSampledImages = 1u << 20;
+			indexing->maxPerStageDescriptorUpdateAfterBindStorageImages = 1u << 20;
+			indexing->maxPerStageUpdateAfterBindResources = 1u << 20;
+			indexing->maxDescriptorSetUpdateAfterBindSamplers = 1u << 20;
+			indexing->maxDescriptorSetUpdateAfterBindStorageBuffers = 1u << 20;
+			indexing->maxDescriptorSetUpdateAfterBindSampledImages = 1u << 20;
+			indexing->maxDescriptorSetUpdateAfterBindStorageImages = 1u << 20;
+		}
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceFeatures(VkPhysicalDevice, VkPhysicalDeviceFeatures* pFeatures)
+	{
+		SetAllFeatures(pFeatures, sizeof(VkPhysicalDeviceFeatures), 0);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceFeatures2(VkPhysicalDevice, VkPhysicalDeviceFeatures2* pFeatures)
+	{
+		SetAllFeatures(&pFeatures->features, sizeof(VkPhysicalDeviceFeatures), 0);
+
+		// Only the core structs, no extensions are reported so their structs stay as they were
+		for (auto next = static_cast<VkBaseOutStructure*>(pFeatures->pNext); next; next = next->pNext)
+		{
+			switch (next->sType)
+			{
+			case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES:	SetAllFeatures(next, sizeof(VkPhysicalDeviceVulkan11Features), sizeof(VkBaseOutStructure)); break;
+			case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES:	SetAllFeatures(next, sizeof(VkPhysicalDeviceVulkan12Features), sizeof(VkBaseOutStructure)); break;
+			case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES:	SetAllFeatures(next, sizeof(VkPhysicalDeviceVulkan13Features), sizeof(VkBaseOutStructure)); break;
+			default: break;
+			}
+		}
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice, uint32_t* pQueueFamilyPropertyCount, VkQueueFamilyProperties* pQueueFamilyProperties)
+	{
+		const StubConfig& config = GetConfig();
+
+		std::vector<VkQueueFamilyProperties> families(config.queueFamilyCount);
+		for (uint32_t i = 0; i < families.size(); i++)
+		{
+			families[i].queueFlags = GetQueueFamilyFlags(i);
+			families[i].queueCount = config.queueCount;
+			families[i].timestampValidBits = config.timestampBits;
+			families[i].minImageTransferGranularity = { 1, 1, 1 };
+		}
+
+		FillArray(families, pQueueFamilyPropertyCount, pQueueFamilyProperties);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+	{
+		GetMemoryProperties(reinterpret_cast<StubPhysicalDevice*>(physicalDevice)->index, pMemoryProperties);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceMemoryProperties2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties2* pMemoryProperties)
+	{
+		GetMemoryProperties(reinterpret_cast<StubPhysicalDevice*>(physicalDevice)->index, &pMemoryProperties->memoryProperties);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubEnumerateDeviceExtensionProperties(VkPhysicalDevice, const char* pLayerName, uint32_t* pPropertyCount, VkExtensionProperties* pProperties)
+	{
+		if (pLayerName)
+			return VK_ERROR_LAYER_NOT_PRESENT;
+
+		return FillArray(GetConfig().deviceExtensions, pPropertyCount, pProperties);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkDevice* pDevice)
+	{
+		const StubConfig& config = GetConfig();
+		for (uint32_t i = 0; i < pCreateInfo->enabledExtensionCount; i++)
+		{
+			if (!HasExtension(config.deviceExtensions, pCreateInfo->ppEnabledExtensionNames[i]))
+				return VK_ERROR_EXTENSION_NOT_PRESENT;
+		}
+
+		for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++)
+		{
+			const VkDeviceQueueCreateInfo& queueInfo = pCreateInfo->pQueueCreateInfos[i];
+			if (queueInfo.queueFamilyIndex >= config.queueFamilyCount || queueInfo.queueCount > config.queueCount)
+				return VK_ERROR_INITIALIZATION_FAILED;
+		}
+
+		auto device = new StubDevice{};
+		set_loader_magic_value(device);
+		device->physicalDeviceIndex = reinterpret_cast<StubPhysicalDevice*>(physicalDevice)->index;
+
+		const uint32_t queueCount = config.queueFamilyCount * config.queueCount;
+		device->queues = std::make_unique<StubQueue[]>(queueCount);
+		for (uint32_t i = 0; i < queueCount; i++)
+			set_loader_magic_value(&device->queues[i]);
+
+		*pDevice = reinterpret_cast<VkDevice>(device);
+		return VK_SUCCESS;
+	}
+
+	// Device functions
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyDevice(VkDevice device, const VkAllocationCallbacks*)
+	{
+		delete reinterpret_cast<StubDevice*>(device);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue* pQueue)
+	{
+		auto stubDevice = reinterpret_cast<StubDevice*>(device);
+		*pQueue = reinterpret_cast<VkQueue>(&stubDevice->queues[queueFamilyIndex * GetConfig().queueCount + queueIndex]);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubQueueSubmit(VkQueue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence)
+	{
+		// Everything finishes right away, so signal what the submits would have
+		for (uint32_t i = 0; i < submitCount; i++)
+		{
+			const VkSubmitInfo& submit = pSubmits[i];
+
+			const VkTimelineSemaphoreSubmitInfo* timelineInfo = nullptr;
+			for (auto next = static_cast<const VkBaseInStructure*>(submit.pNext); next; next = next->pNext)
+			{
+				if (next->sType == VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO)
+					timelineInfo = reinterpret_cast<const VkTimelineSemaphoreSubmitInfo*>(next);
+			}
+
+			for (uint32_t j = 0; j < submit.signalSemaphoreCount; j++)
+			{
+				auto semaphore = FromHandle<StubSemaphore>(submit.pSignalSemaphores[j]);
+				if (timelineInfo && j < timelineInfo->signalSemaphoreValueCount)
+					semaphore->value.store(timelineInfo->pSignalSemaphoreValues[j], std::memory_order_release);
+			}
+		}
+
+		if (fence)
+			FromHandle<StubFence>(fence)->signaled.store(true, std::memory_order_release);
+
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubQueueWaitIdle(VkQueue)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubDeviceWaitIdle(VkDevice)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateFence(VkDevice, const VkFenceCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkFence* pFence)
+	{
+		*pFence = ToHandle<VkFence>(new StubFence{ (pCreateInfo->flags & VK_FENCE_CREATE_SIGNALED_BIT) != 0 });
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyFence(VkDevice, VkFence fence, const VkAllocationCallbacks*)
+	{
+		delete FromHandle<StubFence>(fence);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubResetFences(VkDevice, uint32_t fenceCount, const VkFence* pFences)
+	{
+		for (uint32_t i = 0; i < fenceCount; i++)
+			FromHandle<StubFence>(pFences[i])->signaled.store(false, std::memory_order_relaxed);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubGetFenceStatus(VkDevice, VkFence fence)
+	{
+		return FromHandle<StubFence>(fence)->signaled.load(std::memory_order_acquire) ? VK_SUCCESS : VK_NOT_READY;
+	}
+
+	// Nothing is ever pending, so a wait that isn't satisfied now never will be
+	VKAPI_ATTR VkResult VKAPI_CALL StubWaitForFences(VkDevice, uint32_t fenceCount, const VkFence* pFences, VkBool32 waitAll, uint64_t)
+	{
+		uint32_t signaled = 0;
+		for (uint32_t i = 0; i < fenceCount; i++)
+			signaled += FromHandle<StubFence>(pFences[i])->signaled.load(std::memory_order_acquire);
+
+		return (waitAll ? signaled == fenceCount : signaled > 0) ? VK_SUCCESS : VK_TIMEOUT;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateSemaphore(VkDevice, const VkSemaphoreCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkSemaphore* pSemaphore)
+	{
+		uint64_t initialValue = 0;
+		for (auto next = static_cast<const VkBaseInStructure*>(pCreateInfo->pNext); next; next = next->pNext)
+		{
+			if (next->sType == VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO)
+				initialValue = reinterpret_cast<const VkSemaphoreTypeCreateInfo*>(next)->initialValue;
+		}
+
+		*pSemaphore = ToHandle<VkSemaphore>(new StubSemaphore{ initialValue });
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroySemaphore(VkDevice, VkSemaphore semaphore, const VkAllocationCallbacks*)
+	{
+		delete FromHandle<StubSemaphore>(semaphore);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubGetSemaphoreCounterValue(VkDevice, VkSemaphore semaphore, uint64_t* pValue)
+	{
+		*pValue = FromHandle<StubSemaphore>(semaphore)->value.load(std::memory_order_acquire);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubWaitSemaphores(VkDevice, const VkSemaphoreWaitInfo* pWaitInfo, uint64_t)
+	{
+		uint32_t reached = 0;
+		for (uint32_t i = 0; i < pWaitInfo->semaphoreCount; i++)
+			reached += FromHandle<StubSemaphore>(pWaitInfo->pSemaphores[i])->value.load(std::memory_order_acquire) >= pWaitInfo->pValues[i];
+
+		const bool any = (pWaitInfo->flags & VK_SEMAPHORE_WAIT_ANY_BIT) != 0;
+		return (any ? reached > 0 : reached == pWaitInfo->semaphoreCount) ? VK_SUCCESS : VK_TIMEOUT;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubSignalSemaphore(VkDevice, const VkSemaphoreSignalInfo* pSignalInfo)
+	{
+		FromHandle<StubSemaphore>(pSignalInfo->semaphore)->value.store(pSignalInfo->value, std::memory_order_release);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubAllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks*, VkDeviceMemory* pMemory)
+	{
+		void* data = std::calloc(1, static_cast<size_t>(pAllocateInfo->allocationSize));
+		if (!data)
+			return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+
+		*pMemory = ToHandle<VkDeviceMemory>(new StubMemory{ data });
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+	{
+		if (auto stubMemory = FromHandle<StubMemory>(memory))
+		{
+			std::free(stubMemory->data);
+			delete stubMemory;
+		}
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void** ppData)
+	{
+		*ppData = static_cast<char*>(FromHandle<StubMemory>(memory)->data) + offset;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubUnmapMemory(VkDevice, VkDeviceMemory)
+	{
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubFlushMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateBuffer(VkDevice, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkBuffer* pBuffer)
+	{
+		*pBuffer = ToHandle<VkBuffer>(new StubResource{ pCreateInfo->size });
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*)
+	{
+		delete FromHandle<StubResource>(buffer);
+	}
+
+	// Tightly packed at 4 bytes per texel, which is enough to exercise the allocators
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateImage(VkDevice, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkImage* pImage)
+	{
+		const VkExtent3D& extent = pCreateInfo->extent;
+		const VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * extent.depth * pCreateInfo->arrayLayers * 4;
+		*pImage = ToHandle<VkImage>(new StubResource{ size + size / 3 }); // Room for mips
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*)
+	{
+		delete FromHandle<StubResource>(image);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements)
+	{
+		pMemoryRequirements->size = (FromHandle<StubResource>(buffer)->size + 255) & ~VkDeviceSize(255);
+		pMemoryRequirements->alignment = 256;
+		pMemoryRequirements->memoryTypeBits = 0xF;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements* pMemoryRequirements)
+	{
+		pMemoryRequirements->size = (FromHandle<StubResource>(image)->size + 4095) & ~VkDeviceSize(4095);
+		pMemoryRequirements->alignment = 4096;
+		pMemoryRequirements->memoryTypeBits = 0x1; // Optimal images only fit device local memory on many GPUs
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateShaderModule(VkDevice, const VkShaderModuleCreateInfo*, const VkAllocationCallbacks*, VkShaderModule* pShaderModule)
+	{
+		*pShaderModule = NextHandle<VkShaderModule>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyShaderModule(VkDevice, VkShaderModule, const VkAllocationCallbacks*)
+	{
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreatePipelineCache(VkDevice, const VkPipelineCacheCreateInfo*, const VkAllocationCallbacks*, VkPipelineCache* pPipelineCache)
+	{
+		*pPipelineCache = NextHandle<VkPipelineCache>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyPipelineCache(VkDevice, VkPipelineCache, const VkAllocationCallbacks*)
+	{
+	}
+
+	// Just the header, so caches saved against the stub load back as compatible
+	VKAPI_ATTR VkResult VKAPI_CALL StubGetPipelineCacheData(VkDevice device, VkPipelineCache, size_t* pDataSize, void* pData)
+	{
+		VkPipelineCacheHeaderVersionOne header{};
+		VkPhysicalDeviceProperties properties;
+		GetProperties(reinterpret_cast<StubDevice*>(device)->physicalDeviceIndex, &properties);
+
+		header.headerSize = sizeof(header);
+		header.headerVersion = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+		header.vendorID = properties.vendorID;
+		header.deviceID = properties.deviceID;
+		std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+		if (!pData)
+		{
+			*pDataSize = sizeof(header);
+			return VK_SUCCESS;
+		}
+
+		if (*pDataSize < sizeof(header))
+		{
+			*pDataSize = 0;
+			return VK_INCOMPLETE;
+		}
+
+		std::memcpy(pData, &header, sizeof(header));
+		*pDataSize = sizeof(header);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubMergePipelineCaches(VkDevice, VkPipelineCache, uint32_t, const VkPipelineCache*)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateDescriptorSetLayout(VkDevice, const VkDescriptorSetLayoutCreateInfo*, const VkAllocationCallbacks*, VkDescriptorSetLayout* pSetLayout)
+	{
+		*pSetLayout = NextHandle<VkDescriptorSetLayout>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyDescriptorSetLayout(VkDevice, VkDescriptorSetLayout, const VkAllocationCallbacks*)
+	{
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateDescriptorPool(VkDevice, const VkDescriptorPoolCreateInfo*, const VkAllocationCallbacks*, VkDescriptorPool* pDescriptorPool)
+	{
+		*pDescriptorPool = NextHandle<VkDescriptorPool>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyDescriptorPool(VkDevice, VkDescriptorPool, const VkAllocationCallbacks*)
+	{
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubResetDescriptorPool(VkDevice, VkDescriptorPool, VkDescriptorPoolResetFlags)
+	{
+		return VK_SUCCESS;
+	}
+
+	// Pools never run out
+	VKAPI_ATTR VkResult VKAPI_CALL StubAllocateDescriptorSets(VkDevice, const VkDescriptorSetAllocateInfo* pAllocateInfo, VkDescriptorSet* pDescriptorSets)
+	{
+		for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; i++)
+			pDescriptorSets[i] = NextHandle<VkDescriptorSet>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubUpdateDescriptorSets(VkDevice, uint32_t, const VkWriteDescriptorSet*, uint32_t, const VkCopyDescriptorSet*)
+	{
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateQueryPool(VkDevice, const VkQueryPoolCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkQueryPool* pQueryPool)
+	{
+		auto pool = new StubQueryPool{};
+		pool->values = std::make_unique<uint64_t[]>(pCreateInfo->queryCount);
+		pool->available = std::make_unique<std::atomic<bool>[]>(pCreateInfo->queryCount);
+
+		*pQueryPool = ToHandle<VkQueryPool>(pool);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyQueryPool(VkDevice, VkQueryPool queryPool, const VkAllocationCallbacks*)
+	{
+		delete FromHandle<StubQueryPool>(queryPool);
+	}
+
+	// Queries that weren't written since their reset are unavailable, their values are left as they were
+	VKAPI_ATTR VkResult VKAPI_CALL StubGetQueryPoolResults(VkDevice, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount, size_t, void* pData, VkDeviceSize stride, VkQueryResultFlags flags)
+	{
+		auto pool = FromHandle<StubQueryPool>(queryPool);
+		const bool is64 = (flags & VK_QUERY_RESULT_64_BIT) != 0;
+		const bool availability = (flags & VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) != 0;
+
+		VkResult result = VK_SUCCESS;
+		for (uint32_t i = 0; i < queryCount; i++)
+		{
+			const bool available = pool->available[firstQuery + i].load(std::memory_order_acquire);
+			const uint64_t value = pool->values[firstQuery + i];
+			if (!available)
+				result = VK_NOT_READY;
+
+			char* query = static_cast<char*>(pData) + i * stride;
+			if (is64)
+			{
+				if (available)
+					reinterpret_cast<uint64_t*>(query)[0] = value;
+				if (availability)
+					reinterpret_cast<uint64_t*>(query)[1] = available;
+			}
+			else
+			{
+				if (available)
+					reinterpret_cast<uint32_t*>(query)[0] = static_cast<uint32_t>(value);
+				if (availability)
+					reinterpret_cast<uint32_t*>(query)[1] = available;
+			}
+		}
+
+		return result;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubResetQueryPool(VkDevice, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount)
+	{
+		auto pool = FromHandle<StubQueryPool>(queryPool);
+		for (uint32_t i = 0; i < queryCount; i++)
+			pool->available[firstQuery + i].store(false, std::memory_order_relaxed);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubCreateCommandPool(VkDevice, const VkCommandPoolCreateInfo*, const VkAllocationCallbacks*, VkCommandPool* pCommandPool)
+	{
+		*pCommandPool = ToHandle<VkCommandPool>(new StubCommandPool{});
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubDestroyCommandPool(VkDevice, VkCommandPool commandPool, const VkAllocationCallbacks*)
+	{
+		if (auto pool = FromHandle<StubCommandPool>(commandPool))
+		{
+			for (auto commandBuffer : pool->commandBuffers)
+				delete commandBuffer;
+			delete pool;
+		}
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubResetCommandPool(VkDevice, VkCommandPool, VkCommandPoolResetFlags)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubAllocateCommandBuffers(VkDevice, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers)
+	{
+		auto pool = FromHandle<StubCommandPool>(pAllocateInfo->commandPool);
+		for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; i++)
+		{
+			auto commandBuffer = new StubCommandBuffer{};
+			set_loader_magic_value(commandBuffer);
+			pool->commandBuffers.push_back(commandBuffer);
+			pCommandBuffers[i] = reinterpret_cast<VkCommandBuffer>(commandBuffer);
+		}
+
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL StubFreeCommandBuffers(VkDevice, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers)
+	{
+		auto pool = FromHandle<StubCommandPool>(commandPool);
+		for (uint32_t i = 0; i < commandBufferCount; i++)
+		{
+			auto commandBuffer = reinterpret_cast<StubCommandBuffer*>(pCommandBuffers[i]);
+			auto found = std::find(pool->commandBuffers.begin(), pool->commandBuffers.end(), commandBuffer);
+			if (found != pool->commandBuffers.end())
+			{
+				pool->commandBuffers.erase(found);
+				delete commandBuffer;
+			}
+		}
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubBeginCommandBuffer(VkCommandBuffer, const VkCommandBufferBeginInfo*)
+	{
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL StubEndCommandBuffer(VkCommandBuffer)
+	{
+		return VK_SUCCESS;
+	}
+
+	// Commands do nothing
+
+	VKAPI_ATTR void VKAPI_CALL StubCmdBindPipeline(VkCommandBuffer, VkPipelineBindPoint, VkPipeline) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdBindDescriptorSets(VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, uint32_t, uint32_t, const VkDescriptorSet*, uint32_t, const uint32_t*) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdPushConstants(VkCommandBuffer, VkPipelineLayout, VkShaderStageFlags, uint32_t, uint32_t, const void*) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdDraw(VkCommandBuffer, uint32_t, uint32_t, uint32_t, uint32_t) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdDrawIndexed(VkCommandBuffer, uint32_t, uint32_t, uint32_t, int32_t, uint32_t) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdDispatch(VkCommandBuffer, uint32_t, uint32_t, uint32_t) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdCopyBuffer(VkCommandBuffer, VkBuffer, VkBuffer, uint32_t, const VkBufferCopy*) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdCopyBufferToImage(VkCommandBuffer, VkBuffer, VkImage, VkImageLayout, uint32_t, const VkBufferImageCopy*) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdPipelineBarrier(VkCommandBuffer, VkPipelineStageFlags, VkPipelineStageFlags, VkDependencyFlags, uint32_t, const VkMemoryBarrier*, uint32_t, const VkBufferMemoryBarrier*, uint32_t, const VkImageMemoryBarrier*) {}
+	VKAPI_ATTR void VKAPI_CALL StubCmdPipelineBarrier2(VkCommandBuffer, const VkDependencyInfo*) {}
+
+	// Query commands take effect as they are recorded, the stub would have run them right after anyway
+
+	VKAPI_ATTR void VKAPI_CALL StubCmdResetQueryPool(VkCommandBuffer, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount)
+	{
+		StubResetQueryPool(VK_NULL_HANDLE, queryPool, firstQuery, queryCount);
+	}
+
+	// Every timestamp is 1000 ticks after the one before it, on one clock for the whole driver.
+	// The clock starts 100 timestamps before the valid bits wrap, so code reading timestamps always goes through a wrap
+	VKAPI_ATTR void VKAPI_CALL StubCmdWriteTimestamp(VkCommandBuffer, VkPipelineStageFlagBits, VkQueryPool queryPool, uint32_t query)
+	{
+		constexpr uint64_t Tick = 1000;
+		static std::atomic<uint64_t> s_clock = uint64_t(0) - 100 * Tick;
+
+		const uint32_t bits = GetConfig().timestampBits;
+		const uint64_t mask = bits >= 64 ? UINT64_MAX : (uint64_t(1) << bits) - 1;
+
+		auto pool = FromHandle<StubQueryPool>(queryPool);
+		pool->values[query] = s_clock.fetch_add(Tick, std::memory_order_relaxed) & mask;
+		pool->available[query].store(true, std::memory_order_release);
+	}
+
+	struct StubFunction
+	{
+		const char* name;
+		PFN_vkVoidFunction function;
+	};
+
+#define VKHL_STUB_FUNCTION(name) { "vk" #name, reinterpret_cast<PFN_vkVoidFunction>(Stub##name) }
+
+	const StubFunction g_functions[] = {
+		VKHL_STUB_FUNCTION(EnumerateInstanceVersion),
+		VKHL_STUB_FUNCTION(EnumerateInstanceExtensionProperties),
+		VKHL_STUB_FUNCTION(CreateInstance),
+
+		VKHL_STUB_FUNCTION(DestroyInstance),
+		VKHL_STUB_FUNCTION(EnumeratePhysicalDevices),
+		VKHL_STUB_FUNCTION(EnumeratePhysicalDeviceGroups),
+		VKHL_STUB_FUNCTION(GetPhysicalDeviceProperties),
+		VKHL_STUB_FUNCTION(GetPhysicalDeviceProperties2),
+		VKHL_STUB_FUNCTION(GetPhysicalDeviceFeatures),
+		VKHL_STUB_FUNCTION(GetPhysicalDeviceFeatures2),
+		VKHL_STUB_FUNCTION(GetPhysicalDeviceQueueFamilyProperties),
+		VKHL_STUB_FUNCTION(GetPhysicalDeviceMemoryProperties),
+		VKHL_STUB_FUNCTION(GetPhysicalDeviceMemoryProperties2),
+		VKHL_STUB_FUNCTION(EnumerateDeviceExtensionProperties),
+		VKHL_STUB_FUNCTION(CreateDevice),
+
+		VKHL_STUB_FUNCTION(DestroyDevice),
+		VKHL_STUB_FUNCTION(GetDeviceQueue),
+		VKHL_STUB_FUNCTION(QueueSubmit),
+		VKHL_STUB_FUNCTION(QueueWaitIdle),
+		VKHL_STUB_FUNCTION(DeviceWaitIdle),
+		VKHL_STUB_FUNCTION(CreateFence),
+		VKHL_STUB_FUNCTION(DestroyFence),
+		VKHL_STUB_FUNCTION(ResetFences),
+		VKHL_STUB_FUNCTION(GetFenceStatus),
+		VKHL_STUB_FUNCTION(WaitForFences),
+		VKHL_STUB_FUNCTION(CreateSemaphore),
+		VKHL_STUB_FUNCTION(DestroySemaphore),
+		VKHL_STUB_FUNCTION(GetSemaphoreCounterValue),
+		VKHL_STUB_FUNCTION(WaitSemaphores),
+		VKHL_STUB_FUNCTION(SignalSemaphore),
+		VKHL_STUB_FUNCTION(AllocateMemory),
+		VKHL_STUB_FUNCTION(FreeMemory),
+		VKHL_STUB_FUNCTION(MapMemory),
+		VKHL_STUB_FUNCTION(UnmapMemory),
+		{ "vkFlushMappedMemoryRanges", reinterpret_cast<PFN_vkVoidFunction>(StubFlushMappedMemoryRanges) },
+		{ "vkInvalidateMappedMemoryRanges", reinterpret_cast<PFN_vkVoidFunction>(StubFlushMappedMemoryRanges) },
+		VKHL_STUB_FUNCTION(CreateBuffer),
+		VKHL_STUB_FUNCTION(DestroyBuffer),
+		VKHL_STUB_FUNCTION(CreateImage),
+		VKHL_STUB_FUNCTION(DestroyImage),
+		VKHL_STUB_FUNCTION(GetBufferMemoryRequirements),
+		VKHL_STUB_FUNCTION(GetImageMemoryRequirements),
+		VKHL_STUB_FUNCTION(BindBufferMemory),
+		VKHL_STUB_FUNCTION(BindImageMemory),
+		VKHL_STUB_FUNCTION(CreateShaderModule),
+		VKHL_STUB_FUNCTION(DestroyShaderModule),
+		VKHL_STUB_FUNCTION(CreatePipelineCache),
+		VKHL_STUB_FUNCTION(DestroyPipelineCache),
+		VKHL_STUB_FUNCTION(GetPipelineCacheData),
+		VKHL_STUB_FUNCTION(MergePipelineCaches),
+		VKHL_STUB_FUNCTION(CreateDescriptorSetLayout),
+		VKHL_STUB_FUNCTION(DestroyDescriptorSetLayout),
+		VKHL_STUB_FUNCTION(CreateDescriptorPool),
+		VKHL_STUB_FUNCTION(DestroyDescriptorPool),
+		VKHL_STUB_FUNCTION(ResetDescriptorPool),
+		VKHL_STUB_FUNCTION(AllocateDescriptorSets),
+		VKHL_STUB_FUNCTION(UpdateDescriptorSets),
+		VKHL_STUB_FUNCTION(CreateQueryPool),
+		VKHL_STUB_FUNCTION(DestroyQueryPool),
+		VKHL_STUB_FUNCTION(GetQueryPoolResults),
+		VKHL_STUB_FUNCTION(ResetQueryPool),
+		VKHL_STUB_FUNCTION(CreateCommandPool),
+		VKHL_STUB_FUNCTION(DestroyCommandPool),
+		VKHL_STUB_FUNCTION(ResetCommandPool),
+		VKHL_STUB_FUNCTION(AllocateCommandBuffers),
+		VKHL_STUB_FUNCTION(FreeCommandBuffers),
+		VKHL_STUB_FUNCTION(BeginCommandBuffer),
+		VKHL_STUB_FUNCTION(EndCommandBuffer),
+		VKHL_STUB_FUNCTION(CmdBindPipeline),
+		VKHL_STUB_FUNCTION(CmdBindDescriptorSets),
+		VKHL_STUB_FUNCTION(CmdPushConstants),
+		VKHL_STUB_FUNCTION(CmdDraw),
+		VKHL_STUB_FUNCTION(CmdDrawIndexed),
+		VKHL_STUB_FUNCTION(CmdDispatch),
+		VKHL_STUB_FUNCTION(CmdCopyBuffer),
+		VKHL_STUB_FUNCTION(CmdCopyBufferToImage),
+		VKHL_STUB_FUNCTION(CmdPipelineBarrier),
+		VKHL_STUB_FUNCTION(CmdPipelineBarrier2),
+		VKHL_STUB_FUNCTION(CmdResetQueryPool),
+		VKHL_STUB_FUNCTION(CmdWriteTimestamp),
+	};
+
+#undef VKHL_STUB_FUNCTION
+
+	PFN_vkVoidFunction FindFunction(const char* name)
+	{
+		for (const auto& function : g_functions)
+		{
+			if (std::strcmp(function.name, name) == 0)
+				return function.function;
+		}
+
+		return nullptr;
+	}
+
+	VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL StubGetDeviceProcAddr(VkDevice, const char* pName)
+	{
+		return FindFunction(pName);
+	}
+}
+
+// Loader interface
+
+VKHL_STUB_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vk_icdNegotiateLoaderICDInterfaceVersion(uint32_t* pSupportedVersion)
+{
+	*pSupportedVersion = std::min(*pSupportedVersion, 5u);
+	return VK_SUCCESS;
+}
+
+VKHL_STUB_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vk_icdGetInstanceProcAddr(VkInstance, const char* pName)
+{
+	if (std::strcmp(pName, "vkGetDeviceProcAddr") == 0)
+		return reinterpret_cast<PFN_vkVoidFunction>(StubGetDeviceProcAddr);
+
+	return FindFunction(pName);
+}
@@ -2,20 +2,1728 @@
 
 #include <iostream>
 #include <array>
+#include <span>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <filesystem>
+#include <cmath>
+#include <chrono>
+
+// Checks vkhl against whatever driver the loader finds. ctest runs it on the stub ICD (vkhl_stub_icd) with
+// VKHL_STUB_DEVICE_COUNT=4, VKHL_STUB_DEVICE_GROUP_SIZE=2 and VKHL_STUB_TIMESTAMP_BITS=32, the multi-GPU checks are skipped without them.
+//
+// Usage: vkhl_test [--filter <substring>]
+
+// Prints the failed condition and fails the test
+#define TEST_CHECK(condition)																	\
+	if (!(condition))																			\
+	{																							\
+		std::printf("\t%s:%i: check failed: %s\n", __FILE__, __LINE__, #condition);			\
+		return false;																			\
+	}
+
+struct TestCase
+{
+	const char* name;
+	bool(*func)(VkInstance instance);
+};
 
 std::pair<const char*, vkhl::FeatureRequirement> g_instanceLayers[] = {
 	{ "VK_LAYER_KHRONOS_validation", vkhl::RequestFeature }
 };
 
-int main()
+// A device for the tests of objects built on a device, with the queues of queueInfos or else one queue that can do everything.
+// physicalDeviceOut is optional
+bool CreateTestDevice(VkInstance instance, vkhl::PhysicalDeviceInfo* physicalDeviceInfoOut, VkDevice* deviceOut, vkhl::DeviceInfo* deviceInfoOut,
+	std::span<vkhl::PhysicalDeviceQueueFamilySelectionInfo> queueInfos = {}, VkPhysicalDevice* physicalDeviceOut = nullptr)
+{
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfo = {
+		.graphics = vkhl::RequireFeature,
+		.compute = vkhl::RequireFeature,
+		.transfer = vkhl::RequireFeature
+	};
+
+	if (queueInfos.empty())
+		queueInfos = { &queueInfo, 1 };
+
+	VkPhysicalDevice physicalDevice;
+	std::vector<uint32_t> queueFamilyIndices(queueInfos.size());
+	TEST_CHECK(vkhl::SelectPhyicalDevice(instance, { .queueFamilyInfos = queueInfos }, &physicalDevice, queueFamilyIndices.data(), physicalDeviceInfoOut).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(vkhl::CreateDevice(physicalDevice, *physicalDeviceInfoOut, {}, deviceOut, deviceInfoOut).GetAndReset() == VK_SUCCESS);
+
+	if (physicalDeviceOut)
+		*physicalDeviceOut = physicalDevice;
+	return true;
+}
+
+bool TestDevice(VkInstance instance)
+{
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfos[2] = {
+		{
+			.graphics = vkhl::RequireFeature,
+			.compute = vkhl::RequireFeature,
+			.transfer = vkhl::RequireFeature
+		},
+		{
+			.transfer = vkhl::RequireFeature
+		}
+	};
+
+	VkPhysicalDevice physicalDevice;
+	uint32_t queueFamilyIndices[2];
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+
+	TEST_CHECK(vkhl::SelectPhyicalDevice(instance, {
+			.queueFamilyInfos = queueInfos,
+		}, &physicalDevice, queueFamilyIndices, &physicalDeviceInfo).GetAndReset() == VK_SUCCESS);
+
+	puts("\tQueues:");
+	for (const auto& assignment : physicalDeviceInfo.queueAssignments)
+		std::printf("\t\tfamily %u, queue %u%s\n", assignment.queueFamilyIndex, assignment.queueIndex, assignment.shared ? " (shared)" : "");
+
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	TEST_CHECK(vkhl::CreateDevice(physicalDevice, physicalDeviceInfo, {}, &device, &deviceInfo).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	std::printf("\tTimeline semaphores: %i\n\tSynchronization2: %i\n\tBuffer device address: %i\n\tDescriptor indexing: %i\n",
+		deviceInfo.timelineSemaphore, deviceInfo.synchronization2, deviceInfo.bufferDeviceAddress, deviceInfo.descriptorIndexing);
+
+	return true;
+}
+
+bool TestMultiDevice(VkInstance instance)
+{
+	if (!std::getenv("VKHL_STUB_DEVICE_COUNT") || std::strcmp(std::getenv("VKHL_STUB_DEVICE_COUNT"), "4") != 0 ||
+		!std::getenv("VKHL_STUB_DEVICE_GROUP_SIZE") || std::strcmp(std::getenv("VKHL_STUB_DEVICE_GROUP_SIZE"), "2") != 0)
+	{
+		puts("\tSkipped, needs the stub ICD with VKHL_STUB_DEVICE_COUNT=4 and VKHL_STUB_DEVICE_GROUP_SIZE=2");
+		return true;
+	}
+
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfo = { .compute = vkhl::RequireFeature };
+	vkhl::PhysicalDeviceRankingInfo ranking;
+
+	// Every device passes, the best ranked first. The stub's device types cycle discrete, integrated, virtual, CPU
+	std::vector<vkhl::PhysicalDeviceCandidate> devices;
+	TEST_CHECK(vkhl::SelectPhysicalDevices(instance, { .queueFamilyInfos = { &queueInfo, 1 }, .ranking = &ranking }, 8, &devices).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(devices.size() == 4);
+	TEST_CHECK(devices[0].info.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU);
+	for (size_t i = 1; i < devices.size(); i++)
+	{
+		TEST_CHECK(devices[i - 1].score.total >= devices[i].score.total);
+		TEST_CHECK(devices[i].queueFamilies.size() == 1);
+	}
+
+	std::vector<vkhl::PhysicalDeviceCandidate> limited;
+	TEST_CHECK(vkhl::SelectPhysicalDevices(instance, { .queueFamilyInfos = { &queueInfo, 1 } }, 3, &limited).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(limited.size() == 3);
+
+	// Two groups of two, both pass, so the first one wins
+	vkhl::PhysicalDeviceGroupInfo group;
+	TEST_CHECK(vkhl::SelectPhysicalDeviceGroup(instance, { .queueFamilyInfos = { &queueInfo, 1 } }, &group).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(group.devices.size() == 2);
+	TEST_CHECK(group.devices[0].device != group.devices[1].device);
+
+	// Work follows the scores until devices are measured
+	std::vector<float> weights;
+	for (const auto& device : devices)
+		weights.push_back(device.score.total);
+
+	vkhl::WorkDistributor distributor;
+	TEST_CHECK(distributor.Init(static_cast<uint32_t>(devices.size()), weights).GetAndReset() == VK_SUCCESS);
+
+	// The ranges cover every item once, in order
+	std::array<vkhl::WorkRange, 4> ranges;
+	for (uint64_t itemCount : { 0ull, 1ull, 3ull, 1001ull, 1000000ull })
+	{
+		distributor.Split(itemCount, ranges);
+
+		uint64_t next = 0;
+		for (const auto& range : ranges)
+		{
+			TEST_CHECK(range.first == next);
+			next += range.count;
+		}
+		TEST_CHECK(next == itemCount);
+	}
+
+	distributor.Split(1000000, ranges);
+	TEST_CHECK(ranges[0].count >= ranges[1].count && ranges[1].count >= ranges[2].count && ranges[2].count >= ranges[3].count);
+
+	// Device 0 turns out four times slower per item than the others, so its share has to shrink while theirs grows
+	const std::array<vkhl::WorkRange, 4> before = ranges;
+	for (int frame = 0; frame < 16; frame++)
+	{
+		distributor.Split(1000000, ranges);
+		for (uint32_t device = 0; device < ranges.size(); device++)
+			distributor.Report(device, ranges[device].count, ranges[device].count * (device == 0 ? 4000 : 1000));
+	}
+
+	distributor.Split(1000000, ranges);
+	TEST_CHECK(ranges[0].count < before[0].count);
+	for (uint32_t device = 1; device < ranges.size(); device++)
+		TEST_CHECK(ranges[device].count > before[device].count);
+
+	// Close to the measured speeds: equal shares for equally fast devices, and about a quarter of that for device 0
+	TEST_CHECK(std::max(ranges[1].count, ranges[2].count) - std::min(ranges[1].count, ranges[2].count) <= 1);
+	TEST_CHECK(ranges[1].count > ranges[0].count * 3);
+
+	return true;
+}
+
+bool TestMemoryAllocator(VkInstance instance)
+{
+	// Four ranges fill the allocator, and nothing else fits
+	vkhl::TlsfAllocator tlsf;
+	tlsf.Init(1024);
+
+	std::array<std::pair<VkDeviceSize, uint32_t>, 4> ranges;
+	for (auto& [offset, node] : ranges)
+		TEST_CHECK(tlsf.Allocate(256, 1, &offset, &node));
+
+	VkDeviceSize offset;
+	uint32_t node;
+	TEST_CHECK(!tlsf.Allocate(1, 1, &offset, &node));
+	TEST_CHECK(tlsf.GetUsed() == 1024 && tlsf.GetAllocationCount() == 4);
+
+	std::sort(ranges.begin(), ranges.end());
+	for (size_t i = 0; i < ranges.size(); i++)
+		TEST_CHECK(ranges[i].first == i * 256);
+
+	// Two free ranges that aren't neighbours can't hold 512 bytes, freeing the one between them merges all three
+	tlsf.Free(ranges[0].second);
+	tlsf.Free(ranges[2].second);
+	TEST_CHECK(!tlsf.Allocate(512, 1, &offset, &node));
+
+	tlsf.Free(ranges[1].second);
+	TEST_CHECK(tlsf.Allocate(768, 1, &offset, &node));
+	TEST_CHECK(offset == 0);
+
+	// Once everything is freed the whole range is one block again
+	tlsf.Free(node);
+	tlsf.Free(ranges[3].second);
+	TEST_CHECK(tlsf.IsEmpty() && tlsf.GetUsed() == 0);
+	TEST_CHECK(tlsf.Allocate(1024, 1, &offset, &node));
+	tlsf.Free(node);
+
+	// Alignment is honoured behind an unaligned allocation
+	uint32_t smallNode;
+	TEST_CHECK(tlsf.Allocate(1, 1, &offset, &smallNode));
+	TEST_CHECK(tlsf.Allocate(100, 256, &offset, &node));
+	TEST_CHECK(offset % 256 == 0);
+	tlsf.Free(node);
+	tlsf.Free(smallNode);
+	TEST_CHECK(tlsf.IsEmpty());
+
+	// A free range of exactly the requested size is found even when it isn't a power of two,
+	// whether it is the whole range or a hole between two allocations
+	tlsf.Init(42946560);
+	TEST_CHECK(tlsf.Allocate(42946560, 1, &offset, &node));
+	tlsf.Free(node);
+	TEST_CHECK(tlsf.IsEmpty());
+
+	tlsf.Init(30000000);
+	std::array<uint32_t, 3> holeNodes;
+	for (uint32_t& holeNode : holeNodes)
+		TEST_CHECK(tlsf.Allocate(10000000, 1, &offset, &holeNode));
+	tlsf.Free(holeNodes[1]);
+	TEST_CHECK(tlsf.Allocate(10000000, 1, &offset, &node));
+	TEST_CHECK(offset == 10000000);
+	tlsf.Free(node);
+	for (uint32_t holeNode : { holeNodes[0], holeNodes[2] })
+		tlsf.Free(holeNode);
+	TEST_CHECK(tlsf.IsEmpty());
+
+	// The allocator on top of it, the stub's memory types are device local, both, host visible, host cached
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	vkhl::MemoryAllocator allocator;
+	TEST_CHECK(allocator.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, { .blockSize = 1 << 20 }).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyAllocator([&allocator]() {
+			allocator.Destroy();
+		});
+
+	const vkhl::MemoryAllocationInfo hostInfo = {
+		.requirements = { .size = 4096, .alignment = 64, .memoryTypeBits = 0b1111 },
+		.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+	};
+
+	vkhl::MemoryAllocation* first;
+	vkhl::MemoryAllocation* second;
+	TEST_CHECK(allocator.Allocate(hostInfo, &first).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(allocator.Allocate(hostInfo, &second).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(first->memoryTypeIndex == 3 && second->memoryTypeIndex == 3);
+	TEST_CHECK(first->memory == second->memory);
+	TEST_CHECK(first->offset % 64 == 0 && second->offset % 64 == 0);
+	TEST_CHECK(first->offset + 4096 <= second->offset || second->offset + 4096 <= first->offset);
+	TEST_CHECK(first->mappedData && second->mappedData);
+
+	const uint32_t heap = physicalDeviceInfo.memoryProperties.memoryTypes[3].heapIndex;
+	TEST_CHECK(allocator.GetHeapUsage(heap).allocationBytes == 8192);
+
+	allocator.Free(first);
+	allocator.Free(second);
+	TEST_CHECK(allocator.GetHeapUsage(heap).allocationBytes == 0);
+
+	// Device local only memory can never be host visible, that isn't running out of memory
+	vkhl::MemoryAllocation* allocation;
+	vkhl::MemoryAllocationInfo deviceLocalInfo = hostInfo;
+	deviceLocalInfo.requirements.memoryTypeBits = 0b0001;
+	TEST_CHECK(allocator.Allocate(deviceLocalInfo, &allocation).GetAndReset() == VK_ERROR_FEATURE_NOT_PRESENT);
+
+	return true;
+}
+
+bool TestMemoryBudget(VkInstance instance)
+{
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	VkPhysicalDevice physicalDevice;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo, {}, &physicalDevice))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	vkhl::MemoryAllocator allocator;
+	TEST_CHECK(allocator.Init(vkhl::g_deviceDispatch, physicalDeviceInfo).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyAllocator([&allocator]() {
+			allocator.Destroy();
+		});
+
+	// The thresholds fall between the steps of 1/20 of the budget the test allocates in, so page rounding can't move a level.
+	// Only polled on Update
+	std::vector<std::pair<uint32_t, vkhl::MemoryPressure>> changes;
+	vkhl::MemoryBudgetCreateInfo createInfo = {
+		.allocator = &allocator,
+		.pollInterval = 0,
+		.elevatedThreshold = 0.45f,
+		.highThreshold = 0.7f,
+		.criticalThreshold = 0.85f,
+		.hysteresis = 0.125f,
+		.pressureFunc = [](uint32_t heapIndex, vkhl::MemoryPressure pressure, const vkhl::MemoryHeapBudget&, void* usrPtr) {
+			static_cast<std::vector<std::pair<uint32_t, vkhl::MemoryPressure>>*>(usrPtr)->emplace_back(heapIndex, pressure);
+		},
+		.usrPtr = &changes
+	};
+
+	vkhl::MemoryBudget budget;
+	vkhl::MemoryBudgetCreateInfo unorderedInfo = createInfo;
+	unorderedInfo.highThreshold = 0.4f;
+	TEST_CHECK(budget.Init(physicalDevice, deviceInfo, unorderedInfo).GetAndReset() == VK_ERROR_INITIALIZATION_FAILED);
+
+	TEST_CHECK(budget.Init(physicalDevice, deviceInfo, createInfo).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyBudget([&budget]() {
+			budget.Destroy();
+		});
+
+	// The stub has no VK_EXT_memory_budget, so usage is the allocator's blocks and the budget 80% of the heap
+	TEST_CHECK(!budget.HasBudgetExtension());
+	const uint32_t heap = physicalDeviceInfo.memoryProperties.memoryTypes[0].heapIndex;
+	const vkhl::MemoryHeapBudget initial = budget.GetHeapBudget(heap);
+	TEST_CHECK(initial.usage == 0 && initial.budget == initial.size / 10 * 8 && initial.pressure == vkhl::MemoryPressure::Normal);
+
+	// A reader alongside always gets usage and pressure from the same Update: the level is at least what usage classifies as,
+	// and at most what usage hysteresis higher would
+	auto classify = [&createInfo](double fraction) {
+		const float thresholds[3] = { createInfo.elevatedThreshold, createInfo.highThreshold, createInfo.criticalThreshold };
+		return static_cast<vkhl::MemoryPressure>(std::count_if(std::begin(thresholds), std::end(thresholds), [fraction](float threshold) { return fraction >= threshold; }));
+	};
+
+	std::atomic<bool> stopReading = false;
+	std::atomic<bool> consistent = true;
+	std::thread reader([&]() {
+			while (!stopReading)
+			{
+				const vkhl::MemoryHeapBudget current = budget.GetHeapBudget(heap);
+				const double fraction = static_cast<double>(current.usage) / static_cast<double>(current.budget);
+				if (current.pressure < classify(fraction) || current.pressure > classify(fraction + createInfo.hysteresis))
+					consistent = false;
+			}
+		});
+
+	vkhl::Defer deferStopReader([&stopReading, &reader]() {
+			stopReading = true;
+			reader.join();
+		});
+
+	const VkDeviceSize step = initial.budget / 20 / 4096 * 4096;
+	const vkhl::MemoryAllocationInfo allocationInfo = {
+		.requirements = { .size = step, .alignment = 4096, .memoryTypeBits = 0b0001 },
+		.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		.dedicated = true
+	};
+
+	// Levels start 0.45, 0.7 and 0.85 into the budget, i.e. at 10, 15 and 18 steps. Past 18 the whole budget is used
+	std::vector<vkhl::MemoryAllocation*> allocations;
+	for (uint32_t steps = 1; steps <= 20; steps++)
+	{
+		vkhl::MemoryAllocation* allocation;
+		TEST_CHECK(allocator.Allocate(allocationInfo, &allocation).GetAndReset() == VK_SUCCESS);
+		allocations.push_back(allocation);
+		budget.Update();
+
+		const vkhl::MemoryHeapBudget current = budget.GetHeapBudget(heap);
+		TEST_CHECK(current.usage == steps * step && current.usage == allocator.GetHeapUsage(heap).blockBytes);
+		TEST_CHECK(current.pressure == static_cast<vkhl::MemoryPressure>((steps >= 10) + (steps >= 15) + (steps >= 18)));
+		TEST_CHECK(budget.GetPressure() == current.pressure);
+	}
+
+	// And only end 0.125 lower, below 14, 11 and 6 steps
+	for (uint32_t steps = 19; steps != ~0u; steps--)
+	{
+		allocator.Free(allocations.back());
+		allocations.pop_back();
+		budget.Update();
+
+		const vkhl::MemoryHeapBudget current = budget.GetHeapBudget(heap);
+		TEST_CHECK(current.usage == steps * step);
+		TEST_CHECK(current.pressure == static_cast<vkhl::MemoryPressure>((steps >= 7) + (steps >= 12) + (steps >= 15)));
+	}
+
+	stopReading = true;
+	TEST_CHECK(consistent);
+
+	// Each change was reported once, and only for that heap
+	const std::pair<uint32_t, vkhl::MemoryPressure> expectedChanges[] = {
+		{ heap, vkhl::MemoryPressure::Elevated }, { heap, vkhl::MemoryPressure::High }, { heap, vkhl::MemoryPressure::Critical },
+		{ heap, vkhl::MemoryPressure::High }, { heap, vkhl::MemoryPressure::Elevated }, { heap, vkhl::MemoryPressure::Normal }
+	};
+	TEST_CHECK(std::equal(changes.begin(), changes.end(), std::begin(expectedChanges), std::end(expectedChanges)));
+
+	return true;
+}
+
+bool TestQueueAssignment(VkInstance instance)
 {
+	// The stub's queue families are: everything, compute and transfer, transfer only. Each has 4 queues
+	VkPhysicalDevice physicalDevice;
+	uint32_t queueFamilyIndices[5];
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+
+	// Each request gets the family closest to what it asked for
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo dedicatedInfos[3] = {
+		{ .graphics = vkhl::RequireFeature, .compute = vkhl::RequireFeature, .transfer = vkhl::RequireFeature },
+		{ .compute = vkhl::RequireFeature },
+		{ .transfer = vkhl::RequireFeature }
+	};
+
+	TEST_CHECK(vkhl::SelectPhyicalDevice(instance, { .queueFamilyInfos = dedicatedInfos }, &physicalDevice, queueFamilyIndices, &physicalDeviceInfo).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(physicalDeviceInfo.queueAssignments.size() == 3);
+	for (uint32_t request = 0; request < 3; request++)
+	{
+		const auto& assignment = physicalDeviceInfo.queueAssignments[request];
+		TEST_CHECK(queueFamilyIndices[request] == request);
+		TEST_CHECK(assignment.queueFamilyIndex == request && assignment.queueIndex == 0 && assignment.queueCount == 1 && !assignment.shared);
+		TEST_CHECK(physicalDeviceInfo.queueFamilies[request].assignedQueueCount == 1);
+	}
+
+	// Five graphics requests fill the four queues of family 0, then the fifth shares the first queue
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo graphicsInfo = { .graphics = vkhl::RequireFeature };
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo graphicsInfos[5] = { graphicsInfo, graphicsInfo, graphicsInfo, graphicsInfo, graphicsInfo };
+
+	TEST_CHECK(vkhl::SelectPhyicalDevice(instance, { .queueFamilyInfos = graphicsInfos }, &physicalDevice, queueFamilyIndices, &physicalDeviceInfo).GetAndReset() == VK_SUCCESS);
+	for (uint32_t request = 0; request < 5; request++)
+	{
+		const auto& assignment = physicalDeviceInfo.queueAssignments[request];
+		TEST_CHECK(assignment.queueFamilyIndex == 0 && assignment.queueIndex == request % 4);
+		TEST_CHECK(assignment.shared == (request == 0 || request == 4));
+	}
+	TEST_CHECK(physicalDeviceInfo.queueFamilies[0].assignedQueueCount == 4);
+
+	// Several queues of one request stay together, behind the queue another request already took
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo computeInfos[2] = {
+		{ .compute = vkhl::RequireFeature },
+		{ .minQueueCount = 3, .compute = vkhl::RequireFeature }
+	};
+
+	TEST_CHECK(vkhl::SelectPhyicalDevice(instance, { .queueFamilyInfos = computeInfos }, &physicalDevice, queueFamilyIndices, &physicalDeviceInfo).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(physicalDeviceInfo.queueAssignments[0].queueFamilyIndex == 1 && physicalDeviceInfo.queueAssignments[0].queueIndex == 0);
+	TEST_CHECK(physicalDeviceInfo.queueAssignments[1].queueFamilyIndex == 1 && physicalDeviceInfo.queueAssignments[1].queueIndex == 1);
+	TEST_CHECK(physicalDeviceInfo.queueAssignments[1].queueCount == 3 && !physicalDeviceInfo.queueAssignments[1].shared);
+	TEST_CHECK(physicalDeviceInfo.queueFamilies[1].assignedQueueCount == 4);
+
+	return true;
+}
+
+bool TestDescriptorLayoutCache(VkInstance instance)
+{
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	vkhl::DescriptorLayoutCache cache;
+	TEST_CHECK(cache.Init(vkhl::g_deviceDispatch).GetAndReset() == VK_SUCCESS);
+
+	const VkSampler samplers[2] = { reinterpret_cast<VkSampler>(uintptr_t{ 0x100 }), reinterpret_cast<VkSampler>(uintptr_t{ 0x200 }) };
+	const VkDescriptorSetLayoutBinding bindings[3] = {
+		{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+		{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+		{ 2, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &samplers[0] },
+	};
+
+	// Returns the layout for bindings, after a change to one of them
+	auto getLayout = [&cache, &bindings](auto&& change, const void* next = nullptr, VkDescriptorSetLayoutCreateFlags flags = 0) -> const vkhl::DescriptorSetLayoutInfo* {
+		VkDescriptorSetLayoutBinding changed[3] = { bindings[0], bindings[1], bindings[2] };
+		change(changed);
+
+		const vkhl::DescriptorSetLayoutInfo* layout = nullptr;
+		const VkDescriptorSetLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, next, flags, 3, changed };
+		if (cache.Get(createInfo, &layout).GetAndReset() != VK_SUCCESS)
+			return nullptr;
+		return layout;
+	};
+	auto same = [](VkDescriptorSetLayoutBinding*) {};
+
+	const vkhl::DescriptorSetLayoutInfo* layout = getLayout(same);
+	TEST_CHECK(layout && layout->layout != VK_NULL_HANDLE);
+	TEST_CHECK(layout->descriptorCounts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] == 2);
+	TEST_CHECK(layout->descriptorCounts[VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER] == 3);
+	TEST_CHECK(layout->descriptorCounts[VK_DESCRIPTOR_TYPE_SAMPLER] == 1);
+	TEST_CHECK(layout->descriptorCounts[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER] == 0);
+
+	// The same bindings in another order are the same layout
+	TEST_CHECK(getLayout(same) == layout);
+	TEST_CHECK(getLayout([](VkDescriptorSetLayoutBinding* b) { std::swap(b[0], b[2]); }) == layout);
+
+	// Anything that changes the layout makes a new one
+	TEST_CHECK(getLayout([](VkDescriptorSetLayoutBinding* b) { b[0].descriptorCount = 1; }) != layout);
+	TEST_CHECK(getLayout([](VkDescriptorSetLayoutBinding* b) { b[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; }) != layout);
+	TEST_CHECK(getLayout([](VkDescriptorSetLayoutBinding* b) { b[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT; }) != layout);
+	TEST_CHECK(getLayout([](VkDescriptorSetLayoutBinding* b) { b[1].binding = 5; }) != layout);
+	TEST_CHECK(getLayout([&samplers](VkDescriptorSetLayoutBinding* b) { b[2].pImmutableSamplers = &samplers[1]; }) != layout);
+	TEST_CHECK(getLayout(same, nullptr, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT) != layout);
+
+	// Immutable samplers are keyed on the handles, not the pointer to them
+	const VkSampler samplerCopy = samplers[0];
+	TEST_CHECK(getLayout([&samplerCopy](VkDescriptorSetLayoutBinding* b) { b[2].pImmutableSamplers = &samplerCopy; }) == layout);
+
+	// Binding flags are part of the key and move with their binding
+	const VkDescriptorBindingFlags bindingFlags[3] = { 0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT, 0 };
+	const VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO, nullptr, 3, bindingFlags };
+	const vkhl::DescriptorSetLayoutInfo* flaggedLayout = getLayout(same, &flagsInfo);
+	TEST_CHECK(flaggedLayout && flaggedLayout != layout);
+	TEST_CHECK(getLayout(same, &flagsInfo) == flaggedLayout);
+
+	const VkDescriptorBindingFlags swappedFlags[3] = { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT, 0, 0 };
+	const VkDescriptorSetLayoutBindingFlagsCreateInfo swappedFlagsInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO, nullptr, 3, swappedFlags };
+	TEST_CHECK(getLayout([](VkDescriptorSetLayoutBinding* b) { std::swap(b[0], b[1]); }, &swappedFlagsInfo) == flaggedLayout);
+	TEST_CHECK(getLayout(same, &swappedFlagsInfo) != flaggedLayout);
+
+	// Types the allocator has no pool sizes for are refused
+	TEST_CHECK(getLayout([](VkDescriptorSetLayoutBinding* b) { b[0].descriptorType = VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK; }) == nullptr);
+
+	return true;
+}
+
+bool TestDeletionQueue(VkInstance)
+{
+	vkhl::DeletionQueue queue;
+	TEST_CHECK(queue.Init(4).GetAndReset() == VK_SUCCESS);
+
+	// Functions run once their value is reached, in the order they were enqueued. The last two go past the ring to the overflow list
+	std::string ran;
+	const std::pair<uint64_t, char> entries[] = { { 2, 'a' }, { 1, 'b' }, { 2, 'c' }, { 1, 'd' }, { 3, 'e' }, { 1, 'f' } };
+	for (const auto& [value, name] : entries)
+		queue.Enqueue(value, [&ran, name]() { ran += name; });
+
+	TEST_CHECK(queue.Collect(0) == 0 && ran.empty());
+	TEST_CHECK(queue.Collect(1) == 3 && ran == "bdf");
+	TEST_CHECK(queue.Collect(1) == 0);
+	TEST_CHECK(queue.Collect(2) == 2 && ran == "bdfac");
+
+	// A Defer handed to the queue runs there, not when it goes out of scope
+	{
+		vkhl::Defer defer([&ran]() { ran += 'g'; });
+		queue.Enqueue(2, std::move(defer));
+	}
+	TEST_CHECK(ran == "bdfac");
+
+	// A later value jumps ahead of the ones still waiting
+	TEST_CHECK(queue.Collect(3) == 2 && ran == "bdfaceg");
+	TEST_CHECK(queue.CollectAll() == 0);
+
+	// Several threads at once, past the ring's capacity, collected while they enqueue.
+	// Each thread's functions still run in its order, and each exactly once
+	constexpr uint32_t ThreadCount = 4;
+	constexpr uint32_t PerThread = 10000;
+	std::array<std::vector<uint32_t>, ThreadCount> order;
+	std::atomic<uint32_t> done = 0;
+
+	std::vector<std::thread> threads;
+	for (uint32_t thread = 0; thread < ThreadCount; thread++)
+	{
+		threads.emplace_back([&queue, &order, &done, thread]() {
+				for (uint32_t i = 0; i < PerThread; i++)
+					queue.Enqueue(i / 100, [&order, thread, i]() { order[thread].push_back(i); });
+				done++;
+			});
+	}
+
+	for (uint64_t completed = 0; done < ThreadCount; completed++)
+		queue.Collect(completed / 8);
+
+	for (auto& thread : threads)
+		thread.join();
+	queue.CollectAll();
+
+	for (const auto& threadOrder : order)
+	{
+		TEST_CHECK(threadOrder.size() == PerThread);
+		TEST_CHECK(std::is_sorted(threadOrder.begin(), threadOrder.end()));
+		TEST_CHECK(std::adjacent_find(threadOrder.begin(), threadOrder.end()) == threadOrder.end());
+	}
+
+	return true;
+}
+
+bool TestPipelineCache(VkInstance instance)
+{
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "vkhl_test_pipeline_cache.bin";
+	const std::string pathString = path.string();
+	std::filesystem::remove(path);
+
+	vkhl::Defer deferRemoveFile([&path]() {
+			std::error_code error;
+			std::filesystem::remove(path, error);
+		});
+
+	// No file yet, so nothing is loaded
+	vkhl::PipelineCache cache;
+	TEST_CHECK(cache.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, { .path = pathString.c_str() }).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(!cache.WasLoaded());
+
+	// Each thread gets its own cache, and keeps getting the same one
+	VkPipelineCache threadCaches[2] = {};
+	std::thread threads[2];
+	for (int i = 0; i < 2; i++)
+	{
+		threads[i] = std::thread([&cache, &threadCaches, i]() {
+				threadCaches[i] = cache.Get();
+				if (cache.Get() != threadCaches[i])
+					threadCaches[i] = VK_NULL_HANDLE;
+			});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	TEST_CHECK(threadCaches[0] != VK_NULL_HANDLE && threadCaches[1] != VK_NULL_HANDLE);
+	TEST_CHECK(threadCaches[0] != threadCaches[1]);
+	TEST_CHECK(cache.Get() != threadCaches[0] && cache.Get() != threadCaches[1]);
+
+	// Saving merges them and writes what the device gave back, the stub gives just the header
+	TEST_CHECK(cache.Save().GetAndReset() == VK_SUCCESS);
+	cache.Destroy();
+
+	VkPipelineCacheHeaderVersionOne header;
+	std::FILE* file = std::fopen(pathString.c_str(), "rb");
+	TEST_CHECK(file);
+	const size_t headerRead = std::fread(&header, 1, sizeof(header), file);
+	std::fclose(file);
+	TEST_CHECK(headerRead == sizeof(header) && std::filesystem::file_size(path) == sizeof(header));
+
+	TEST_CHECK(cache.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, { .path = pathString.c_str() }).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(cache.WasLoaded());
+	cache.Destroy();
+
+	// Writes the header with one change, returns whether Init still hands the file to the device
+	auto loads = [&](auto&& change) {
+		VkPipelineCacheHeaderVersionOne changed = header;
+		change(changed);
+		if (!vkhl::WriteFileAtomic(pathString.c_str(), &changed, sizeof(changed)))
+			return true;
+
+		const bool loaded = cache.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, { .path = pathString.c_str() }).GetAndReset() != VK_SUCCESS || cache.WasLoaded();
+		cache.Destroy();
+		return loaded;
+	};
+
+	TEST_CHECK(!loads([](VkPipelineCacheHeaderVersionOne& h) { h.pipelineCacheUUID[3] ^= 0xff; }));
+	TEST_CHECK(!loads([](VkPipelineCacheHeaderVersionOne& h) { h.deviceID++; }));
+	TEST_CHECK(!loads([](VkPipelineCacheHeaderVersionOne& h) { h.vendorID++; }));
+	TEST_CHECK(!loads([](VkPipelineCacheHeaderVersionOne& h) { h.headerVersion = static_cast<VkPipelineCacheHeaderVersion>(7); }));
+	TEST_CHECK(!loads([](VkPipelineCacheHeaderVersionOne& h) { h.headerSize = sizeof(h) + 1; })); // Claims more than the file has
+	TEST_CHECK(loads([](VkPipelineCacheHeaderVersionOne&) {}));
+
+	return true;
+}
+
+// Stand in for vkCreateComputePipelines and vkDestroyPipeline in TestPipelineCompiler, builds hand out fake handles
+std::atomic<uint32_t> g_fakePipelinesStarted = 0;
+std::atomic<uint32_t> g_fakePipelinesDestroyed = 0;
+std::atomic<bool> g_fakePipelineGateOpen = true; // Builds wait while it is closed
+
+VKAPI_ATTR VkResult VKAPI_CALL FakeCreateComputePipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount, const VkComputePipelineCreateInfo*,
+	const VkAllocationCallbacks*, VkPipeline* pPipelines)
+{
+	for (uint32_t i = 0; i < createInfoCount; i++)
+	{
+		const uint32_t index = g_fakePipelinesStarted++;
+		while (!g_fakePipelineGateOpen)
+			std::this_thread::yield();
+		pPipelines[i] = reinterpret_cast<VkPipeline>(uintptr_t{ 0x1000 } + index);
+	}
+
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL FakeDestroyPipeline(VkDevice, VkPipeline, const VkAllocationCallbacks*)
+{
+	g_fakePipelinesDestroyed++;
+}
+
+bool TestPipelineCompiler(VkInstance)
+{
+	vkhl::DeviceDispatch dispatch = vkhl::g_deviceDispatch;
+	dispatch.vkCreateComputePipelines = FakeCreateComputePipelines;
+	dispatch.vkDestroyPipeline = FakeDestroyPipeline;
+	g_fakePipelinesStarted = 0;
+	g_fakePipelinesDestroyed = 0;
+	g_fakePipelineGateOpen = true;
+
+	vkhl::PipelineCompiler compiler;
+	TEST_CHECK(compiler.Init(dispatch, { .workerCount = 1 }).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyCompiler([&compiler]() {
+			g_fakePipelineGateOpen = true;
+			compiler.Destroy();
+		});
+
+	// A key is built once, however often it is requested
+	VkComputePipelineCreateInfo createInfo{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	TEST_CHECK(compiler.Request({ .key = 1, .compute = &createInfo }).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(compiler.Wait(1, &pipeline).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(pipeline == reinterpret_cast<VkPipeline>(uintptr_t{ 0x1000 }) && compiler.TryGet(1) == pipeline);
+	TEST_CHECK(compiler.Request({ .key = 1, .compute = &createInfo }).GetAndReset() == VK_SUCCESS);
+	compiler.WaitIdle();
+	TEST_CHECK(g_fakePipelinesStarted == 1);
+
+	// Destroy while the worker is stuck in one build and another is queued. The queued one is dropped, the threads waiting on
+	// either are woken, and only leave once they read their result
+	g_fakePipelineGateOpen = false;
+	TEST_CHECK(compiler.Request({ .key = 2, .compute = &createInfo }).GetAndReset() == VK_SUCCESS);
+	while (g_fakePipelinesStarted == 1)
+		std::this_thread::yield();
+	TEST_CHECK(compiler.Request({ .key = 3, .priority = vkhl::PipelinePriority::Prewarm, .compute = &createInfo }).GetAndReset() == VK_SUCCESS);
+
+	std::atomic<bool> idle = false;
+	VkResult waitResult = VK_NOT_READY;
+	std::thread idleThread([&compiler, &idle]() {
+			compiler.WaitIdle();
+			idle = true;
+		});
+	std::thread waitThread([&compiler, &waitResult, &pipeline]() {
+			waitResult = compiler.Wait(2, &pipeline).GetAndReset();
+		});
+
+	// Give the waiters and Destroy time to get going, the running build only ends once the gate opens
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	std::thread destroyThread([&compiler]() {
+			compiler.Destroy();
+		});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	g_fakePipelineGateOpen = true;
+
+	destroyThread.join();
+	idleThread.join();
+	waitThread.join();
+
+	TEST_CHECK(idle);
+	TEST_CHECK(waitResult == VK_SUCCESS && pipeline == reinterpret_cast<VkPipeline>(uintptr_t{ 0x1001 }));
+	TEST_CHECK(g_fakePipelinesStarted == 2 && g_fakePipelinesDestroyed == 2);
+
+	return true;
+}
+
+// Shader modules TestShaderModuleCache saw created and destroyed, both still go to the stub
+uint32_t g_shaderModulesCreated = 0;
+std::vector<VkShaderModule> g_destroyedShaderModules;
+
+VKAPI_ATTR VkResult VKAPI_CALL RecordCreateShaderModule(VkDevice device, const VkShaderModuleCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator,
+	VkShaderModule* pShaderModule)
+{
+	g_shaderModulesCreated++;
+	return vkhl::g_deviceDispatch.vkCreateShaderModule(device, pCreateInfo, pAllocator, pShaderModule);
+}
+
+VKAPI_ATTR void VKAPI_CALL RecordDestroyShaderModule(VkDevice device, VkShaderModule shaderModule, const VkAllocationCallbacks* pAllocator)
+{
+	g_destroyedShaderModules.push_back(shaderModule);
+	vkhl::g_deviceDispatch.vkDestroyShaderModule(device, shaderModule, pAllocator);
+}
+
+bool TestShaderModuleCache(VkInstance instance)
+{
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	vkhl::DeviceDispatch dispatch = vkhl::g_deviceDispatch;
+	dispatch.vkCreateShaderModule = RecordCreateShaderModule;
+	dispatch.vkDestroyShaderModule = RecordDestroyShaderModule;
+	g_shaderModulesCreated = 0;
+	g_destroyedShaderModules.clear();
+
+	vkhl::ShaderModuleCache cache;
+	TEST_CHECK(cache.Init(dispatch, deviceInfo, { .maxUnusedModules = 2 }).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyCache([&cache]() {
+			cache.Destroy();
+		});
+
+	// Two files with the same bytes, and the same code from memory, are one shader
+	const std::filesystem::path directory = std::filesystem::temp_directory_path();
+	const std::string paths[2] = { (directory / "vkhl_test_shader_a.spv").string(), (directory / "vkhl_test_shader_b.spv").string() };
+	const uint32_t code[4][3] = { { 0x07230203, 0x00010000, 1 }, { 0x07230203, 0x00010000, 2 }, { 0x07230203, 0x00010000, 3 }, { 0x07230203, 0x00010000, 4 } };
+	for (const auto& path : paths)
+		TEST_CHECK(vkhl::WriteFileAtomic(path.c_str(), code[0], sizeof(code[0])));
+
+	vkhl::Defer deferRemoveFiles([&paths]() {
+			for (const auto& path : paths)
+				std::filesystem::remove(path);
+		});
+
+	vkhl::Hash shaders[4], sameShaders[3];
+	TEST_CHECK(cache.Load(paths[0].c_str(), &shaders[0]).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(cache.Load(paths[1].c_str(), &sameShaders[0]).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(cache.Load(paths[0].c_str(), &sameShaders[1]).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(cache.Add(code[0], &sameShaders[2]).GetAndReset() == VK_SUCCESS);
+	for (const vkhl::Hash hash : sameShaders)
+		TEST_CHECK(hash == shaders[0]);
+
+	for (uint32_t i = 1; i < 4; i++)
+		TEST_CHECK(cache.Add(code[i], &shaders[i]).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(cache.GetShaderCount() == 4);
+
+	// The stub has no VK_EXT_shader_module_identifier
+	VkPipelineShaderStageModuleIdentifierCreateInfoEXT identifier;
+	TEST_CHECK(!cache.UsesIdentifiers() && !cache.GetIdentifier(shaders[0], &identifier));
+
+	// Acquiring again shares the module, and releasing the last user keeps it around, unused
+	VkShaderModule modules[4], module;
+	TEST_CHECK(cache.Acquire(shaders[0], &modules[0]).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(cache.Acquire(shaders[0], &module).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(module == modules[0] && g_shaderModulesCreated == 1);
+	cache.Release(shaders[0]);
+	cache.Release(shaders[0]);
+	TEST_CHECK(g_destroyedShaderModules.empty());
+
+	TEST_CHECK(cache.Acquire(shaders[0], &module).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(module == modules[0] && g_shaderModulesCreated == 1);
+	cache.Release(shaders[0]);
+
+	// A third unused module goes past maxUnusedModules, which destroys the one released longest ago
+	for (uint32_t i = 1; i < 3; i++)
+	{
+		TEST_CHECK(cache.Acquire(shaders[i], &modules[i]).GetAndReset() == VK_SUCCESS);
+		cache.Release(shaders[i]);
+	}
+	TEST_CHECK((g_destroyedShaderModules == std::vector<VkShaderModule>{ modules[0] }));
+
+	// A module in use is never evicted, so the next oldest unused one goes
+	TEST_CHECK(cache.Acquire(shaders[2], &module).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(cache.Acquire(shaders[3], &modules[3]).GetAndReset() == VK_SUCCESS);
+	cache.Release(shaders[3]);
+	TEST_CHECK(g_destroyedShaderModules.size() == 1);
+	cache.Release(shaders[2]);
+	TEST_CHECK((g_destroyedShaderModules == std::vector<VkShaderModule>{ modules[0], modules[1] }));
+
+	// An evicted shader is created again from its SPIR-V, which stayed mapped
+	TEST_CHECK(cache.Acquire(shaders[0], &module).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(module != VK_NULL_HANDLE && module != modules[0] && g_shaderModulesCreated == 5);
+	cache.Release(shaders[0]);
+
+	// Trim destroys whatever is unused
+	TEST_CHECK(g_destroyedShaderModules.size() == 3);
+	cache.Trim();
+	TEST_CHECK(g_destroyedShaderModules.size() == 5);
+
+	return true;
+}
+
+void SkipJsonSpace(std::string_view& text)
+{
+	while (!text.empty() && (text[0] == ' ' || text[0] == '\t' || text[0] == '\r' || text[0] == '\n'))
+		text.remove_prefix(1);
+}
+
+bool SkipJsonString(std::string_view& text)
+{
+	if (text.empty() || text[0] != '"')
+		return false;
+
+	for (size_t i = 1; i < text.size(); i++)
+	{
+		if (static_cast<unsigned char>(text[i]) < 0x20)
+			return false;
+		if (text[i] == '\\')
+		{
+			if (++i == text.size() || !std::strchr("\"\\/bfnrtu", text[i]))
+				return false;
+		}
+		else if (text[i] == '"')
+		{
+			text.remove_prefix(i + 1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Moves text past one JSON value, false if it doesn't start with one. The text must be followed by a null terminator somewhere, for strtod
+bool SkipJsonValue(std::string_view& text)
+{
+	SkipJsonSpace(text);
+	if (text.empty())
+		return false;
+
+	if (text[0] == '"')
+		return SkipJsonString(text);
+
+	if (text[0] == '{' || text[0] == '[')
+	{
+		const bool object = text[0] == '{';
+		const char close = object ? '}' : ']';
+		text.remove_prefix(1);
+
+		SkipJsonSpace(text);
+		if (!text.empty() && text[0] == close)
+		{
+			text.remove_prefix(1);
+			return true;
+		}
+
+		for (;;)
+		{
+			if (object)
+			{
+				SkipJsonSpace(text);
+				if (!SkipJsonString(text))
+					return false;
+
+				SkipJsonSpace(text);
+				if (text.empty() || text[0] != ':')
+					return false;
+				text.remove_prefix(1);
+			}
+
+			if (!SkipJsonValue(text))
+				return false;
+
+			SkipJsonSpace(text);
+			if (text.empty())
+				return false;
+
+			const char separator = text[0];
+			text.remove_prefix(1);
+			if (separator == close)
+				return true;
+			if (separator != ',')
+				return false;
+		}
+	}
+
+	for (std::string_view literal : { "true", "false", "null" })
+	{
+		if (text.starts_with(literal))
+		{
+			text.remove_prefix(literal.size());
+			return true;
+		}
+	}
+
+	// strtod takes more than JSON does, like nan and inf, so check the first character
+	if (text[0] != '-' && (text[0] < '0' || text[0] > '9'))
+		return false;
+
+	char* end;
+	std::strtod(text.data(), &end);
+	text.remove_prefix(end - text.data());
+	return true;
+}
+
+bool IsValidJson(std::string_view text)
+{
+	if (!SkipJsonValue(text))
+		return false;
+
+	SkipJsonSpace(text);
+	return text.empty();
+}
+
+size_t CountSubstrings(std::string_view text, std::string_view substring)
+{
+	size_t count = 0;
+	for (size_t found = text.find(substring); found != std::string_view::npos; found = text.find(substring, found + 1))
+		count++;
+	return count;
+}
+
+bool TestGpuProfiler(VkInstance instance)
+{
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	// ctest gives the stub 32 valid timestamp bits, the stub's clock wraps them after its first 100 timestamps
+	const uint32_t family = physicalDeviceInfo.queueAssignments[0].queueFamilyIndex;
+	std::printf("\tTimestamp valid bits: %u\n", physicalDeviceInfo.queueFamilies[family].properties.timestampValidBits);
+
+	const VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, family };
+	VkCommandPool commandPool;
+	TEST_CHECK(vkhl::g_deviceDispatch.vkCreateCommandPool(device, &poolInfo, vkhl::GetAllocationCallbacks(), &commandPool) == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyPool([device, commandPool]() {
+			vkhl::g_deviceDispatch.vkDestroyCommandPool(device, commandPool, vkhl::GetAllocationCallbacks());
+		});
+
+	const VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr, commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1 };
+	VkCommandBuffer commandBuffer;
+	TEST_CHECK(vkhl::g_deviceDispatch.vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer) == VK_SUCCESS);
+
+	vkhl::GpuProfiler profiler;
+	TEST_CHECK(profiler.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, { .framesInFlight = 2, .maxZonesPerFrame = 3 }).GetAndReset() == VK_SUCCESS);
+	profiler.SetCapture(true);
+
+	// Each frame is a zone with two passes nested in it, 6 timestamps 1000 ticks apart. Results come back two frames later
+	constexpr uint64_t FrameCount = 40;
+	const double tick = 1000.0 * profiler.GetTimestampPeriod();
+	auto near = [](double a, double b) { return std::abs(a - b) < 0.5; };
+
+	for (uint64_t frame = 0; frame < FrameCount + 2; frame++)
+	{
+		TEST_CHECK(profiler.BeginFrame(frame).GetAndReset() == VK_SUCCESS);
+
+		const auto results = profiler.GetFrameResults();
+		if (frame < 2)
+		{
+			TEST_CHECK(results.empty());
+		}
+		else
+		{
+			// Every frame starts 6 timestamps after the last, also across the wrap
+			const double frameStart = double(frame - 2) * 6 * tick;
+			TEST_CHECK(results.size() == 3);
+			TEST_CHECK(std::strcmp(results[0].name, "frame") == 0 && results[0].frameIndex == frame - 2 && results[0].queueFamilyIndex == family);
+			TEST_CHECK(near(results[0].start, frameStart) && near(results[0].duration, 5 * tick));
+			TEST_CHECK(near(results[1].start, frameStart + tick) && near(results[1].duration, tick));
+			TEST_CHECK(near(results[2].start, frameStart + 3 * tick) && near(results[2].duration, tick));
+		}
+
+		if (frame >= FrameCount)
+			continue;
+
+		const VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+		TEST_CHECK(vkhl::g_deviceDispatch.vkBeginCommandBuffer(commandBuffer, &beginInfo) == VK_SUCCESS);
+		profiler.RecordReset(commandBuffer);
+		{
+			vkhl::GpuScope frameScope(profiler, commandBuffer, family, "frame");
+
+			const vkhl::GpuZone first = profiler.BeginZone(commandBuffer, family, "pass \"A\"");
+			profiler.EndZone(commandBuffer, first);
+
+			const vkhl::GpuZone second = profiler.BeginZone(commandBuffer, family, "pass B");
+			profiler.EndZone(commandBuffer, second);
+
+			// Past maxZonesPerFrame, dropped without writing a timestamp
+			if (frame == 0)
+			{
+				const vkhl::GpuZone dropped = profiler.BeginZone(commandBuffer, family, "dropped");
+				TEST_CHECK(dropped.index == UINT32_MAX);
+				profiler.EndZone(commandBuffer, dropped);
+			}
+		}
+		TEST_CHECK(vkhl::g_deviceDispatch.vkEndCommandBuffer(commandBuffer) == VK_SUCCESS);
+
+		const VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr, 0, nullptr, nullptr, 1, &commandBuffer, 0, nullptr };
+		TEST_CHECK(vkhl::g_deviceDispatch.vkQueueSubmit(deviceInfo.queues[0], 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS);
+		TEST_CHECK(vkhl::g_deviceDispatch.vkQueueWaitIdle(deviceInfo.queues[0]) == VK_SUCCESS);
+	}
+
+	// One track for the family, every captured zone on it
+	const std::string trace = profiler.GetChromeTrace();
+	TEST_CHECK(IsValidJson(trace));
+	TEST_CHECK(CountSubstrings(trace, "\"ph\":\"M\"") == 1);
+	TEST_CHECK(CountSubstrings(trace, "\"ph\":\"X\"") == FrameCount * 3);
+	TEST_CHECK(CountSubstrings(trace, "\"name\":\"pass \\\"A\\\"\"") == FrameCount);
+
+	profiler.Destroy();
+	return true;
+}
+
+bool TestQueueScheduler(VkInstance instance)
+{
+	// Five graphics requests wrap around family 0's four queues, so the last one shares the first one's queue. The sixth is dedicated compute
+	const vkhl::PhysicalDeviceQueueFamilySelectionInfo graphicsInfo = { .graphics = vkhl::RequireFeature };
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfos[6] = {
+		graphicsInfo, graphicsInfo, graphicsInfo, graphicsInfo, graphicsInfo, { .compute = vkhl::RequireFeature }
+	};
+
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo, queueInfos))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	// Timeline semaphores are the whole point, a device without them is refused
+	vkhl::QueueScheduler scheduler;
+	vkhl::DeviceInfo noTimelineInfo = deviceInfo;
+	noTimelineInfo.timelineSemaphore = false;
+	TEST_CHECK(scheduler.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, noTimelineInfo).GetAndReset() == VK_ERROR_FEATURE_NOT_PRESENT);
+
+	TEST_CHECK(scheduler.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, deviceInfo).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(scheduler.GetQueueCount() == 6);
+
+	// The shared assignments are one timeline, the others each have their own
+	TEST_CHECK(physicalDeviceInfo.queueAssignments[0].shared && physicalDeviceInfo.queueAssignments[4].shared);
+	TEST_CHECK(scheduler.GetQueue(0) == scheduler.GetQueue(4) && scheduler.GetSemaphore(0) == scheduler.GetSemaphore(4));
+	for (uint32_t a = 0; a < 6; a++)
+	{
+		for (uint32_t b = a + 1; b < 6; b++)
+			TEST_CHECK((scheduler.GetSemaphore(a) == scheduler.GetSemaphore(b)) == (a == 0 && b == 4));
+	}
+	TEST_CHECK(scheduler.GetQueueFamilyIndex(0) == 0 && scheduler.GetQueueFamilyIndex(5) == 1);
+
+	// Each submit takes the next value of its timeline, which the shared assignments count together
+	vkhl::QueueTicket graphicsTicket, sharedTicket, computeTicket;
+	TEST_CHECK(scheduler.Submit(0, {}, &graphicsTicket).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(graphicsTicket.queue == 0 && graphicsTicket.value == 1);
+	TEST_CHECK(scheduler.Submit(4, {}, &sharedTicket).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(sharedTicket.queue == 4 && sharedTicket.value == 2);
+	TEST_CHECK(scheduler.GetLastTicket(0).value == 2);
+
+	// Compute waits on both graphics submits, and starts its own timeline at 1
+	const vkhl::QueueTicketWait waits[2] = { { graphicsTicket }, { sharedTicket, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT } };
+	TEST_CHECK(scheduler.Submit(5, { .waits = waits }, &computeTicket).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(computeTicket.queue == 5 && computeTicket.value == 1);
+	TEST_CHECK(scheduler.GetLastTicket(1).value == 0);
+
+	// The stub finishes work on submit
+	const vkhl::QueueTicket tickets[3] = { graphicsTicket, sharedTicket, computeTicket };
+	TEST_CHECK(scheduler.Wait(tickets).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(scheduler.WaitIdle(5).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(scheduler.IsComplete(sharedTicket) && scheduler.IsComplete(computeTicket));
+	TEST_CHECK(scheduler.GetCompletedValue(4) == 2);
+	TEST_CHECK(scheduler.IsComplete({ 1, 0 }));
+
+	// A ticket past the last submit would wait forever
+	TEST_CHECK(scheduler.Wait({ 5, 2 }).GetAndReset() == VK_ERROR_INITIALIZATION_FAILED);
+
+	// Fences come back once they signalled
+	VkFence fence, reused;
+	TEST_CHECK(scheduler.AcquireFence(&fence).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(scheduler.Submit(1, { .fence = fence }).GetAndReset() == VK_SUCCESS);
+	scheduler.ReleaseFence(fence);
+	TEST_CHECK(scheduler.AcquireFence(&reused).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(reused == fence);
+	scheduler.ReleaseFence(reused, false);
+
+	return true;
+}
+
+bool TestUploadManager(VkInstance instance)
+{
+	// A dedicated transfer queue, family 2 on the stub
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfo = { .transfer = vkhl::RequireFeature };
+
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo, { &queueInfo, 1 }))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	vkhl::MemoryAllocator allocator;
+	TEST_CHECK(allocator.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, { .blockSize = 1 << 20 }).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyAllocator([&allocator]() {
+			allocator.Destroy();
+		});
+
+	constexpr VkDeviceSize StagingSize = 64 << 10;
+	const vkhl::UploadManagerCreateInfo createInfo = {
+		.queue = deviceInfo.queues[0],
+		.queueFamilyIndex = physicalDeviceInfo.queueAssignments[0].queueFamilyIndex,
+		.stagingSize = StagingSize
+	};
+
+	// The uploads are tracked on a timeline semaphore, a device without them is refused
+	vkhl::UploadManager uploads;
+	vkhl::DeviceInfo noTimelineInfo = deviceInfo;
+	noTimelineInfo.timelineSemaphore = false;
+	TEST_CHECK(uploads.Init(allocator, vkhl::g_deviceDispatch, noTimelineInfo, createInfo).GetAndReset() == VK_ERROR_FEATURE_NOT_PRESENT);
+
+	TEST_CHECK(uploads.Init(allocator, vkhl::g_deviceDispatch, deviceInfo, createInfo).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyUploads([&uploads]() {
+			uploads.Destroy();
+		});
+
+	// Nothing uploaded yet, nothing to wait for
+	vkhl::UploadToken token;
+	TEST_CHECK(uploads.Submit(&token).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(token.value == 0 && uploads.IsComplete(token));
+
+	const VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr, 0, StagingSize * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+	VkBuffer buffer;
+	TEST_CHECK(vkhl::g_deviceDispatch.vkCreateBuffer(device, &bufferInfo, vkhl::GetAllocationCallbacks(), &buffer) == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyBuffer([device, buffer]() {
+			vkhl::g_deviceDispatch.vkDestroyBuffer(device, buffer, vkhl::GetAllocationCallbacks());
+		});
+
+	// Four rings worth goes through in eight half ring chunks. Every third chunk finds the ring full, so the two before it are submitted
+	// and waited for. That is three submits on the way, and Submit makes the fourth
+	std::vector<uint8_t> data(static_cast<size_t>(StagingSize * 4) - 12);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<uint8_t>(i * 7);
+
+	TEST_CHECK(uploads.UploadBuffer(buffer, 8, data.data(), data.size()).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(uploads.Submit(&token).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(token.value == 4);
+	TEST_CHECK(uploads.Wait(token).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(uploads.IsComplete(token));
+
+	// The ring was retired, so a small upload after it doesn't need another wait and submits right after the last one
+	vkhl::UploadToken smallToken;
+	TEST_CHECK(uploads.UploadBuffer(buffer, 0, data.data(), 100).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(uploads.Submit(&smallToken).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(smallToken.value == token.value + 1);
+	TEST_CHECK(uploads.Wait(smallToken).GetAndReset() == VK_SUCCESS);
+
+	// A token that was never submitted can't be waited on
+	TEST_CHECK(uploads.Wait({ smallToken.value + 1 }).GetAndReset() == VK_ERROR_INITIALIZATION_FAILED);
+
+	return true;
+}
+
+// What vkUpdateDescriptorSets was given, TestBindlessHeap swaps it into its dispatch so the writes never reach the driver
+struct RecordedWrite
+{
+	uint32_t binding;
+	uint32_t arrayElement;
+	std::vector<uintptr_t> handles; // Image views or buffers
+};
+
+std::vector<RecordedWrite> g_recordedWrites;
+uint32_t g_updateDescriptorSetsCalls = 0;
+
+VKAPI_ATTR void VKAPI_CALL RecordUpdateDescriptorSets(VkDevice, uint32_t descriptorWriteCount, const VkWriteDescriptorSet* pDescriptorWrites, uint32_t, const VkCopyDescriptorSet*)
+{
+	g_updateDescriptorSetsCalls++;
+	for (uint32_t i = 0; i < descriptorWriteCount; i++)
+	{
+		const VkWriteDescriptorSet& write = pDescriptorWrites[i];
+		RecordedWrite& recorded = g_recordedWrites.emplace_back(write.dstBinding, write.dstArrayElement);
+		for (uint32_t element = 0; element < write.descriptorCount; element++)
+		{
+			recorded.handles.push_back(write.pBufferInfo ? reinterpret_cast<uintptr_t>(write.pBufferInfo[element].buffer) :
+				reinterpret_cast<uintptr_t>(write.pImageInfo[element].imageView));
+		}
+	}
+}
+
+bool TestBindlessHeap(VkInstance instance)
+{
+	// The index allocator on its own, 4 slots and 2 frames in flight
+	vkhl::BindlessIndexAllocator indices;
+	indices.Init(4, 2);
+
+	TEST_CHECK(indices.GetCapacity() == 4);
+	TEST_CHECK(indices.Allocate() == 0);
+	TEST_CHECK(indices.Allocate() == 1);
+
+	// Removing twice, out of range or an index that was never handed out changes nothing
+	TEST_CHECK(indices.Remove(0));
+	TEST_CHECK(!indices.Remove(0));
+	TEST_CHECK(!indices.Remove(4));
+	TEST_CHECK(!indices.Remove(3));
+
+	// 0 waits for frame 0 to come around again, even once the array is full
+	TEST_CHECK(indices.Allocate() == 2);
+	indices.BeginFrame(1);
+	TEST_CHECK(indices.Allocate() == 3);
+	TEST_CHECK(indices.Allocate() == vkhl::InvalidBindlessIndex);
+
+	indices.BeginFrame(2);
+	TEST_CHECK(indices.Allocate() == 0);
+	TEST_CHECK(indices.Allocate() == vkhl::InvalidBindlessIndex);
+
+	// Removed in frame 2, so free in frame 4 and not before
+	TEST_CHECK(indices.Remove(1) && indices.Remove(2));
+	indices.BeginFrame(3);
+	TEST_CHECK(indices.Allocate() == vkhl::InvalidBindlessIndex);
+	indices.BeginFrame(4);
+	const vkhl::BindlessIndex reused[2] = { indices.Allocate(), indices.Allocate() };
+	TEST_CHECK(std::min(reused[0], reused[1]) == 1 && std::max(reused[0], reused[1]) == 2);
+	TEST_CHECK(indices.Allocate() == vkhl::InvalidBindlessIndex);
+	indices.Destroy();
+
+	// The heap on a device, with its descriptor writes recorded
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	VkPhysicalDevice physicalDevice;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo, {}, &physicalDevice))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	vkhl::DeviceDispatch dispatch = vkhl::g_deviceDispatch;
+	dispatch.vkUpdateDescriptorSets = RecordUpdateDescriptorSets;
+	g_recordedWrites.clear();
+	g_updateDescriptorSetsCalls = 0;
+
+	vkhl::BindlessHeap heap;
+	const vkhl::BindlessHeapCreateInfo createInfo = {
+		.sampledImageCount = 16,
+		.storageImageCount = 16,
+		.storageBufferCount = 16,
+		.bufferDeviceAddress = false
+	};
+	TEST_CHECK(heap.Init(dispatch, physicalDevice, deviceInfo, createInfo).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyHeap([&heap]() {
+			heap.Destroy();
+		});
+
+	TEST_CHECK(heap.GetCapacity(vkhl::BindlessType::SampledImage) == 16);
+
+	// Nothing queued, nothing written
+	heap.Flush();
+	TEST_CHECK(g_updateDescriptorSetsCalls == 0);
+
+	auto imageView = [](uintptr_t handle) { return reinterpret_cast<VkImageView>(handle); };
+	auto buffer = [](uintptr_t handle) { return reinterpret_cast<VkBuffer>(handle); };
+
+	// Neighbouring indices of a binding become one write, each binding gets its own, all in one call
+	TEST_CHECK(heap.AddSampledImage(imageView(0x10)) == 0);
+	TEST_CHECK(heap.AddStorageBuffer(buffer(0x30)) == 0);
+	TEST_CHECK(heap.AddSampledImage(imageView(0x11)) == 1);
+	TEST_CHECK(heap.AddStorageImage(imageView(0x20)) == 0);
+	TEST_CHECK(heap.AddSampledImage(imageView(0x12)) == 2);
+	TEST_CHECK(heap.AddStorageBuffer(buffer(0x31)) == 1);
+	heap.Flush();
+
+	TEST_CHECK(g_updateDescriptorSetsCalls == 1);
+	TEST_CHECK(g_recordedWrites.size() == 3);
+	TEST_CHECK(g_recordedWrites[0].binding == 0 && g_recordedWrites[0].arrayElement == 0);
+	TEST_CHECK((g_recordedWrites[0].handles == std::vector<uintptr_t>{ 0x10, 0x11, 0x12 }));
+	TEST_CHECK(g_recordedWrites[1].binding == 1 && g_recordedWrites[1].arrayElement == 0);
+	TEST_CHECK((g_recordedWrites[1].handles == std::vector<uintptr_t>{ 0x20 }));
+	TEST_CHECK(g_recordedWrites[2].binding == 2 && g_recordedWrites[2].arrayElement == 0);
+	TEST_CHECK((g_recordedWrites[2].handles == std::vector<uintptr_t>{ 0x30, 0x31 }));
+
+	// A removed index comes back framesInFlight frames later. Written twice before a Flush, only the last write goes out,
+	// and indices with a gap between them are separate writes
+	g_recordedWrites.clear();
+	heap.Remove(vkhl::BindlessType::SampledImage, 1);
+	heap.BeginFrame(1);
+	TEST_CHECK(heap.AddSampledImage(imageView(0x13)) == 3);
+	heap.BeginFrame(2);
+	TEST_CHECK(heap.AddSampledImage(imageView(0x14)) == 1);
+	heap.Remove(vkhl::BindlessType::SampledImage, 1);
+	heap.BeginFrame(3);
+	heap.BeginFrame(4);
+	TEST_CHECK(heap.AddSampledImage(imageView(0x15)) == 1);
+	heap.Flush();
+
+	TEST_CHECK(g_updateDescriptorSetsCalls == 2);
+	TEST_CHECK(g_recordedWrites.size() == 2);
+	TEST_CHECK(g_recordedWrites[0].binding == 0 && g_recordedWrites[0].arrayElement == 1);
+	TEST_CHECK((g_recordedWrites[0].handles == std::vector<uintptr_t>{ 0x15 }));
+	TEST_CHECK(g_recordedWrites[1].binding == 0 && g_recordedWrites[1].arrayElement == 3);
+	TEST_CHECK((g_recordedWrites[1].handles == std::vector<uintptr_t>{ 0x13 }));
+
+	return true;
+}
+
+// What a FrameGraph recorded, in order: a pass, or the barriers of one vkCmdPipelineBarrier2
+struct RecordedFrameCommand
+{
+	VkCommandBuffer commandBuffer;
+	const char* pass; // nullptr for barriers
+	std::vector<VkMemoryBarrier2> memoryBarriers;
+	std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+	std::vector<VkImageMemoryBarrier2> imageBarriers;
+};
+
+std::vector<RecordedFrameCommand> g_recordedFrameCommands;
+
+// Passes log themselves, usrPtr is the name
+void RecordFramePass(VkCommandBuffer commandBuffer, void* usrPtr)
+{
+	g_recordedFrameCommands.push_back({ commandBuffer, static_cast<const char*>(usrPtr) });
+}
+
+VKAPI_ATTR void VKAPI_CALL RecordPipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo)
+{
+	RecordedFrameCommand& command = g_recordedFrameCommands.emplace_back(commandBuffer, nullptr);
+	command.memoryBarriers.assign(pDependencyInfo->pMemoryBarriers, pDependencyInfo->pMemoryBarriers + pDependencyInfo->memoryBarrierCount);
+	command.bufferBarriers.assign(pDependencyInfo->pBufferMemoryBarriers, pDependencyInfo->pBufferMemoryBarriers + pDependencyInfo->bufferMemoryBarrierCount);
+	command.imageBarriers.assign(pDependencyInfo->pImageMemoryBarriers, pDependencyInfo->pImageMemoryBarriers + pDependencyInfo->imageMemoryBarrierCount);
+}
+
+bool TestFrameGraph(VkInstance instance)
+{
+	// Queue 0 is graphics on family 0, queue 1 dedicated compute on family 1
+	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfos[2] = { { .graphics = vkhl::RequireFeature }, { .compute = vkhl::RequireFeature } };
+
+	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
+	VkDevice device;
+	vkhl::DeviceInfo deviceInfo;
+	if (!CreateTestDevice(instance, &physicalDeviceInfo, &device, &deviceInfo, queueInfos))
+		return false;
+
+	vkhl::Defer deferDestroyDevice([device]() {
+			vkhl::DestroyDevice(device);
+		});
+
+	const uint32_t queueFamilies[2] = { 0, 1 };
+	vkhl::CommandPoolRecycler commandPools;
+	TEST_CHECK(commandPools.Init(vkhl::g_deviceDispatch, queueFamilies, 1).GetAndReset() == VK_SUCCESS);
+
+	vkhl::Defer deferDestroyCommandPools([&commandPools]() {
+			commandPools.Destroy();
+		});
+
+	// Destroyed first, it waits for the submits
+	vkhl::QueueScheduler scheduler;
+	TEST_CHECK(scheduler.Init(vkhl::g_deviceDispatch, physicalDeviceInfo, deviceInfo).GetAndReset() == VK_SUCCESS);
+	TEST_CHECK(scheduler.GetQueueFamilyIndex(0) == 0 && scheduler.GetQueueFamilyIndex(1) == 1);
+
+	vkhl::Defer deferDestroyScheduler([&scheduler]() {
+			scheduler.Destroy();
+		});
+
+	vkhl::DeviceDispatch dispatch = vkhl::g_deviceDispatch;
+	dispatch.vkCmdPipelineBarrier2 = RecordPipelineBarrier2;
+
+	// The barriers are all synchronization2, a device without it is refused
+	vkhl::FrameGraph graph;
+	vkhl::DeviceInfo noSync2Info = deviceInfo;
+	noSync2Info.synchronization2 = false;
+	TEST_CHECK(graph.Init(dispatch, noSync2Info, scheduler, commandPools).GetAndReset() == VK_ERROR_FEATURE_NOT_PRESENT);
+
+	TEST_CHECK(graph.Init(dispatch, deviceInfo, scheduler, commandPools).GetAndReset() == VK_SUCCESS);
+
+	auto pass = [](const char* name, uint32_t queue, std::span<const vkhl::FrameResourceUse> uses) {
+		return vkhl::FramePassInfo{ name, queue, uses, RecordFramePass, const_cast<char*>(name) };
+	};
+	auto isPass = [](const RecordedFrameCommand& command, std::string_view name) {
+		return command.pass && command.pass == name;
+	};
+
+	const VkImage image = reinterpret_cast<VkImage>(uintptr_t{ 0x100 });
+	const VkBuffer buffers[2] = { reinterpret_cast<VkBuffer>(uintptr_t{ 0x200 }), reinterpret_cast<VkBuffer>(uintptr_t{ 0x300 }) };
+	const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	// Write then read on one queue. The image gets a layout transition before each pass, and the buffer's transfer write
+	// is made visible to the compute read with a global barrier in the same call as the second transition
+	{
+		g_recordedFrameCommands.clear();
+		const vkhl::FrameResource target = graph.ImportImage({ image, range });
+		const vkhl::FrameResource data = graph.ImportBuffer({ buffers[0] });
+
+		const vkhl::FrameResourceUse writeUses[2] = {
+			vkhl::MakeFrameResourceUse(target, vkhl::FrameAccess::ColorAttachmentWrite), vkhl::MakeFrameResourceUse(data, vkhl::FrameAccess::TransferWrite)
+		};
+		const vkhl::FrameResourceUse readUses[2] = {
+			vkhl::MakeFrameResourceUse(target, vkhl::FrameAccess::SampledRead), vkhl::MakeFrameResourceUse(data, vkhl::FrameAccess::StorageRead)
+		};
+		graph.AddPass(pass("write", 0, writeUses));
+		graph.AddPass(pass("read", 0, readUses));
+		TEST_CHECK(graph.Execute().GetAndReset() == VK_SUCCESS);
+
+		const auto& commands = g_recordedFrameCommands;
+		TEST_CHECK(commands.size() == 4);
+		TEST_CHECK(!commands[0].pass && isPass(commands[1], "write") && !commands[2].pass && isPass(commands[3], "read"));
+		for (const auto& command : commands)
+			TEST_CHECK(command.commandBuffer == commands[0].commandBuffer);
+
+		TEST_CHECK(commands[0].memoryBarriers.empty() && commands[0].bufferBarriers.empty() && commands[0].imageBarriers.size() == 1);
+		const VkImageMemoryBarrier2& toAttachment = commands[0].imageBarriers[0];
+		TEST_CHECK(toAttachment.srcStageMask == VK_PIPELINE_STAGE_2_NONE && toAttachment.srcAccessMask == VK_ACCESS_2_NONE);
+		TEST_CHECK(toAttachment.dstStageMask == VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+		TEST_CHECK(toAttachment.dstAccessMask == (VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT));
+		TEST_CHECK(toAttachment.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && toAttachment.newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		TEST_CHECK(toAttachment.srcQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED && toAttachment.dstQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED);
+		TEST_CHECK(toAttachment.image == image);
+
+		TEST_CHECK(commands[2].memoryBarriers.size() == 1 && commands[2].bufferBarriers.empty() && commands[2].imageBarriers.size() == 1);
+		const VkImageMemoryBarrier2& toSampled = commands[2].imageBarriers[0];
+		TEST_CHECK(toSampled.srcStageMask == VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT && toSampled.srcAccessMask == VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+		TEST_CHECK(toSampled.dstStageMask == VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT && toSampled.dstAccessMask == VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+		TEST_CHECK(toSampled.oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && toSampled.newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		const VkMemoryBarrier2& visible = commands[2].memoryBarriers[0];
+		TEST_CHECK(visible.srcStageMask == VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT && visible.srcAccessMask == VK_ACCESS_2_TRANSFER_WRITE_BIT);
+		TEST_CHECK(visible.dstStageMask == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT && visible.dstAccessMask == VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+		const vkhl::FrameGraphStats& stats = graph.GetStats();
+		TEST_CHECK(stats.passCount == 2 && stats.submitCount == 1 && stats.barrierCount == 2);
+		TEST_CHECK(stats.imageBarrierCount == 2 && stats.bufferBarrierCount == 0 && stats.ownershipTransferCount == 0);
+
+		const vkhl::FrameResourceState state = graph.GetFinalState(target);
+		TEST_CHECK(state.layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && state.queueFamilyIndex == 0);
+		TEST_CHECK(state.stageMask == VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT && state.accessMask == VK_ACCESS_2_NONE);
+	}
+
+	// Written on graphics, read on compute. The buffer is released after the write in the graphics submit,
+	// and acquired before the read in the compute submit, which waits for the graphics one
+	{
+		graph.Reset();
+		g_recordedFrameCommands.clear();
+		const vkhl::FrameResource data = graph.ImportBuffer({ buffers[0], 64, 256 });
+
+		const vkhl::FrameResourceUse produceUse = vkhl::MakeFrameResourceUse(data, vkhl::FrameAccess::StorageWrite);
+		const vkhl::FrameResourceUse consumeUse = vkhl::MakeFrameResourceUse(data, vkhl::FrameAccess::StorageRead);
+		graph.AddPass(pass("produce", 0, { &produceUse, 1 }));
+		graph.AddPass(pass("consume", 1, { &consumeUse, 1 }));
+
+		std::vector<vkhl::QueueTicket> tickets;
+		TEST_CHECK(graph.Execute({}, &tickets).GetAndReset() == VK_SUCCESS);
+
+		const auto& commands = g_recordedFrameCommands;
+		TEST_CHECK(commands.size() == 4);
+		TEST_CHECK(isPass(commands[0], "produce") && !commands[1].pass && !commands[2].pass && isPass(commands[3], "consume"));
+		TEST_CHECK(commands[1].commandBuffer == commands[0].commandBuffer && commands[2].commandBuffer == commands[3].commandBuffer);
+		TEST_CHECK(commands[0].commandBuffer != commands[3].commandBuffer);
+
+		TEST_CHECK(commands[1].memoryBarriers.empty() && commands[1].imageBarriers.empty() && commands[1].bufferBarriers.size() == 1);
+		const VkBufferMemoryBarrier2& release = commands[1].bufferBarriers[0];
+		TEST_CHECK(release.srcStageMask == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT && release.srcAccessMask == VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+		TEST_CHECK(release.dstStageMask == VK_PIPELINE_STAGE_2_NONE && release.dstAccessMask == VK_ACCESS_2_NONE);
+		TEST_CHECK(release.srcQueueFamilyIndex == 0 && release.dstQueueFamilyIndex == 1);
+		TEST_CHECK(release.buffer == buffers[0] && release.offset == 64 && release.size == 256);
+
+		TEST_CHECK(commands[2].memoryBarriers.empty() && commands[2].imageBarriers.empty() && commands[2].bufferBarriers.size() == 1);
+		const VkBufferMemoryBarrier2& acquire = commands[2].bufferBarriers[0];
+		TEST_CHECK(acquire.srcStageMask == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT && acquire.srcAccessMask == VK_ACCESS_2_NONE);
+		TEST_CHECK(acquire.dstStageMask == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT && acquire.dstAccessMask == VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+		TEST_CHECK(acquire.srcQueueFamilyIndex == 0 && acquire.dstQueueFamilyIndex == 1);
+
+		const vkhl::FrameGraphStats& stats = graph.GetStats();
+		TEST_CHECK(stats.submitCount == 2 && stats.barrierCount == 2 && stats.bufferBarrierCount == 2 && stats.ownershipTransferCount == 1);
+
+		// The last ticket of each queue, compute's first
+		TEST_CHECK(tickets.size() == 2 && tickets[0].queue == 1 && tickets[1].queue == 0);
+		TEST_CHECK(scheduler.Wait(tickets).GetAndReset() == VK_SUCCESS);
+
+		const vkhl::FrameResourceState state = graph.GetFinalState(data);
+		TEST_CHECK(state.queueFamilyIndex == 1 && state.stageMask == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT && state.accessMask == VK_ACCESS_2_NONE);
+	}
+
+	// Two readers after one writer, on a concurrent buffer. The graphics reader moves ahead of the compute one declared before it,
+	// so graphics is one submit, and only it needs a barrier: compute waits on the graphics submit instead
+	{
+		graph.Reset();
+		g_recordedFrameCommands.clear();
+		const vkhl::FrameResource data = graph.ImportBuffer({ .buffer = buffers[0], .concurrent = true });
+		const vkhl::FrameResource other = graph.ImportBuffer({ buffers[1] });
+
+		const vkhl::FrameResourceUse writeUse = vkhl::MakeFrameResourceUse(data, vkhl::FrameAccess::TransferWrite);
+		const vkhl::FrameResourceUse computeUse = vkhl::MakeFrameResourceUse(data, vkhl::FrameAccess::StorageRead);
+		const vkhl::FrameResourceUse otherUse = vkhl::MakeFrameResourceUse(other, vkhl::FrameAccess::StorageWrite);
+		const vkhl::FrameResourceUse graphicsUse = vkhl::MakeFrameResourceUse(data, vkhl::FrameAccess::UniformRead);
+		graph.AddPass(pass("write", 0, { &writeUse, 1 }));
+		graph.AddPass(pass("computeRead", 1, { &computeUse, 1 }));
+		graph.AddPass(pass("other", 0, { &otherUse, 1 }));
+		graph.AddPass(pass("graphicsRead", 0, { &graphicsUse, 1 }));
+		TEST_CHECK(graph.Execute().GetAndReset() == VK_SUCCESS);
+
+		const auto& commands = g_recordedFrameCommands;
+		TEST_CHECK(commands.size() == 5);
+		TEST_CHECK(isPass(commands[0], "write") && isPass(commands[1], "other") && !commands[2].pass && isPass(commands[3], "graphicsRead"));
+		TEST_CHECK(isPass(commands[4], "computeRead"));
+		TEST_CHECK(commands[3].commandBuffer == commands[0].commandBuffer && commands[4].commandBuffer != commands[0].commandBuffer);
+
+		TEST_CHECK(commands[2].memoryBarriers.size() == 1 && commands[2].imageBarriers.empty() && commands[2].bufferBarriers.empty());
+		const VkMemoryBarrier2& visible = commands[2].memoryBarriers[0];
+		TEST_CHECK(visible.srcStageMask == VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT && visible.srcAccessMask == VK_ACCESS_2_TRANSFER_WRITE_BIT);
+		TEST_CHECK(visible.dstStageMask == graphicsUse.stageMask && visible.dstAccessMask == VK_ACCESS_2_UNIFORM_READ_BIT);
+
+		const vkhl::FrameGraphStats& stats = graph.GetStats();
+		TEST_CHECK(stats.passCount == 4 && stats.submitCount == 2 && stats.barrierCount == 1 && stats.ownershipTransferCount == 0);
+		TEST_CHECK(graph.GetFinalState(data).queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED);
+	}
+
+	return true;
+}
+
+// Logs through the async log into a temporary file, returns what was written
+template<typename FuncT>
+std::string CaptureAsyncLog(const vkhl::AsyncLogCreateInfo& createInfo, FuncT&& func)
+{
+	std::FILE* file = std::tmpfile();
+	if (!file)
+		return "(no temporary file)";
+
+	vkhl::AsyncLogCreateInfo fileInfo = createInfo;
+	fileInfo.output = file;
+	vkhl::StartAsyncLog(fileInfo);
+	func();
+	vkhl::StopAsyncLog();
+
+	std::string text(static_cast<size_t>(std::ftell(file)), '\0');
+	std::rewind(file);
+	text.resize(std::fread(text.data(), 1, text.size(), file));
+	std::fclose(file);
+	return text;
+}
+
+bool TestAsyncLog(VkInstance)
+{
+	const vkhl::AsyncLogCreateInfo createInfo = { .rateLimit = 0, .deduplicate = false };
+
+	// Every argument type goes through the ring and comes out as printf would have written it
+	std::string text = CaptureAsyncLog(createInfo, []() {
+			vkhl::PrintError("%d %i %u %lld %llu %x %X %o\n", -1, 2, 3u, -4ll, 5ull, 0xabu, 0xcdu, 8u);
+			vkhl::PrintError("%zu %c %.2f %e %% %s %s\n", size_t{ 6 }, 'c', 1.5, 1000.0, "str", static_cast<const char*>(nullptr));
+			vkhl::PrintWarning("%-4d|%04d|%*d|%-*d|%p\n", 7, 7, 3, 7, 3, 7, reinterpret_cast<const void*>(uintptr_t{ 0x1234 }));
+		});
+
+	char expected[256];
+	std::snprintf(expected, sizeof(expected), "%d %i %u %lld %llu %x %X %o\n%zu %c %.2f %e %% %s %s\n%-4d|%04d|%*d|%-*d|%p\n",
+		-1, 2, 3u, -4ll, 5ull, 0xabu, 0xcdu, 8u, size_t{ 6 }, 'c', 1.5, 1000.0, "str", "(null)", 7, 7, 3, 7, 3, 7, reinterpret_cast<const void*>(uintptr_t{ 0x1234 }));
+	TEST_CHECK(text == expected);
+
+	// Strings are only read up to their precision, so they don't need a null terminator past it
+	text = CaptureAsyncLog(createInfo, []() {
+			const char name[4] = { 'a', 'b', 'c', 'd' };
+			vkhl::PrintError("%.3s|%.*s|%5.2s|%.*s\n", name, 2, name, name, -1, "whole");
+		});
+	TEST_CHECK(text == "abc|ab|   ab|whole\n");
+
+	// The format and the strings are copied, so both can change as soon as PrintError returns
+	text = CaptureAsyncLog(createInfo, []() {
+			std::string format = "runtime %s %d\n";
+			std::string argument = "argument";
+			vkhl::PrintError(format.c_str(), argument.c_str(), 5);
+
+			format.assign("overwritten %s %d\n");
+			argument.assign("XXXXXXXX");
+		});
+	TEST_CHECK(text == "runtime argument 5\n");
+
+	// Back to back repeats collapse into a count
+	text = CaptureAsyncLog({ .rateLimit = 0, .deduplicate = true }, []() {
+			for (int i = 0; i < 3; i++)
+				vkhl::PrintError("repeated %d\n", 1);
+			vkhl::PrintError("different\n");
+		});
+	TEST_CHECK(text == "repeated 1\n(last message repeated 2 times)\ndifferent\n");
+
+	return true;
+}
+
+TestCase g_testCases[] = {
+	{ "Device", TestDevice },
+	{ "MultiDevice", TestMultiDevice },
+	{ "QueueAssignment", TestQueueAssignment },
+	{ "MemoryAllocator", TestMemoryAllocator },
+	{ "MemoryBudget", TestMemoryBudget },
+	{ "DescriptorLayoutCache", TestDescriptorLayoutCache },
+	{ "DeletionQueue", TestDeletionQueue },
+	{ "PipelineCache", TestPipelineCache },
+	{ "PipelineCompiler", TestPipelineCompiler },
+	{ "ShaderModuleCache", TestShaderModuleCache },
+	{ "QueueScheduler", TestQueueScheduler },
+	{ "GpuProfiler", TestGpuProfiler },
+	{ "UploadManager", TestUploadManager },
+	{ "BindlessHeap", TestBindlessHeap },
+	{ "FrameGraph", TestFrameGraph },
+	{ "AsyncLog", TestAsyncLog },
+};
+
+int main(int argc, char** argv)
+{
+	const char* filter = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else
+		{
+			std::printf("Usage: %s [--filter <substring>]\n", argv[0]);
+			return 1;
+		}
+	}
+
 	VkInstance instance;
 	vkhl::InstanceInfo instanceInfo;
 
-	vkhl::GetInstanceInfo(&instanceInfo);
+	vkhl::InstallHostAllocator();
+
+	if (vkhl::GetInstanceInfo(&instanceInfo).GetAndReset() < 0)
+		return 1;
+
 	auto instVersion = vkhl::MakeVersionStruct(instanceInfo.apiVersion);
 	std::printf("Version: %i.%i.%i\nLayers:\n", instVersion.major, instVersion.minor, instVersion.patch);
-	
+
 	for (auto layer : instanceInfo.layers)
 		std::printf("\t%s\n", layer.c_str());
 
@@ -23,37 +1731,33 @@ int main()
 	for (auto extension : instanceInfo.extensions)
 		std::printf("\t%s\n", extension.c_str());
 
-	vkhl::CreateInstance({
+	if (vkhl::CreateInstance({
 		.appName = "vkhl test",
 		.engineName = "vkhl test engine",
 		.appVersion = vkhl::MakeVersion(1, 0),
 		.engineVersion = vkhl::MakeVersion(1, 0),
 		.minApiVersion = vkhl::MakeVersion(1, 1),
+		.maxApiVersion = vkhl::MakeVersion(1, 3),
 		.layers = g_instanceLayers
-		}, &instance, &instanceInfo).Reset();
+		}, &instance, &instanceInfo).GetAndReset() < 0)
+		return 1;
 
 	vkhl::Defer deferDestroyInst([instance](){
 			vkhl::DestroyInstance(instance);
 		});
 
-	vkhl::PhysicalDeviceQueueFamilySelectionInfo queueInfos[2] = {
-		{
-			.graphics = vkhl::RequireFeature,
-			.compute = vkhl::RequireFeature,
-			.transfer = vkhl::RequireFeature
-		},
-		{
-			.transfer = vkhl::RequireFeature
-		}
-	};
+	int failed = 0;
+	for (const auto& testCase : g_testCases)
+	{
+		if (filter && !std::strstr(testCase.name, filter))
+			continue;
 
-	VkPhysicalDevice physicalDevice;
-	uint32_t queueFamilyIndices[2];
-	vkhl::PhysicalDeviceInfo physicalDeviceInfo;
-
-	vkhl::SelectPhyicalDevice(instance, {
-			.queueFamilyInfos = queueInfos,
-		}, &physicalDevice, queueFamilyIndices, &physicalDeviceInfo);
+		std::printf("%s:\n", testCase.name);
+		const bool passed = testCase.func(instance);
+		std::printf("%s %s\n", testCase.name, passed ? "passed" : "FAILED");
+		failed += passed ? 0 : 1;
+	}
 
-	return 0;
+	std::printf("%i failed\n", failed);
+	return failed == 0 ? 0 : 1;
 }